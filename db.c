@@ -20,9 +20,22 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <libpq-events.h>
 
 #include "db.h"
 
+// Cursors declared on a connection, kept with the connection instead of a temp table
+#define CURSOR_BUCKETS 64
+
+struct declCursor {
+    char name[255];
+    struct declCursor *next;
+};
+
+struct declCursors {
+    struct declCursor *buckets[CURSOR_BUCKETS];
+};
+
 
 void safeExit(PGconn *conn) {
     PQfinish(conn);
@@ -30,6 +43,52 @@ void safeExit(PGconn *conn) {
 }
 
 
+void clearCursors(struct declCursors *decl) {
+    for (int b = 0; b < CURSOR_BUCKETS; b++) {
+        struct declCursor *c = decl->buckets[b];
+        while (c != NULL) {
+            struct declCursor *n = c->next;
+            free(c);
+            c = n;
+        }
+        decl->buckets[b] = NULL;
+    }
+}
+
+
+// Frees the cursor registry with the connection
+int cursorEventProc(PGEventId evtId, void *evtInfo, void *passThrough) {
+    if (evtId == PGEVT_CONNDESTROY) {
+        PGconn *conn = ((PGEventConnDestroy*)evtInfo)->conn;
+        struct declCursors *decl = (struct declCursors*)PQinstanceData(conn,cursorEventProc);
+        if (decl != NULL) {
+            clearCursors(decl);
+            free(decl);
+        }
+    }
+    return 1;
+}
+
+
+unsigned int hashCursor(char *name) {
+    unsigned int h = 0;
+    for (; *name != 0x00; name++) {
+        h = 31*h + (unsigned char)*name;
+    }
+    return h % CURSOR_BUCKETS;
+}
+
+
+// Returns the link to the cursor's entry, the link to append it if not declared
+struct declCursor **findCursor(struct declCursors *decl, char *name) {
+    struct declCursor **c = &decl->buckets[hashCursor(name)];
+    while ((*c != NULL) && (strcmp((*c)->name,name) != 0)) {
+        c = &(*c)->next;
+    }
+    return c;
+}
+
+
 // Pool usage: Used connection always forms one transaction
 PGconn *getDBConnection(char *conInfo) {
     if (conInfo == NULL) {
@@ -49,11 +108,9 @@ PGconn *getDBConnection(char *conInfo) {
         printf("ERROR: START TRANSACTION failed: %s", PQerrorMessage(conn));
     }
     PQclear(res);
-    res = PQexec(conn, "DROP TABLE IF EXISTS qwics_decl");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        printf("ERROR: START TRANSACTION failed: %s", PQerrorMessage(conn));
-    }
-    PQclear(res);
+    struct declCursors *decl = (struct declCursors*)calloc(1,sizeof(struct declCursors));
+    PQregisterEventProc(conn,cursorEventProc,"qwics_decl",NULL);
+    PQsetInstanceData(conn,cursorEventProc,decl);
     return conn;
 }
 
@@ -62,13 +119,13 @@ int checkSQL(PGconn *conn, char *sql) {
     // Filter out Db2 statements invalid in PostgreSQL
     char token[255];
     int pos = 0, i = 0, l = strlen(sql), state = 0;
-    PGresult *res;
+    struct declCursors *decl = (struct declCursors*)PQinstanceData(conn,cursorEventProc);
 
     do {
         while ((i < l) && (sql[i] == ' ')) {
             i++;
         }
-        while ((i < l) && (sql[i] != ' ')) {
+        while ((i < l) && (sql[i] != ' ') && (pos < 254)) {
             token[pos] = toupper(sql[i]);
             pos++;
             i++;
@@ -76,49 +133,29 @@ int checkSQL(PGconn *conn, char *sql) {
         token[pos] = 0x00;
 
         if (state == 3) {
-            char q[255];
-            sprintf(q,"DELETE FROM qwics_decl WHERE curname='%s'",token);
-            res = PQexec(conn, q);
-            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                printf("ERROR: Failure while executing SQL %s:\n %s", q, PQerrorMessage(conn));
-                PQclear(res);
-                return 0;
+            if (decl != NULL) {
+                struct declCursor **c = findCursor(decl,token);
+                if (*c != NULL) {
+                    struct declCursor *n = (*c)->next;
+                    free(*c);
+                    *c = n;
+                }
             }
-
             state++;
         }
         if (state == 1) {
-            // Remember delared cursors in temp table
-            res = PQexec(conn, "CREATE TEMP TABLE IF NOT EXISTS qwics_decl(curname text)");
-            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                printf("ERROR: Failure while executing SQL %s:\n %s", 
-                        "CREATE TEMP TABLE IF NOT EXISTS qwics_decl(curname text)", PQerrorMessage(conn));
-                PQclear(res);
-                return 0;
-            }
-            PQclear(res);
-
-            char q[255];
-            sprintf(q,"SELECT curname FROM qwics_decl WHERE curname='%s'",token);
-            res = PQexec(conn, q);
-            if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-                printf("ERROR: Failure while executing SQL %s:\n %s", q, PQerrorMessage(conn));
-                PQclear(res);
-                return 0;
-            }
-            int rows = PQntuples(res);
-            PQclear(res);
-            if (rows > 0) {
-                return 1;
+            // Remember declared cursors, a cursor is declared once on the DB
+            if (decl != NULL) {
+                struct declCursor **c = findCursor(decl,token);
+                if (*c != NULL) {
+                    return 1;
+                }
+                *c = (struct declCursor*)malloc(sizeof(struct declCursor));
+                if (*c != NULL) {
+                    sprintf((*c)->name,"%s",token);
+                    (*c)->next = NULL;
+                }
             }
-
-            sprintf(q,"INSERT INTO qwics_decl(curname) VALUES ('%s')",token);
-            res = PQexec(conn, q);
-            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                printf("ERROR: Failure while executing SQL %s:\n %s", q, PQerrorMessage(conn));
-            }
-            PQclear(res);
-
             state++;
         }
         if (state == 0) {
@@ -151,11 +188,11 @@ int execSQL(PGconn *conn, char *sql) {
     }
 
     if (strstr(sql,"COMMIT") || strstr(sql,"ROLLBACK")) {
-        res = PQexec(conn, "DROP TABLE IF EXISTS qwics_decl");
-        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-            printf("ERROR: START TRANSACTION failed: %s", PQerrorMessage(conn));
+        // Cursors end with the transaction
+        struct declCursors *decl = (struct declCursors*)PQinstanceData(conn,cursorEventProc);
+        if (decl != NULL) {
+            clearCursors(decl);
         }
-        PQclear(res);
     }
 
     res = PQexec(conn, sql);
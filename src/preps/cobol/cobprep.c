@@ -21,6 +21,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <unistd.h>
 
 int sqlca = 0;
@@ -48,6 +50,30 @@ struct linkageVarDef {
 
 int numOfLinkageVars = 0;
 
+// Data items defined with OCCURS, used as host variable arrays in EXEC SQL
+char occursVarNames[1024][33];
+int numOfOccursVars = 0;
+char lastDataName[33];
+
+// PIC and USAGE of data items, reported as host variable types in the SQL catalog
+struct dataItemDef {
+    char name[33];
+    char type[64];
+    int level;
+} dataItems[4096];
+
+int numOfDataItems = 0;
+
+// EXEC SQL statement as the server builds it from the TPMI tokens, see addSqlStmtToken
+char sqlStmtText[8192];
+char sqlStmtTypes[2048];
+int sqlStmtParams = 0;
+int sqlStmtState = 0;    // Same as cmdState of the server, 2 and above within an INTO list
+int sqlStmtComplete = 1;
+int sqlStmtNum = 0;
+char sqlCatName[255];
+FILE *sqlCatFile = NULL;
+
 
 void parseLinkageVarDef(char *line) {
     char lbuf[4];
@@ -91,6 +117,105 @@ void parseLinkageVarDef(char *line) {
 }
 
 
+void addDataItemType(char *token) {
+    struct dataItemDef *item = &dataItems[numOfDataItems-1];
+    int l = strlen(item->type);
+    if (l + strlen(token) + 2 < sizeof(item->type)) {
+        sprintf(&item->type[l],"%s%s",(l > 0) ? " " : "",token);
+    }
+}
+
+
+int isUsageToken(char *token) {
+    return (strncasecmp(token,"COMP",4) == 0) || (strcasecmp(token,"BINARY") == 0) ||
+           (strcasecmp(token,"PACKED-DECIMAL") == 0) || (strcasecmp(token,"DISPLAY") == 0);
+}
+
+
+// Tracks data items defined with OCCURS and the types of all data items
+void parseDataItemDef(char *line) {
+    char token[255];
+    int len = strlen(line);
+    if (len > 72) {
+        len = 72;
+    }
+    if ((len < 8) || (line[6] == '*') || (line[6] == '/')) {
+        return;
+    }
+    int pos = 7;
+    int n = 0;
+    int level = 0;
+    int pic = 0;
+    while (pos < len) {
+        while ((pos < len) && ((line[pos] == ' ') || (line[pos] == '.') ||
+               (line[pos] == '\n') || (line[pos] == '\r'))) pos++;
+
+        int i = 0;
+        while ((pos < len) && (line[pos] != ' ') && (line[pos] != '.') &&
+               (line[pos] != '\n') && (line[pos] != '\r') && (i < 254)) {
+            token[i] = line[pos];
+            pos++;
+            i++;
+        }
+        token[i] = 0x00;
+        if (i == 0) {
+            break;
+        }
+        if ((n == 0) && isdigit((unsigned char)token[0])) {
+            level = atoi(token);
+        }
+        if ((n == 1) && level) {
+            snprintf(lastDataName,sizeof(lastDataName),"%s",token);
+            if (numOfDataItems < 4096) {
+                snprintf(dataItems[numOfDataItems].name,33,"%s",token);
+                dataItems[numOfDataItems].type[0] = 0x00;
+                dataItems[numOfDataItems].level = level;
+                numOfDataItems++;
+            }
+        }
+        // PIC and USAGE may also follow on a continuation line of the definition
+        if (((n > 1) || !level) && (numOfDataItems > 0) &&
+            (strcasecmp(dataItems[numOfDataItems-1].name,lastDataName) == 0)) {
+            if (pic) {
+                addDataItemType(token);
+                struct dataItemDef *item = &dataItems[numOfDataItems-1];
+                if ((item->level == 49) && (toupper((unsigned char)token[0]) == 'X')) {
+                    // Text of a VARCHAR group, which is preceded by its length field
+                    for (int i = numOfDataItems-2; i >= 0; i--) {
+                        if (dataItems[i].level != 49) {
+                            snprintf(dataItems[i].type,sizeof(dataItems[i].type),"%s%s","VARCHAR ",token);
+                            break;
+                        }
+                    }
+                }
+            }
+            if (isUsageToken(token)) {
+                addDataItemType(token);
+            }
+            pic = (strcasecmp(token,"PIC") == 0) || (strcasecmp(token,"PICTURE") == 0);
+        }
+        // OCCURS may also follow on a continuation line of the definition
+        if ((strcasecmp(token,"OCCURS") == 0) && (lastDataName[0] != 0x00) &&
+            (strcasecmp(lastDataName,"FILLER") != 0) && (numOfOccursVars < 1024)) {
+            sprintf(occursVarNames[numOfOccursVars],"%s",lastDataName);
+            numOfOccursVars++;
+        }
+        n++;
+    }
+}
+
+
+int isOccursVar(char *name) {
+    int i;
+    for (i = 0; i < numOfOccursVars; i++) {
+        if (strcasecmp(occursVarNames[i],name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
 // Load and insert copybook content
 int includeCbk(char *copybook, FILE *outFile) {
     char path[255];
@@ -116,6 +241,7 @@ int includeCbk(char *copybook, FILE *outFile) {
         }
         if (!inExec) {
             fputs(line,outFile);
+            parseDataItemDef(line);
         }
         if (inExec && strstr(line,"END-EXEC")) {
             inExec = 0;
@@ -179,6 +305,7 @@ int includeCbkL(FILE *outFile) {
         while (fgets(line, 255, (FILE*)cbk) != NULL) {
             fputs(line,outFile);
             parseLinkageVarDef(line);
+            parseDataItemDef(line);
         }
 
         fclose(cbk);        
@@ -274,6 +401,184 @@ char *getExecTerminator(int quotes) {
 }
 
 
+char *getDataItemType(char *name) {
+    // Qualified host variables are looked up by their last part
+    char *p = strrchr(name,'.');
+    if (p != NULL) {
+        name = p+1;
+    }
+    for (int i = 0; i < numOfDataItems; i++) {
+        if (strcasecmp(dataItems[i].name,name) == 0) {
+            return (dataItems[i].type[0] != 0x00) ? dataItems[i].type : "GROUP";
+        }
+    }
+    return "UNKNOWN";
+}
+
+
+// Statements the server executes with host variables passed as $n parameters
+int isSqlParamStmt(char *sql) {
+    while (*sql == ' ') sql++;
+    return (strncasecmp(sql,"SELECT ",7) == 0) || (strncasecmp(sql,"INSERT ",7) == 0) ||
+           (strncasecmp(sql,"UPDATE ",7) == 0) || (strncasecmp(sql,"DELETE ",7) == 0) ||
+           (strncasecmp(sql,"DECLARE ",8) == 0) || (strncasecmp(sql,"WITH ",5) == 0) ||
+           (strncasecmp(sql,"VALUES ",7) == 0);
+}
+
+
+// DECLARE of a statement name or of a cursor for a statement prepared at runtime,
+// its text is not known here
+int isSqlDynamicDecl(char *sql) {
+    char u[8192];
+    int l = 0;
+    while (*sql == ' ') sql++;
+    for (l = 0; (sql[l] != 0x00) && (l < (int)sizeof(u)-1); l++) {
+        u[l] = toupper((unsigned char)sql[l]);
+    }
+    u[l] = 0x00;
+    while ((l > 0) && (u[l-1] == ' ')) u[--l] = 0x00;
+    char *last = strrchr(u,' ');
+    if ((strncmp(u,"DECLARE ",8) != 0) || (last == NULL)) {
+        return 0;
+    }
+    return (strcmp(last," STATEMENT") == 0) ||
+           ((last-u >= 4) && (strncmp(last-4," FOR ",5) == 0) && (strcmp(last," UPDATE") != 0) &&
+            (strcmp(last," SHARE") != 0));
+}
+
+
+// Queries which may run on a read only replica
+int isSqlReadStmt(char *sql) {
+    char u[8192];
+    int l = 0;
+    while (*sql == ' ') sql++;
+    for (l = 0; (sql[l] != 0x00) && (l < (int)sizeof(u)-2); l++) {
+        u[l] = toupper((unsigned char)sql[l]);
+    }
+    u[l] = ' ';
+    u[l+1] = 0x00;
+    if ((strncmp(u,"INSERT ",7) == 0) || (strncmp(u,"UPDATE ",7) == 0) ||
+        (strncmp(u,"DELETE ",7) == 0)) {
+        return 0;
+    }
+    // Locking reads and data changing CTEs need the primary
+    return (strstr(u," UPDATE ") == NULL) && (strstr(u," INSERT ") == NULL) &&
+           (strstr(u," DELETE ") == NULL) && (strstr(u," SHARE ") == NULL);
+}
+
+
+void startSqlStmt() {
+    sqlStmtText[0] = 0x00;
+    sqlStmtTypes[0] = 0x00;
+    sqlStmtParams = 0;
+    sqlStmtState = 0;
+    sqlStmtComplete = 1;
+}
+
+
+// Builds the statement text from the tokens passed to the server in the same way as
+// its execCallback: output variables of INTO are dropped, input ones replaced by $n
+void addSqlStmtToken(char *token, int hostVar) {
+    int l = strlen(sqlStmtText);
+    if (l + strlen(token) + 16 >= sizeof(sqlStmtText)) {
+        sqlStmtComplete = 0;
+        return;
+    }
+    if (strstr(token,"END-EXEC") != NULL) {
+        return;
+    }
+    if (hostVar) {
+        if (sqlStmtState >= 2) {
+            sqlStmtState++;
+            return;
+        }
+        char *stmt = strstr(sqlStmtText,"EXEC SQL");
+        if ((stmt == NULL) || !isSqlParamStmt(stmt+9)) {
+            // Value is inserted as literal
+            sqlStmtComplete = 0;
+            return;
+        }
+        char *type = getDataItemType(token);
+        int t = strlen(sqlStmtTypes);
+        if (t + strlen(type) + 2 >= sizeof(sqlStmtTypes)) {
+            sqlStmtComplete = 0;
+            return;
+        }
+        sprintf(&sqlStmtTypes[t],"%s%s",(sqlStmtParams > 0) ? ";" : "",type);
+        sqlStmtParams++;
+        sprintf(&sqlStmtText[l],"%s%d%s","$",sqlStmtParams," ");
+        return;
+    }
+    if (strstr(token,"SELECT") || strstr(token,"FETCH")) {
+        sqlStmtState = 1;
+    } else {
+        if (strstr(token,"INTO") && (sqlStmtState == 1)) {
+            sqlStmtState = 2;
+        } else {
+            if ((strstr(token,",") == NULL) && (sqlStmtState >= 2)) {
+                sqlStmtState = 0;
+            }
+        }
+    }
+    if (sqlStmtState < 2) {
+        sprintf(&sqlStmtText[l],"%s%s",token," ");
+    }
+}
+
+
+// Static statements prepared by the server are written to the program's SQL catalog
+// as <no> <R|W> <number of params> <host variable types> <text>, separated by tabs
+void endSqlStmt(char *srcName) {
+    char *stmt = strstr(sqlStmtText,"EXEC SQL");
+    int l = strlen(sqlStmtText);
+    if (l > 0) {
+        sqlStmtText[l-1] = 0x00;
+    }
+    if (sqlStmtComplete && (stmt != NULL) && isSqlParamStmt(stmt+9) && !isSqlDynamicDecl(stmt+9)) {
+        if (sqlCatFile == NULL) {
+            sqlCatFile = fopen(sqlCatName,"w");
+            if (sqlCatFile == NULL) {
+                printf("%s%s\n","Could not create SQL catalog: ",sqlCatName);
+            } else {
+                fprintf(sqlCatFile,"%s%s\n","# QWICS SQL catalog of ",srcName);
+            }
+        }
+        if (sqlCatFile != NULL) {
+            sqlStmtNum++;
+            fprintf(sqlCatFile,"%d\t%s\t%d\t%s\t%s\n",sqlStmtNum,isSqlReadStmt(stmt+9) ? "R" : "W",
+                    sqlStmtParams,(sqlStmtParams > 0) ? sqlStmtTypes : "-",stmt+9);
+        }
+    }
+    startSqlStmt();
+}
+
+
+// Host variable arrays are passed by their first element, preceded by a marker
+void putSqlHostVar(char *token, FILE *fp2) {
+    char execbuf[255];
+    addSqlStmtToken(token,1);
+    if (isOccursVar(token)) {
+        sprintf(execbuf,"%s%s\n","           DISPLAY \"TPMI:#ARRAY",getExecTerminator(1));
+        fputs(execbuf, (FILE*)fp2);
+        sprintf(execbuf,"%s%s%s%s\n","           DISPLAY \"TPMI:\" ",
+                token,"(1)",getExecTerminator(0));
+    } else {
+        sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:\" ",
+                token,getExecTerminator(0));
+    }
+    fputs(execbuf, (FILE*)fp2);
+}
+
+
+void putSqlToken(char *token, FILE *fp2) {
+    char execbuf[255];
+    sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
+            token,getExecTerminator(1));
+    fputs(execbuf, (FILE*)fp2);
+    addSqlStmtToken(token,0);
+}
+
+
 // Process EXEC ... END-EXEC statement line in the procedure division
 void processExecLine(int execCmd, char *buf, FILE *fp2) {
     char execbuf[255];
@@ -289,6 +594,9 @@ void processExecLine(int execCmd, char *buf, FILE *fp2) {
                 sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
                         token,getExecTerminator(1));
                 fputs(execbuf, (FILE*)fp2);
+                if (execCmd == 2) {
+                    addSqlStmtToken(token,0);
+                }
                 tokenPos = 0;
             }
             verbatim = 1;
@@ -304,6 +612,9 @@ void processExecLine(int execCmd, char *buf, FILE *fp2) {
                 sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
                         token,getExecTerminator(1));
                 fputs(execbuf, (FILE*)fp2);
+                if (execCmd == 2) {
+                    addSqlStmtToken(token,0);
+                }
             }
             if (mapNameMode == 1) {
                 token[strlen(token)-1] = 0x00;
@@ -471,9 +782,7 @@ void processExecLine(int execCmd, char *buf, FILE *fp2) {
             if (buf[i] == ':') {
                 if (tokenPos > 0) {
                     token[tokenPos] = 0x00;
-                    sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
-                            token,getExecTerminator(1));
-                    fputs(execbuf, (FILE*)fp2);
+                    putSqlToken(token,fp2);
                     tokenPos = 0;
                 }
                 value = 1;
@@ -483,13 +792,10 @@ void processExecLine(int execCmd, char *buf, FILE *fp2) {
                     if (tokenPos > 0) {
                         token[tokenPos] = 0x00;
                         if (value == 1) {
-                            sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:\" ",
-                                    token,getExecTerminator(0));
+                            putSqlHostVar(token,fp2);
                         } else {
-                            sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
-                                    token,getExecTerminator(1));
+                            putSqlToken(token,fp2);
                         }
-                        fputs(execbuf, (FILE*)fp2);
                         tokenPos = 0;
                     }
                     value = 0;
@@ -499,21 +805,16 @@ void processExecLine(int execCmd, char *buf, FILE *fp2) {
                         if (tokenPos > 0) {
                             token[tokenPos] = 0x00;
                             if (value == 1) {
-                                sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:\" ",
-                                        token,getExecTerminator(0));
+                                putSqlHostVar(token,fp2);
                             } else {
-                                sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
-                                        token,getExecTerminator(1));
+                                putSqlToken(token,fp2);
                             }
-                            fputs(execbuf, (FILE*)fp2);
                             tokenPos = 0;
                         }
                         value = 0;
                         token[0] = buf[i];
                         token[1] = 0x00;
-                        sprintf(execbuf,"%s%s%s\n","           DISPLAY \"TPMI:",
-                                token,getExecTerminator(1));
-                        fputs(execbuf, (FILE*)fp2);
+                        putSqlToken(token,fp2);
                     } else {
                         token[tokenPos] = buf[i];
                         tokenPos++;
@@ -575,6 +876,16 @@ int main(int argc, char **argv) {
         return -1;
    }
 
+   // Catalog of the static SQL statements, input to the sqlbind step
+   snprintf(sqlCatName,sizeof(sqlCatName)-8,"%s",argv[1]);
+   char *ext = strrchr(sqlCatName,'.');
+   if (ext != NULL) {
+        ext[0] = 0x00;
+   }
+   strcat(sqlCatName,".sqlcat");
+   unlink(sqlCatName);
+   startSqlStmt();
+
    int execCmd = 0;
    int inProcDivision = 0;
    int startProcDivision = 0;
@@ -620,6 +931,9 @@ int main(int argc, char **argv) {
                if (linkageSectionPresent) {
                    parseLinkageVarDef(buf);
                }
+               if (!inProcDivision) {
+                   parseDataItemDef(buf);
+               }
                if (startProcDivision) {
                    if (sqlca) {
                        char buf[80];
@@ -672,6 +986,9 @@ int main(int argc, char **argv) {
 
            char *cmd = strstr(buf,"END-EXEC");
            if (cmd != NULL) {
+               if (execCmd == 2) {
+                   endSqlStmt(argv[1]);
+               }
                execCmd = 0;
                if (isReturn || isXctl) {
                    char gb[30];
@@ -694,6 +1011,9 @@ int main(int argc, char **argv) {
 
     fclose(fp);
     fclose(fp2);
+    if (sqlCatFile != NULL) {
+        fclose(sqlCatFile);
+    }
     return 0;
     
   // argv[0| = "cobc";
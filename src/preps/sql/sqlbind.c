@@ -0,0 +1,185 @@
+/*******************************************************************************************/
+/*   QWICS Server SQL Catalog Bind Step                                                    */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <libpq-fe.h>
+
+// Validates the SQL catalog written by cobprep against the database and writes the
+// bound catalog (.sqlbnd) the server prepares on its pooled connections. Statements
+// failing to prepare are left out, so they are only parsed at execution time.
+
+#define OID_INT8 20
+#define OID_INT2 21
+#define OID_INT4 23
+#define OID_FLOAT4 700
+#define OID_FLOAT8 701
+#define OID_NUMERIC 1700
+
+
+// Drops a clause PostgreSQL does not know from a statement, same as the server does
+void removeSqlPhrase(char *sql, char *phrase) {
+    char *u = strdup(sql);
+    for (int i = 0; u[i] != 0x00; i++) {
+        u[i] = toupper((unsigned char)u[i]);
+    }
+    char *p = strstr(u,phrase);
+    if (p != NULL) {
+        int pos = p-u;
+        int l = strlen(phrase);
+        memmove(&sql[pos],&sql[pos+l],strlen(sql)-pos-l+1);
+    }
+    free(u);
+}
+
+
+void translateSql(char *sql) {
+    if (strncasecmp(sql,"DECLARE ",8) == 0) {
+        removeSqlPhrase(sql," WITH ROWSET POSITIONING");
+        removeSqlPhrase(sql," WITHOUT ROWSET POSITIONING");
+    }
+}
+
+
+int isNumericHostVar(char *type) {
+    if ((strncmp(type,"VARCHAR",7) == 0) || (strcmp(type,"GROUP") == 0) ||
+        (strcmp(type,"UNKNOWN") == 0) || (toupper((unsigned char)type[0]) == 'X')) {
+        return 0;
+    }
+    return strchr(type,'9') != NULL;
+}
+
+
+int isNumericParam(Oid type) {
+    return (type == OID_INT2) || (type == OID_INT4) || (type == OID_INT8) ||
+           (type == OID_FLOAT4) || (type == OID_FLOAT8) || (type == OID_NUMERIC);
+}
+
+
+// Compares the host variable types with the parameter types derived by the database
+void checkParamTypes(int no, PGresult *desc, char *types) {
+    char *save = NULL;
+    char *t = strtok_r(types,";",&save);
+    for (int i = 0; (i < PQnparams(desc)) && (t != NULL); i++) {
+        if ((strcmp(t,"UNKNOWN") != 0) && (isNumericHostVar(t) != isNumericParam(PQparamtype(desc,i)))) {
+            printf("%s%d%s%d%s%s%s%s\n","WARNING: Statement ",no,", parameter $",i+1,": Host variable ",t,
+                   " is bound to a ",isNumericParam(PQparamtype(desc,i)) ? "numeric column" : "character column");
+        }
+        t = strtok_r(NULL,";",&save);
+    }
+}
+
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("%s\n","Usage: sqlbind <SQL catalog> [<connect string>]");
+        return 1;
+    }
+    char *conInfo = (argc > 2) ? argv[2] : getenv("QWICS_DB_CONNECTSTR");
+    if (conInfo == NULL) {
+        conInfo = "dbname=qwics";
+    }
+
+    FILE *in = fopen(argv[1],"r");
+    if (in == NULL) {
+        printf("%s%s\n","No input file: ",argv[1]);
+        return 1;
+    }
+    char oname[1024];
+    snprintf(oname,sizeof(oname)-8,"%s",argv[1]);
+    char *ext = strrchr(oname,'.');
+    if ((ext != NULL) && (strcmp(ext,".sqlcat") == 0)) {
+        ext[0] = 0x00;
+    }
+    strcat(oname,".sqlbnd");
+
+    PGconn *conn = PQconnectdb(conInfo);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        printf("ERROR: Connection to database failed: %s", PQerrorMessage(conn));
+        PQfinish(conn);
+        fclose(in);
+        return 1;
+    }
+    FILE *out = fopen(oname,"w");
+    if (out == NULL) {
+        printf("%s%s\n","Could not create output file: ",oname);
+        PQfinish(conn);
+        fclose(in);
+        return 1;
+    }
+
+    char line[8192];
+    int bound = 0, failed = 0;
+    while (fgets(line,sizeof(line),in) != NULL) {
+        if (line[0] == '#') {
+            fputs(line,out);
+            continue;
+        }
+        // <no> <R|W> <number of params> <host variable types> <text>, separated by tabs
+        char *fields[5];
+        int n = 0;
+        fields[n++] = line;
+        for (char *c = line; (*c != 0x00) && (n < 5); c++) {
+            if (*c == '\t') {
+                *c = 0x00;
+                fields[n++] = c+1;
+            }
+        }
+        if (n < 5) {
+            continue;
+        }
+        fields[4][strcspn(fields[4],"\r\n")] = 0x00;
+        int no = atoi(fields[0]);
+        translateSql(fields[4]);
+
+        PGresult *res = PQprepare(conn,"qwics_bind",fields[4],0,NULL);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            printf("%s%d%s%s\n %s","ERROR: Statement ",no,": ",fields[4],PQresultErrorMessage(res));
+            PQclear(res);
+            failed++;
+            continue;
+        }
+        PQclear(res);
+        res = PQdescribePrepared(conn,"qwics_bind");
+        if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+            if (PQnparams(res) != atoi(fields[2])) {
+                printf("%s%d%s%d%s%s\n","WARNING: Statement ",no,": Database expects ",PQnparams(res),
+                       " parameters, host variables are ",fields[2]);
+            }
+            char types[2048];
+            snprintf(types,sizeof(types),"%s",fields[3]);
+            checkParamTypes(no,res,types);
+        }
+        PQclear(res);
+        PQclear(PQexec(conn,"DEALLOCATE qwics_bind"));
+
+        fprintf(out,"%s\t%s\t%s\t%s\t%s\n",fields[0],fields[1],fields[2],fields[3],fields[4]);
+        bound++;
+    }
+
+    printf("%s%s%s%d%s%d%s\n","Bound ",oname,": ",bound," statements, ",failed," failed");
+    fclose(out);
+    fclose(in);
+    PQfinish(conn);
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+/*******************************************************************************************/
+/*   QWICS Server Task Channel and Container Store                                         */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chnstore.h"
+
+
+struct chnStore *createChnStore() {
+    struct chnStore *store = (struct chnStore*)malloc(sizeof(struct chnStore));
+    if (store == NULL) {
+        return NULL;
+    }
+    store->arena = NULL;
+    store->channels = NULL;
+    store->level = 0;
+    for (int i = 0; i < CHN_MAX_LEVELS; i++) {
+        store->current[i] = NULL;
+    }
+    store->reqContainer[0] = 0x00;
+    store->reqChannel[0] = 0x00;
+    store->pendingChannel[0] = 0x00;
+    return store;
+}
+
+
+void freeChnStore(struct chnStore *store) {
+    if (store == NULL) {
+        return;
+    }
+    struct chnArenaBlock *b = store->arena;
+    while (b != NULL) {
+        struct chnArenaBlock *n = b->next;
+        free(b);
+        b = n;
+    }
+    free(store);
+}
+
+
+// Allocate from task arena, memory stays valid until task end
+void *chnAlloc(struct chnStore *store, int size) {
+    if (size < 0) {
+        return NULL;
+    }
+    size = (size + 15) & ~15;
+    struct chnArenaBlock *b = store->arena;
+    if ((b != NULL) && (b->size - b->used >= size)) {
+        void *p = &b->data[b->used];
+        b->used += size;
+        return p;
+    }
+    int bsize = (size > CHN_ARENA_BLOCK_SIZE) ? size : CHN_ARENA_BLOCK_SIZE;
+    struct chnArenaBlock *nb = (struct chnArenaBlock*)malloc(sizeof(struct chnArenaBlock)+bsize);
+    if (nb == NULL) {
+        return NULL;
+    }
+    nb->size = bsize;
+    nb->used = size;
+    if ((b != NULL) && (bsize == size)) {
+        // Dedicated block for large item, keep current block for small ones
+        nb->next = b->next;
+        b->next = nb;
+    } else {
+        nb->next = b;
+        store->arena = nb;
+    }
+    return nb->data;
+}
+
+
+void chnCopyName(char *dest, char *src) {
+    int l = strlen(src);
+    if (l > CHN_NAME_LEN) l = CHN_NAME_LEN;
+    while ((l > 0) && (src[l-1] == ' ')) l--;
+    memcpy(dest,src,l);
+    dest[l] = 0x00;
+}
+
+
+struct chnChannel *getChannel(struct chnStore *store, char *name, int create) {
+    struct chnChannel *chn = NULL;
+    if ((name == NULL) || (name[0] == 0x00)) {
+        chn = store->current[store->level];
+        if ((chn == NULL) && create && (store->level == 0)) {
+            // Top level current channel is provided implicitly
+            chn = (struct chnChannel*)chnAlloc(store,sizeof(struct chnChannel));
+            if (chn == NULL) {
+                return NULL;
+            }
+            chn->name[0] = 0x00;
+            chn->level = 0;
+            chn->containers = NULL;
+            chn->next = store->channels;
+            store->channels = chn;
+            store->current[0] = chn;
+        }
+        return chn;
+    }
+
+    char cname[CHN_NAME_LEN+1];
+    chnCopyName(cname,name);
+    // Visible are channels of this LINK level, the passed one and DFHTRANSACTION
+    for (chn = store->channels; chn != NULL; chn = chn->next) {
+        if (strcmp(chn->name,cname) == 0) {
+            if ((chn->level == store->level) || (chn == store->current[store->level]) ||
+                (strcmp(cname,"DFHTRANSACTION") == 0)) {
+                return chn;
+            }
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    chn = (struct chnChannel*)chnAlloc(store,sizeof(struct chnChannel));
+    if (chn == NULL) {
+        return NULL;
+    }
+    sprintf(chn->name,"%s",cname);
+    chn->level = (strcmp(cname,"DFHTRANSACTION") == 0) ? 0 : store->level;
+    chn->containers = NULL;
+    chn->next = store->channels;
+    store->channels = chn;
+    return chn;
+}
+
+
+struct chnContainer *getContainer(struct chnStore *store, char *channel, char *container) {
+    struct chnChannel *chn = getChannel(store,channel,0);
+    if (chn == NULL) {
+        return NULL;
+    }
+    char cname[CHN_NAME_LEN+1];
+    chnCopyName(cname,container);
+    struct chnContainer *cnt = NULL;
+    for (cnt = chn->containers; cnt != NULL; cnt = cnt->next) {
+        if (strcmp(cnt->name,cname) == 0) {
+            return cnt;
+        }
+    }
+    return NULL;
+}
+
+
+// Returns 0 if stored, -1 if container must be handled by client
+int putContainer(struct chnStore *store, char *channel, char *container,
+                 unsigned char *data, int dataLen, int len, int append) {
+    struct chnContainer *cnt = getContainer(store,channel,container);
+    if ((cnt == NULL) && append) {
+        // Container to extend may only exist on client side
+        return -1;
+    }
+    if (cnt == NULL) {
+        struct chnChannel *chn = getChannel(store,channel,1);
+        if (chn == NULL) {
+            return -1;
+        }
+        cnt = (struct chnContainer*)chnAlloc(store,sizeof(struct chnContainer));
+        if (cnt == NULL) {
+            return -1;
+        }
+        chnCopyName(cnt->name,container);
+        cnt->data = NULL;
+        cnt->len = 0;
+        cnt->cap = 0;
+        cnt->next = chn->containers;
+        chn->containers = cnt;
+    }
+
+    int start = append ? cnt->len : 0;
+    if (start + len > cnt->cap) {
+        int cap = (start + len > 2*cnt->cap) ? start + len : 2*cnt->cap;
+        unsigned char *buf = (unsigned char*)chnAlloc(store,cap);
+        if (buf == NULL) {
+            return -1;
+        }
+        if (start > 0) {
+            memcpy(buf,cnt->data,start);
+        }
+        cnt->data = buf;
+        cnt->cap = cap;
+    }
+    if (dataLen > len) {
+        dataLen = len;
+    }
+    memmove(&cnt->data[start],data,dataLen);
+    if (dataLen < len) {
+        memset(&cnt->data[start+dataLen],0x00,len-dataLen);
+    }
+    cnt->len = start + len;
+    cnt->dirty = 1;
+    return 0;
+}
+
+
+void chnPushLevel(struct chnStore *store) {
+    struct chnChannel *chn = NULL;
+    if (store->pendingChannel[0] != 0x00) {
+        chn = getChannel(store,store->pendingChannel,1);
+    }
+    if (store->level < CHN_MAX_LEVELS-1) {
+        store->level++;
+    }
+    store->current[store->level] = chn;
+    store->pendingChannel[0] = 0x00;
+}
+
+
+void chnPopLevel(struct chnStore *store) {
+    // Channels created by the linked program go out of scope
+    struct chnChannel **chn = &store->channels;
+    while (*chn != NULL) {
+        if ((*chn)->level >= store->level && (store->level > 0)) {
+            *chn = (*chn)->next;
+        } else {
+            chn = &(*chn)->next;
+        }
+    }
+    store->current[store->level] = NULL;
+    if (store->level > 0) {
+        store->level--;
+    }
+}
+
+
+void chnXctl(struct chnStore *store) {
+    struct chnChannel *chn = NULL;
+    if (store->pendingChannel[0] != 0x00) {
+        chn = getChannel(store,store->pendingChannel,1);
+    }
+    if ((chn != NULL) || (store->level > 0)) {
+        store->current[store->level] = chn;
+    }
+    store->pendingChannel[0] = 0x00;
+}
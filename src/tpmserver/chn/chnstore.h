@@ -0,0 +1,79 @@
+/*******************************************************************************************/
+/*   QWICS Server Task Channel and Container Store                                         */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _chnstore_h
+#define _chnstore_h
+
+#define CHN_NAME_LEN 16
+#define CHN_MAX_LEVELS 100
+#define CHN_ARENA_BLOCK_SIZE 65536
+
+// Task memory arena, released as a whole at task end
+struct chnArenaBlock {
+    struct chnArenaBlock *next;
+    int size;
+    int used;
+    unsigned char data[];
+};
+
+struct chnContainer {
+    char name[CHN_NAME_LEN+1];
+    unsigned char *data;
+    int len;
+    int cap;
+    int dirty;    // Not yet known to the client
+    struct chnContainer *next;
+};
+
+struct chnChannel {
+    char name[CHN_NAME_LEN+1];
+    int level;    // LINK level the channel was created on
+    struct chnContainer *containers;
+    struct chnChannel *next;
+};
+
+struct chnStore {
+    struct chnArenaBlock *arena;
+    struct chnChannel *channels;
+    struct chnChannel *current[CHN_MAX_LEVELS];
+    int level;
+    // Names of the command currently processed
+    char reqContainer[CHN_NAME_LEN+1];
+    char reqChannel[CHN_NAME_LEN+1];
+    char pendingChannel[CHN_NAME_LEN+1];
+};
+
+// Store management
+struct chnStore *createChnStore();
+void freeChnStore(struct chnStore *store);
+void *chnAlloc(struct chnStore *store, int size);
+
+// Channel scope handling for LINK and XCTL
+void chnPushLevel(struct chnStore *store);
+void chnPopLevel(struct chnStore *store);
+void chnXctl(struct chnStore *store);
+
+// Container access, channel name "" means current channel
+struct chnChannel *getChannel(struct chnStore *store, char *name, int create);
+struct chnContainer *getContainer(struct chnStore *store, char *channel, char *container);
+int putContainer(struct chnStore *store, char *channel, char *container,
+                 unsigned char *data, int dataLen, int len, int append);
+
+#endif
@@ -0,0 +1,161 @@
+/*******************************************************************************************/
+/*   QWICS Server Task Clock and Time Formatting                                           */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tpmclock.h"
+
+// Local time of last second seen by this thread, saves localtime() per call
+struct clockCache {
+    time_t sec;
+    long gmtOff;
+};
+
+static __thread struct clockCache clockCache = { -1, 0 };
+
+
+long long getAbsTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    if (ts.tv_sec != clockCache.sec) {
+        // Offset to UTC only needs to be checked once per second
+        struct tm tm;
+        localtime_r(&ts.tv_sec,&tm);
+        clockCache.gmtOff = tm.tm_gmtoff;
+        clockCache.sec = ts.tv_sec;
+    }
+    return ((long long)ts.tv_sec + clockCache.gmtOff)*1000LL +
+           ts.tv_nsec/1000000 + ABSTIME_EPOCH_OFFSET;
+}
+
+
+// ABSTIME already contains the local offset, so it is broken down as UTC
+void getAbsTimeFields(long long absTime, struct tm *tm) {
+    time_t t = (time_t)((absTime - ABSTIME_EPOCH_OFFSET) / 1000LL);
+    if ((absTime < ABSTIME_EPOCH_OFFSET) && ((absTime % 1000LL) != 0)) {
+        t--;
+    }
+    gmtime_r(&t,tm);
+}
+
+
+void getEibDateTime(long long absTime, int *eibDate, int *eibTime) {
+    struct tm tm;
+    getAbsTimeFields(absTime,&tm);
+    *eibDate = tm.tm_year*1000 + tm.tm_yday + 1;
+    *eibTime = tm.tm_hour*10000 + tm.tm_min*100 + tm.tm_sec;
+}
+
+
+void formatDate(char *buf, char dateSep, int a, int b, int c, int la, int lb, int lc) {
+    if (dateSep != 0x00) {
+        sprintf(buf,"%0*d%c%0*d%c%0*d",la,a,dateSep,lb,b,dateSep,lc,c);
+    } else {
+        sprintf(buf,"%0*d%0*d%0*d",la,a,lb,b,lc,c);
+    }
+}
+
+
+int formatAbsTime(long long absTime, char *opt, char dateSep, char timeSep, char *buf) {
+    struct tm tm;
+    getAbsTimeFields(absTime,&tm);
+    int yyyy = tm.tm_year + 1900;
+    int yy = yyyy % 100;
+    int mm = tm.tm_mon + 1;
+    int dd = tm.tm_mday;
+    int ddd = tm.tm_yday + 1;
+
+    if ((strcmp(opt,"YYYYMMDD") == 0) || (strcmp(opt,"FULLDATE") == 0)) {
+        formatDate(buf,dateSep,yyyy,mm,dd,4,2,2);
+        return 0;
+    }
+    if (strcmp(opt,"YYMMDD") == 0) {
+        formatDate(buf,dateSep,yy,mm,dd,2,2,2);
+        return 0;
+    }
+    if (strcmp(opt,"YYYYDDMM") == 0) {
+        formatDate(buf,dateSep,yyyy,dd,mm,4,2,2);
+        return 0;
+    }
+    if (strcmp(opt,"YYDDMM") == 0) {
+        formatDate(buf,dateSep,yy,dd,mm,2,2,2);
+        return 0;
+    }
+    if (strcmp(opt,"DDMMYYYY") == 0) {
+        formatDate(buf,dateSep,dd,mm,yyyy,2,2,4);
+        return 0;
+    }
+    if (strcmp(opt,"DDMMYY") == 0) {
+        formatDate(buf,dateSep,dd,mm,yy,2,2,2);
+        return 0;
+    }
+    if (strcmp(opt,"MMDDYYYY") == 0) {
+        formatDate(buf,dateSep,mm,dd,yyyy,2,2,4);
+        return 0;
+    }
+    if (strcmp(opt,"MMDDYY") == 0) {
+        formatDate(buf,dateSep,mm,dd,yy,2,2,2);
+        return 0;
+    }
+    if ((strcmp(opt,"YYYYDDD") == 0) || (strcmp(opt,"YYDDD") == 0)) {
+        int ly = (opt[2] == 'Y') ? 4 : 2;
+        if (dateSep != 0x00) {
+            sprintf(buf,"%0*d%c%03d",ly,(ly == 4) ? yyyy : yy,dateSep,ddd);
+        } else {
+            sprintf(buf,"%0*d%03d",ly,(ly == 4) ? yyyy : yy,ddd);
+        }
+        return 0;
+    }
+    if (strcmp(opt,"TIME") == 0) {
+        if (timeSep != 0x00) {
+            sprintf(buf,"%02d%c%02d%c%02d",tm.tm_hour,timeSep,tm.tm_min,timeSep,tm.tm_sec);
+        } else {
+            sprintf(buf,"%02d%02d%02d",tm.tm_hour,tm.tm_min,tm.tm_sec);
+        }
+        return 0;
+    }
+    if (strcmp(opt,"DAYCOUNT") == 0) {
+        sprintf(buf,"%lld",absTime / 86400000LL);
+        return 0;
+    }
+    if (strcmp(opt,"DAYOFWEEK") == 0) {
+        sprintf(buf,"%d",tm.tm_wday);
+        return 0;
+    }
+    if (strcmp(opt,"DAYOFMONTH") == 0) {
+        sprintf(buf,"%d",dd);
+        return 0;
+    }
+    if (strcmp(opt,"MONTHOFYEAR") == 0) {
+        sprintf(buf,"%d",mm);
+        return 0;
+    }
+    if (strcmp(opt,"YEAR") == 0) {
+        sprintf(buf,"%d",yyyy);
+        return 0;
+    }
+    if (strcmp(opt,"MILLISECONDS") == 0) {
+        sprintf(buf,"%d",(int)(absTime % 1000LL));
+        return 0;
+    }
+    return -1;
+}
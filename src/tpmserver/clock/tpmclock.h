@@ -0,0 +1,36 @@
+/*******************************************************************************************/
+/*   QWICS Server Task Clock and Time Formatting                                           */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _tpmclock_h
+#define _tpmclock_h
+
+// Milliseconds between 1.1.1900 and 1.1.1970
+#define ABSTIME_EPOCH_OFFSET 2208988800000LL
+
+// Current local time as CICS ABSTIME (ms since 1.1.1900)
+long long getAbsTime();
+
+// EIBDATE (0CYYDDD) and EIBTIME (0HHMMSS) values of ABSTIME
+void getEibDateTime(long long absTime, int *eibDate, int *eibTime);
+
+// Value of FORMATTIME option, returns -1 if option is not supported
+int formatAbsTime(long long absTime, char *opt, char dateSep, char timeSep, char *buf);
+
+#endif
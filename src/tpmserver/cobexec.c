@@ -22,11 +22,14 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <pthread.h>
 #include <dlfcn.h>
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include <limits.h>
 
 #include <libcob.h>
 #include <setjmp.h>
@@ -36,6 +39,17 @@
 #include "msg/queueman.h"
 #include "shm/shmtpm.h"
 #include "enqdeq/enqdeq.h"
+#include "chn/chnstore.h"
+#include "tsq/tsqueue.h"
+#include "tdq/tdqueue.h"
+#include "task/bgtask.h"
+#include "sched/timerwheel.h"
+#include "clock/tpmclock.h"
+#include "ctr/namedctr.h"
+#include "jrnl/journal.h"
+#include "fc/filectl.h"
+#include "dtab/datatable.h"
+#include "qcache/querycache.h"
 
 #ifdef __APPLE__
 #include "macosx/fmemopen.h"
@@ -75,8 +89,18 @@ pthread_key_t respFieldsStateKey;
 pthread_key_t taskLocksKey;
 pthread_key_t callStackKey;
 pthread_key_t callStackPtrKey;
-pthread_key_t chnBufListKey;
-pthread_key_t chnBufListPtrKey;
+pthread_key_t chnStoreKey;
+pthread_key_t cmdDeferKey;
+pthread_key_t roParamsKey;
+pthread_key_t ctrParamsKey;
+pthread_key_t jrnlParamsKey;
+pthread_key_t fcParamsKey;
+pthread_key_t fcTaskKey;
+pthread_key_t dtBypassKey;
+pthread_key_t sqlParamsKey;
+pthread_key_t sqlCursorsKey;
+pthread_key_t sqlTxModeKey;
+pthread_key_t sqlPlansKey;
 
 // Callback function declared in libcob
 extern int (*performEXEC)(char*, void*);
@@ -94,18 +118,30 @@ pthread_cond_t  waitForModuleChange;
 
 pthread_mutex_t sharedMemMutex;
 
+int xa_coordinator = -1;
+#define XA_COORDINATOR GETENV_NUMBER(xa_coordinator,"QWICS_XA_COORDINATOR",0)
+
 int mem_pool_size = -1;
 #define MEM_POOL_SIZE GETENV_NUMBER(mem_pool_size,"QWICS_MEM_POOL_SIZE",100)
 
 char *jsDir = NULL;
 char *loadmodDir = NULL;
 char *connectStr = NULL;
+// Programs and transactions run as read only transactions, on a replica if configured
+char *readOnlyTasks = NULL;
+// Programs and transactions run with a weaker isolation level than SERIALIZABLE
+char *readCommittedTasks = NULL;
+char *repeatableReadTasks = NULL;
+// Programs and transactions whose INSERT, UPDATE and DELETE are queued in pipeline
+// mode. SQLCODE of these is 0, failures are reported by the next statement waiting.
+char *pipelineTasks = NULL;
 
 void **sharedAllocMem;
 int *sharedAllocMemLen;
 int *sharedAllocMemPtr = NULL;
 
-char paramsBuf[10][256];
+__thread char paramsBuf[10][256];
+int startReqidCnt = 0;
 void *paramList[10];
 
 unsigned char *cwa;
@@ -115,36 +151,319 @@ jmp_buf *condHandler[100];
 
 cob_module thisModule;
 
-struct chnBuf {
-    unsigned char *buf;
+// Client output of a command, which is kept back while it may be handled locally
+struct cmdDefer {
+    int active;
+    int len;
+    int tokens;   // Tokens of current command, 1 is the command verb
+    int noClient; // Background task, current command needs a client
+    char buf[CMDBUF_SIZE];
+};
+
+// Host variables of the EXEC SQL statement being built, passed as $n params
+#define SQL_MAX_PARAMS 256
+#define SQL_MAX_ARRAYS 100
+#define SQL_ROWSET_MAX_PARAMS 65535
+struct sqlParams {
+    int num;
+    int len;                        // Used bytes of buf
+    int text[SQL_MAX_PARAMS];       // Value of an alphanumeric field
+    char *values[SQL_MAX_PARAMS];
+    int array[SQL_MAX_PARAMS];      // Index+1 in arrays of a host variable array param
+    cob_field vars[SQL_MAX_PARAMS]; // Host variables, read again at OPEN of a cursor
+    int nextArray;                  // Next host variable is an array
+    int numArrays;
+    cob_field arrays[SQL_MAX_ARRAYS];  // First elements of host variable arrays
+    char buf[CMDBUF_SIZE];
+};
+
+// Cursors declared by a task, the DECLARE is sent to the DB at OPEN
+#define SQL_MAX_CURSORS 256
+#define SQL_CURSOR_BUCKETS 64
+struct sqlCursor {
+    char name[64];
+    char *decl;        // DECLARE statement with $n params
+    int numVars;
+    cob_field *vars;   // Host variables of the params
+    int open;
+    int prefetch;      // Declared by the task as forward only and read only
+    int hold;          // WITH HOLD, survives the end of the UOW
+    PGresult *res;     // Rows fetched ahead
+    int row;           // Next row of res to return
+    int block;         // Rows of the next FETCH FORWARD
+    int end;           // Last block was not full
+    int binary;        // Rows are fetched in binary format, -1 if not known yet
+    int next;          // Next cursor in hash bucket, -1 at end
+};
+
+// Statements of dynamic SQL prepared by a task, cursors are declared for them by name
+#define SQL_MAX_DYN_STMTS 64
+struct sqlDynStmt {
+    char name[64];
+    char *sql;         // Text with parameter markers as $n
+    int numParams;
+};
+
+struct sqlCursors {
+    int num;
+    int buckets[SQL_CURSOR_BUCKETS];
+    struct sqlCursor cursors[SQL_MAX_CURSORS];
+    int numStmts;
+    struct sqlDynStmt stmts[SQL_MAX_DYN_STMTS];
+};
+
+// SQL descriptor area of dynamic SQL, see copybooks/SQLDA.cpy. Its binary fields are
+// big-endian as COMP of the programs, SQLDATA and SQLIND are native pointers.
+#define SQLDA_HEADER_SIZE 16
+#define SQLDA_VAR_SIZE (4+2*(int)sizeof(void*)+32)
+#define SQL_TYPE_DATE 384
+#define SQL_TYPE_TIME 388
+#define SQL_TYPE_TIMESTAMP 392
+#define SQL_TYPE_VARCHAR 448
+#define SQL_TYPE_CHAR 452
+#define SQL_TYPE_LONG_VARCHAR 456
+#define SQL_TYPE_FLOAT 480
+#define SQL_TYPE_DECIMAL 484
+#define SQL_TYPE_BIGINT 492
+#define SQL_TYPE_INTEGER 496
+#define SQL_TYPE_SMALLINT 500
+
+// Conversion of result columns to host variables, built once per statement of a task
+#define SQL_PLAN_BUCKETS 64
+#define SQL_COL_TEXT 0
+#define SQL_COL_INT 1
+#define SQL_COL_NUMERIC 2
+typedef void (*sqlPutText)(cob_field *var, char *v, int len);
+typedef void (*sqlPutInt)(cob_field *var, long long v);
+
+struct sqlPlanCol {
+    int kind;                      // SQL_COL_*, binary columns are decoded first
+    Oid type;
+    const cob_field_attr *attr;
+    size_t size;
+    sqlPutText putText;
+    sqlPutInt putInt;              // NULL if integers are stored as text
+};
+
+struct sqlPlan {
+    char *sql;
+    unsigned int hash;
+    int binary;
+    int cols;
+    int maxCols;
+    struct sqlPlanCol *col;
+    struct sqlPlan *next;
+};
+
+struct sqlPlans {
+    struct sqlPlan *buckets[SQL_PLAN_BUCKETS];
+};
+
+// Mode of the task's DB transaction, started with its first EXEC SQL
+struct sqlTxMode {
+    int lazy;          // Connection is acquired on first use
+    int readOnly;
+    int isolation;     // DB_ISOLATION_*
+    int pipeline;      // INSERT, UPDATE and DELETE need not wait for their results
+};
+
+// Statement of a multi-row INSERT being built from host variable arrays
+struct sqlRowset {
+    struct sqlParams *params;
+    char *sql;
+    int len;
+    char **values;                  // Params of the statement
+    int num;
+    char *buf;                      // Text of the param values
+    int bufLen;
+    int map[SQL_MAX_PARAMS];        // Param number of a host variable in the current row, 0 if unused
+};
+
+int fetch_initial = -1;
+#define FETCH_INITIAL GETENV_NUMBER(fetch_initial,"QWICS_FETCH_INITIAL",4)
+int fetch_max = -1;
+#define FETCH_MAX GETENV_NUMBER(fetch_max,"QWICS_FETCH_MAX",1024)
+
+// Output params of read only data cmd (ASKTIME, FORMATTIME, ASSIGN) answered locally
+#define RO_MAX_PARAMS 16
+struct roParams {
+    int cmd;
+    int num;
+    char opt[RO_MAX_PARAMS][16];
+    cob_field *vars[RO_MAX_PARAMS];
+    char dateSep;
+    char timeSep;
+    long long absTime;
+};
+
+#define RO_ASKTIME 1
+#define RO_FORMATTIME 2
+#define RO_ASSIGN 3
+#define RO_INQUIRE 4
+
+// Params of named counter cmds, always answered locally
+struct ctrParams {
+    int cmd;
+    int param;    // Option whose value comes next
+    int opts;
+    int dcounter;
+    char name[CTR_NAME_LEN+1];
+    int hasValue;
+    long long value;
+    long long increment;
+    long long minimum;
+    long long maximum;
+    long long compMin;
+    long long compMax;
+    int hasMinimum;
+    int hasMaximum;
+    cob_field *valueVar;
+    cob_field *minimumVar;
+    cob_field *maximumVar;
+};
+
+#define CTR_GET 1
+#define CTR_PUT 2
+#define CTR_UPDATE 3
+#define CTR_DEFINE 4
+#define CTR_DELETE 5
+#define CTR_REWIND 6
+#define CTR_QUERY 7
+
+// Params of WRITE and WAIT JOURNALNAME, answered locally
+struct jrnlParams {
+    int cmd;
+    int param;    // Option whose value comes next
+    char name[JRNL_NAME_LEN+1];
+    char jtypeid[3];
+    cob_field *from;
+    int flength;
+    cob_field *prefix;
+    char prefixBuf[256];
+    int pfxleng;
+    cob_field *reqid;
+    int wait;
+    int nosuspend;
+};
+
+#define JRNL_WRITE 1
+#define JRNL_WAIT 2
+
+// Params of file control cmds, answered locally if files are defined
+struct fcParams {
+    int cmd;
+    int param;    // Option whose value comes next
+    int opts;
+    char name[FC_NAME_LEN+1];
+    cob_field *into;
+    cob_field *set;
+    cob_field *from;
+    cob_field *ridfld;
+    char ridBuf[BPT_MAX_KEY+1];   // RIDFLD given as constant
+    cob_field *lengthVar;
+    int length;
+    int keyLength;
+    cob_field *numrec;
+    int reqid;
 };
 
+#define FC_CMD_READ 1
+#define FC_CMD_WRITE 2
+#define FC_CMD_REWRITE 3
+#define FC_CMD_DELETE 4
+#define FC_CMD_UNLOCK 5
+#define FC_CMD_STARTBR 6
+#define FC_CMD_READNEXT 7
+#define FC_CMD_READPREV 8
+#define FC_CMD_RESETBR 9
+#define FC_CMD_ENDBR 10
+
+int applIdState = -1;
+char *applId = NULL;
+char *sysId = NULL;
+
 char *cobDateFormat = "YYYY-MM-dd-hh.mm.ss.uuuuu";
 char *dbDateFormat = "dd-MM-YYYY hh:mm:ss.uuu";
 char result[30];
 
 
-unsigned char *getNextChnBuf(int size) {
-    int *chnBufListPtr = (int*)pthread_getspecific(chnBufListPtrKey);
-    struct chnBuf *chnBufList = (struct chnBuf *)pthread_getspecific(chnBufListKey);
+void deferCmd() {
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    cmdDefer->active = 1;
+    cmdDefer->len = 0;
+}
+
+
+// Returns 1 if nothing of the current command has been sent to the client yet
+int isCmdDeferred() {
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    return cmdDefer->active;
+}
+
+
+// Command handled locally, client never sees it
+void dropDeferredCmd() {
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    cmdDefer->active = 0;
+    cmdDefer->len = 0;
+}
+
 
-    if (*chnBufListPtr < 256) {
-        chnBufList[*chnBufListPtr].buf = malloc(size);
-        (*chnBufListPtr)++;
-        return chnBufList[(*chnBufListPtr)-1].buf;
+// Command must be handled by client, send what has been kept back so far
+void flushDeferredCmd(int childfd) {
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    if (getBackgroundTask() != NULL) {
+        // No client to send it to, cmd fails at END-EXEC
+        cmdDefer->noClient = 1;
+    } else
+    if (cmdDefer->active && (cmdDefer->len > 0)) {
+        write(childfd,cmdDefer->buf,cmdDefer->len);
     }
-    return NULL;
+    cmdDefer->active = 0;
+    cmdDefer->len = 0;
 }
 
 
-void clearChnBufList() {
-    int *chnBufListPtr = (int*)pthread_getspecific(chnBufListPtrKey);
-    struct chnBuf *chnBufList = (struct chnBuf *)pthread_getspecific(chnBufListKey);
-    int i;
+ssize_t writeCmd(int childfd, const void *buf, size_t n) {
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    if ((cmdDefer != NULL) && cmdDefer->active) {
+        if (cmdDefer->len + n <= CMDBUF_SIZE) {
+            memcpy(&cmdDefer->buf[cmdDefer->len],buf,n);
+            cmdDefer->len += n;
+            return n;
+        }
+        if (getBackgroundTask() != NULL) {
+            // Kept back anyway, background task has no client
+            return n;
+        }
+        // Too large to keep back, command goes to client
+        flushDeferredCmd(childfd);
+    }
+    return write(childfd,buf,n);
+}
+
 
-    for (i = 0; i < (*chnBufListPtr); i++) {
-        free(chnBufList[i].buf);
+// Copy name param from string constant or COBOL field, trailing blanks removed
+void getNameParam(char *cmd, cob_field *cobvar, char *name, int maxlen) {
+    int l = 0;
+    if (cobvar == NULL) {
+        char *str = (cmd[0] == '\'') ? cmd+1 : cmd;
+        l = strlen(str);
+        while ((l > 0) && ((str[l-1]==' ') || (str[l-1]=='\'') ||
+                           (str[l-1]==10) || (str[l-1]==13))) {
+            l--;
+        }
+        if (l > maxlen) l = maxlen;
+        memcpy(name,str,l);
+    } else {
+        l = (int)cobvar->size;
+        if (l > maxlen) l = maxlen;
+        while ((l > 0) && ((cobvar->data[l-1]==' ') || (cobvar->data[l-1]==0x00))) {
+            l--;
+        }
+        memcpy(name,cobvar->data,l);
     }
+    name[l] = 0x00;
 }
 
 
@@ -230,6 +549,509 @@ void setNumericValue(long v, cob_field *cobvar) {
 }
 
 
+#define CTR_P_NONE 0
+#define CTR_P_NAME 1
+#define CTR_P_POOL 2
+#define CTR_P_VALUE 3
+#define CTR_P_INCREMENT 4
+#define CTR_P_MINIMUM 5
+#define CTR_P_MAXIMUM 6
+#define CTR_P_COMPAREMIN 7
+#define CTR_P_COMPAREMAX 8
+
+void resetCtrParams(struct ctrParams *ctr, int cmd) {
+    ctr->cmd = cmd;
+    ctr->param = CTR_P_NONE;
+    ctr->opts = 0;
+    ctr->dcounter = 0;
+    ctr->name[0] = 0x00;
+    ctr->hasValue = 0;
+    ctr->value = 0;
+    ctr->increment = 1;
+    ctr->minimum = 0;
+    ctr->maximum = -1;
+    ctr->compMin = 0;
+    ctr->compMax = 0;
+    ctr->hasMinimum = 0;
+    ctr->hasMaximum = 0;
+    ctr->valueVar = NULL;
+    ctr->minimumVar = NULL;
+    ctr->maximumVar = NULL;
+}
+
+
+// Option keyword of a named counter cmd, its value follows
+void setCtrOption(struct ctrParams *ctr, char *cmd) {
+    ctr->param = CTR_P_NONE;
+    if (strcmp(cmd,"POOL") == 0) ctr->param = CTR_P_POOL;
+    if (strcmp(cmd,"VALUE") == 0) ctr->param = CTR_P_VALUE;
+    if (strcmp(cmd,"INCREMENT") == 0) ctr->param = CTR_P_INCREMENT;
+    if (strcmp(cmd,"MINIMUM") == 0) ctr->param = CTR_P_MINIMUM;
+    if (strcmp(cmd,"MAXIMUM") == 0) ctr->param = CTR_P_MAXIMUM;
+    if (strcmp(cmd,"COMPAREMIN") == 0) {
+        ctr->param = CTR_P_COMPAREMIN;
+        ctr->opts |= CTR_COMPAREMIN;
+    }
+    if (strcmp(cmd,"COMPAREMAX") == 0) {
+        ctr->param = CTR_P_COMPAREMAX;
+        ctr->opts |= CTR_COMPAREMAX;
+    }
+    if (strcmp(cmd,"WRAP") == 0) ctr->opts |= CTR_WRAP;
+    if (strcmp(cmd,"REDUCE") == 0) ctr->opts |= CTR_REDUCE;
+}
+
+
+void setCtrParam(struct ctrParams *ctr, char *cmd, cob_field *cobvar) {
+    int output = (ctr->cmd == CTR_QUERY) ||
+                 ((ctr->cmd == CTR_GET) && (ctr->param == CTR_P_VALUE));
+    long long v = 0;
+    if (cobvar == NULL) {
+        v = strtoll(cmd,NULL,10);
+    } else
+    if (!output && (ctr->param != CTR_P_NAME) && (ctr->param != CTR_P_POOL)) {
+        v = cob_get_llint(cobvar);
+    }
+    switch (ctr->param) {
+        case CTR_P_NAME: getNameParam(cmd,cobvar,ctr->name,CTR_NAME_LEN);
+                         break;
+        case CTR_P_VALUE: ctr->value = v;
+                          ctr->valueVar = cobvar;
+                          ctr->hasValue = 1;
+                          break;
+        case CTR_P_INCREMENT: ctr->increment = v;
+                              break;
+        case CTR_P_MINIMUM: ctr->minimum = v;
+                            ctr->minimumVar = cobvar;
+                            ctr->hasMinimum = 1;
+                            break;
+        case CTR_P_MAXIMUM: ctr->maximum = v;
+                            ctr->maximumVar = cobvar;
+                            ctr->hasMaximum = 1;
+                            break;
+        case CTR_P_COMPAREMIN: ctr->compMin = v;
+                               break;
+        case CTR_P_COMPAREMAX: ctr->compMax = v;
+                               break;
+    }
+    ctr->param = CTR_P_NONE;
+}
+
+
+// Runs a named counter cmd at END-EXEC, returns RESP
+int execCtrCmd(struct ctrParams *ctr, int *resp2) {
+    long long value = 0, minimum = 0, maximum = 0;
+    int resp = 0;
+    switch (ctr->cmd) {
+        case CTR_GET:
+            resp = getCounter(ctr->name,ctr->increment,ctr->opts,ctr->compMin,ctr->compMax,&value,resp2);
+            if ((resp == 0) && (ctr->valueVar != NULL)) {
+                setNumericValue(value,ctr->valueVar);
+            }
+            break;
+        case CTR_PUT:
+        case CTR_UPDATE:
+            resp = updateCounter(ctr->name,ctr->value,ctr->opts,ctr->compMin,ctr->compMax,resp2);
+            break;
+        case CTR_DEFINE:
+            if (!ctr->hasMaximum) {
+                ctr->maximum = ctr->dcounter ? LLONG_MAX : 2147483647LL;
+            }
+            if (!ctr->hasValue) {
+                ctr->value = ctr->minimum;
+            }
+            resp = defineCounter(ctr->name,ctr->value,ctr->minimum,ctr->maximum,resp2);
+            break;
+        case CTR_DELETE:
+            resp = deleteCounter(ctr->name,resp2);
+            break;
+        case CTR_REWIND:
+            resp = rewindCounter(ctr->name,resp2);
+            break;
+        case CTR_QUERY:
+            resp = queryCounter(ctr->name,&value,&minimum,&maximum,resp2);
+            if (resp == 0) {
+                if (ctr->valueVar != NULL) setNumericValue(value,ctr->valueVar);
+                if (ctr->minimumVar != NULL) setNumericValue(minimum,ctr->minimumVar);
+                if (ctr->maximumVar != NULL) setNumericValue(maximum,ctr->maximumVar);
+            }
+            break;
+    }
+    return resp;
+}
+
+
+#define JRNL_P_NONE 0
+#define JRNL_P_NAME 1
+#define JRNL_P_NUM 2
+#define JRNL_P_JTYPEID 3
+#define JRNL_P_FROM 4
+#define JRNL_P_FLENGTH 5
+#define JRNL_P_PREFIX 6
+#define JRNL_P_PFXLENG 7
+#define JRNL_P_REQID 8
+
+void resetJrnlParams(struct jrnlParams *jrnl, int cmd) {
+    jrnl->cmd = cmd;
+    jrnl->param = JRNL_P_NONE;
+    jrnl->name[0] = 0x00;
+    sprintf(jrnl->jtypeid,"%s","  ");
+    jrnl->from = NULL;
+    jrnl->flength = -1;
+    jrnl->prefix = NULL;
+    jrnl->prefixBuf[0] = 0x00;
+    jrnl->pfxleng = -1;
+    jrnl->reqid = NULL;
+    jrnl->wait = 0;
+    jrnl->nosuspend = 0;
+}
+
+
+// Option keyword of a journal cmd, its value follows
+void setJrnlOption(struct jrnlParams *jrnl, char *cmd) {
+    jrnl->param = JRNL_P_NONE;
+    if (strcmp(cmd,"JOURNALNAME") == 0) jrnl->param = JRNL_P_NAME;
+    if (strcmp(cmd,"JOURNALNUM") == 0) jrnl->param = JRNL_P_NUM;
+    if (strcmp(cmd,"JTYPEID") == 0) jrnl->param = JRNL_P_JTYPEID;
+    if (strcmp(cmd,"FROM") == 0) jrnl->param = JRNL_P_FROM;
+    if ((strcmp(cmd,"FLENGTH") == 0) || (strcmp(cmd,"LENGTH") == 0)) jrnl->param = JRNL_P_FLENGTH;
+    if (strcmp(cmd,"PREFIX") == 0) jrnl->param = JRNL_P_PREFIX;
+    if (strcmp(cmd,"PFXLENG") == 0) jrnl->param = JRNL_P_PFXLENG;
+    if (strcmp(cmd,"REQID") == 0) jrnl->param = JRNL_P_REQID;
+    if (strcmp(cmd,"WAIT") == 0) jrnl->wait = 1;
+    if (strcmp(cmd,"NOSUSPEND") == 0) jrnl->nosuspend = 1;
+}
+
+
+void setJrnlParam(struct jrnlParams *jrnl, char *cmd, cob_field *cobvar) {
+    switch (jrnl->param) {
+        case JRNL_P_NAME: getNameParam(cmd,cobvar,jrnl->name,JRNL_NAME_LEN);
+                          break;
+        case JRNL_P_NUM: sprintf(jrnl->name,"DFHJ%02d",
+                                 (int)((cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd)) % 100);
+                         break;
+        case JRNL_P_JTYPEID: getNameParam(cmd,cobvar,jrnl->jtypeid,2);
+                             break;
+        case JRNL_P_FROM: jrnl->from = cobvar;
+                          break;
+        case JRNL_P_FLENGTH: jrnl->flength = (cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd);
+                             break;
+        case JRNL_P_PREFIX: jrnl->prefix = cobvar;
+                            if (cobvar == NULL) {
+                                getNameParam(cmd,NULL,jrnl->prefixBuf,255);
+                            }
+                            break;
+        case JRNL_P_PFXLENG: jrnl->pfxleng = (cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd);
+                             break;
+        case JRNL_P_REQID: jrnl->reqid = cobvar;
+                           break;
+    }
+    jrnl->param = JRNL_P_NONE;
+}
+
+
+// Runs a journal cmd at END-EXEC, returns RESP
+int execJrnlCmd(struct jrnlParams *jrnl) {
+    if (jrnl->cmd == JRNL_WAIT) {
+        return waitJournal(jrnl->name);
+    }
+    int len = 0;
+    unsigned char *data = NULL;
+    if (jrnl->from != NULL) {
+        len = (jrnl->flength >= 0) ? jrnl->flength : (int)jrnl->from->size;
+        if (len > jrnl->from->size) {
+            return 22;   // LENGERR
+        }
+        data = jrnl->from->data;
+    }
+    int pfxLen = 0;
+    unsigned char *prefix = (unsigned char*)jrnl->prefixBuf;
+    if (jrnl->prefix != NULL) {
+        pfxLen = (jrnl->pfxleng >= 0) ? jrnl->pfxleng : (int)jrnl->prefix->size;
+        if (pfxLen > jrnl->prefix->size) {
+            return 22;
+        }
+        prefix = jrnl->prefix->data;
+    } else {
+        pfxLen = (jrnl->pfxleng >= 0) ? jrnl->pfxleng : (int)strlen(jrnl->prefixBuf);
+        if (pfxLen > strlen(jrnl->prefixBuf)) {
+            return 22;
+        }
+    }
+    unsigned int reqid = 0;
+    int resp = writeJournal(jrnl->name,jrnl->jtypeid,prefix,pfxLen,data,len,
+                            jrnl->wait,jrnl->nosuspend,&reqid);
+    if ((resp == 0) && (jrnl->reqid != NULL)) {
+        setNumericValue(reqid,jrnl->reqid);
+    }
+    return resp;
+}
+
+
+#define FC_P_NONE 0
+#define FC_P_FILE 1
+#define FC_P_INTO 2
+#define FC_P_SET 3
+#define FC_P_FROM 4
+#define FC_P_RIDFLD 5
+#define FC_P_LENGTH 6
+#define FC_P_KEYLENGTH 7
+#define FC_P_REQID 8
+#define FC_P_NUMREC 9
+#define FC_P_IGNORE 10
+
+void resetFcParams(struct fcParams *fc, int cmd) {
+    fc->cmd = cmd;
+    fc->param = FC_P_NONE;
+    fc->opts = 0;
+    fc->name[0] = 0x00;
+    fc->into = NULL;
+    fc->set = NULL;
+    fc->from = NULL;
+    fc->ridfld = NULL;
+    fc->ridBuf[0] = 0x00;
+    fc->lengthVar = NULL;
+    fc->length = -1;
+    fc->keyLength = -1;
+    fc->numrec = NULL;
+    fc->reqid = 0;
+}
+
+
+// Option keyword of a file control cmd, its value follows
+void setFcOption(struct fcParams *fc, char *cmd) {
+    fc->param = FC_P_NONE;
+    if ((strcmp(cmd,"FILE") == 0) || (strcmp(cmd,"DATASET") == 0)) fc->param = FC_P_FILE;
+    if (strcmp(cmd,"INTO") == 0) fc->param = FC_P_INTO;
+    if (strcmp(cmd,"SET") == 0) fc->param = FC_P_SET;
+    if (strcmp(cmd,"FROM") == 0) fc->param = FC_P_FROM;
+    if (strcmp(cmd,"RIDFLD") == 0) fc->param = FC_P_RIDFLD;
+    if (strcmp(cmd,"LENGTH") == 0) fc->param = FC_P_LENGTH;
+    if (strcmp(cmd,"KEYLENGTH") == 0) fc->param = FC_P_KEYLENGTH;
+    if (strcmp(cmd,"REQID") == 0) fc->param = FC_P_REQID;
+    if (strcmp(cmd,"NUMREC") == 0) fc->param = FC_P_NUMREC;
+    if ((strcmp(cmd,"SYSID") == 0) || (strcmp(cmd,"TOKEN") == 0)) fc->param = FC_P_IGNORE;
+    if (strcmp(cmd,"GENERIC") == 0) fc->opts |= FC_GENERIC;
+    if (strcmp(cmd,"GTEQ") == 0) fc->opts |= FC_GTEQ;
+    if (strcmp(cmd,"EQUAL") == 0) fc->opts &= ~FC_GTEQ;
+    if (strcmp(cmd,"UPDATE") == 0) fc->opts |= FC_UPDATE;
+    if (strcmp(cmd,"NOSUSPEND") == 0) fc->opts |= FC_NOSUSPEND;
+}
+
+
+void setFcParam(struct fcParams *fc, char *cmd, cob_field *cobvar) {
+    switch (fc->param) {
+        case FC_P_FILE: getNameParam(cmd,cobvar,fc->name,FC_NAME_LEN);
+                        break;
+        case FC_P_INTO: fc->into = cobvar;
+                        break;
+        case FC_P_SET: fc->set = cobvar;
+                       break;
+        case FC_P_FROM: fc->from = cobvar;
+                        break;
+        case FC_P_RIDFLD: fc->ridfld = cobvar;
+                          if (cobvar == NULL) {
+                              getNameParam(cmd,NULL,fc->ridBuf,BPT_MAX_KEY);
+                          }
+                          break;
+        case FC_P_LENGTH: fc->lengthVar = cobvar;
+                          fc->length = (cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd);
+                          break;
+        case FC_P_KEYLENGTH: fc->keyLength = (cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd);
+                             break;
+        case FC_P_REQID: fc->reqid = (cobvar != NULL) ? cob_get_int(cobvar) : atoi(cmd);
+                         break;
+        case FC_P_NUMREC: fc->numrec = cobvar;
+                          break;
+    }
+    fc->param = FC_P_NONE;
+}
+
+
+// Runs a file control cmd at END-EXEC, returns RESP or FC_LOCK_FAILED
+int execFcCmd(struct fcParams *fc, struct fcTask *task, struct chnStore *chnStore, int *resp2) {
+    *resp2 = 0;
+    struct fcFile *f = getFile(fc->name);
+    if (f == NULL) {
+        return 12;   // FILENOTFOUND
+    }
+    unsigned char key[BPT_MAX_KEY];
+    int hasKey = (fc->ridfld != NULL) || (fc->ridBuf[0] != 0x00);
+    int genLen = f->keyLen;
+    if (hasKey && (f->type == FC_KSDS)) {
+        if (fc->ridfld != NULL) {
+            fileKey(f,fc->ridfld->data,(int)fc->ridfld->size,0,key);
+        } else {
+            fileKey(f,(unsigned char*)fc->ridBuf,strlen(fc->ridBuf),0,key);
+        }
+        if ((fc->opts & FC_GENERIC) && (fc->keyLength > 0) && (fc->keyLength < f->keyLen)) {
+            genLen = fc->keyLength;
+        }
+    } else
+    if (hasKey) {
+        fileKey(f,NULL,0,(fc->ridfld != NULL) ? cob_get_llint(fc->ridfld) : strtoll(fc->ridBuf,NULL,10),key);
+    }
+
+    unsigned char *buf = NULL;
+    int len = 0;
+    int resp = 0;
+    int numrec = 0;
+    switch (fc->cmd) {
+        case FC_CMD_READ:
+        case FC_CMD_READNEXT:
+        case FC_CMD_READPREV:
+            if (fc->set != NULL) {
+                buf = (unsigned char*)chnAlloc(chnStore,f->recLen);
+                len = f->recLen;
+            } else
+            if (fc->into != NULL) {
+                buf = fc->into->data;
+                len = ((fc->length >= 0) && (fc->length < fc->into->size)) ? fc->length : (int)fc->into->size;
+            }
+            if (fc->cmd == FC_CMD_READ) {
+                if (!hasKey) {
+                    return 16;   // INVREQ
+                }
+                resp = fileRead(task,f,key,genLen,fc->opts,buf,&len,resp2);
+            } else {
+                resp = fileReadnext(task,f,fc->reqid,fc->cmd == FC_CMD_READPREV,key,buf,&len,resp2);
+            }
+            if ((resp != 0) && (resp != 22)) {
+                return resp;
+            }
+            if (fc->set != NULL) {
+                (*((unsigned char**)fc->set->data)) = buf;
+            }
+            if (fc->lengthVar != NULL) {
+                setNumericValue(len,fc->lengthVar);
+            }
+            break;
+        case FC_CMD_WRITE:
+        case FC_CMD_REWRITE:
+            if (fc->from == NULL) {
+                return 16;
+            }
+            len = (fc->length >= 0) ? fc->length : (int)fc->from->size;
+            if (len > fc->from->size) {
+                return 22;   // LENGERR
+            }
+            if (fc->cmd == FC_CMD_REWRITE) {
+                return fileRewrite(task,f,fc->from->data,len,resp2);
+            }
+            if (!hasKey) {
+                return 16;
+            }
+            resp = fileWrite(task,f,key,fc->from->data,len,resp2);
+            break;
+        case FC_CMD_DELETE:
+            resp = fileDelete(task,f,hasKey ? key : NULL,genLen,fc->opts,&numrec,resp2);
+            if (fc->numrec != NULL) {
+                setNumericValue(numrec,fc->numrec);
+            }
+            return resp;
+        case FC_CMD_UNLOCK:
+            return fileUnlock(task,f);
+        case FC_CMD_STARTBR:
+        case FC_CMD_RESETBR:
+            if (!hasKey) {
+                return 16;
+            }
+            return fileStartbr(task,f,key,genLen,fc->opts,fc->reqid,fc->cmd == FC_CMD_RESETBR,resp2);
+        case FC_CMD_ENDBR:
+            return fileEndbr(task,f,fc->reqid);
+    }
+
+    // Key of the record read or the RBA of a new ESDS record is returned in RIDFLD
+    if ((resp == 0) || (resp == 22)) {
+        if ((fc->ridfld != NULL) && (f->type == FC_KSDS)) {
+            memcpy(fc->ridfld->data,key,(fc->ridfld->size < f->keyLen) ? fc->ridfld->size : f->keyLen);
+        } else
+        if (fc->ridfld != NULL) {
+            setNumericValue(fileRid(key),fc->ridfld);
+        }
+    }
+    return resp;
+}
+
+
+// Set field to value line of read only data cmd
+void setReadOnlyValue(char *buf, cob_field *cobvar) {
+    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) {
+        int l = strlen(buf);
+        for (int i = 0; i < cobvar->size; i++) {
+          cobvar->data[i] = (i < l) ? buf[i] : ' ';
+        }
+    }
+    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_NUMERIC) {
+        char hbuf[256];
+        cob_put_picx(cobvar->data,cobvar->size,
+            convertNumeric(buf,cobvar->attr->digits,
+                           cobvar->attr->scale,hbuf));
+    }
+    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_NUMERIC_PACKED) {
+      long v = atol(buf);
+      cob_put_s64_comp3(v,cobvar->data,cobvar->size);
+    }
+    if (getCobType(cobvar) == COB_TYPE_NUMERIC_BINARY) {
+      long v = atol(buf);
+      cob_put_u64_compx(v,cobvar->data,cobvar->size);
+    }
+    if (getCobType(cobvar) == COB_TYPE_NUMERIC_COMP5) {
+      long v = atol(buf);
+      cob_put_s64_comp5(v,cobvar->data,cobvar->size);
+    }
+}
+
+
+// Returns 1 if option of read only data cmd is known in tpmserver
+int isLocalReadOnlyOption(int cmd, char *opt) {
+    if ((strcmp(opt,"RESP") == 0) || (strcmp(opt,"RESP2") == 0) ||
+        (strcmp(opt,"NOHANDLE") == 0)) {
+        return 1;
+    }
+    if (cmd == RO_ASKTIME) {
+        return (strcmp(opt,"ABSTIME") == 0);
+    }
+    if (cmd == RO_FORMATTIME) {
+        char buf[64];
+        return ((strcmp(opt,"ABSTIME") == 0) || (strcmp(opt,"DATESEP") == 0) ||
+                (strcmp(opt,"TIMESEP") == 0) || (formatAbsTime(0,opt,0,0,buf) == 0));
+    }
+    if (cmd == RO_ASSIGN) {
+        if (applIdState < 0) {
+            applId = getenv("QWICS_APPLID");
+            sysId = getenv("QWICS_SYSID");
+            applIdState = 1;
+        }
+        return ((strcmp(opt,"CWALENG") == 0) || (strcmp(opt,"TWALENG") == 0) ||
+                (strcmp(opt,"TCTUALENG") == 0) ||
+                ((strcmp(opt,"APPLID") == 0) && (applId != NULL)) ||
+                ((strcmp(opt,"SYSID") == 0) && (sysId != NULL)));
+    }
+    return 0;
+}
+
+
+// Value of ASSIGN option owned by tpmserver
+void getAssignValue(char *opt, char *buf) {
+    buf[0] = 0x00;
+    if (strcmp(opt,"CWALENG") == 0) {
+        sprintf(buf,"%d",4096);
+    }
+    if (strcmp(opt,"TWALENG") == 0) {
+        sprintf(buf,"%d",32768);
+    }
+    if (strcmp(opt,"TCTUALENG") == 0) {
+        sprintf(buf,"%d",256);
+    }
+    if (strcmp(opt,"APPLID") == 0) {
+        sprintf(buf,"%.8s",applId);
+    }
+    if (strcmp(opt,"SYSID") == 0) {
+        sprintf(buf,"%.4s",sysId);
+    }
+}
+
+
 char* adjustDateFormatToDb(char *str, int len) {
     int i = 0, l = strlen(cobDateFormat), pos = 0;
     char lastc = ' ';
@@ -258,136 +1080,1966 @@ char* adjustDateFormatToDb(char *str, int len) {
         }
     }
 
-    memset(result,' ',len);
-    result[len] = 0x00;
+    memset(result,' ',len);
+    result[len] = 0x00;
+
+    for (i = 0; i < strlen(dbDateFormat); i++) {
+        if ((dbDateFormat[i] == '-') || (dbDateFormat[i] == ' ') || 
+            (dbDateFormat[i] == ':') || (dbDateFormat[i] == '.')) {
+            result[i] = dbDateFormat[i];
+            continue;
+        } else {
+            if (lastc != dbDateFormat[i]) {
+                int j = 0;
+                while (j < l) {
+                    if (dbDateFormat[i] == cobDateFormat[j]) {
+                        break;
+                    }
+                    j++;
+                }                
+                if (j < l) {
+                    pos = j;
+                } else {
+                    return result;                    
+                }
+                lastc = dbDateFormat[i];
+            }
+
+            result[i] = str[pos];
+            pos++;
+        }
+    }
+
+    return result;
+}
+
+
+// Synchronizing COBOL module execution
+void startModule(char *progname) {
+  int found = 0;
+  cm(pthread_mutex_lock(&moduleMutex));
+  do {
+    found = 0;
+    for (int i = 0; i < runningModuleCnt; i++) {
+      if (strcmp(runningModules[i],progname) == 0) {
+        found = 1;
+        break;
+      }
+    }
+    if (found == 1) {
+        pthread_cond_wait(&waitForModuleChange,&moduleMutex);
+    }
+  } while (found == 1);
+
+  if (runningModuleCnt < 500) {
+      sprintf(runningModules[runningModuleCnt],"%s",progname);
+      runningModuleCnt++;
+  }
+  cm(pthread_mutex_unlock(&moduleMutex));
+}
+
+
+void endModule(char *progname) {
+  int found = 0;
+  cm(pthread_mutex_lock(&moduleMutex));
+  for (int i = 0; i < runningModuleCnt; i++) {
+    if (found == 1) {
+      sprintf(runningModules[i-1],"%s",runningModules[i]);
+    }
+    if ((found == 0) && (strcmp(runningModules[i],progname) == 0)) {
+      found = 1;
+    }
+  }
+  if (runningModuleCnt > 0) {
+    runningModuleCnt--;
+  }
+  cm(pthread_mutex_unlock(&moduleMutex));
+  pthread_cond_broadcast(&waitForModuleChange);
+}
+
+
+void writeJson(char *map, char *mapset, int childfd) {
+    int n = 0, l = strlen(map), found = 0, brackets = 0;
+    write(childfd,"JSON=",5);
+    char jsonFile[255];
+    sprintf(jsonFile,"%s%s%s%s",GETENV_STRING(jsDir,"QWICS_JSDIR","../copybooks"),"/",mapset,".js");
+    FILE *js = fopen(jsonFile,"rb");
+    if (js != NULL) {
+        while (1) {
+            char c = fgetc(js);
+            if (feof(js)) {
+                break;
+            }
+            if (found == 0) {
+                if (map[n] == c) {
+                    n++;
+                } else {
+                    n = 0;
+                }
+                if (n == l) {
+                    found = 1;
+                }
+            }
+            if (found == 1) {
+                if (c == '{') {
+                    found = 2;
+                }
+            }
+            if (found == 2) {
+                write(childfd,&c,1);
+                if (c == '{') {
+                    brackets++;
+                }
+                if (c == '}') {
+                    brackets--;
+                }
+                if (brackets <= 0) {
+                    break;
+                }
+            }
+        }
+        fclose(js);
+    }
+    write(childfd,"\n",1);
+}
+
+
+void setSQLCA(int code, char *state) {
+    if (sqlcode != NULL) {
+        cob_field sqlstate = { 5, sqlcode->data+119, NULL };
+        cob_set_int(sqlcode,code);
+        cob_put_picx(sqlstate.data,sqlstate.size,state);
+    }
+}
+
+
+// Rows processed by a rowset FETCH or multi-row INSERT
+void setSQLERRD3(int rows) {
+    if (sqlcode != NULL) {
+        cob_put_u64_compx(rows,sqlcode->data+92,4);
+    }
+}
+
+
+// Statements without results, which need not wait for the database
+int isDeferrableStmt(char *sql) {
+    while (*sql == ' ') sql++;
+    return (strncasecmp(sql,"INSERT ",7) == 0) || (strncasecmp(sql,"UPDATE ",7) == 0) ||
+           (strncasecmp(sql,"DELETE ",7) == 0);
+}
+
+
+// Statements whose host variables are passed as params of a prepared statement
+int isParamStmt(char *sql) {
+    while (*sql == ' ') sql++;
+    return (strncasecmp(sql,"SELECT ",7) == 0) || (strncasecmp(sql,"INSERT ",7) == 0) ||
+           (strncasecmp(sql,"UPDATE ",7) == 0) || (strncasecmp(sql,"DELETE ",7) == 0) ||
+           (strncasecmp(sql,"DECLARE ",8) == 0) || (strncasecmp(sql,"WITH ",5) == 0) ||
+           (strncasecmp(sql,"VALUES ",7) == 0);
+}
+
+
+// Copy text of a field to param value, ext. ASCII is converted to UTF-8
+int copySqlParamText(unsigned char *data, int len, char *dest) {
+    int j = 0;
+    for (int i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        if (c == 0x00) {
+            // Same as the former literal '\0'
+            dest[j++] = '\\';
+            dest[j++] = '0';
+        } else
+        if ((c & 0x80) == 0) {
+            dest[j++] = c;
+        } else {
+            dest[j++] = 0xC0 | ((c & 0xC0) >> 6);
+            dest[j++] = 0x80 | (c & 0x3F);
+        }
+    }
+    dest[j] = 0x00;
+    return j;
+}
+
+
+// Converts the value of a host variable to param text, v needs 2*size+64 bytes
+int convertSqlParam(cob_field *cobvar, char *v, int *isText) {
+    int text = 1;
+    int l = 0;
+    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_GROUP) {
+        // VARCHAR field
+        unsigned int vl = ((unsigned int)cobvar->data[0] << 8) | (unsigned int)cobvar->data[1];
+        if (vl > (cobvar->size-2)) {
+            vl = cobvar->size-2;
+        }
+        l = copySqlParamText(&cobvar->data[2],vl,v);
+    } else
+    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) {
+        char *str = adjustDateFormatToDb((char*)cobvar->data,cobvar->size);
+        l = copySqlParamText((unsigned char*)str,cobvar->size,v);
+    } else {
+        text = 0;
+        if ((getCobType(cobvar) == COB_TYPE_NUMERIC_BINARY) ||
+            (getCobType(cobvar) == COB_TYPE_NUMERIC_COMP5) ||
+            (getCobType(cobvar) == COB_TYPE_NUMERIC) ||
+            (getCobType(cobvar) == COB_TYPE_NUMERIC_PACKED)) {
+            if (cobvar->attr->scale == 0) {
+                l = sprintf(v,"%lld",(long long)cob_get_llint(cobvar));
+            } else {
+                FILE *f = fmemopen(v, 2*cobvar->size+64, "w");
+                display_cobfield(cobvar,f);
+                putc(0x00,f);
+                fclose(f);
+                l = strlen(v);
+            }
+        } else
+        if (getCobType(cobvar) == COB_TYPE_NUMERIC_DOUBLE) {
+            double d;
+            memcpy(&d,cobvar->data,sizeof(d));
+            l = sprintf(v,"%.17g",d);
+        } else
+        if (getCobType(cobvar) == COB_TYPE_NUMERIC_FLOAT) {
+            float d;
+            memcpy(&d,cobvar->data,sizeof(d));
+            l = sprintf(v,"%.9g",d);
+        } else {
+            v[0] = 0x00;
+        }
+    }
+    *isText = text;
+    return l;
+}
+
+
+// Adds the value of a host variable, returns its param number or -1 if there is no room
+int addSqlParam(struct sqlParams *params, cob_field *cobvar) {
+    if ((params->num >= SQL_MAX_PARAMS) || (params->len + 2*(int)cobvar->size + 64 > CMDBUF_SIZE)) {
+        return -1;
+    }
+    char *v = &params->buf[params->len];
+    int text = 1;
+    int l = convertSqlParam(cobvar,v,&text);
+    params->values[params->num] = v;
+    params->text[params->num] = text;
+    params->array[params->num] = 0;
+    params->vars[params->num] = *cobvar;
+    params->len += l + 1;
+    params->num++;
+    return params->num;
+}
+
+
+// Keeps the first element of a host variable array, returns its index+1 or 0
+int addSqlArray(struct sqlParams *params, cob_field *cobvar) {
+    if (params->numArrays >= SQL_MAX_ARRAYS) {
+        return 0;
+    }
+    params->arrays[params->numArrays] = *cobvar;
+    params->numArrays++;
+    return params->numArrays;
+}
+
+
+int isSqlArray(struct sqlParams *params, cob_field *cobvar) {
+    return (params != NULL) && (cobvar >= &params->arrays[0]) &&
+           (cobvar < &params->arrays[params->numArrays]);
+}
+
+
+void initSqlCursors(struct sqlCursors *cursors) {
+    cursors->num = 0;
+    cursors->numStmts = 0;
+    for (int i = 0; i < SQL_CURSOR_BUCKETS; i++) {
+        cursors->buckets[i] = -1;
+    }
+}
+
+
+unsigned int hashSqlCursor(char *name) {
+    unsigned int h = 0;
+    for (; *name != 0x00; name++) {
+        h = 31*h + toupper((unsigned char)*name);
+    }
+    return h % SQL_CURSOR_BUCKETS;
+}
+
+
+struct sqlCursor *getSqlCursor(struct sqlCursors *cursors, char *name, int create) {
+    unsigned int h = hashSqlCursor(name);
+    for (int i = cursors->buckets[h]; i >= 0; i = cursors->cursors[i].next) {
+        if (strcasecmp(cursors->cursors[i].name,name) == 0) {
+            return &cursors->cursors[i];
+        }
+    }
+    if (!create || (cursors->num >= SQL_MAX_CURSORS)) {
+        return NULL;
+    }
+    struct sqlCursor *cur = &cursors->cursors[cursors->num];
+    snprintf(cur->name,sizeof(cur->name),"%s",name);
+    cur->decl = NULL;
+    cur->numVars = 0;
+    cur->vars = NULL;
+    cur->open = 0;
+    cur->res = NULL;
+    cur->binary = -1;
+    cur->next = cursors->buckets[h];
+    cursors->buckets[h] = cursors->num++;
+    return cur;
+}
+
+
+void resetSqlCursor(struct sqlCursor *cur) {
+    if (cur->res != NULL) {
+        PQclear(cur->res);
+    }
+    cur->res = NULL;
+    cur->row = 0;
+    cur->block = FETCH_INITIAL;
+    cur->end = 0;
+}
+
+
+// Commit and rollback close all cursors not declared WITH HOLD, declarations
+// stay until the end of the task
+void endSqlCursors(struct sqlCursors *cursors, int all) {
+    if (cursors == NULL) {
+        return;
+    }
+    for (int i = 0; i < cursors->num; i++) {
+        struct sqlCursor *cur = &cursors->cursors[i];
+        if (all || !cur->hold) {
+            resetSqlCursor(cur);
+            cur->open = 0;
+        }
+        if (all) {
+            free(cur->decl);
+            free(cur->vars);
+        }
+    }
+    if (all) {
+        for (int i = 0; i < cursors->numStmts; i++) {
+            free(cursors->stmts[i].sql);
+        }
+        initSqlCursors(cursors);
+    }
+}
+
+
+// Takes the next word of a statement, returns NULL at its end
+char *nextSqlWord(char *sql, char *word, int maxlen) {
+    while (*sql == ' ') sql++;
+    if (*sql == 0x00) {
+        return NULL;
+    }
+    int l = 0;
+    while ((*sql != ' ') && (*sql != 0x00)) {
+        if (l < maxlen) {
+            word[l++] = *sql;
+        }
+        sql++;
+    }
+    word[l] = 0x00;
+    return sql;
+}
+
+
+// Dynamic SQL statements, their host variables are passed as $n params, too. OPEN
+// and FETCH are dynamic with a USING clause or a descriptor.
+int isDynamicSqlStmt(char *sql) {
+    char word[16];
+    char *p = nextSqlWord(sql,word,15);
+    if (p == NULL) {
+        return 0;
+    }
+    if ((strcasecmp(word,"PREPARE") == 0) || (strcasecmp(word,"DESCRIBE") == 0) ||
+        (strcasecmp(word,"EXECUTE") == 0)) {
+        return 1;
+    }
+    if ((strcasecmp(word,"OPEN") != 0) && (strcasecmp(word,"FETCH") != 0)) {
+        return 0;
+    }
+    while ((p = nextSqlWord(p,word,15)) != NULL) {
+        if ((strcasecmp(word,"USING") == 0) || (strcasecmp(word,"DESCRIPTOR") == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Position of a keyword outside of parentheses and literals of an upper case statement
+char *findSqlKeyword(char *u, char *kw) {
+    int l = strlen(kw);
+    int depth = 0;
+    char quote = 0;
+    for (char *c = u; *c != 0x00; c++) {
+        if (quote) {
+            if (*c == quote) quote = 0;
+        } else
+        if ((*c == '\'') || (*c == '"')) {
+            quote = *c;
+        } else
+        if (*c == '(') {
+            depth++;
+        } else
+        if (*c == ')') {
+            depth--;
+        } else
+        if ((depth == 0) && (strncmp(c,kw,l) == 0)) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+
+// Cursors that cannot be used by UPDATE or DELETE WHERE CURRENT OF
+int isReadOnlySqlCursor(char *u) {
+    char *clauses[] = { " FOR READ ONLY", " FOR FETCH ONLY", " ORDER BY ", " GROUP BY ", " HAVING ",
+                        " DISTINCT ", " UNION ", " INTERSECT ", " EXCEPT ", " JOIN ", NULL };
+    char *aggregates[] = { " COUNT", " SUM", " AVG", " MIN", " MAX", NULL };
+    for (int i = 0; clauses[i] != NULL; i++) {
+        if (findSqlKeyword(u,clauses[i]) != NULL) {
+            return 1;
+        }
+    }
+    for (int i = 0; aggregates[i] != NULL; i++) {
+        char *a = findSqlKeyword(u,aggregates[i]);
+        if (a != NULL) {
+            a += strlen(aggregates[i]);
+            while (*a == ' ') a++;
+            if (*a == '(') {
+                return 1;
+            }
+        }
+    }
+    // More than one table in the FROM list
+    char *from = findSqlKeyword(u," FROM ");
+    if (from == NULL) {
+        return 0;
+    }
+    char *end[] = { " WHERE ", " GROUP ", " ORDER ", " FOR ", " FETCH ", " LIMIT ", " OFFSET ",
+                    " WITH ", NULL };
+    int depth = 0;
+    for (char *c = from+6; *c != 0x00; c++) {
+        if (*c == '(') {
+            depth++;
+        } else
+        if (*c == ')') {
+            depth--;
+        } else
+        if (depth == 0) {
+            if (*c == ',') {
+                return 1;
+            }
+            for (int i = 0; end[i] != NULL; i++) {
+                if (strncmp(c,end[i],strlen(end[i])) == 0) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+
+// Prefetch and hold of a cursor by the text of its declaration
+void setSqlCursorMode(struct sqlCursor *cur, char *decl) {
+    char *u = strdup(decl);
+    for (int i = 0; u[i] != 0x00; i++) {
+        u[i] = toupper((unsigned char)u[i]);
+    }
+    // Rows are only fetched ahead if the server position does not matter, i.e. no
+    // positioned UPDATE or DELETE can refer to the cursor
+    cur->prefetch = (strstr(u," CURSOR ") != NULL) &&
+                    ((strstr(u,"SCROLL ") == NULL) || (strstr(u,"NO SCROLL ") != NULL)) &&
+                    (strstr(u,"FOR UPDATE") == NULL) && (strstr(u,"FOR SHARE") == NULL) &&
+                    (strstr(u,"FOR NO KEY") == NULL) && (strstr(u,"FOR KEY SHARE") == NULL) &&
+                    isReadOnlySqlCursor(u);
+    cur->hold = (strstr(u,"WITH HOLD") != NULL);
+    free(u);
+}
+
+
+// Handles DECLARE, OPEN and CLOSE of cursors in memory, the DB only sees OPEN as
+// DECLARE and CLOSE of open cursors. Returns 0 if sql is no cursor statement.
+int execSqlCursorStmt(struct sqlCursors *cursors, PGconn *conn, char *sql, struct sqlParams *params) {
+    char word[64];
+    char *p = nextSqlWord(sql,word,63);
+    if ((p != NULL) && ((strcasecmp(word,"COMMIT") == 0) || (strcasecmp(word,"ROLLBACK") == 0))) {
+        // ROLLBACK [WORK] TO SAVEPOINT keeps the cursors open
+        char *q = nextSqlWord(p,word,63);
+        if ((q != NULL) && ((strcasecmp(word,"WORK") == 0) || (strcasecmp(word,"TRANSACTION") == 0))) {
+            q = nextSqlWord(q,word,63);
+        }
+        if ((q == NULL) || (strcasecmp(word,"TO") != 0)) {
+            endSqlCursors(cursors,0);
+        }
+        return 0;
+    }
+    if ((p == NULL) || ((strcasecmp(word,"DECLARE") != 0) && (strcasecmp(word,"OPEN") != 0) &&
+                        (strcasecmp(word,"CLOSE") != 0))) {
+        return 0;
+    }
+    char verb = toupper((unsigned char)word[0]);
+    if ((p = nextSqlWord(p,word,63)) == NULL) {
+        return 0;
+    }
+    struct sqlCursor *cur = getSqlCursor(cursors,word,verb == 'D');
+    if (verb == 'D') {
+        if (cur == NULL) {
+            // No room left, cursor is declared on the DB at once as before
+            return 0;
+        }
+        if (cur->open) {
+            // DECLARE is not executable, it has no effect on an open cursor
+            return 1;
+        }
+        setSqlCursorMode(cur,p);
+        free(cur->decl);
+        free(cur->vars);
+        cur->decl = strdup(sql);
+        cur->binary = -1;
+        cur->numVars = (params != NULL) ? params->num : 0;
+        cur->vars = NULL;
+        if (cur->numVars > 0) {
+            cur->vars = (cob_field*)malloc(cur->numVars*sizeof(cob_field));
+            memcpy(cur->vars,params->vars,cur->numVars*sizeof(cob_field));
+        }
+        return 1;
+    }
+    if ((cur == NULL) || (cur->decl == NULL)) {
+        if (verb == 'O') {
+            setSQLCA(-504,"34000");
+            return 1;
+        }
+        // Cursor declared outside of the registry
+        return 0;
+    }
+    if (verb == 'O') {
+        if (cur->open) {
+            setSQLCA(-502,"24502");
+            return 1;
+        }
+        // Host variables are read at OPEN
+        char *values[SQL_MAX_PARAMS];
+        int size = 0;
+        for (int i = 0; i < cur->numVars; i++) {
+            size += 2*(int)cur->vars[i].size + 64;
+        }
+        char *buf = (char*)malloc(size+1);
+        int len = 0;
+        for (int i = 0; i < cur->numVars; i++) {
+            int text = 1;
+            values[i] = &buf[len];
+            len += convertSqlParam(&cur->vars[i],values[i],&text) + 1;
+        }
+        int r = (cur->numVars > 0) ? execSQLParams(conn, cur->decl, cur->numVars, values) :
+                                     execSQL(conn, cur->decl);
+        free(buf);
+        resetSqlCursor(cur);
+        cur->open = r;
+        if (r == 0) {
+            setSQLCA(-1,"00000");
+        }
+        return 1;
+    }
+    if (!cur->open) {
+        setSQLCA(-501,"24501");
+        return 1;
+    }
+    resetSqlCursor(cur);
+    cur->open = 0;
+    if (execSQL(conn, sql) == 0) {
+        setSQLCA(-1,"00000");
+    }
+    return 1;
+}
+
+
+// FETCH of a declared cursor that is not open, answered without the DB
+int isClosedSqlCursor(struct sqlCursors *cursors, char *sql) {
+    char word[64];
+    char name[64];
+    char *p = nextSqlWord(sql,word,63);
+    if ((p == NULL) || (strcasecmp(word,"FETCH") != 0)) {
+        return 0;
+    }
+    // Name follows FROM or IN, or is the last word before INTO
+    name[0] = 0x00;
+    while (((p = nextSqlWord(p,word,63)) != NULL) && (strcasecmp(word,"INTO") != 0)) {
+        if ((strcasecmp(word,"FROM") == 0) || (strcasecmp(word,"IN") == 0)) {
+            if (nextSqlWord(p,name,63) == NULL) {
+                name[0] = 0x00;
+            }
+            break;
+        }
+        sprintf(name,"%s",word);
+    }
+    struct sqlCursor *cur = getSqlCursor(cursors,name,0);
+    return (cur != NULL) && (cur->decl != NULL) && !cur->open;
+}
+
+
+// Returns the result holding the next row of a FETCH NEXT, NULL if the cursor
+// is not prefetched. Row is set to -1 at the end of the cursor.
+PGresult *fetchSqlCursor(struct sqlCursors *cursors, PGconn *conn, char *sql, int *row) {
+    char word[64];
+    char *p = nextSqlWord(sql,word,63);
+    if ((p == NULL) || (strcasecmp(word,"FETCH") != 0) || ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return NULL;
+    }
+    if ((strcasecmp(word,"NEXT") == 0) && ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return NULL;
+    }
+    if (((strcasecmp(word,"FROM") == 0) || (strcasecmp(word,"IN") == 0)) &&
+        ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return NULL;
+    }
+    char rest[8];
+    if (nextSqlWord(p,rest,7) != NULL) {
+        return NULL;
+    }
+    struct sqlCursor *cur = getSqlCursor(cursors,word,0);
+    if ((cur == NULL) || !cur->prefetch || ((cur->decl != NULL) && !cur->open)) {
+        return NULL;
+    }
+    if ((cur->res == NULL) || (cur->row >= PQntuples(cur->res))) {
+        if (cur->end) {
+            *row = -1;
+            return cur->res;
+        }
+        if (cur->res != NULL) {
+            PQclear(cur->res);
+        }
+        char fetch[128];
+        sprintf(fetch,"%s%d%s%s","FETCH FORWARD ",cur->block," FROM ",cur->name);
+        cur->res = execSQLFetch(conn,fetch,cur->binary == 1);
+        cur->row = 0;
+        if (cur->res == NULL) {
+            return NULL;
+        }
+        if (cur->binary < 0) {
+            // Next blocks in binary format if all column types allow it
+            cur->binary = canFetchBinary(cur->res);
+        }
+        cur->end = (PQntuples(cur->res) < cur->block);
+        // Blocks grow as long as the program keeps fetching
+        cur->block = (2*cur->block < FETCH_MAX) ? 2*cur->block : FETCH_MAX;
+        if (PQntuples(cur->res) == 0) {
+            *row = -1;
+            return cur->res;
+        }
+    }
+    *row = cur->row++;
+    return cur->res;
+}
+
+
+// Column values of host variables by COBOL type, text is not terminated after len
+void putSqlVarchar(cob_field *var, char *v, int len) {
+    // Map VARCHAR to group struct
+    unsigned int l = (unsigned int)len;
+    if (l > (var->size-2)) {
+       l = var->size-2;
+    }
+    var->data[0] = (unsigned char)((l >> 8) & 0xFF);
+    var->data[1] = (unsigned char)(l & 0xFF);
+    memcpy(&var->data[2],v,l);
+}
+
+
+void putSqlZoned(cob_field *var, char *v, int len) {
+    char buf[256];
+    cob_put_picx(var->data,var->size,convertNumeric(v,var->attr->digits,var->attr->scale,buf));
+}
+
+
+void putSqlPacked(cob_field *var, char *v, int len) {
+    cob_put_s64_comp3(atol(v),var->data,var->size);
+}
+
+
+void putSqlBinary(cob_field *var, char *v, int len) {
+    cob_put_u64_compx(atol(v),var->data,var->size);
+}
+
+
+void putSqlComp5(cob_field *var, char *v, int len) {
+    cob_put_s64_comp5(atol(v),var->data,var->size);
+}
+
+
+void putSqlPicx(cob_field *var, char *v, int len) {
+    cob_put_picx(var->data,var->size,v);
+}
+
+
+void putSqlDouble(cob_field *var, char *v, int len) {
+    char buf[64];
+    snprintf(buf,sizeof(buf),"%.*s",len,v);
+    double d = strtod(buf,NULL);
+    memcpy(var->data,&d,sizeof(d));
+}
+
+
+void putSqlFloat(cob_field *var, char *v, int len) {
+    char buf[64];
+    snprintf(buf,sizeof(buf),"%.*s",len,v);
+    float d = strtof(buf,NULL);
+    memcpy(var->data,&d,sizeof(d));
+}
+
+
+void skipSqlVar(cob_field *var, char *v, int len) {
+}
+
+
+void putSqlPackedInt(cob_field *var, long long v) {
+    cob_put_s64_comp3(v,var->data,var->size);
+}
+
+
+void putSqlBinaryInt(cob_field *var, long long v) {
+    cob_put_u64_compx(v,var->data,var->size);
+}
+
+
+void putSqlComp5Int(cob_field *var, long long v) {
+    cob_put_s64_comp5(v,var->data,var->size);
+}
+
+
+sqlPutText getSqlPutText(cob_field *var) {
+    if (var->attr->type == COB_TYPE_GROUP) {
+        return putSqlVarchar;
+    }
+    if (var->attr->type == COB_TYPE_NUMERIC) {
+        return putSqlZoned;
+    }
+    if (var->attr->type == COB_TYPE_NUMERIC_PACKED) {
+        return putSqlPacked;
+    }
+    if (getCobType(var) == COB_TYPE_NUMERIC_BINARY) {
+        return putSqlBinary;
+    }
+    if (getCobType(var) == COB_TYPE_NUMERIC_COMP5) {
+        return putSqlComp5;
+    }
+    if (var->attr->type == COB_TYPE_NUMERIC_DOUBLE) {
+        return putSqlDouble;
+    }
+    if (var->attr->type == COB_TYPE_NUMERIC_FLOAT) {
+        return putSqlFloat;
+    }
+    return putSqlPicx;
+}
+
+
+sqlPutInt getSqlPutInt(cob_field *var) {
+    if (var->attr->type == COB_TYPE_GROUP) {
+        return NULL;
+    }
+    if (var->attr->type == COB_TYPE_NUMERIC_PACKED) {
+        return putSqlPackedInt;
+    }
+    if (getCobType(var) == COB_TYPE_NUMERIC_BINARY) {
+        return putSqlBinaryInt;
+    }
+    if (getCobType(var) == COB_TYPE_NUMERIC_COMP5) {
+        return putSqlComp5Int;
+    }
+    return NULL;
+}
+
+
+// Set host variable of SELECT INTO to column value
+void setSqlOutputVar(cob_field *var, char *v) {
+    getSqlPutText(var)(var,v,strlen(v));
+}
+
+
+long long getSqlBinaryInt(unsigned char *p, int len) {
+    if (len == 2) {
+        return (short)((p[0] << 8) | p[1]);
+    }
+    if (len == 4) {
+        return (int)(((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | (p[2] << 8) | p[3]);
+    }
+    long long v = 0;
+    for (int i = 0; i < len; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+
+// NUMERIC in binary format: ndigits, weight, sign, dscale and base 10000 digits
+long long getSqlNumericInt(unsigned char *p) {
+    int ndigits = (short)((p[0] << 8) | p[1]);
+    int weight = (short)((p[2] << 8) | p[3]);
+    int sign = (p[4] << 8) | p[5];
+    long long v = 0;
+    for (int i = 0; i <= weight; i++) {
+        v = v*10000 + ((i < ndigits) ? ((p[8+2*i] << 8) | p[9+2*i]) : 0);
+    }
+    return (sign == 0x4000) ? -v : v;
+}
+
+
+// Same text as the numeric output of the server, returns its length
+int getSqlNumericText(unsigned char *p, char *buf) {
+    int ndigits = (short)((p[0] << 8) | p[1]);
+    int weight = (short)((p[2] << 8) | p[3]);
+    int sign = (p[4] << 8) | p[5];
+    int dscale = (p[6] << 8) | p[7];
+    int l = 0;
+    if (sign == 0xC000) {
+        return sprintf(buf,"%s","NaN");
+    }
+    if (sign == 0x4000) {
+        buf[l++] = '-';
+    }
+    if (weight < 0) {
+        buf[l++] = '0';
+    }
+    for (int i = 0; i <= weight; i++) {
+        int d = (i < ndigits) ? ((p[8+2*i] << 8) | p[9+2*i]) : 0;
+        l += sprintf(&buf[l],(i == 0) ? "%d" : "%04d",d);
+    }
+    if (dscale > 0) {
+        buf[l++] = '.';
+        int n = 0;
+        for (int i = weight+1; n < dscale; i++) {
+            int d = ((i >= 0) && (i < ndigits)) ? ((p[8+2*i] << 8) | p[9+2*i]) : 0;
+            char q[5];
+            sprintf(q,"%04d",d);
+            for (int j = 0; (j < 4) && (n < dscale); j++, n++) {
+                buf[l++] = q[j];
+            }
+        }
+    }
+    buf[l] = 0x00;
+    return l;
+}
+
+
+void setSqlPlanCol(struct sqlPlanCol *col, Oid type, cob_field *var, int binary) {
+    col->type = type;
+    col->attr = var->attr;
+    col->size = var->size;
+    col->putText = getSqlPutText(var);
+    col->putInt = getSqlPutInt(var);
+    col->kind = SQL_COL_TEXT;
+    if (binary && ((type == DB_OID_INT2) || (type == DB_OID_INT4) || (type == DB_OID_INT8))) {
+        col->kind = SQL_COL_INT;
+    } else
+    if (binary && (type == DB_OID_NUMERIC)) {
+        col->kind = SQL_COL_NUMERIC;
+    }
+}
+
+
+// Returns the conversion plan of a statement, rebuilt if result or host variables changed
+struct sqlPlan *getSqlPlan(struct sqlPlans *plans, char *sql, PGresult *res, cob_field **outputVars) {
+    unsigned int h = 0;
+    for (char *c = sql; *c != 0x00; c++) {
+        h = 31*h + (unsigned char)*c;
+    }
+    int cols = 0;
+    while ((outputVars[cols] != NULL) && (cols < PQnfields(res))) cols++;
+    int binary = (PQnfields(res) > 0) && (PQfformat(res,0) == 1);
+
+    struct sqlPlan *plan = plans->buckets[h % SQL_PLAN_BUCKETS];
+    while ((plan != NULL) && ((plan->hash != h) || (strcmp(plan->sql,sql) != 0))) {
+        plan = plan->next;
+    }
+    if (plan != NULL) {
+        int valid = (plan->cols == cols) && (plan->binary == binary);
+        for (int i = 0; valid && (i < cols); i++) {
+            valid = (plan->col[i].type == PQftype(res,i)) && (plan->col[i].attr == outputVars[i]->attr) &&
+                    (plan->col[i].size == outputVars[i]->size);
+        }
+        if (valid) {
+            return plan;
+        }
+    } else {
+        plan = (struct sqlPlan*)malloc(sizeof(struct sqlPlan));
+        plan->sql = strdup(sql);
+        plan->hash = h;
+        plan->maxCols = 0;
+        plan->col = NULL;
+        plan->next = plans->buckets[h % SQL_PLAN_BUCKETS];
+        plans->buckets[h % SQL_PLAN_BUCKETS] = plan;
+    }
+    if (cols > plan->maxCols) {
+        free(plan->col);
+        plan->col = (struct sqlPlanCol*)malloc(cols*sizeof(struct sqlPlanCol));
+        plan->maxCols = cols;
+    }
+    plan->cols = cols;
+    plan->binary = binary;
+    for (int i = 0; i < cols; i++) {
+        setSqlPlanCol(&plan->col[i],PQftype(res,i),outputVars[i],binary);
+    }
+    return plan;
+}
+
+
+// Writes a row to the host variables in one pass over the plan
+void setSqlPlanRow(struct sqlPlan *plan, cob_field **outputVars, PGresult *res, int row) {
+    char buf[1024];
+    for (int i = 0; i < plan->cols; i++) {
+        struct sqlPlanCol *col = &plan->col[i];
+        char *v = PQgetvalue(res,row,i);
+        int len = PQgetlength(res,row,i);
+        if ((col->kind == SQL_COL_TEXT) || PQgetisnull(res,row,i)) {
+            col->putText(outputVars[i],v,len);
+        } else
+        if ((col->kind == SQL_COL_INT) && (col->putInt != NULL)) {
+            col->putInt(outputVars[i],getSqlBinaryInt((unsigned char*)v,len));
+        } else
+        if (col->kind == SQL_COL_INT) {
+            len = sprintf(buf,"%lld",getSqlBinaryInt((unsigned char*)v,len));
+            col->putText(outputVars[i],buf,len);
+        } else
+        if (col->putInt != NULL) {
+            col->putInt(outputVars[i],getSqlNumericInt((unsigned char*)v));
+        } else {
+            int weight = (short)((v[2] << 8) | (unsigned char)v[3]);
+            int dscale = ((unsigned char)v[6] << 8) | (unsigned char)v[7];
+            int size = 4*((weight >= 0) ? weight+1 : 1) + dscale + 8;
+            char *t = (size <= (int)sizeof(buf)) ? buf : (char*)malloc(size);
+            len = getSqlNumericText((unsigned char*)v,t);
+            col->putText(outputVars[i],t,len);
+            if (t != buf) {
+                free(t);
+            }
+        }
+    }
+}
+
+
+void freeSqlPlans(struct sqlPlans *plans) {
+    for (int b = 0; b < SQL_PLAN_BUCKETS; b++) {
+        struct sqlPlan *plan = plans->buckets[b];
+        while (plan != NULL) {
+            struct sqlPlan *n = plan->next;
+            free(plan->sql);
+            free(plan->col);
+            free(plan);
+            plan = n;
+        }
+        plans->buckets[b] = NULL;
+    }
+}
+
+
+// Sets rows of a result to the elements of the host variable arrays, starting at offset
+int setSqlRowsetVars(cob_field **outputVars, struct sqlParams *params, PGresult *res,
+                     int first, int max, int offset, char *sql) {
+    int n = PQntuples(res) - first;
+    if (n > max) {
+        n = max;
+    }
+    struct sqlPlans *plans = (struct sqlPlans*)pthread_getspecific(sqlPlansKey);
+    struct sqlPlan *plan = getSqlPlan(plans,sql,res,outputVars);
+    cob_field vars[SQL_MAX_PARAMS];
+    cob_field *rowVars[SQL_MAX_PARAMS];
+    for (int i = 0; (i < plan->cols) && (i < SQL_MAX_PARAMS); i++) {
+        vars[i] = *outputVars[i];
+        rowVars[i] = &vars[i];
+    }
+    // Scalar host variables only get the first row
+    struct sqlPlanCol restCols[plan->cols+1];
+    struct sqlPlan rest = *plan;
+    rest.col = restCols;
+    for (int i = 0; i < plan->cols; i++) {
+        restCols[i] = plan->col[i];
+        if (!isSqlArray(params,outputVars[i])) {
+            restCols[i].kind = SQL_COL_TEXT;
+            restCols[i].putText = skipSqlVar;
+        }
+    }
+    for (int r = 0; r < n; r++) {
+        for (int i = 0; i < plan->cols; i++) {
+            if (isSqlArray(params,outputVars[i])) {
+                vars[i].data = outputVars[i]->data + (offset+r)*vars[i].size;
+            }
+        }
+        setSqlPlanRow((offset+r > 0) ? &rest : plan,rowVars,res,first+r);
+    }
+    return (n > 0) ? n : 0;
+}
+
+
+// Parses FETCH [NEXT] ROWSET [FROM] cursor [FOR n ROWS], returns 0 for other statements
+int parseSqlRowsetFetch(char *sql, char *name, int *rows) {
+    char word[64];
+    char *p = nextSqlWord(sql,word,63);
+    if ((p == NULL) || (strcasecmp(word,"FETCH") != 0) || ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return 0;
+    }
+    if ((strcasecmp(word,"NEXT") == 0) && ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return 0;
+    }
+    if ((strcasecmp(word,"ROWSET") != 0) || ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return 0;
+    }
+    if (((strcasecmp(word,"FROM") == 0) || (strcasecmp(word,"IN") == 0)) &&
+        ((p = nextSqlWord(p,word,63)) == NULL)) {
+        return 0;
+    }
+    sprintf(name,"%s",word);
+    *rows = 1;
+    if (((p = nextSqlWord(p,word,63)) != NULL) && (strcasecmp(word,"FOR") == 0) &&
+        (nextSqlWord(p,word,63) != NULL)) {
+        *rows = atoi(word);
+    }
+    return 1;
+}
+
+
+// Fills the host variable arrays of a rowset FETCH in one round trip, rows already
+// fetched ahead for the cursor are returned first
+void fetchSqlRowset(struct sqlCursors *cursors, PGconn *conn, char *name, int rows,
+                    cob_field **outputVars, struct sqlParams *params) {
+    if ((rows < 1) || (rows > 32767)) {
+        setSQLCA(-246,"22527");
+        return;
+    }
+    struct sqlCursor *cur = getSqlCursor(cursors,name,0);
+    int n = 0;
+    int failed = 0;
+    char key[80];
+    sprintf(key,"%s%s","FETCH ROWSET ",name);
+    if ((cur != NULL) && (cur->res != NULL)) {
+        n = setSqlRowsetVars(outputVars,params,cur->res,cur->row,rows,0,key);
+        cur->row += n;
+    }
+    if ((n < rows) && ((cur == NULL) || !cur->end)) {
+        char fetch[128];
+        sprintf(fetch,"%s%d%s%s","FETCH FORWARD ",rows-n," FROM ",name);
+        PGresult *res = execSQLFetch(conn,fetch,(cur != NULL) && (cur->binary == 1));
+        if ((res != NULL) && (cur != NULL) && (cur->binary < 0)) {
+            cur->binary = canFetchBinary(res);
+        }
+        if (res != NULL) {
+            int m = setSqlRowsetVars(outputVars,params,res,0,rows-n,n,key);
+            if ((cur != NULL) && (m < rows-n)) {
+                cur->end = 1;
+            }
+            n += m;
+            PQclear(res);
+        } else {
+            failed = 1;
+        }
+    }
+    setSQLERRD3(n);
+    if (failed) {
+        setSQLCA(-1,"00000");
+    } else
+    if (n < rows) {
+        // Partial rowset at the end of the cursor
+        setSQLCA(100,"02000");
+    }
+}
+
+
+short getSqldaShort(unsigned char *p) {
+    return (short)((p[0] << 8) | p[1]);
+}
+
+
+void putSqldaShort(unsigned char *p, int v) {
+    p[0] = (unsigned char)((v >> 8) & 0xFF);
+    p[1] = (unsigned char)(v & 0xFF);
+}
+
+
+// Number of SQLVAR entries (SQLN) that fit into the SQLDA passed by the program
+int getSqldaSize(cob_field *sqlda) {
+    if (sqlda->size < SQLDA_HEADER_SIZE) {
+        return -1;
+    }
+    int n = getSqldaShort(&sqlda->data[12]);
+    int max = ((int)sqlda->size - SQLDA_HEADER_SIZE) / SQLDA_VAR_SIZE;
+    return (n < 0) ? 0 : ((n > max) ? max : n);
+}
+
+
+// Number of SQLVAR entries in use (SQLD), -1 if they do not fit
+int getSqldaVars(cob_field *sqlda) {
+    int n = getSqldaSize(sqlda);
+    int d = (n >= 0) ? getSqldaShort(&sqlda->data[14]) : -1;
+    return ((d < 0) || (d > n) || (d > SQL_MAX_PARAMS)) ? -1 : d;
+}
+
+
+// SQLTYPE and SQLLEN of a param or column type, nullable as the DB does not tell
+void getSqlDescType(Oid type, int mod, int *sqlType, int *sqlLen) {
+    switch (type) {
+        case DB_OID_INT2:
+            *sqlType = SQL_TYPE_SMALLINT;
+            *sqlLen = 2;
+            break;
+        case DB_OID_INT4:
+            *sqlType = SQL_TYPE_INTEGER;
+            *sqlLen = 4;
+            break;
+        case DB_OID_INT8:
+            *sqlType = SQL_TYPE_BIGINT;
+            *sqlLen = 8;
+            break;
+        case DB_OID_NUMERIC:
+            // Precision and scale are kept in the type modifier, unconstrained ones are approximated
+            if (mod >= 4) {
+                *sqlType = SQL_TYPE_DECIMAL;
+                *sqlLen = ((((mod-4) >> 16) & 0xFF) << 8) | ((mod-4) & 0xFF);
+            } else {
+                *sqlType = SQL_TYPE_FLOAT;
+                *sqlLen = 8;
+            }
+            break;
+        case DB_OID_FLOAT4:
+            *sqlType = SQL_TYPE_FLOAT;
+            *sqlLen = 4;
+            break;
+        case DB_OID_FLOAT8:
+            *sqlType = SQL_TYPE_FLOAT;
+            *sqlLen = 8;
+            break;
+        case DB_OID_BPCHAR:
+            *sqlType = SQL_TYPE_CHAR;
+            *sqlLen = (mod >= 4) ? mod-4 : 1;
+            break;
+        case DB_OID_BOOL:
+            *sqlType = SQL_TYPE_CHAR;
+            *sqlLen = 1;
+            break;
+        case DB_OID_DATE:
+            *sqlType = SQL_TYPE_DATE;
+            *sqlLen = 10;
+            break;
+        case DB_OID_TIME:
+            *sqlType = SQL_TYPE_TIME;
+            *sqlLen = 8;
+            break;
+        case DB_OID_TIMESTAMP:
+        case DB_OID_TIMESTAMPTZ:
+            *sqlType = SQL_TYPE_TIMESTAMP;
+            *sqlLen = 26;
+            break;
+        case DB_OID_NAME:
+            *sqlType = SQL_TYPE_VARCHAR;
+            *sqlLen = 64;
+            break;
+        default:
+            *sqlType = SQL_TYPE_VARCHAR;
+            *sqlLen = ((type == DB_OID_VARCHAR) && (mod >= 4) && (mod-4 <= 32704)) ? mod-4 : 32704;
+    }
+    *sqlType += 1;
+}
+
+
+// Writes the description of a prepared statement to a SQLDA, SQLDATA and SQLIND
+// are set by the program afterwards
+void describeSqlda(cob_field *sqlda, PGresult *desc, int input) {
+    int sqln = getSqldaSize(sqlda);
+    if (sqln < 0) {
+        setSQLCA(-804,"07002");
+        return;
+    }
+    int n = input ? PQnparams(desc) : PQnfields(desc);
+    unsigned char *d = sqlda->data;
+    memcpy(d,"SQLDA   ",8);
+    cob_put_u64_compx(SQLDA_HEADER_SIZE+sqln*SQLDA_VAR_SIZE,&d[8],4);
+    putSqldaShort(&d[14],n);
+    if (n > sqln) {
+        // Only SQLD is set, the program retries with a larger SQLDA
+        setSQLCA(236,"01005");
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        unsigned char *var = &d[SQLDA_HEADER_SIZE+i*SQLDA_VAR_SIZE];
+        unsigned char *name = &var[4+2*sizeof(void*)];
+        int type = 0, len = 0;
+        getSqlDescType(input ? PQparamtype(desc,i) : PQftype(desc,i),input ? -1 : PQfmod(desc,i),&type,&len);
+        putSqldaShort(var,type);
+        putSqldaShort(&var[2],len);
+        char *fname = input ? "" : PQfname(desc,i);
+        int l = strlen(fname);
+        if (l > 30) {
+            l = 30;
+        }
+        putSqldaShort(name,l);
+        memset(&name[2],' ',30);
+        for (int j = 0; j < l; j++) {
+            name[2+j] = toupper((unsigned char)fname[j]);
+        }
+    }
+}
+
+
+// Host variable an SQLVAR entry points to, described by its SQLTYPE and SQLLEN.
+// Returns 0 if the type is not supported or SQLDATA is not set.
+int getSqldaVar(unsigned char *var, cob_field *f, cob_field_attr *attr) {
+    int type = getSqldaShort(var) & ~1;
+    int len = getSqldaShort(&var[2]) & 0xFFFF;
+    memset(attr,0,sizeof(cob_field_attr));
+    memcpy(&f->data,&var[4],sizeof(void*));
+    f->attr = attr;
+    f->size = len;
+    switch (type) {
+        case SQL_TYPE_CHAR:
+        case SQL_TYPE_DATE:
+        case SQL_TYPE_TIME:
+        case SQL_TYPE_TIMESTAMP:
+            attr->type = COB_TYPE_ALPHANUMERIC;
+            break;
+        case SQL_TYPE_VARCHAR:
+        case SQL_TYPE_LONG_VARCHAR:
+            attr->type = COB_TYPE_GROUP;
+            f->size = len+2;
+            break;
+        case SQL_TYPE_SMALLINT:
+        case SQL_TYPE_INTEGER:
+        case SQL_TYPE_BIGINT:
+            attr->type = COB_TYPE_NUMERIC_BINARY;
+            attr->flags = COB_FLAG_HAVE_SIGN | COB_FLAG_BINARY_SWAP;
+            f->size = (type == SQL_TYPE_SMALLINT) ? 2 : ((type == SQL_TYPE_INTEGER) ? 4 : 8);
+            attr->digits = (f->size == 2) ? 4 : ((f->size == 4) ? 9 : 18);
+            break;
+        case SQL_TYPE_DECIMAL:
+            attr->type = COB_TYPE_NUMERIC_PACKED;
+            attr->flags = COB_FLAG_HAVE_SIGN;
+            attr->digits = len >> 8;
+            attr->scale = len & 0xFF;
+            f->size = attr->digits/2 + 1;
+            break;
+        case SQL_TYPE_FLOAT:
+            attr->type = (len == 4) ? COB_TYPE_NUMERIC_FLOAT : COB_TYPE_NUMERIC_DOUBLE;
+            f->size = (len == 4) ? 4 : 8;
+            break;
+        default:
+            return 0;
+    }
+    return f->data != NULL;
+}
+
+
+// Indicator variable of a nullable SQLVAR entry, NULL if there is none
+unsigned char *getSqldaInd(unsigned char *var) {
+    unsigned char *ind = NULL;
+    if (getSqldaShort(var) & 1) {
+        memcpy(&ind,&var[4+sizeof(void*)],sizeof(void*));
+    }
+    return ind;
+}
+
+
+// Param values of the SQLVAR entries of a SQLDA, NULL if the indicator is negative.
+// Returns their number or -1 if an entry is not valid, buf is allocated for the values.
+int getSqldaValues(cob_field *sqlda, char **values, char **buf) {
+    int n = getSqldaVars(sqlda);
+    if (n < 0) {
+        return -1;
+    }
+    cob_field vars[n+1];
+    cob_field_attr attrs[n+1];
+    int size = 0;
+    for (int i = 0; i < n; i++) {
+        if (!getSqldaVar(&sqlda->data[SQLDA_HEADER_SIZE+i*SQLDA_VAR_SIZE],&vars[i],&attrs[i])) {
+            return -1;
+        }
+        size += 2*(int)vars[i].size + 64;
+    }
+    *buf = (char*)malloc(size+1);
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned char *ind = getSqldaInd(&sqlda->data[SQLDA_HEADER_SIZE+i*SQLDA_VAR_SIZE]);
+        if ((ind != NULL) && (getSqldaShort(ind) < 0)) {
+            values[i] = NULL;
+        } else {
+            int text = 1;
+            values[i] = &(*buf)[len];
+            len += convertSqlParam(&vars[i],values[i],&text) + 1;
+        }
+    }
+    return n;
+}
+
+
+// Writes a row to the host variables of the SQLVAR entries and sets their indicators
+void setSqldaRow(cob_field *sqlda, PGresult *res, int row) {
+    int n = getSqldaVars(sqlda);
+    if (n < 0) {
+        setSQLCA(-804,"07002");
+        return;
+    }
+    if (n > PQnfields(res)) {
+        n = PQnfields(res);
+    }
+    cob_field vars[n+1];
+    cob_field_attr attrs[n+1];
+    cob_field *rowVars[n+1];
+    struct sqlPlanCol cols[n+1];
+    // Conversion plan for this row only, the SQLDA may point elsewhere at the next FETCH
+    struct sqlPlan plan;
+    plan.cols = n;
+    plan.binary = (PQnfields(res) > 0) && (PQfformat(res,0) == 1);
+    plan.col = cols;
+    for (int i = 0; i < n; i++) {
+        if (!getSqldaVar(&sqlda->data[SQLDA_HEADER_SIZE+i*SQLDA_VAR_SIZE],&vars[i],&attrs[i])) {
+            setSQLCA(-804,"07002");
+            return;
+        }
+        rowVars[i] = &vars[i];
+        setSqlPlanCol(&cols[i],PQftype(res,i),&vars[i],plan.binary);
+    }
+    setSqlPlanRow(&plan,rowVars,res,row);
+    for (int i = 0; i < n; i++) {
+        unsigned char *ind = getSqldaInd(&sqlda->data[SQLDA_HEADER_SIZE+i*SQLDA_VAR_SIZE]);
+        if (ind != NULL) {
+            putSqldaShort(ind,PQgetisnull(res,row,i) ? -1 : 0);
+        }
+    }
+}
+
+
+// Index of a host variable passed as $n, -1 if word is no param
+int getSqlParamRef(char *word, struct sqlParams *params) {
+    if ((word[0] != '$') || (params == NULL)) {
+        return -1;
+    }
+    int k = atoi(&word[1]) - 1;
+    return ((k >= 0) && (k < params->num)) ? k : -1;
+}
+
+
+// Values of the USING clause of EXECUTE or OPEN, host variables or a descriptor.
+// Returns their number or -1 if the clause is not valid.
+int getDynamicSqlValues(char *p, struct sqlParams *params, char **values, char **buf) {
+    char word[64];
+    int n = 0;
+    *buf = NULL;
+    char *d = nextSqlWord(p,word,63);
+    if ((d != NULL) && (strcasecmp(word,"DESCRIPTOR") == 0)) {
+        int k = (nextSqlWord(d,word,63) != NULL) ? getSqlParamRef(word,params) : -1;
+        return (k >= 0) ? getSqldaValues(&params->vars[k],values,buf) : -1;
+    }
+    for (char *c = p; *c != 0x00; c++) {
+        if (*c == '$') {
+            int k = getSqlParamRef(c,params);
+            if ((k < 0) || (n >= SQL_MAX_PARAMS)) {
+                return -1;
+            }
+            values[n++] = params->values[k];
+        }
+    }
+    return n;
+}
+
+
+struct sqlDynStmt *getSqlDynStmt(struct sqlCursors *cursors, char *name, int create) {
+    for (int i = 0; i < cursors->numStmts; i++) {
+        if (strcasecmp(cursors->stmts[i].name,name) == 0) {
+            return &cursors->stmts[i];
+        }
+    }
+    if (!create || (cursors->numStmts >= SQL_MAX_DYN_STMTS)) {
+        return NULL;
+    }
+    struct sqlDynStmt *stmt = &cursors->stmts[cursors->numStmts++];
+    snprintf(stmt->name,sizeof(stmt->name),"%s",name);
+    stmt->sql = NULL;
+    stmt->numParams = 0;
+    return stmt;
+}
+
+
+// Statement text of PREPARE or EXECUTE IMMEDIATE, parameter markers ? become $n
+char *getDynamicSqlText(char *text, int *numParams) {
+    int l = strlen(text);
+    while ((l > 0) && ((text[l-1] == ' ') || (text[l-1] == ';'))) l--;
+    int markers = 0;
+    for (int i = 0; i < l; i++) {
+        if (text[i] == '?') markers++;
+    }
+    char *sql = (char*)malloc(l+6*markers+1);
+    char quote = 0;
+    int n = 0, j = 0;
+    for (int i = 0; i < l; i++) {
+        char c = text[i];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else
+        if ((c == '\'') || (c == '"')) {
+            quote = c;
+        } else
+        if (c == '?') {
+            j += sprintf(&sql[j],"%s%d","$",++n);
+            continue;
+        }
+        sql[j++] = c;
+    }
+    sql[j] = 0x00;
+    *numParams = n;
+    return sql;
+}
+
+
+// Declaration of a cursor for a dynamic statement with the statement text, NULL
+// for other cursors. The caller frees the result.
+char *getDynamicSqlCursorDecl(struct sqlCursors *cursors, struct sqlCursor *cur, struct sqlDynStmt **stmt) {
+    char word[64];
+    char prev[64];
+    char next[64];
+    char *p = cur->decl;
+    char *last = NULL;
+    prev[0] = 0x00;
+    word[0] = 0x00;
+    while (1) {
+        char *start = p;
+        while (*start == ' ') start++;
+        if ((p = nextSqlWord(p,next,63)) == NULL) {
+            break;
+        }
+        sprintf(prev,"%s",word);
+        sprintf(word,"%s",next);
+        last = start;
+    }
+    if ((last == NULL) || (strcasecmp(prev,"FOR") != 0) ||
+        ((*stmt = getSqlDynStmt(cursors,word,0)) == NULL)) {
+        return NULL;
+    }
+    if ((*stmt)->sql == NULL) {
+        return strdup("");
+    }
+    int l = last - cur->decl;
+    char *decl = (char*)malloc(l+strlen((*stmt)->sql)+1);
+    memcpy(decl,cur->decl,l);
+    strcpy(&decl[l],(*stmt)->sql);
+    return decl;
+}
+
+
+// Handles PREPARE, DESCRIBE, EXECUTE [IMMEDIATE] and OPEN and FETCH of cursors for
+// prepared statements, which may pass their values by a SQLDA. The statements are
+// prepared in the statement cache of the connection, so repeated texts are parsed
+// by the DB only once. Returns 0 if sql is no dynamic statement.
+int execDynamicSql(struct sqlCursors *cursors, PGconn *conn, char *sql, struct sqlParams *params, int *dtBypass) {
+    char word[64];
+    char name[64];
+    char *values[SQL_MAX_PARAMS];
+    char *buf = NULL;
+    char *p = nextSqlWord(sql,word,63);
+    int l = strlen(sql);
+    if ((p != NULL) && (strcasecmp(word,"DECLARE") == 0) && (l > 10) && (strcasecmp(&sql[l-10]," STATEMENT") == 0)) {
+        // DECLARE STATEMENT only documents the names of prepared statements
+        return 1;
+    }
+    if ((p == NULL) || !isDynamicSqlStmt(sql) || ((p = nextSqlWord(p,name,63)) == NULL)) {
+        return 0;
+    }
+    if (strcasecmp(word,"PREPARE") == 0) {
+        int into = -1, from = -1;
+        while ((p = nextSqlWord(p,word,63)) != NULL) {
+            if ((strcasecmp(word,"INTO") == 0) && ((p = nextSqlWord(p,word,63)) != NULL)) {
+                into = getSqlParamRef(word,params);
+            } else
+            if ((strcasecmp(word,"FROM") == 0) && ((p = nextSqlWord(p,word,63)) != NULL)) {
+                from = getSqlParamRef(word,params);
+            }
+            if (p == NULL) {
+                break;
+            }
+        }
+        struct sqlDynStmt *stmt = getSqlDynStmt(cursors,name,1);
+        if (from < 0) {
+            setSQLCA(-104,"42601");
+            return 1;
+        }
+        if (stmt == NULL) {
+            setSQLCA(-904,"57011");
+            return 1;
+        }
+        free(stmt->sql);
+        stmt->sql = getDynamicSqlText(params->values[from],&stmt->numParams);
+        int r = 1;
+        if (into >= 0) {
+            PGresult *desc = describeSQL(conn,stmt->sql);
+            if ((r = (desc != NULL))) {
+                describeSqlda(&params->vars[into],desc,0);
+                PQclear(desc);
+            }
+        } else {
+            r = prepareSQL(conn,stmt->sql);
+        }
+        if (!r) {
+            // Statement stays unprepared until the next PREPARE
+            free(stmt->sql);
+            stmt->sql = NULL;
+            setSQLCA(-1,"00000");
+        }
+        return 1;
+    }
+    if (strcasecmp(word,"DESCRIBE") == 0) {
+        int input = (strcasecmp(name,"INPUT") == 0);
+        if ((input || (strcasecmp(name,"OUTPUT") == 0)) && ((p = nextSqlWord(p,name,63)) == NULL)) {
+            return 0;
+        }
+        int into = -1;
+        if (((p = nextSqlWord(p,word,63)) != NULL) && (strcasecmp(word,"INTO") == 0) &&
+            (nextSqlWord(p,word,63) != NULL)) {
+            into = getSqlParamRef(word,params);
+        }
+        struct sqlDynStmt *stmt = getSqlDynStmt(cursors,name,0);
+        if (into < 0) {
+            setSQLCA(-104,"42601");
+        } else
+        if ((stmt == NULL) || (stmt->sql == NULL)) {
+            setSQLCA(-518,"07003");
+        } else {
+            PGresult *desc = describeSQL(conn,stmt->sql);
+            if (desc != NULL) {
+                describeSqlda(&params->vars[into],desc,input);
+                PQclear(desc);
+            } else {
+                setSQLCA(-1,"00000");
+            }
+        }
+        return 1;
+    }
+    if ((strcasecmp(word,"EXECUTE") == 0) && (strcasecmp(name,"IMMEDIATE") == 0)) {
+        int k = (nextSqlWord(p,word,63) != NULL) ? getSqlParamRef(word,params) : -1;
+        if (k < 0) {
+            setSQLCA(-104,"42601");
+            return 1;
+        }
+        int n = 0;
+        char *text = getDynamicSqlText(params->values[k],&n);
+        if ((dtBypass != NULL) && (isDataTableUpdate(text) || isQueryCacheUpdate(text))) {
+            (*dtBypass) = 1;
+        }
+        // Executed once, so it is not prepared
+        if (execSQL(conn,text) == 0) {
+            setSQLCA(-1,"00000");
+        }
+        free(text);
+        return 1;
+    }
+    if (strcasecmp(word,"EXECUTE") == 0) {
+        struct sqlDynStmt *stmt = getSqlDynStmt(cursors,name,0);
+        if ((stmt == NULL) || (stmt->sql == NULL)) {
+            setSQLCA(-518,"07003");
+            return 1;
+        }
+        int n = 0;
+        if (((p = nextSqlWord(p,word,63)) != NULL) && (strcasecmp(word,"USING") == 0)) {
+            n = getDynamicSqlValues(p,params,values,&buf);
+        }
+        if (n < 0) {
+            setSQLCA(-804,"07002");
+        } else
+        if (n != stmt->numParams) {
+            setSQLCA(-313,"07001");
+        } else {
+            if ((dtBypass != NULL) && (isDataTableUpdate(stmt->sql) || isQueryCacheUpdate(stmt->sql))) {
+                (*dtBypass) = 1;
+            }
+            if (execSQLParams(conn,stmt->sql,n,values) == 0) {
+                setSQLCA(-1,"00000");
+            }
+        }
+        free(buf);
+        return 1;
+    }
+    if (strcasecmp(word,"OPEN") == 0) {
+        struct sqlCursor *cur = getSqlCursor(cursors,name,0);
+        struct sqlDynStmt *stmt = NULL;
+        char *decl = ((cur != NULL) && (cur->decl != NULL)) ? getDynamicSqlCursorDecl(cursors,cur,&stmt) : NULL;
+        if (decl == NULL) {
+            // Cursor of a static statement
+            return 0;
+        }
+        int n = 0;
+        if (((p = nextSqlWord(p,word,63)) != NULL) && (strcasecmp(word,"USING") == 0)) {
+            n = getDynamicSqlValues(p,params,values,&buf);
+        }
+        if (cur->open) {
+            setSQLCA(-502,"24502");
+        } else
+        if (decl[0] == 0x00) {
+            setSQLCA(-518,"07003");
+        } else
+        if (n < 0) {
+            setSQLCA(-804,"07002");
+        } else
+        if (n != stmt->numParams) {
+            setSQLCA(-313,"07001");
+        } else {
+            // Mode and result format depend on the statement prepared last
+            setSqlCursorMode(cur,decl);
+            int r = execSQLParams(conn,decl,n,values);
+            resetSqlCursor(cur);
+            cur->binary = -1;
+            cur->open = r;
+            if (r == 0) {
+                setSQLCA(-1,"00000");
+            }
+        }
+        free(buf);
+        free(decl);
+        return 1;
+    }
+    // FETCH [NEXT] [FROM] cursor USING DESCRIPTOR or INTO DESCRIPTOR, INTO is not passed
+    int sqlda = -1;
+    p = sql;
+    nextSqlWord(p,word,63);
+    p = nextSqlWord(p,word,63);
+    while (p != NULL) {
+        if (strcasecmp(word,"DESCRIPTOR") == 0) {
+            if (nextSqlWord(p,word,63) != NULL) {
+                sqlda = getSqlParamRef(word,params);
+            }
+            break;
+        }
+        if ((strcasecmp(word,"NEXT") != 0) && (strcasecmp(word,"FROM") != 0) && (strcasecmp(word,"IN") != 0) &&
+            (strcasecmp(word,"USING") != 0)) {
+            sprintf(name,"%s",word);
+        }
+        p = nextSqlWord(p,word,63);
+    }
+    if (sqlda < 0) {
+        return 0;
+    }
+    struct sqlCursor *cur = getSqlCursor(cursors,name,0);
+    if ((cur != NULL) && (cur->decl != NULL) && !cur->open) {
+        setSQLCA(-501,"24501");
+        return 1;
+    }
+    char fetch[128];
+    int row = 0;
+    sprintf(fetch,"%s%s","FETCH ",name);
+    PGresult *res = fetchSqlCursor(cursors,conn,fetch,&row);
+    PGresult *single = NULL;
+    if (res == NULL) {
+        sprintf(fetch,"%s%s","FETCH NEXT FROM ",name);
+        res = single = execSQLFetch(conn,fetch,0);
+        row = ((res != NULL) && (PQntuples(res) > 0)) ? 0 : -1;
+    }
+    if (res == NULL) {
+        setSQLCA(-1,"00000");
+    } else
+    if (row < 0) {
+        setSQLCA(100,"02000");
+    } else {
+        setSqldaRow(&params->vars[sqlda],res,row);
+    }
+    if (single != NULL) {
+        PQclear(single);
+    }
+    return 1;
+}
+
+
+// Appends a part of a multi-row INSERT, its params refer to the values of a row
+void appendSqlRowsetText(struct sqlRowset *rs, char *src, int len, int row) {
+    struct sqlParams *params = rs->params;
+    int quoted = 0;
+    int i = 0;
+    memset(rs->map,0,sizeof(rs->map));
+    while (i < len) {
+        if (src[i] == '\'') {
+            quoted = !quoted;
+        }
+        if (quoted || (src[i] != '$') || !isdigit((unsigned char)src[i+1])) {
+            rs->sql[rs->len++] = src[i++];
+            continue;
+        }
+        int j = atoi(&src[i+1]);
+        i++;
+        while ((i < len) && isdigit((unsigned char)src[i])) i++;
+        if ((j < 1) || (j > params->num)) {
+            rs->len += sprintf(&rs->sql[rs->len],"%s%d","$",j);
+            continue;
+        }
+        if (rs->map[j-1] == 0) {
+            char *v = &rs->buf[rs->bufLen];
+            int a = params->array[j-1];
+            if (a > 0) {
+                cob_field var = params->arrays[a-1];
+                int text = 1;
+                var.data += row*var.size;
+                rs->bufLen += convertSqlParam(&var,v,&text) + 1;
+            } else {
+                rs->bufLen += sprintf(v,"%s",params->values[j-1]) + 1;
+            }
+            rs->values[rs->num++] = v;
+            rs->map[j-1] = rs->num;
+        }
+        rs->len += sprintf(&rs->sql[rs->len],"%s%d","$",rs->map[j-1]);
+    }
+    rs->sql[rs->len] = 0x00;
+}
+
 
-    for (i = 0; i < strlen(dbDateFormat); i++) {
-        if ((dbDateFormat[i] == '-') || (dbDateFormat[i] == ' ') || 
-            (dbDateFormat[i] == ':') || (dbDateFormat[i] == '.')) {
-            result[i] = dbDateFormat[i];
-            continue;
+// Inserts rows first to first+rows-1 with one statement having a VALUES list
+int execSqlRowsetInsert(PGconn *conn, char *sql, int groupStart, int groupEnd, int sqlEnd,
+                        struct sqlParams *params, int first, int rows) {
+    struct sqlRowset rs;
+    int rowBytes = 1;
+    for (int j = 0; j < params->num; j++) {
+        if (params->array[j] > 0) {
+            rowBytes += 2*params->arrays[params->array[j]-1].size + 64;
         } else {
-            if (lastc != dbDateFormat[i]) {
-                int j = 0;
-                while (j < l) {
-                    if (dbDateFormat[i] == cobDateFormat[j]) {
-                        break;
-                    }
-                    j++;
-                }                
-                if (j < l) {
-                    pos = j;
-                } else {
-                    return result;                    
-                }
-                lastc = dbDateFormat[i];
+            rowBytes += strlen(params->values[j]) + 1;
+        }
+    }
+    int groupLen = groupEnd - groupStart;
+    rs.params = params;
+    rs.sql = (char*)malloc(2*sqlEnd + rows*(3*groupLen+16) + 16);
+    rs.values = (char**)malloc((rows+2)*(params->num+1)*sizeof(char*));
+    rs.buf = (char*)malloc((rows+2)*rowBytes);
+    int ret = 0;
+    if ((rs.sql != NULL) && (rs.values != NULL) && (rs.buf != NULL)) {
+        rs.len = 0;
+        rs.num = 0;
+        rs.bufLen = 0;
+        appendSqlRowsetText(&rs,sql,groupStart,first);
+        for (int r = 0; r < rows; r++) {
+            if (r > 0) {
+                rs.sql[rs.len++] = ',';
+                rs.sql[rs.len++] = ' ';
             }
-
-            result[i] = str[pos];
-            pos++;
+            appendSqlRowsetText(&rs,&sql[groupStart],groupLen,first+r);
         }
+        appendSqlRowsetText(&rs,&sql[groupEnd],sqlEnd-groupEnd,first);
+        ret = execSQLParams(conn,rs.sql,rs.num,rs.values);
     }
-
-    return result;
+    free(rs.sql);
+    free(rs.values);
+    free(rs.buf);
+    return ret;
 }
 
 
-// Synchronizing COBOL module execution
-void startModule(char *progname) {
-  int found = 0;
-  cm(pthread_mutex_lock(&moduleMutex));
-  do {
-    found = 0;
-    for (int i = 0; i < runningModuleCnt; i++) {
-      if (strcmp(runningModules[i],progname) == 0) {
-        found = 1;
-        break;
-      }
+// Multi-row INSERT ... FOR n ROWS [ATOMIC | NOT ATOMIC CONTINUE ON SQLEXCEPTION] from
+// host variable arrays, returns -1 for other statements
+int insertSqlRowset(PGconn *conn, char *sql, struct sqlParams *params) {
+    char word[64];
+    char *p = nextSqlWord(sql,word,63);
+    if ((p == NULL) || (strcasecmp(word,"INSERT") != 0)) {
+        return -1;
     }
-    if (found == 1) {
-        pthread_cond_wait(&waitForModuleChange,&moduleMutex);
+    char *u = strdup(sql);
+    for (int i = 0; u[i] != 0x00; i++) {
+        u[i] = toupper((unsigned char)u[i]);
+    }
+    char *f = NULL;
+    char *q = u;
+    while ((q = strstr(q," FOR ")) != NULL) {
+        f = q;
+        q++;
+    }
+    char *v = strstr(u," VALUES");
+    if ((f == NULL) || (v == NULL) || (v > f)) {
+        free(u);
+        return -1;
+    }
+    char count[64];
+    int atomic = 1;
+    p = nextSqlWord(&sql[f-u+5],count,63);
+    if ((p == NULL) || (nextSqlWord(p,word,63) == NULL) || (strcasecmp(word,"ROWS") != 0)) {
+        free(u);
+        return -1;
+    }
+    p = nextSqlWord(p,word,63);
+    if ((nextSqlWord(p,word,63) != NULL) && (strcasecmp(word,"NOT") == 0)) {
+        atomic = 0;
     }
-  } while (found == 1);
-
-  if (runningModuleCnt < 500) {
-      sprintf(runningModules[runningModuleCnt],"%s",progname);
-      runningModuleCnt++;
-  }
-  cm(pthread_mutex_unlock(&moduleMutex));
-}
-
 
-void endModule(char *progname) {
-  int found = 0;
-  cm(pthread_mutex_lock(&moduleMutex));
-  for (int i = 0; i < runningModuleCnt; i++) {
-    if (found == 1) {
-      sprintf(runningModules[i-1],"%s",runningModules[i]);
+    // Row values to repeat
+    int groupStart = -1;
+    int groupEnd = -1;
+    int depth = 0;
+    int quoted = 0;
+    for (int i = v-u+7; i < f-u; i++) {
+        if (u[i] == '\'') {
+            quoted = !quoted;
+        }
+        if (quoted) {
+            continue;
+        }
+        if (u[i] == '(') {
+            if (depth == 0) {
+                groupStart = i;
+            }
+            depth++;
+        }
+        if ((u[i] == ')') && (depth > 0)) {
+            depth--;
+            if (depth == 0) {
+                groupEnd = i+1;
+                break;
+            }
+        }
     }
-    if ((found == 0) && (strcmp(runningModules[i],progname) == 0)) {
-      found = 1;
+    int sqlEnd = f-u;
+    free(u);
+    if (groupEnd < 0) {
+        return -1;
     }
-  }
-  if (runningModuleCnt > 0) {
-    runningModuleCnt--;
-  }
-  cm(pthread_mutex_unlock(&moduleMutex));
-  pthread_cond_broadcast(&waitForModuleChange);
-}
 
+    int rows = atoi(count);
+    if (count[0] == '$') {
+        int j = atoi(&count[1]);
+        rows = ((j > 0) && (j <= params->num)) ? atoi(params->values[j-1]) : 0;
+    }
+    if ((rows < 1) || (rows > 32767)) {
+        setSQLCA(-246,"22527");
+        return 0;
+    }
 
-void writeJson(char *map, char *mapset, int childfd) {
-    int n = 0, l = strlen(map), found = 0, brackets = 0;
-    write(childfd,"JSON=",5);
-    char jsonFile[255];
-    sprintf(jsonFile,"%s%s%s%s",GETENV_STRING(jsDir,"QWICS_JSDIR","../copybooks"),"/",mapset,".js");
-    FILE *js = fopen(jsonFile,"rb");
-    if (js != NULL) {
-        while (1) {
-            char c = fgetc(js);
-            if (feof(js)) {
+    int chunk = (SQL_ROWSET_MAX_PARAMS - params->num) / ((params->num > 0) ? params->num : 1);
+    int chunked = (rows > chunk);
+    int done = 0;
+    int failed = 0;
+    if (atomic) {
+        if (chunked) {
+            execSQL(conn,"SAVEPOINT qwics_rowset");
+        }
+        for (int first = 0; first < rows; first += chunk) {
+            int n = (rows-first < chunk) ? rows-first : chunk;
+            if (!execSqlRowsetInsert(conn,sql,groupStart,groupEnd,sqlEnd,params,first,n)) {
+                failed = 1;
                 break;
             }
-            if (found == 0) {
-                if (map[n] == c) {
-                    n++;
-                } else {
-                    n = 0;
-                }
-                if (n == l) {
-                    found = 1;
-                }
+            done += n;
+        }
+        if (failed) {
+            if (chunked) {
+                execSQL(conn,"ROLLBACK TO SAVEPOINT qwics_rowset");
             }
-            if (found == 1) {
-                if (c == '{') {
-                    found = 2;
+            done = 0;
+            setSQLCA(-1,"00000");
+        }
+        if (chunked) {
+            execSQL(conn,"RELEASE SAVEPOINT qwics_rowset");
+        }
+    } else {
+        for (int first = 0; first < rows; first += chunk) {
+            int n = (rows-first < chunk) ? rows-first : chunk;
+            execSQL(conn,"SAVEPOINT qwics_rowset");
+            if (execSqlRowsetInsert(conn,sql,groupStart,groupEnd,sqlEnd,params,first,n)) {
+                done += n;
+            } else {
+                // Retry row by row to skip only the failing ones
+                execSQL(conn,"ROLLBACK TO SAVEPOINT qwics_rowset");
+                for (int r = first; r < first+n; r++) {
+                    execSQL(conn,"SAVEPOINT qwics_row");
+                    if (execSqlRowsetInsert(conn,sql,groupStart,groupEnd,sqlEnd,params,r,1)) {
+                        done++;
+                    } else {
+                        execSQL(conn,"ROLLBACK TO SAVEPOINT qwics_row");
+                        failed++;
+                    }
+                    execSQL(conn,"RELEASE SAVEPOINT qwics_row");
                 }
             }
-            if (found == 2) {
-                write(childfd,&c,1);
-                if (c == '{') {
-                    brackets++;
-                }
-                if (c == '}') {
-                    brackets--;
-                }
-                if (brackets <= 0) {
-                    break;
-                }
+            execSQL(conn,"RELEASE SAVEPOINT qwics_rowset");
+        }
+        if (failed) {
+            if (done > 0) {
+                setSQLCA(-253,"22529");
+            } else {
+                setSQLCA(-254,"22530");
             }
         }
-        fclose(js);
     }
-    write(childfd,"\n",1);
+    setSQLERRD3(done);
+    return 0;
 }
 
 
-void setSQLCA(int code, char *state) {
-    if (sqlcode != NULL) {
-        cob_field sqlstate = { 5, sqlcode->data+119, NULL };
-        cob_set_int(sqlcode,code);
-        cob_put_picx(sqlstate.data,sqlstate.size,state);
+// Drops a clause PostgreSQL does not know from a statement
+void removeSqlPhrase(char *sql, char *phrase) {
+    char *u = strdup(sql);
+    for (int i = 0; u[i] != 0x00; i++) {
+        u[i] = toupper((unsigned char)u[i]);
+    }
+    char *p = strstr(u,phrase);
+    if (p != NULL) {
+        int pos = p-u;
+        int l = strlen(phrase);
+        memmove(&sql[pos],&sql[pos+l],strlen(sql)-pos-l+1);
+    }
+    free(u);
+}
+
+
+// Name is listed, separated by blanks or commas
+int isListedTask(char *list, char *name) {
+    int l = 0;
+    while ((l < 8) && (name[l] != 0x00) && (name[l] != ' ')) l++;
+    if (l == 0) {
+        return 0;
+    }
+    char *p = list;
+    while (*p != 0x00) {
+        while ((*p == ' ') || (*p == ',')) p++;
+        int n = 0;
+        while ((p[n] != 0x00) && (p[n] != ' ') && (p[n] != ',')) n++;
+        if ((n == l) && (strncmp(p,name,l) == 0)) {
+            return 1;
+        }
+        p += n;
+    }
+    return 0;
+}
+
+
+// Applies the configured transaction mode of a program or TRNID, returns 0 if none is set
+int setSqlTxMode(struct sqlTxMode *mode, char *name) {
+    int set = 0;
+    if (isListedTask(GETENV_STRING(readOnlyTasks,"QWICS_DB_READONLY",""),name)) {
+        mode->readOnly = 1;
+        set = 1;
+    }
+    if (isListedTask(GETENV_STRING(readCommittedTasks,"QWICS_DB_READ_COMMITTED",""),name)) {
+        mode->isolation = DB_ISOLATION_READ_COMMITTED;
+        set = 1;
+    } else
+    if (isListedTask(GETENV_STRING(repeatableReadTasks,"QWICS_DB_REPEATABLE_READ",""),name)) {
+        mode->isolation = DB_ISOLATION_REPEATABLE_READ;
+        set = 1;
+    }
+    if (isListedTask(GETENV_STRING(pipelineTasks,"QWICS_DB_PIPELINE_TASKS",""),name)) {
+        // Connection stays the same, so not counted as set
+        mode->pipeline = 1;
+    }
+    return set;
+}
+
+
+// Applies a transaction mode to a started transaction, possible until its first statement
+void switchSqlTxMode(struct sqlTxMode *mode) {
+    PGconn *conn = (PGconn*)pthread_getspecific(connKey);
+    if (conn != NULL) {
+        pthread_setspecific(connKey, (void*)switchDBConnection(conn,mode->readOnly,mode->isolation));
+    }
+}
+
+
+// DB connection of the task, the transaction begins on first use
+PGconn *getTaskConnection() {
+    PGconn *conn = (PGconn*)pthread_getspecific(connKey);
+    struct sqlTxMode *mode = (struct sqlTxMode*)pthread_getspecific(sqlTxModeKey);
+    if ((conn == NULL) && (mode != NULL) && mode->lazy) {
+        conn = getDBConnectionMode(mode->readOnly,mode->isolation);
+        pthread_setspecific(connKey, (void*)conn);
     }
+    return conn;
 }
 
 
@@ -396,66 +3048,129 @@ int processCmd(char *cmd, cob_field **outputVars) {
     char *pos;
     if ((pos=strstr(cmd,"EXEC SQL")) != NULL) {
         char *sql = (char*)pos+9;
-        PGconn *conn = (PGconn*)pthread_getspecific(connKey);
+        PGconn *conn = getTaskConnection();
+        int *dtBypass = (int*)pthread_getspecific(dtBypassKey);
+        struct sqlParams *params = (struct sqlParams*)pthread_getspecific(sqlParamsKey);
+        struct sqlCursors *cursors = (struct sqlCursors*)pthread_getspecific(sqlCursorsKey);
+        struct sqlPlans *plans = (struct sqlPlans*)pthread_getspecific(sqlPlansKey);
+        struct sqlTxMode *txMode = (struct sqlTxMode*)pthread_getspecific(sqlTxModeKey);
+        int prepared = (params != NULL) && isParamStmt(sql);
+        int deferred = prepared && (outputVars[0] == NULL) && (txMode != NULL) && txMode->pipeline &&
+                       isDeferrableStmt(sql);
+        char cursor[64];
+        char state[6];
+        int rowset = 0;
+        // Failures of statements queued before are reported by the next one waiting for the DB
+        int queuedOk = deferred ? 1 : syncDBPipeline(conn,state);
         setSQLCA(0,"00000");
         if (outputVars[0] == NULL) {
-            int r = execSQL(conn, sql);
-            if (r == 0) {
-                setSQLCA(-1,"00000");
+            if (strncasecmp(sql,"DECLARE ",8) == 0) {
+                removeSqlPhrase(sql," WITH ROWSET POSITIONING");
+                removeSqlPhrase(sql," WITHOUT ROWSET POSITIONING");
+            }
+            if ((dtBypass != NULL) && (isDataTableUpdate(sql) || isQueryCacheUpdate(sql))) {
+                // Task sees its own changes only in the database
+                (*dtBypass) = 1;
+            }
+            int r = ((cursors != NULL) && (execDynamicSql(cursors, conn, sql, params, dtBypass) ||
+                                          execSqlCursorStmt(cursors, conn, sql, params))) ? 1 : -1;
+            if ((r < 0) && prepared) {
+                r = insertSqlRowset(conn, sql, params);
+            }
+            if (r < 0) {
+                if (deferred) {
+                    r = execSQLDeferred(conn, sql, params->num, params->values);
+                } else {
+                    r = prepared ? execSQLParams(conn, sql, params->num, params->values) : execSQL(conn, sql);
+                }
+                if (r == 0) {
+                    setSQLCA(-1,"00000");
+                }
             }
+        } else
+        if ((cursors != NULL) && isClosedSqlCursor(cursors,sql)) {
+            setSQLCA(-501,"24501");
+        } else
+        if ((cursors != NULL) && parseSqlRowsetFetch(sql,cursor,&rowset)) {
+            fetchSqlRowset(cursors,conn,cursor,rowset,outputVars,params);
         } else {
-            // Query returns data
-            PGresult *res = execSQLQuery(conn, sql);
-            if (res != NULL) {
-                int i = 0;
-                int cols = PQnfields(res);
-                int rows = PQntuples(res);
-                if (rows > 0) {
-                    while (outputVars[i] != NULL) {
-                        if (i < cols) {
-                            if (outputVars[i]->attr->type == COB_TYPE_GROUP) {
-                                // Map VARCHAR to group struct
-                                char *v = (char*)PQgetvalue(res, 0, i);
-                                unsigned int l = (unsigned int)strlen(v);
-		                if (l > (outputVars[i]->size-2)) {
-                                   l = outputVars[i]->size-2;
-                                }
-	                        outputVars[i]->data[0] = (unsigned char)((l >> 8) & 0xFF);
-	                        outputVars[i]->data[1] = (unsigned char)(l & 0xFF);
-                                memcpy(&outputVars[i]->data[2],v,l);
-                            } else 
-                            if (outputVars[i]->attr->type == COB_TYPE_NUMERIC) {
-                                char buf[256];
-                                cob_put_picx(outputVars[i]->data,outputVars[i]->size,
-                                convertNumeric(PQgetvalue(res, 0, i),
-                                                 outputVars[i]->attr->digits,
-                                                 outputVars[i]->attr->scale,buf));
-                            } else
-                            if (outputVars[i]->attr->type == COB_TYPE_NUMERIC_PACKED) {
-                                long v = atol(PQgetvalue(res, 0, i));
-                                cob_put_s64_comp3(v,outputVars[i]->data,outputVars[i]->size);
-                            } else 
-                            if (getCobType(outputVars[i]) == COB_TYPE_NUMERIC_BINARY) {
-                                long v = atol(PQgetvalue(res, 0, i));
-                                cob_put_u64_compx(v,outputVars[i]->data,outputVars[i]->size);  
-                            } else
-                            if (getCobType(outputVars[i]) == COB_TYPE_NUMERIC_COMP5) {
-                                long v = atol(PQgetvalue(res, 0, i));
-                                cob_put_s64_comp5(v,outputVars[i]->data,outputVars[i]->size);  
+            char *values[100];
+            char buf[16384];
+            int cols = 0;
+            int r = DT_NOT_CACHED;
+            int row = 0;
+            PGresult *fetched = NULL;
+            if (cursors != NULL) {
+                fetched = fetchSqlCursor(cursors,conn,sql,&row);
+            }
+            if (fetched != NULL) {
+                if (row < 0) {
+                    setSQLCA(100,"02000");
+                } else {
+                    setSqlPlanRow(getSqlPlan(plans,sql,fetched,outputVars),outputVars,fetched,row);
+                }
+            } else {
+                // Shared copies are read without SSI predicate lock and independent of the
+                // snapshot, so only in read only or READ COMMITTED transactions. Only a statement
+                // snapshot of READ COMMITTED is not older than the query cache generations.
+                int qcFresh = (txMode != NULL) && (txMode->isolation == DB_ISOLATION_READ_COMMITTED);
+                int shared = (dtBypass != NULL) && !(*dtBypass) && (txMode != NULL) &&
+                             (txMode->readOnly || qcFresh);
+                if (shared) {
+                    // Single row by key of a shared data table
+                    r = lookupDataTable(sql,prepared ? params->values : NULL,prepared ? params->text : NULL,
+                                        prepared ? params->num : 0,values,100,&cols,buf,sizeof(buf));
+                }
+                if (r == DT_FOUND) {
+                    for (int i = 0; (outputVars[i] != NULL) && (i < cols); i++) {
+                        setSqlOutputVar(outputVars[i],values[i]);
+                    }
+                } else
+                if (r == DT_NOTFOUND) {
+                    setSQLCA(100,"02000");
+                } else {
+                    // Converted host variables of a repeated single row query
+                    struct qcVar qcVars[100];
+                    int numQcVars = 0;
+                    long ticket = 0;
+                    int q = QC_NOT_CACHED;
+                    if (shared) {
+                        while ((numQcVars < 100) && (outputVars[numQcVars] != NULL)) {
+                            qcVars[numQcVars].data = outputVars[numQcVars]->data;
+                            qcVars[numQcVars].size = outputVars[numQcVars]->size;
+                            numQcVars++;
+                        }
+                        q = lookupQueryCache(sql,prepared ? params->values : NULL,prepared ? params->num : 0,
+                                             qcVars,numQcVars,&ticket);
+                    }
+                    if (q == QC_NOTFOUND) {
+                        setSQLCA(100,"02000");
+                    } else
+                    if (q != QC_FOUND) {
+                        // Query returns data
+                        PGresult *res = prepared ? execSQLQueryBinary(conn, sql, params->num, params->values) :
+                                                   execSQLQuery(conn, sql);
+                        if (res != NULL) {
+                            if (PQntuples(res) > 0) {
+                                setSqlPlanRow(getSqlPlan(plans,sql,res,outputVars),outputVars,res,0);
                             } else {
-                                cob_put_picx(outputVars[i]->data,outputVars[i]->size,PQgetvalue(res, 0, i));
+                                setSQLCA(100,"02000");
+                            }
+                            if ((q == QC_MISS) && queuedOk && qcFresh) {
+                                storeQueryCache(sql,prepared ? params->values : NULL,prepared ? params->num : 0,
+                                                qcVars,numQcVars,PQntuples(res) > 0,ticket);
                             }
+                            PQclear(res);
+                        } else {
+                            setSQLCA(-1,"00000");
                         }
-                        i++;
                     }
-                } else {
-                    setSQLCA(100,"02000");
                 }
-                PQclear(res);
-            } else {
-                setSQLCA(-1,"00000");
             }
         }
+        if (!queuedOk) {
+            setSQLCA(-1,state);
+        }
         printf("%s\n",sql);
     }
     return 1;
@@ -563,6 +3278,107 @@ void clearMain() {
 }
 
 
+// Rows of a streamed query are sent in chunks of known row count
+#define SQL_STREAM_CHUNK 32768
+
+struct sqlStream {
+    int fd;
+    int rows;          // Complete rows in buf
+    int len;
+    int cap;           // Grows only for rows larger than a chunk
+    char *buf;
+};
+
+
+void flushSqlStream(struct sqlStream *out) {
+    if (out->rows > 0) {
+        char count[16];
+        sprintf(count,"%d\n",out->rows);
+        write(out->fd,count,strlen(count));
+        write(out->fd,out->buf,out->len);
+    }
+    out->rows = 0;
+    out->len = 0;
+}
+
+
+void putSqlStream(struct sqlStream *out, char *v, int len) {
+    if (out->len + len + 1 > out->cap) {
+        out->cap = out->len + len + 1;
+        out->buf = (char*)realloc(out->buf,out->cap);
+    }
+    memcpy(&out->buf[out->len],v,len);
+    out->len += len;
+    out->buf[out->len++] = '\n';
+}
+
+
+// Streams the result of a SELECT in single row mode: OK, columns, column names and -1
+// rows, then chunks of rows each preceded by its row count, 0 and the total row count.
+// Memory use does not depend on the size of the result.
+void streamSqlQuery(PGconn *conn, char *sql, int fd) {
+    struct sqlStream out;
+    out.fd = fd;
+    out.rows = 0;
+    out.len = 0;
+    out.cap = SQL_STREAM_CHUNK;
+    out.buf = (char*)malloc(out.cap);
+    int started = 0;
+    int failed = !sendSQLQuery(conn, sql);
+    long total = 0;
+    PGresult *res;
+    while (!failed && ((res = PQgetResult(conn)) != NULL)) {
+        ExecStatusType st = PQresultStatus(res);
+        if ((st != PGRES_SINGLE_TUPLE) && (st != PGRES_TUPLES_OK)) {
+            printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+            failed = 1;
+        } else {
+            int cols = PQnfields(res);
+            if (!started) {
+                char line[32];
+                sprintf(line,"%s\n%d\n","OK",cols);
+                putSqlStream(&out,line,strlen(line)-1);
+                for (int j = 0; j < cols; j++) {
+                    putSqlStream(&out,PQfname(res,j),strlen(PQfname(res,j)));
+                }
+                putSqlStream(&out,"-1",2);
+                write(fd,out.buf,out.len);
+                out.len = 0;
+                started = 1;
+            }
+            for (int i = 0; i < PQntuples(res); i++) {
+                for (int j = 0; j < cols; j++) {
+                    putSqlStream(&out,PQgetvalue(res,i,j),PQgetlength(res,i,j));
+                }
+                out.rows++;
+                total++;
+                if (out.len >= SQL_STREAM_CHUNK/2) {
+                    flushSqlStream(&out);
+                }
+            }
+        }
+        PQclear(res);
+    }
+    if (failed) {
+        // Remaining results of the query are discarded
+        while ((res = PQgetResult(conn)) != NULL) {
+            PQclear(res);
+        }
+        if (started) {
+            flushSqlStream(&out);
+            write(fd,"-1\n",3);
+        }
+        write(fd,"ERROR\n",6);
+    } else {
+        flushSqlStream(&out);
+        char trailer[32];
+        sprintf(trailer,"%d\n%ld\n",0,total);
+        write(fd,trailer,strlen(trailer));
+    }
+    free(out.buf);
+}
+
+
 // Execute SQL pure instruction
 void _execSql(char *sql, void *fd, int sendRes, int sync) {
     char response[1024];
@@ -577,6 +3393,9 @@ void _execSql(char *sql, void *fd, int sendRes, int sync) {
         }
         return;
     }
+    if (strstr(sql,"COMMIT") || strstr(sql,"ROLLBACK")) {
+        endSqlCursors((struct sqlCursors*)pthread_getspecific(sqlCursorsKey),0);
+    }
     if (strstr(sql,"COMMIT")) {
         PGconn *conn = (PGconn*)pthread_getspecific(connKey);
         int r = 0;
@@ -618,34 +3437,9 @@ void _execSql(char *sql, void *fd, int sendRes, int sync) {
     if ((strstr(sql,"SELECT") || strstr(sql,"FETCH") || strstr(sql,"select") || strstr(sql,"fetch")) &&
         (strstr(sql,"DECLARE") == NULL) && (strstr(sql,"declare") == NULL)) {
         PGconn *conn = (PGconn*)pthread_getspecific(connKey);
-        PGresult *res = execSQLQuery(conn, sql);
-        if (res != NULL) {
-            int i,j;
-            int cols = PQnfields(res);
-            int rows = PQntuples(res);
-            sprintf(response,"%s\n","OK");
-            write(*((int*)fd),&response,strlen(response));
-            sprintf(response,"%d\n",cols);
-            write(*((int*)fd),&response,strlen(response));
-            for (j = 0; j < cols; j++) {
-                sprintf(response,"%s\n",PQfname(res,j));
-                write(*((int*)fd),&response,strlen(response));
-            }
-            sprintf(response,"%d\n",rows);
-            write(*((int*)fd),&response,strlen(response));
-            for (i = 0; i < rows; i++) {
-                for (j = 0; j < cols; j++) {
-                    sprintf(response,"%s\n",PQgetvalue(res, i, j));
-                    write(*((int*)fd),&response,strlen(response));
-                }
-            }
-            PQclear(res);
-        } else {
-            sprintf(response,"%s\n","ERROR");
-            write(*((int*)fd),&response,strlen(response));
-        }
+        streamSqlQuery(conn, sql, *((int*)fd));
         return;
-    }    
+    }
     PGconn *conn = (PGconn*)pthread_getspecific(connKey);
     char *r = execSQLCmd(conn, sql);
     if (r == NULL) {
@@ -669,10 +3463,14 @@ int setJmpAbend(int *errcond, char *bufVar) {
 }
 
 
+void abendTask(char *abcode, int resp, int resp2);
+
+
 void abend(int resp, int resp2) {
-  char response[1024];
   char *abcode = "ASRA";
   switch (resp) {
+      case 17: abcode = "AEIQ"; 
+               break;
       case 16: abcode = "A47B"; 
                break;
       case 22: abcode = "AEIV"; 
@@ -685,6 +3483,8 @@ void abend(int resp, int resp2) {
                break;
       case 28: abcode = "AEI1"; 
                break;
+      case 29: abcode = "AEI2"; 
+               break;
       case 44: abcode = "AEYH"; 
                break;
       case 55: abcode = "ASRA"; 
@@ -696,6 +3496,12 @@ void abend(int resp, int resp2) {
       case 122: abcode = "ASRA"; 
                break;
   }
+  abendTask(abcode,resp,resp2);
+}
+
+
+void abendTask(char *abcode, int resp, int resp2) {
+  char response[1024];
   int *respFieldsState = (int*)pthread_getspecific(respFieldsStateKey);
   int *cmdState = (int*)pthread_getspecific(cmdStateKey);
   if ((*cmdState) != -17) {
@@ -744,6 +3550,39 @@ void readLine(char *buf, int childfd) {
 }
 
 
+// Pass locally changed containers to the client, when channels leave the task
+void flushChannels(int childfd) {
+    struct chnStore *chnStore = (struct chnStore*)pthread_getspecific(chnStoreKey);
+    struct chnChannel *chn;
+    char buf[2048];
+    for (chn = chnStore->channels; chn != NULL; chn = chn->next) {
+        if (chn->level > 0) {
+            continue;
+        }
+        struct chnContainer *cnt;
+        for (cnt = chn->containers; cnt != NULL; cnt = cnt->next) {
+            if (!cnt->dirty) {
+                continue;
+            }
+            sprintf(buf,"%s\n%s\n%s%s%s","PUT","CONTAINER","='",cnt->name,"'\n");
+            write(childfd,buf,strlen(buf));
+            if (chn->name[0] != 0x00) {
+                sprintf(buf,"%s\n%s%s%s","CHANNEL","='",chn->name,"'\n");
+                write(childfd,buf,strlen(buf));
+            }
+            sprintf(buf,"%s\n%s%d\n\n","FLENGTH","=",cnt->len);
+            write(childfd,buf,strlen(buf));
+            write(childfd,cnt->data,cnt->len);
+            readLine((char*)&buf,childfd);
+            readLine((char*)&buf,childfd);
+            write(childfd,"\n",1);
+            write(childfd,"\n",1);
+            cnt->dirty = 0;
+        }
+    }
+}
+
+
 // Handling plain COBOL call invocation for preprocessed QWICS modules
 struct callLoadlib {
     char name[9];
@@ -934,6 +3773,7 @@ int execLoadModule(char *name, int mode, int parCount) {
 #endif
             int *runState = (int*)pthread_getspecific(runStateKey);
             if ((mode == 0) && ((*runState) < 3)) {
+                flushChannels(childfd);
                 sprintf(response,"\n%s\n","STOP");
                 write(childfd,&response,strlen(response));
             }
@@ -970,6 +3810,13 @@ int execCallback(char *cmd, void *var) {
     int *respFieldsState = (int*)pthread_getspecific(respFieldsStateKey);
     void **respFields = (void**)pthread_getspecific(respFieldsKey);
     int *callStackPtr = (int*)pthread_getspecific(callStackPtrKey);
+    struct chnStore *chnStore = (struct chnStore*)pthread_getspecific(chnStoreKey);
+    struct cmdDefer *cmdDefer = (struct cmdDefer*)pthread_getspecific(cmdDeferKey);
+    struct ctrParams *ctrParams = (struct ctrParams*)pthread_getspecific(ctrParamsKey);
+    struct jrnlParams *jrnlParams = (struct jrnlParams*)pthread_getspecific(jrnlParamsKey);
+    struct fcParams *fcParams = (struct fcParams*)pthread_getspecific(fcParamsKey);
+    struct fcTask *fcTask = (struct fcTask*)pthread_getspecific(fcTaskKey);
+    struct sqlParams *sqlParams = (struct sqlParams*)pthread_getspecific(sqlParamsKey);
     int respFieldsStateLocal = 0;
     void *respFieldsLocal[2];
 
@@ -1041,6 +3888,13 @@ int execCallback(char *cmd, void *var) {
             eibbuf[pos] = ' ';
             pos++;
         }
+        char trnId[5];
+        memcpy(trnId,&eibbuf[8],4);
+        trnId[4] = 0x00;
+        struct sqlTxMode *txMode = (struct sqlTxMode*)pthread_getspecific(sqlTxModeKey);
+        if ((txMode != NULL) && setSqlTxMode(txMode,trnId)) {
+            switchSqlTxMode(txMode);
+        }
         // Read in REQID from client
         c = 0x00;
         pos = 43;
@@ -1084,11 +3938,9 @@ int execCallback(char *cmd, void *var) {
         int id = atoi(idbuf);
         cob_put_s64_comp3(id,(void*)&eibbuf[12],4);
         // SET EIBDATE and EIBTIME
-        time_t t = time(NULL);
-        struct tm now = *localtime(&t);
-        int ti = now.tm_hour*10000 + now.tm_min*100 + now.tm_sec;
+        int da = 0, ti = 0;
+        getEibDateTime(getAbsTime(),&da,&ti);
         cob_put_s64_comp3(ti,(void*)&eibbuf[0],4);
-        int da = now.tm_year*1000 + now.tm_yday;
         cob_put_s64_comp3(da,(void*)&eibbuf[4],4);
         return 1;
     } else 
@@ -1178,15 +4030,19 @@ int execCallback(char *cmd, void *var) {
     }
 
     if (strcmp(cmd,"CICS") == 0) {
+        dropDeferredCmd();
+        cmdDefer->tokens = 0;
+        cmdDefer->noClient = 0;
         cmdbuf[0] = 0x00;
         (*cmdState) = -1;
         return 1;
     }
+    cmdDefer->tokens++;
 
     if ((*cmdState) < 0) {
         if (strcmp(cmd,"SEND") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
@@ -1195,7 +4051,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"RECEIVE") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -2;
             (*memParamsState) = 0;
@@ -1207,21 +4063,29 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"XCTL") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -3;
             (*xctlState) = 0;
+            chnStore->pendingChannel[0] = 0x00;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
         if (strcmp(cmd,"RETRIEVE") == 0) {
+            if (getBackgroundTask() != NULL) {
+                // Data of START is kept by the background task
+                deferCmd();
+            }
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -4;
             (*retrieveState) = 0;
+            memParams[1] = NULL;
+            memParams[2] = NULL;
+            memParams[3] = NULL;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
@@ -1229,10 +4093,11 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"LINK") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -5;
             (*xctlState) = 0;
+            chnStore->pendingChannel[0] = 0x00;
             xctlParams[1] = NULL;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
@@ -1241,7 +4106,7 @@ int execCallback(char *cmd, void *var) {
         }
         if ((strcmp(cmd,"GETMAIN") == 0) || (strcmp(cmd,"GETMAIN64") == 0)) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -6;
             (*memParamsState) = 0;
@@ -1254,7 +4119,7 @@ int execCallback(char *cmd, void *var) {
         }
         if ((strcmp(cmd,"FREEMAIN") == 0) || (strcmp(cmd,"FREEMAIN64") == 0)) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -7;
             (*memParamsState) = 0;
@@ -1266,7 +4131,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"ADDRESS") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -8;
             (*memParamsState) = 0;
@@ -1276,20 +4141,28 @@ int execCallback(char *cmd, void *var) {
             return 1;
         }
         if (strcmp(cmd,"PUT") == 0) {
+            // Containers are kept in task, client only involved if needed
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -9;
             (*memParamsState) = 0;
             *((int*)memParams[0]) = -1;
+            memParams[1] = NULL;
+            memParams[4] = NULL;
+            resetCtrParams(ctrParams,CTR_PUT);
+            chnStore->reqContainer[0] = 0x00;
+            chnStore->reqChannel[0] = 0x00;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
         if (strcmp(cmd,"GET") == 0) {
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -10;
             (*memParamsState) = 0;
@@ -1298,6 +4171,9 @@ int execCallback(char *cmd, void *var) {
             memParams[2] = NULL;
             memParams[3] = NULL;
             memParams[4] = NULL;
+            resetCtrParams(ctrParams,CTR_GET);
+            chnStore->reqContainer[0] = 0x00;
+            chnStore->reqChannel[0] = 0x00;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
@@ -1305,7 +4181,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"ENQ") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -11;
             (*memParamsState) = 0;
@@ -1320,7 +4196,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"DEQ") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -12;
             (*memParamsState) = 0;
@@ -1334,8 +4210,12 @@ int execCallback(char *cmd, void *var) {
             return 1;
         }
         if (strcmp(cmd,"SYNCPOINT") == 0) {
+            if (!XA_COORDINATOR || (getBackgroundTask() != NULL)) {
+                // Unit of work is owned by tpmserver, client is not involved
+                deferCmd();
+            }
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -13;
             (*memParamsState) = 0;
@@ -1345,38 +4225,56 @@ int execCallback(char *cmd, void *var) {
             return 1;
         }
         if (strcmp(cmd,"WRITEQ") == 0) {
+            // TS and TD queues are handled by local queue managers
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -14;
             (*memParamsState) = 0;
             *((int*)memParams[0]) = -1;
+            memParams[2] = (void*)&paramsBuf[2];
+            ((char*)memParams[2])[0] = 0x00;
             memParams[3] = NULL;
+            memParams[4] = NULL;
+            memParams[5] = NULL;
+            memParams[6] = NULL;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
         if (strcmp(cmd,"READQ") == 0) {
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -15;
             (*memParamsState) = 0;
             *((int*)memParams[0]) = -1;
+            memParams[2] = (void*)&paramsBuf[2];
+            ((char*)memParams[2])[0] = 0x00;
             memParams[3] = NULL;
+            memParams[4] = NULL;
+            memParams[5] = NULL;
+            memParams[7] = NULL;
+            memParams[8] = NULL;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
         if (strcmp(cmd,"DELETEQ") == 0) {
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -16;
             (*memParamsState) = 0;
             *((int*)memParams[0]) = -1;
+            memParams[2] = (void*)&paramsBuf[2];
+            ((char*)memParams[2])[0] = 0x00;
+            memParams[5] = NULL;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
@@ -1384,7 +4282,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"ABEND") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -17;
             (*respFieldsState) = 0;
@@ -1396,8 +4294,21 @@ int execCallback(char *cmd, void *var) {
             (strcmp(cmd,"INQUIRE") == 0) ||
             (strcmp(cmd,"ASSIGN") == 0) ||
             (strcmp(cmd,"FORMATTIME") == 0)) {
+            struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+            roParams->cmd = RO_INQUIRE;
+            if (strcmp(cmd,"ASKTIME") == 0) roParams->cmd = RO_ASKTIME;
+            if (strcmp(cmd,"FORMATTIME") == 0) roParams->cmd = RO_FORMATTIME;
+            if (strcmp(cmd,"ASSIGN") == 0) roParams->cmd = RO_ASSIGN;
+            roParams->num = 0;
+            roParams->dateSep = 0x00;
+            roParams->timeSep = 0x00;
+            roParams->absTime = getAbsTime();
+            if (roParams->cmd != RO_INQUIRE) {
+                // Answered locally unless an option is owned by the client
+                deferCmd();
+            }
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -18; // General read only data cmd
             (*memParamsState) = 0;
@@ -1409,22 +4320,34 @@ int execCallback(char *cmd, void *var) {
         }
         if ((strcmp(cmd,"START") == 0) ||
             (strcmp(cmd,"CANCEL") == 0)) {
+            // Scheduled locally for transactions defined in tpmserver
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -19; // Call other transactions
             (*memParamsState) = 0;
             *((int*)memParams[0]) = -1;
             memParams[1] = NULL;
-            memParams[2] = NULL;
+            memParams[2] = (strcmp(cmd,"CANCEL") == 0) ? (void*)1 : NULL;
+            memParams[3] = (void*)&paramsBuf[3];
+            ((char*)memParams[3])[0] = 0x00;
+            memParams[4] = (void*)&paramsBuf[4];
+            ((char*)memParams[4])[0] = 0x00;
+            for (int i = 5; i < 10; i++) {
+                memParams[i] = NULL;
+            }
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
         if (strcmp(cmd,"RETURN") == 0) {
+            if (((*linkStackPtr) == 0) && ((*callStackPtr) == 0)) {
+                flushChannels(childfd);
+            }
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -20; // RETURN
             (*memParamsState) = 0;
@@ -1439,7 +4362,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"SOAPFAULT") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -21;
             (*memParamsState) = 0;
@@ -1451,7 +4374,7 @@ int execCallback(char *cmd, void *var) {
         }
         if (strcmp(cmd,"INVOKE") == 0) {
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -22;
             (*memParamsState) = 0;
@@ -1462,8 +4385,10 @@ int execCallback(char *cmd, void *var) {
             return 1;
         }
         if (strcmp(cmd,"QUERY") == 0) {
+            // QUERY COUNTER is answered locally
+            deferCmd();
             sprintf(cmdbuf,"%s%s",cmd,"\n");
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             (*cmdState) = -23;
             (*memParamsState) = 0;
@@ -1472,18 +4397,172 @@ int execCallback(char *cmd, void *var) {
             memParams[2] = NULL;
             memParams[3] = NULL;
             memParams[4] = NULL;
+            resetCtrParams(ctrParams,CTR_QUERY);
+            (*respFieldsState) = 0;
+            respFields[0] = NULL;
+            respFields[1] = NULL;
+            return 1;
+        }
+        if (((*cmdState) == -1) && (cmdDefer->tokens == 1) &&
+            ((strcmp(cmd,"DEFINE") == 0) || (strcmp(cmd,"DELETE") == 0) ||
+             (strcmp(cmd,"REWIND") == 0) || (strcmp(cmd,"UPDATE") == 0))) {
+            // Named counter cmd if COUNTER or DCOUNTER follows
+            deferCmd();
+            sprintf(cmdbuf,"%s%s",cmd,"\n");
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+            cmdbuf[0] = 0x00;
+            (*cmdState) = -24;
+            (*memParamsState) = 0;
+            resetCtrParams(ctrParams,CTR_DEFINE);
+            if (cmd[1] == 'E') ctrParams->cmd = (cmd[2] == 'L') ? CTR_DELETE : CTR_REWIND;
+            if (cmd[0] == 'U') ctrParams->cmd = CTR_UPDATE;
+            (*respFieldsState) = 0;
+            respFields[0] = NULL;
+            respFields[1] = NULL;
+            return 1;
+        }
+        if (((*cmdState) == -1) && (cmdDefer->tokens == 1) &&
+            ((strcmp(cmd,"WRITE") == 0) || (strcmp(cmd,"WAIT") == 0))) {
+            // Journal cmd if JOURNALNAME or JOURNALNUM follows
+            deferCmd();
+            sprintf(cmdbuf,"%s%s",cmd,"\n");
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+            cmdbuf[0] = 0x00;
+            (*cmdState) = -25;
+            (*memParamsState) = 0;
+            resetJrnlParams(jrnlParams,(cmd[1] == 'R') ? JRNL_WRITE : JRNL_WAIT);
+            (*respFieldsState) = 0;
+            respFields[0] = NULL;
+            respFields[1] = NULL;
+            return 1;
+        }
+        if (((*cmdState) == -1) && (cmdDefer->tokens == 1) && (numFileDefs() > 0) &&
+            ((strcmp(cmd,"READ") == 0) || (strcmp(cmd,"REWRITE") == 0) ||
+             (strcmp(cmd,"UNLOCK") == 0) || (strcmp(cmd,"STARTBR") == 0) ||
+             (strcmp(cmd,"READNEXT") == 0) || (strcmp(cmd,"READPREV") == 0) ||
+             (strcmp(cmd,"RESETBR") == 0) || (strcmp(cmd,"ENDBR") == 0))) {
+            // File control cmd if FILE or DATASET follows
+            deferCmd();
+            sprintf(cmdbuf,"%s%s",cmd,"\n");
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+            cmdbuf[0] = 0x00;
+            (*cmdState) = -26;
+            (*memParamsState) = 0;
+            resetFcParams(fcParams,FC_CMD_READ);
+            if (strcmp(cmd,"REWRITE") == 0) fcParams->cmd = FC_CMD_REWRITE;
+            if (strcmp(cmd,"UNLOCK") == 0) fcParams->cmd = FC_CMD_UNLOCK;
+            if (strcmp(cmd,"STARTBR") == 0) fcParams->cmd = FC_CMD_STARTBR;
+            if (strcmp(cmd,"READNEXT") == 0) fcParams->cmd = FC_CMD_READNEXT;
+            if (strcmp(cmd,"READPREV") == 0) fcParams->cmd = FC_CMD_READPREV;
+            if (strcmp(cmd,"RESETBR") == 0) fcParams->cmd = FC_CMD_RESETBR;
+            if (strcmp(cmd,"ENDBR") == 0) fcParams->cmd = FC_CMD_ENDBR;
             (*respFieldsState) = 0;
             respFields[0] = NULL;
             respFields[1] = NULL;
             return 1;
         }
+        if ((cmdDefer->tokens == 2) && (var == NULL) && (numFileDefs() > 0) &&
+            (((*cmdState) == -24) || ((*cmdState) == -25) || ((*cmdState) == -26))) {
+            if ((strcmp(cmd,"FILE") == 0) || (strcmp(cmd,"DATASET") == 0)) {
+                if ((*cmdState) != -26) {
+                    // DELETE or WRITE of a record
+                    resetFcParams(fcParams,((*cmdState) == -24) ? FC_CMD_DELETE : FC_CMD_WRITE);
+                    ctrParams->cmd = 0;
+                    (*cmdState) = -26;
+                }
+                fcParams->param = FC_P_FILE;
+                return 1;
+            }
+            if ((*cmdState) == -26) {
+                // Not a file, client handles the cmd as before
+                flushDeferredCmd(childfd);
+                (*cmdState) = -1;
+            }
+        }
+        if ((cmdDefer->tokens == 2) && (var == NULL) && (ctrParams->cmd != 0) &&
+            (((*cmdState) == -9) || ((*cmdState) == -10) ||
+             ((*cmdState) == -23) || ((*cmdState) == -24))) {
+            if ((strcmp(cmd,"COUNTER") == 0) || (strcmp(cmd,"DCOUNTER") == 0)) {
+                ctrParams->dcounter = (cmd[0] == 'D');
+                ctrParams->param = CTR_P_NAME;
+                (*cmdState) = -24;
+                return 1;
+            }
+            ctrParams->cmd = 0;
+            if ((*cmdState) == -23) {
+                flushDeferredCmd(childfd);
+            }
+            if ((*cmdState) == -24) {
+                // Not a counter, client handles the cmd as before
+                flushDeferredCmd(childfd);
+                (*cmdState) = -1;
+            }
+        }
+        if ((cmdDefer->tokens == 2) && ((*cmdState) == -25) && (var == NULL) &&
+            (strcmp(cmd,"JOURNALNAME") != 0) && (strcmp(cmd,"JOURNALNUM") != 0)) {
+            // Not a journal, client handles the cmd as before
+            flushDeferredCmd(childfd);
+            (*cmdState) = -1;
+        }
+        if ((((*cmdState) == -24) || ((*cmdState) == -25) || ((*cmdState) == -26)) &&
+            !strstr(cmd,"END-EXEC")) {
+            if ((strcmp(cmd,"RESP") == 0) || (strcmp(cmd,"RESP2") == 0)) {
+                if (var != NULL) {
+                    cob_field *cobvar = (cob_field*)var;
+                    cob_put_u64_compx(0,cobvar->data,4);
+                    (*respFieldsState) = (cmd[4] == '2') ? 2 : 1;
+                    respFields[(*respFieldsState)-1] = (void*)cobvar;
+                }
+                return 1;
+            }
+            if (strcmp(cmd,"NOHANDLE") == 0) {
+                if ((*respFieldsState) == 0) {
+                    (*respFieldsState) = 3;
+                }
+                return 1;
+            }
+            int option = (var == NULL) && (cmd[0] >= 'A') && (cmd[0] <= 'Z');
+            if ((*cmdState) == -26) {
+                if (option) {
+                    setFcOption(fcParams,cmd);
+                } else {
+                    setFcParam(fcParams,cmd,(cob_field*)var);
+                }
+            } else
+            if ((*cmdState) == -25) {
+                if (option) {
+                    setJrnlOption(jrnlParams,cmd);
+                } else {
+                    setJrnlParam(jrnlParams,cmd,(cob_field*)var);
+                }
+            } else {
+                if (option) {
+                    setCtrOption(ctrParams,cmd);
+                } else {
+                    setCtrParam(ctrParams,cmd,(cob_field*)var);
+                }
+            }
+            return 1;
+        }
 
         if (strstr(cmd,"END-EXEC")) {
             int resp = 0;
             int resp2 = 0;
             cmdbuf[0] = 0x00;
             outputVars[0] = NULL; // NULL terminated list
-            write(childfd,"\n",1);
+            writeCmd(childfd,"\n",1);
+            if ((getBackgroundTask() != NULL) && !isCmdDeferred() &&
+                (((*cmdState) == -2) || ((*cmdState) == -4) || ((*cmdState) == -13) ||
+                 ((*cmdState) == -18) || ((*cmdState) == -21) || ((*cmdState) == -22))) {
+                // Answer of the client is needed, but background task has none
+                cmdDefer->noClient = 1;
+            }
+            if (cmdDefer->noClient) {
+                // INVREQ, nothing of the cmd is executed
+                (*cmdState) = -1;
+                resp = 16;
+                abend(resp,resp2);
+            }
             if (((*cmdState) == -2) && ((*memParamsState) >= 1)) {
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
@@ -1523,8 +4602,39 @@ int execCallback(char *cmd, void *var) {
                 (*xctlState) = 0;
                 (*cmdState) = 0;
                 //printf("%s%s\n","XCTL ",xctlParams[0]);
+                chnXctl(chnStore);
                 execLoadModule(xctlParams[0],1,0);
             }
+            if (((*cmdState) == -4) && isCmdDeferred()) {
+                // RETRIEVE FROM data of START in background task
+                struct bgTaskReq *req = getBackgroundTask();
+                (*retrieveState) = 0;
+                dropDeferredCmd();
+                if ((req == NULL) || (req->data == NULL) || req->retrieved) {
+                    resp = 29;
+                } else {
+                    if (memParams[1] != NULL) {
+                        cob_field *cobvar = (cob_field*)memParams[1];
+                        int l = (req->len < (int)cobvar->size) ? req->len : (int)cobvar->size;
+                        memcpy(cobvar->data,req->data,l);
+                        if (req->len > (int)cobvar->size) {
+                            resp = 22;
+                            resp2 = 11;
+                        }
+                    }
+                    if (memParams[2] != NULL) {
+                        cob_field *cobvar = (cob_field*)memParams[2];
+                        (*((unsigned char**)cobvar->data)) = req->data;
+                    }
+                    if (memParams[3] != NULL) {
+                        setNumericValue(req->len,(cob_field*)memParams[3]);
+                    }
+                    req->retrieved = 1;
+                }
+                if (resp > 0) {
+                  abend(resp,resp2);
+                }
+            } else
             if (((*cmdState) == -4) && ((*retrieveState) >= 1)) {
                 // RETRIEVE
                 (*retrieveState) = 0;
@@ -1559,7 +4669,9 @@ int execCallback(char *cmd, void *var) {
                     respFieldsLocal[1] = respFields[1];
                     cob_field *cobvar = (cob_field*)xctlParams[1];
 
+                    chnPushLevel(chnStore);
                     int r = execLoadModule(xctlParams[0],1,0);
+                    chnPopLevel(chnStore);
 
                     *respFieldsState = respFieldsStateLocal;
                     respFields[0] = respFieldsLocal[0];
@@ -1618,24 +4730,65 @@ int execCallback(char *cmd, void *var) {
                 } else {
                   l = cobvar->size;
                 }
-                write(childfd,cobvar->data,l);
-                if (l < len) {
-                  char zero[1];
-                  zero[0] = 0x00;
-                  for (i = l; i < len; i++) {
-                    write(childfd,&zero,1);
-                  }
+                if (isCmdDeferred() &&
+                    (putContainer(chnStore,chnStore->reqChannel,chnStore->reqContainer,
+                                  cobvar->data,l,(len >= 0) ? len : l,(int)memParams[4]) == 0)) {
+                    dropDeferredCmd();
+                } else {
+                    flushDeferredCmd(childfd);
+                    write(childfd,cobvar->data,l);
+                    if (l < len) {
+                      char zero[1];
+                      zero[0] = 0x00;
+                      for (i = l; i < len; i++) {
+                        write(childfd,&zero,1);
+                      }
+                    }
+                    char buf[2048];
+                    readLine((char*)&buf,childfd);
+                    resp = atoi(buf);
+                    readLine((char*)&buf,childfd);
+                    resp2 = atoi(buf);
+                    write(childfd,"\n",1);
+                    write(childfd,"\n",1);
                 }
-                char buf[2048];
-                readLine((char*)&buf,childfd);
-                resp = atoi(buf);
-                readLine((char*)&buf,childfd);
-                resp2 = atoi(buf);
-                write(childfd,"\n",1);
-                write(childfd,"\n",1);
             }
+            struct chnContainer *cnt = NULL;
+            if (((*cmdState) == -10) && ((*memParamsState) >= 1) && isCmdDeferred()) {
+                cnt = getContainer(chnStore,chnStore->reqChannel,chnStore->reqContainer);
+            }
+            if (cnt != NULL) {
+                // GET served from task channel store
+                dropDeferredCmd();
+                int len = *((int*)memParams[0]);
+                int l = cnt->len;
+                if (memParams[2] != NULL) {
+                    // SET mode, data is not copied
+                    (*((unsigned char**)((cob_field*)memParams[2])->data)) = cnt->data;
+                } else
+                if ((memParams[4] == NULL) && (memParams[1] != NULL)) {
+                    cob_field *cobvar = (cob_field*)memParams[1];
+                    int max = ((len >= 0) && (len <= cobvar->size)) ? len : (int)cobvar->size;
+                    if (l > max) {
+                        l = max;
+                        resp = 22;
+                        resp2 = 11;
+                    }
+                    memcpy(cobvar->data,cnt->data,l);
+                }
+                if (memParams[3] != NULL) {
+                    if (((cob_field*)memParams[3])->data != NULL) {
+                        setNumericValue(l,(cob_field*)memParams[3]);
+                    }
+                }
+            } else
+            if (((*cmdState) == -10) && ((*memParamsState) >= 1) && (getBackgroundTask() != NULL)) {
+                // Container not in task and there is no client to ask
+                cmdDefer->noClient = 1;
+            } else
             if (((*cmdState) == -10) && ((*memParamsState) >= 1)) {
                 char buf[2048];
+                flushDeferredCmd(childfd);
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = NULL, dummy = { len, NULL, NULL };
                 if (memParams[1] != NULL) {
@@ -1646,7 +4799,7 @@ int execCallback(char *cmd, void *var) {
                     readLine((char*)&buf,childfd);
                     len = atoi(buf);
 
-                    (*((unsigned char**)((cob_field*)memParams[2])->data)) = getNextChnBuf(len);
+                    (*((unsigned char**)((cob_field*)memParams[2])->data)) = (unsigned char*)chnAlloc(chnStore,len);
                     dummy.size = len;
                     dummy.data = (*((unsigned char**)((cob_field*)memParams[2])->data));
                     cobvar = &dummy;
@@ -1700,28 +4853,46 @@ int execCallback(char *cmd, void *var) {
             if (((*cmdState) == -11) && ((*memParamsState) >= 1)) {
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
-                int type = ((int)memParams[4] == 1) ? 1 : 0;
+                int type = ((int)memParams[4] == 1) ? TASK : UOW;
                 int nosuspend = ((int)memParams[2] == 1) ? 1 : 0;
+                int r = ENQ_OK;
                 if (len <= 0) {
-                  int r = enq((char*)cobvar,0,nosuspend,type,taskLocks);
+                  if (memParams[1] == (void*)&paramsBuf[1]) {
+                    // Resource name given as constant
+                    r = enq((char*)memParams[1],strlen((char*)memParams[1]),nosuspend,type,taskLocks);
+                  } else {
+                    r = enq((char*)cobvar,0,nosuspend,type,taskLocks);
+                  }
                 } else {
                   if (len > 255) {
                     resp = 22;
                     resp2 = 1;
                   } else {
-                    int r = enq((char*)cobvar->data,len,nosuspend,type,taskLocks);
-                    if (r < 0) {
-                      resp = 55;
-                    }
+                    r = enq((char*)cobvar->data,len,nosuspend,type,taskLocks);
                   }
                 }
+                if (r == ENQ_BUSY) {
+                  resp = 55;
+                }
+                if ((r == ENQ_DEADLOCK) || (r == ENQ_TIMEOUT)) {
+                  // Victim is backed out and abended, so its locks and DB connection are freed
+                  fprintf(stderr,"%s\n",(r == ENQ_DEADLOCK) ? "ENQ deadlock detected" : "ENQ wait timed out");
+                  _execSql("ROLLBACK",pthread_getspecific(childfdKey),0,1);
+                  releaseLocks(UOW,taskLocks);
+                  (*respFieldsState) = 0;
+                  abendTask("AKCS",0,0);
+                }
             }
             if (((*cmdState) == -12) && ((*memParamsState) >= 1)) {
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
-                int type = ((int)memParams[4] == 1) ? 1 : 0;
+                int type = ((int)memParams[4] == 1) ? TASK : UOW;
                 if (len <= 0) {
-                  deq((char*)cobvar,0,type,taskLocks);
+                  if (memParams[1] == (void*)&paramsBuf[1]) {
+                    deq((char*)memParams[1],strlen((char*)memParams[1]),type,taskLocks);
+                  } else {
+                    deq((char*)cobvar,0,type,taskLocks);
+                  }
                 } else {
                   if (len > 255) {
                     resp = 22;
@@ -1731,6 +4902,28 @@ int execCallback(char *cmd, void *var) {
                   }
                 }
             }
+            if ((*cmdState) == -13) {
+                // Failure of a queued statement is reported in SQLCA, COMMIT backs out then
+                char state[6];
+                if (!syncDBPipeline((PGconn*)pthread_getspecific(connKey),state)) {
+                    setSQLCA(-1,state);
+                }
+            }
+            if (((*cmdState) == -13) && isCmdDeferred()) {
+                // SYNCPOINT on the task's DB connection, next UOW starts in place
+                PGconn *conn = (PGconn*)pthread_getspecific(connKey);
+                int commit = ((*memParamsState) == 0);
+                dropDeferredCmd();
+                int r = syncDBConnection(conn,commit);
+                releaseLocks(UOW, taskLocks);
+                endFcUow(fcTask);
+                endSqlCursors((struct sqlCursors*)pthread_getspecific(sqlCursorsKey),0);
+                if (commit && (r == 0)) {
+                  // COMMIT failed, changes are backed out
+                  resp = 82;
+                  abend(resp,resp2);
+                }
+            } else
             if ((*cmdState) == -13) {
                 // SYNCPOINT handling
                 char buf[2048];
@@ -1755,6 +4948,8 @@ int execCallback(char *cmd, void *var) {
                   }
                 }
                 releaseLocks(UOW, taskLocks);
+                endFcUow(fcTask);
+                endSqlCursors((struct sqlCursors*)pthread_getspecific(sqlCursorsKey),0);
                 if ((strstr(buf,"ROLLBACK") != NULL) && ((*memParamsState) == 0)) {
                   if ((*memParamsState) == 0) {
                     resp = 82;
@@ -1762,7 +4957,83 @@ int execCallback(char *cmd, void *var) {
                   abend(resp,resp2);
                 }
             }
-            if (((*cmdState) == -14) && ((*memParamsState) >= 1)) {
+            int tsqDone = 0;
+            if ((((*cmdState) == -14) || ((*cmdState) == -15) || ((*cmdState) == -16)) &&
+                isCmdDeferred()) {
+                // TS/TD queue operation served by local queue manager
+                int r = -1, item = 0, numItems = 0;
+                int td = ((((long)memParams[5]) & 1) != 0);
+                char *qname = (char*)memParams[2];
+                if (memParams[3] != NULL) {
+                    item = cob_get_int((cob_field*)memParams[3]);
+                } else {
+                    item = (int)((long)memParams[4]);
+                }
+                if (((*cmdState) == -14) && ((*memParamsState) >= 1) && (memParams[1] != NULL)) {
+                    int len = *((int*)memParams[0]);
+                    cob_field *cobvar = (cob_field*)memParams[1];
+                    int rewrite = ((((long)memParams[5]) & 2) != 0);
+                    if ((len >= 0) && (len > cobvar->size) && (len <= TSQ_MAX_ITEM_LEN)) {
+                        // Pad with zeros up to LENGTH
+                        unsigned char *buf = (unsigned char*)calloc(len,1);
+                        memcpy(buf,cobvar->data,cobvar->size);
+                        r = td ? writeTDQ(qname,buf,len) :
+                                 writeTSQ(qname,(memParams[6] != NULL),buf,len,&item,rewrite);
+                        free(buf);
+                    } else {
+                        int l = ((len >= 0) && (len <= cobvar->size)) ? len : (int)cobvar->size;
+                        r = td ? writeTDQ(qname,cobvar->data,l) :
+                                 writeTSQ(qname,(memParams[6] != NULL),cobvar->data,l,&item,rewrite);
+                    }
+                    if ((r == 0) && !td && !rewrite && (memParams[3] != NULL)) {
+                        setNumericValue(item,(cob_field*)memParams[3]);
+                    }
+                }
+                if (((*cmdState) == -15) && ((*memParamsState) >= 1) && (memParams[1] != NULL)) {
+                    int len = *((int*)memParams[0]);
+                    cob_field *cobvar = (cob_field*)memParams[1];
+                    int l = ((len >= 0) && (len <= cobvar->size)) ? len : (int)cobvar->size;
+                    int rlen = l;
+                    if (td) {
+                        r = readTDQ(qname,cobvar->data,&rlen);
+                    } else {
+                        r = readTSQ(qname,cobvar->data,&rlen,&item,(((long)memParams[5]) & 2) != 0,&numItems);
+                    }
+                    if ((r == 0) || (r == 22)) {
+                        if (rlen < l) {
+                            memset(&cobvar->data[rlen],' ',l-rlen);
+                        }
+                        if ((memParams[3] != NULL) && !td) {
+                            setNumericValue(item,(cob_field*)memParams[3]);
+                        }
+                        if (memParams[7] != NULL) {
+                            setNumericValue(rlen,(cob_field*)memParams[7]);
+                        }
+                    }
+                    if ((r >= 0) && (r != 44) && !td && (memParams[8] != NULL)) {
+                        setNumericValue(numItems,(cob_field*)memParams[8]);
+                    }
+                }
+                if ((*cmdState) == -16) {
+                    r = td ? deleteTDQ(qname) : deleteTSQ(qname);
+                }
+                if (r >= 0) {
+                    dropDeferredCmd();
+                    tsqDone = 1;
+                    resp = r;
+                    if (resp > 0) {
+                        abend(resp,resp2);
+                    }
+                }
+            }
+            if ((((*cmdState) == -14) || ((*cmdState) == -15) || ((*cmdState) == -16)) &&
+                !tsqDone && (getBackgroundTask() != NULL)) {
+                // Queue not served locally and there is no client to serve it
+                cmdDefer->noClient = 1;
+                tsqDone = 1;
+            }
+            if (((*cmdState) == -14) && ((*memParamsState) >= 1) && !tsqDone) {
+                flushDeferredCmd(childfd);
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
                 int i,l;
@@ -1771,12 +5042,12 @@ int execCallback(char *cmd, void *var) {
                 } else {
                   l = cobvar->size;
                 }
-                write(childfd,cobvar->data,l);
+                writeCmd(childfd,cobvar->data,l);
                 if (l < len) {
                   char zero[1];
                   zero[0] = 0x00;
                   for (i = l; i < len; i++) {
-                    write(childfd,&zero,1);
+                    writeCmd(childfd,&zero,1);
                   }
                 }
                 char buf[2048];
@@ -1794,13 +5065,14 @@ int execCallback(char *cmd, void *var) {
                 resp = atoi(buf);
                 readLine((char*)&buf,childfd);
                 resp2 = atoi(buf);
-                write(childfd,"\n",1);
-                write(childfd,"\n",1);
+                writeCmd(childfd,"\n",1);
+                writeCmd(childfd,"\n",1);
                 if (resp > 0) {
                   abend(resp,resp2);
                 }
             }
-            if (((*cmdState) == -15) && ((*memParamsState) >= 1)) {
+            if (((*cmdState) == -15) && ((*memParamsState) >= 1) && !tsqDone) {
+                flushDeferredCmd(childfd);
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
                 int i,l;
@@ -1848,8 +5120,9 @@ int execCallback(char *cmd, void *var) {
                   }
                 }
             }
-            if ((*cmdState) == -16) {
+            if (((*cmdState) == -16) && !tsqDone) {
                 char buf[2048];
+                flushDeferredCmd(childfd);
                 readLine((char*)&buf,childfd);
                 resp = atoi(buf);
                 readLine((char*)&buf,childfd);
@@ -1858,6 +5131,26 @@ int execCallback(char *cmd, void *var) {
             if ((*cmdState) == -17) {
               abend(resp,resp2);
             }
+            if (((*cmdState) == -18) && isCmdDeferred()) {
+                struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+                dropDeferredCmd();
+                for (int i = 0; i < roParams->num; i++) {
+                    if (roParams->cmd == RO_FORMATTIME) {
+                        char buf[64];
+                        if (formatAbsTime(roParams->absTime,roParams->opt[i],
+                                          roParams->dateSep,roParams->timeSep,buf) == 0) {
+                            setReadOnlyValue(buf,roParams->vars[i]);
+                        }
+                    }
+                }
+                if (roParams->cmd == RO_ASKTIME) {
+                    // ASKTIME updates EIBDATE and EIBTIME as well
+                    int da = 0, ti = 0;
+                    getEibDateTime(roParams->absTime,&da,&ti);
+                    cob_put_s64_comp3(ti,(void*)&eibbuf[0],4);
+                    cob_put_s64_comp3(da,(void*)&eibbuf[4],4);
+                }
+            } else
             if ((*cmdState) == -18) {
                 char buf[2048];
                 readLine((char*)&buf,childfd);
@@ -1865,7 +5158,60 @@ int execCallback(char *cmd, void *var) {
                 readLine((char*)&buf,childfd);
                 resp2 = atoi(buf);
             }
-            if ((*cmdState) == -19) {
+            int startDone = 0;
+            if (((*cmdState) == -19) && isCmdDeferred()) {
+                // START/CANCEL of locally defined transactions
+                int r = -1;
+                char *reqid = (char*)memParams[3];
+                char *transid = (char*)memParams[4];
+                if (memParams[2] != NULL) {
+                    r = cancelStart(reqid,transid);
+                    if (r == 13) {
+                        // Request may have been scheduled by the client
+                        r = -1;
+                    }
+                } else
+                if (getTransProgram(transid) != NULL) {
+                    long delay = getStartDelay((int)((long)memParams[6]),(long)memParams[5],
+                                               (int)((long)memParams[7]),(int)((long)memParams[8]),
+                                               (int)((long)memParams[9]),&resp2);
+                    if (delay < 0) {
+                        r = 16;
+                    } else {
+                        if (reqid[0] == 0x00) {
+                            sprintf(reqid,"DF%06d",__sync_fetch_and_add(&startReqidCnt,1) % 1000000);
+                        }
+                        int l = strlen(reqid);
+                        for (int i = 0; i < 8; i++) {
+                            eibbuf[43+i] = (i < l) ? reqid[i] : ' ';
+                        }
+                        int len = *((int*)memParams[0]);
+                        cob_field *cobvar = (cob_field*)memParams[1];
+                        unsigned char *data = NULL;
+                        if (cobvar != NULL) {
+                            l = ((len >= 0) && (len <= cobvar->size)) ? len : (int)cobvar->size;
+                            data = cobvar->data;
+                        } else {
+                            l = 0;
+                        }
+                        r = scheduleStart(transid,reqid,delay,data,l);
+                    }
+                }
+                if (r >= 0) {
+                    dropDeferredCmd();
+                    startDone = 1;
+                    resp = r;
+                    if (resp > 0) {
+                        abend(resp,resp2);
+                    }
+                }
+            }
+            if (((*cmdState) == -19) && !startDone && (getBackgroundTask() != NULL)) {
+                cmdDefer->noClient = 1;
+                startDone = 1;
+            }
+            if (((*cmdState) == -19) && !startDone) {
+                flushDeferredCmd(childfd);
                 // Send FROM data
                 int len = *((int*)memParams[0]);
                 cob_field *cobvar = (cob_field*)memParams[1];
@@ -1876,7 +5222,7 @@ int execCallback(char *cmd, void *var) {
                   } else {
                     l = cobvar->size;
                   }
-                  write(childfd,cobvar->data,l);
+                  writeCmd(childfd,cobvar->data,l);
                 }
 
                 char buf[2048];
@@ -1951,6 +5297,42 @@ int execCallback(char *cmd, void *var) {
                 }
             }
 
+            if ((*cmdState) == -24) {
+                resp = execCtrCmd(ctrParams,&resp2);
+                if (resp > 0) {
+                  abend(resp,resp2);
+                }
+            }
+            if ((*cmdState) == -25) {
+                resp = execJrnlCmd(jrnlParams);
+                if (resp > 0) {
+                  abend(resp,resp2);
+                }
+            }
+            if ((*cmdState) == -26) {
+                resp = execFcCmd(fcParams,fcTask,chnStore,&resp2);
+                if (resp == FC_LOCK_FAILED) {
+                  // Same as for ENQ, victim is backed out and abended
+                  fprintf(stderr,"%s\n","Record lock deadlock or wait timed out");
+                  _execSql("ROLLBACK",pthread_getspecific(childfdKey),0,1);
+                  releaseLocks(UOW,taskLocks);
+                  endFcUow(fcTask);
+                  (*respFieldsState) = 0;
+                  abendTask("AKCS",0,0);
+                }
+                if (resp > 0) {
+                  abend(resp,resp2);
+                }
+            }
+
+            if (cmdDefer->noClient && (resp == 0)) {
+                // Fell back to client after local handling failed
+                resp = 16;
+                resp2 = 0;
+                abend(resp,resp2);
+            }
+            dropDeferredCmd();
+
             // SET EIBRESP and EIBRESP2
             cob_put_u64_compx(resp,&eibbuf[76],4);
             cob_put_u64_compx(resp2,&eibbuf[80],4);
@@ -2048,10 +5430,18 @@ int execCallback(char *cmd, void *var) {
                 xctlParams[0][l] = 0x00;
                 (*xctlState) = 10;
             }
+            if ((((*cmdState) == -3) || ((*cmdState) == -5)) && ((*xctlState) == 3)) {
+                // XCTL/LINK CHANNEL param value
+                getNameParam(cmd,NULL,chnStore->pendingChannel,CHN_NAME_LEN);
+                (*xctlState) = 10;
+            }
             if ((*cmdState) == -3) {
                 if (strstr(cmd,"PROGRAM")) {
                     (*xctlState) = 1;
                 }
+                if (strcmp(cmd,"CHANNEL") == 0) {
+                    (*xctlState) = 3;
+                }
             }
             if ((*cmdState) == -4) {
                 if (strstr(cmd,"INTO")) {
@@ -2090,6 +5480,9 @@ int execCallback(char *cmd, void *var) {
               if (strstr(cmd,"COMMAREA")) {
                   (*xctlState) = 2;
               }
+              if (strcmp(cmd,"CHANNEL") == 0) {
+                  (*xctlState) = 3;
+              }
             }
             if (((*cmdState) == -6) && ((*memParamsState) == 3)) {
                 // GETMAIN INITIMG param value
@@ -2163,6 +5556,16 @@ int execCallback(char *cmd, void *var) {
                 (*((int*)memParams[0])) = atoi(cmd);
                 (*memParamsState) = 10;
             }
+            if ((((*cmdState) == -9) || ((*cmdState) == -10)) && ((*memParamsState) == 4)) {
+                // PUT/GET CONTAINER param value
+                getNameParam(cmd,NULL,chnStore->reqContainer,CHN_NAME_LEN);
+                (*memParamsState) = 10;
+            }
+            if ((((*cmdState) == -9) || ((*cmdState) == -10)) && ((*memParamsState) == 5)) {
+                // PUT/GET CHANNEL param value
+                getNameParam(cmd,NULL,chnStore->reqChannel,CHN_NAME_LEN);
+                (*memParamsState) = 10;
+            }
             if ((*cmdState) == -9) {
                 if (strcmp(cmd,"FLENGTH") == 0) {
                     (*memParamsState) = 1;
@@ -2170,6 +5573,17 @@ int execCallback(char *cmd, void *var) {
                 if (strcmp(cmd,"FROM") == 0) {
                     (*memParamsState) = 2;
                 }
+                if (strcmp(cmd,"APPEND") == 0) {
+                    memParams[4] = (void*)1;
+                }
+            }
+            if (((*cmdState) == -9) || ((*cmdState) == -10)) {
+                if (strcmp(cmd,"CONTAINER") == 0) {
+                    (*memParamsState) = 4;
+                }
+                if (strcmp(cmd,"CHANNEL") == 0) {
+                    (*memParamsState) = 5;
+                }
             }
             if (((*cmdState) == -10) && ((*memParamsState) == 1)) {
                 // GET FLENGTH param value
@@ -2287,6 +5701,17 @@ int execCallback(char *cmd, void *var) {
                 (*((int*)memParams[0])) = atoi(cmd);
                 (*memParamsState) = 10;
             }
+            if ((((*cmdState) == -14) || ((*cmdState) == -15) || ((*cmdState) == -16)) &&
+                ((*memParamsState) == 3)) {
+                // QUEUE/QNAME param value
+                getNameParam(cmd,NULL,(char*)memParams[2],TSQ_NAME_LEN);
+                (*memParamsState) = 10;
+            }
+            if ((((*cmdState) == -14) || ((*cmdState) == -15)) && ((*memParamsState) == 4)) {
+                // ITEM param value
+                memParams[4] = (void*)((long)atoi(cmd));
+                (*memParamsState) = 10;
+            }
             if ((*cmdState) == -14) {
                 if (strcmp(cmd,"LENGTH") == 0) {
                     (*memParamsState) = 1;
@@ -2306,6 +5731,9 @@ int execCallback(char *cmd, void *var) {
                 if (strcmp(cmd,"REWRITE") == 0) {
                     memParams[5] = (void*)((long)memParams[5] + 2);
                 }
+                if (strcmp(cmd,"AUXILIARY") == 0) {
+                    memParams[6] = (void*)1;
+                }
             }
             if (((*cmdState) == -15) && ((*memParamsState) == 1)) {
                 // READQ LENGTH param value
@@ -2331,6 +5759,9 @@ int execCallback(char *cmd, void *var) {
                 if (strcmp(cmd,"NEXT") == 0) {
                     memParams[5] = (void*)((long)memParams[5] + 2);
                 }
+                if (strcmp(cmd,"NUMITEMS") == 0) {
+                    (*memParamsState) = 5;
+                }
             }
             if ((*cmdState) == -16) {
                 if ((strcmp(cmd,"QUEUE") == 0) || (strcmp(cmd,"QNAME") == 0)) {
@@ -2341,14 +5772,43 @@ int execCallback(char *cmd, void *var) {
                 }
             }
             if (((*cmdState) == -18) && ((*memParamsState) == 1)) {
+                if ((cmd[0] == '\'') && (cmd[1] != 0x00)) {
+                    // DATESEP/TIMESEP param value
+                    struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+                    if ((long)memParams[2] == 2) {
+                        roParams->timeSep = cmd[1];
+                    } else {
+                        roParams->dateSep = cmd[1];
+                    }
+                }
                 (*memParamsState) = 0;
             }
             if ((*cmdState) == -18) {
+                if ((var == NULL) && (cmd[0] != '\'') && isCmdDeferred()) {
+                    struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+                    if (isLocalReadOnlyOption(roParams->cmd,cmd) && (roParams->num < RO_MAX_PARAMS)) {
+                        memParams[1] = (void*)&paramsBuf[1];
+                        sprintf((char*)memParams[1],"%.15s",cmd);
+                    } else {
+                        // Client owned option, it answers the ones before as well
+                        flushDeferredCmd(childfd);
+                        for (int i = 0; i < roParams->num; i++) {
+                            char buf[2048];
+                            readLine((char*)&buf,childfd);
+                            setReadOnlyValue(buf,roParams->vars[i]);
+                        }
+                        roParams->num = 0;
+                    }
+                }
                 if (strcmp(cmd,"DATESEP") == 0) {
                     (*memParamsState) = 1;
+                    memParams[2] = (void*)1;
+                    ((struct roParams*)pthread_getspecific(roParamsKey))->dateSep = '/';
                 }
                 if (strcmp(cmd,"TIMESEP") == 0) {
                     (*memParamsState) = 1;
+                    memParams[2] = (void*)2;
+                    ((struct roParams*)pthread_getspecific(roParamsKey))->timeSep = ':';
                 }
             }
             if (((*cmdState) == -19) && ((*memParamsState) == 1)) {
@@ -2356,6 +5816,16 @@ int execCallback(char *cmd, void *var) {
                 (*((int*)memParams[0])) = atoi(cmd);
                 (*memParamsState) = 10;
             }
+            if (((*cmdState) == -19) && ((*memParamsState) == 3)) {
+                getNameParam(cmd,NULL,(char*)memParams[3],8);
+            }
+            if (((*cmdState) == -19) && ((*memParamsState) == 4)) {
+                getNameParam(cmd,NULL,(char*)memParams[4],4);
+            }
+            if (((*cmdState) == -19) && ((*memParamsState) >= 5) && ((*memParamsState) <= 9)) {
+                // INTERVAL or TIME value in 5, HOURS, MINUTES, SECONDS in 7-9
+                memParams[((*memParamsState) == 6) ? 5 : (*memParamsState)] = (void*)atol(cmd);
+            }
             if ((*cmdState) == -19) {
                 (*memParamsState) = 10;
 
@@ -2368,6 +5838,35 @@ int execCallback(char *cmd, void *var) {
                 if (strcmp(cmd,"REQID") == 0) {
                   (*memParamsState) = 3;
                 }
+                if (strcmp(cmd,"TRANSID") == 0) {
+                  (*memParamsState) = 4;
+                }
+                if (strcmp(cmd,"INTERVAL") == 0) {
+                  (*memParamsState) = 5;
+                }
+                if (strcmp(cmd,"TIME") == 0) {
+                  (*memParamsState) = 6;
+                  memParams[6] = (void*)START_TIME;
+                }
+                if (strcmp(cmd,"HOURS") == 0) {
+                  (*memParamsState) = 7;
+                }
+                if (strcmp(cmd,"MINUTES") == 0) {
+                  (*memParamsState) = 8;
+                }
+                if (strcmp(cmd,"SECONDS") == 0) {
+                  (*memParamsState) = 9;
+                }
+                if (strcmp(cmd,"AFTER") == 0) {
+                  memParams[6] = (void*)START_AFTER;
+                }
+                if (strcmp(cmd,"AT") == 0) {
+                  memParams[6] = (void*)START_AT;
+                }
+                if ((strcmp(cmd,"TERMID") == 0) && isCmdDeferred()) {
+                  // Local starts run without terminal, client owns the terminal association
+                  flushDeferredCmd(childfd);
+                }
             }
             if ((*cmdState) == -21) {
                 (*memParamsState) = 10;
@@ -2407,9 +5906,9 @@ int execCallback(char *cmd, void *var) {
 
             if (cmdbuf[0] == '\'') {
               // String constant
-              write(childfd,"=",1);
+              writeCmd(childfd,"=",1);
             }
-            write(childfd,cmdbuf,strlen(cmdbuf));
+            writeCmd(childfd,cmdbuf,strlen(cmdbuf));
             cmdbuf[0] = 0x00;
             if ((*cmdState) == -1) {
                 if (strstr(cmd,"MAP=")) {
@@ -2436,12 +5935,12 @@ int execCallback(char *cmd, void *var) {
                     if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) putc('\'',f);
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                 }
                 if (((*cmdState) == -2) && ((*memParamsState) == 0)) {
                     sprintf(end,"%s%s",cmd,"\n");
-                    write(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
                     // Read in client response value
                     char buf[2048];
                     buf[0] = 0x00;
@@ -2463,9 +5962,9 @@ int execCallback(char *cmd, void *var) {
                     (*memParamsState) = 10;
                     char str[20];
                     sprintf((char*)&str,"%s\n","SIZE");
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                     sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -2) && ((*memParamsState) == 1)) {
                     // WRITEQ LENGTH
@@ -2480,8 +5979,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2499,8 +5998,8 @@ int execCallback(char *cmd, void *var) {
                     if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) putc('\'',f);
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     if ((*xctlState) == 1) {
                         // XCTL PROGRAM param value
                         char *progname = (cmdbuf+2);
@@ -2515,13 +6014,24 @@ int execCallback(char *cmd, void *var) {
                         sprintf(xctlParams[0],"%s",progname);
                         (*xctlState) = 10;
                     }
+                    if ((*xctlState) == 3) {
+                        // XCTL CHANNEL param value
+                        getNameParam(cmd,cobvar,chnStore->pendingChannel,CHN_NAME_LEN);
+                        (*xctlState) = 10;
+                    }
                 }
+                if (((*cmdState) == -4) && isCmdDeferred()) {
+                    // Started task data is retrieved locally
+                    if (((*retrieveState) >= 1) && ((*retrieveState) <= 3)) {
+                        memParams[(*retrieveState)] = (void*)cobvar;
+                    }
+                } else
                 if ((*cmdState) == -4) {
                     if ((*retrieveState) == 1) {
                       // INTO
                       sprintf(end,"%d",(int)cobvar->size);
-                      write(childfd,cmdbuf,strlen(cmdbuf));
-                      write(childfd,"\n",1);
+                      writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                      writeCmd(childfd,"\n",1);
                       int i = 0;
                       char c;
                       for (i = 0; i < (size_t)cobvar->size; ) {
@@ -2547,8 +6057,8 @@ int execCallback(char *cmd, void *var) {
                     if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) putc('\'',f);
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     if ((*xctlState) == 1) {
                         // LINK PROGRAM param value
                         char *progname = (cmdbuf+2);
@@ -2563,6 +6073,11 @@ int execCallback(char *cmd, void *var) {
                         sprintf(xctlParams[0],"%s",progname);
                         (*xctlState) = 10;
                     }
+                    if ((*xctlState) == 3) {
+                        // LINK CHANNEL param value
+                        getNameParam(cmd,cobvar,chnStore->pendingChannel,CHN_NAME_LEN);
+                        (*xctlState) = 10;
+                    }
                 }
                 if (((*cmdState) == -5) && ((*xctlState) == 2)) {
                     xctlParams[1] = (char*)cobvar;
@@ -2611,8 +6126,8 @@ int execCallback(char *cmd, void *var) {
                     if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) putc('\'',f);
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                 }
                 if (((*cmdState) == -6) && ((*memParamsState) == 1)) {
                   memParams[1] = (void*)cobvar;
@@ -2631,8 +6146,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2690,8 +6205,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2700,9 +6215,9 @@ int execCallback(char *cmd, void *var) {
                   (*memParamsState) = 10;
                   char str[20];
                   sprintf((char*)&str,"%s\n","SIZE");
-                  write(childfd,str,strlen(str));
+                  writeCmd(childfd,str,strlen(str));
                   sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                  write(childfd,str,strlen(str));
+                  writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -10) && ((*memParamsState) == 1)) {
                     // GET FLENGTH param value
@@ -2717,8 +6232,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     memParams[3] = (void*)cobvar;
                     (*memParamsState) = 10;
@@ -2728,14 +6243,24 @@ int execCallback(char *cmd, void *var) {
                     (*memParamsState) = 10;
                     char str[20];
                     sprintf((char*)&str,"%s\n","SIZE");
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                     sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -10) && ((*memParamsState) == 3)) {
                     memParams[2] = (void*)cobvar;
                     (*memParamsState) = 10;
                 }
+                if ((((*cmdState) == -9) || ((*cmdState) == -10)) && ((*memParamsState) == 4)) {
+                    // PUT/GET CONTAINER param value
+                    getNameParam(cmd,cobvar,chnStore->reqContainer,CHN_NAME_LEN);
+                    (*memParamsState) = 10;
+                }
+                if ((((*cmdState) == -9) || ((*cmdState) == -10)) && ((*memParamsState) == 5)) {
+                    // PUT/GET CHANNEL param value
+                    getNameParam(cmd,cobvar,chnStore->reqChannel,CHN_NAME_LEN);
+                    (*memParamsState) = 10;
+                }
                 if (((*cmdState) == -11) && ((*memParamsState) == 1)) {
                     // ENQ RESOURCE
                     memParams[1] = (void*)cobvar;
@@ -2754,8 +6279,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2777,8 +6302,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2786,14 +6311,20 @@ int execCallback(char *cmd, void *var) {
                     memParams[3] = (void*)cobvar;
                     (*memParamsState) = 10;
                 }
+                if ((((*cmdState) == -14) || ((*cmdState) == -15) || ((*cmdState) == -16)) &&
+                    ((*memParamsState) == 3)) {
+                    // QUEUE/QNAME param value
+                    getNameParam(cmd,cobvar,(char*)memParams[2],TSQ_NAME_LEN);
+                    (*memParamsState) = 10;
+                }
                 if (((*cmdState) == -14) && ((*memParamsState) == 2)) {
                     memParams[1] = (void*)cobvar;
                     (*memParamsState) = 10;
                     char str[20];
                     sprintf((char*)&str,"%s\n","SIZE");
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                     sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -14) && ((*memParamsState) == 1)) {
                     // WRITEQ LENGTH
@@ -2808,8 +6339,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2817,14 +6348,19 @@ int execCallback(char *cmd, void *var) {
                     memParams[3] = (void*)cobvar;
                     (*memParamsState) = 10;
                 }
+                if (((*cmdState) == -15) && ((*memParamsState) == 5)) {
+                    // READQ NUMITEMS
+                    memParams[8] = (void*)cobvar;
+                    (*memParamsState) = 10;
+                }
                 if (((*cmdState) == -15) && ((*memParamsState) == 2)) {
                     memParams[1] = (void*)cobvar;
                     (*memParamsState) = 10;
                     char str[20];
                     sprintf((char*)&str,"%s\n","SIZE");
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                     sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -15) && ((*memParamsState) == 1)) {
                     // READQ LENGTH
@@ -2839,49 +6375,69 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
+                    memParams[7] = (void*)cobvar;
                     (*memParamsState) = 10;
                 }
+                if (((*cmdState) == -18) && ((*memParamsState) == 0) && isCmdDeferred()) {
+                    // Read-Only data answered locally
+                    struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+                    char *opt = (char*)memParams[1];
+                    char buf[256];
+                    if (roParams->num < RO_MAX_PARAMS) {
+                        sprintf(roParams->opt[roParams->num],"%s",opt);
+                        roParams->vars[roParams->num] = cobvar;
+                        roParams->num++;
+                    }
+                    if ((roParams->cmd == RO_FORMATTIME) && (strcmp(opt,"ABSTIME") == 0)) {
+                        roParams->absTime = cob_get_llint(cobvar);
+                    } else
+                    if (roParams->cmd == RO_ASKTIME) {
+                        sprintf(buf,"%lld",roParams->absTime);
+                        setReadOnlyValue(buf,cobvar);
+                    } else
+                    if (roParams->cmd == RO_ASSIGN) {
+                        getAssignValue(opt,buf);
+                        setReadOnlyValue(buf,cobvar);
+                    }
+                    // FORMATTIME output is set at END-EXEC, when separators are known
+                } else
                 if (((*cmdState) == -18) && ((*memParamsState) == 0)) {
                     // General Read-Only data handling
                     char buf[2048];
                     readLine((char*)&buf,childfd);
-
-                    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_ALPHANUMERIC) {
-                        for (int i = 0; i < cobvar->size; i++) {
-                          cobvar->data[i] = buf[i];
-                        }
-                    }
-                    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_NUMERIC) {
-                        char hbuf[256];
-                        cob_put_picx(cobvar->data,cobvar->size,
-                            convertNumeric(buf,cobvar->attr->digits,
-                                           cobvar->attr->scale,hbuf));
-                    }
-                    if (COB_FIELD_TYPE(cobvar) == COB_TYPE_NUMERIC_PACKED) {
-                      long v = atol(buf);
-                      cob_put_s64_comp3(v,cobvar->data,cobvar->size);
-                    }
-                    if (getCobType(cobvar) == COB_TYPE_NUMERIC_BINARY) {
-                      long v = atol(buf);
-                      cob_put_u64_compx(v,cobvar->data,cobvar->size);
-                    }
-                    if (getCobType(cobvar) == COB_TYPE_NUMERIC_COMP5) {
-                      long v = atol(buf);
-                      cob_put_s64_comp5(v,cobvar->data,cobvar->size);
-                    }
+                    setReadOnlyValue(buf,cobvar);
                 }
                 if (((*cmdState) == -18) && ((*memParamsState) == 1)) {
+                    // DATESEP/TIMESEP param value
+                    if (cobvar->size > 0) {
+                        struct roParams *roParams = (struct roParams*)pthread_getspecific(roParamsKey);
+                        if ((long)memParams[2] == 2) {
+                            roParams->timeSep = (char)cobvar->data[0];
+                        } else {
+                            roParams->dateSep = (char)cobvar->data[0];
+                        }
+                    }
                     (*memParamsState) = 0;
                 }
                 if (((*cmdState) == -19) && ((*memParamsState) == 3)) {
                     // START TRANSID REQID
-                    write(childfd,"=",1);
-                    write(childfd,"'",1);
-                    write(childfd,cobvar->data,8);
-                    write(childfd,"'\n",2);
+                    getNameParam("",cobvar,(char*)memParams[3],8);
+                    writeCmd(childfd,"=",1);
+                    writeCmd(childfd,"'",1);
+                    writeCmd(childfd,cobvar->data,8);
+                    writeCmd(childfd,"'\n",2);
+                    (*memParamsState) = 10;
+                }
+                if (((*cmdState) == -19) && ((*memParamsState) == 4)) {
+                    getNameParam("",cobvar,(char*)memParams[4],4);
+                    (*memParamsState) = 10;
+                }
+                if (((*cmdState) == -19) && ((*memParamsState) >= 5) && ((*memParamsState) <= 9)) {
+                    // START INTERVAL/TIME/HOURS/MINUTES/SECONDS
+                    memParams[((*memParamsState) == 6) ? 5 : (*memParamsState)] = (void*)(long)cob_get_int(cobvar);
                     (*memParamsState) = 10;
                 }
                 if (((*cmdState) == -19) && ((*memParamsState) == 2)) {
@@ -2889,9 +6445,9 @@ int execCallback(char *cmd, void *var) {
                     (*memParamsState) = 10;
                     char str[20];
                     sprintf((char*)&str,"%s\n","SIZE");
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                     sprintf((char*)&str,"%s%d\n","=",(int)cobvar->size);
-                    write(childfd,str,strlen(str));
+                    writeCmd(childfd,str,strlen(str));
                 }
                 if (((*cmdState) == -19) && ((*memParamsState) == 1)) {
                     // START TRANSID LENGTH
@@ -2906,8 +6462,8 @@ int execCallback(char *cmd, void *var) {
                     }
                     putc(0x00,f);
                     fclose(f);
-                    write(childfd,cmdbuf,strlen(cmdbuf));
-                    write(childfd,"\n",1);
+                    writeCmd(childfd,cmdbuf,strlen(cmdbuf));
+                    writeCmd(childfd,"\n",1);
                     (*((int*)memParams[0])) = atoi(end);
                     (*memParamsState) = 10;
                 }
@@ -2944,6 +6500,10 @@ int execCallback(char *cmd, void *var) {
 //      write(childfd,cmdbuf,strlen(cmdbuf));
         cmdbuf[strlen(cmdbuf)-1] = 0x00;
         processCmd(cmdbuf,outputVars);
+        sqlParams->num = 0;
+        sqlParams->len = 0;
+        sqlParams->numArrays = 0;
+        sqlParams->nextArray = 0;
         cmdbuf[0] = 0x00;
         (*cmdState) = 0;
         outputVars[0] = NULL; // NULL terminated list
@@ -2951,6 +6511,18 @@ int execCallback(char *cmd, void *var) {
         if ((strlen(cmd) == 0) && (var != NULL)) {
             cob_field *cobvar = (cob_field*)var;
             if ((*cmdState) < 2) {
+                char *stmt = strstr(cmdbuf,"EXEC SQL");
+                int n = -1;
+                if ((stmt != NULL) && (isParamStmt(stmt+9) || isDynamicSqlStmt(stmt+9))) {
+                    n = addSqlParam(sqlParams,cobvar);
+                }
+                if ((n > 0) && sqlParams->nextArray) {
+                    sqlParams->array[n-1] = addSqlArray(sqlParams,cobvar);
+                }
+                sqlParams->nextArray = 0;
+                if (n > 0) {
+                    sprintf(end,"%s%d%s","$",n," ");
+                } else
                 if (COB_FIELD_TYPE(cobvar) == COB_TYPE_GROUP) {
 		    // Treat as VARCHAR field
 		    unsigned int l = (unsigned int)cobvar->data[0];	
@@ -3029,12 +6601,19 @@ int execCallback(char *cmd, void *var) {
                 }
             } else {
                 int index = (*cmdState)-2;
+                int a = sqlParams->nextArray ? addSqlArray(sqlParams,cobvar) : 0;
+                sqlParams->nextArray = 0;
                 if (index <= 98) {
-                    outputVars[index] = cobvar;
+                    // Elements of an array are set by a rowset FETCH
+                    outputVars[index] = (a > 0) ? &sqlParams->arrays[a-1] : cobvar;
                     outputVars[index+1] = NULL;
                 }
                 (*cmdState)++;
             }
+        } else
+        if (strstr(cmd,"#ARRAY")) {
+            // Marker of cobprep, next host variable is the first element of an OCCURS table
+            sqlParams->nextArray = 1;
         } else {
             if (strstr(cmd,"SELECT") || strstr(cmd,"FETCH")) {
                 (*cmdState) = 1;
@@ -3082,6 +6661,7 @@ void initExec(int initCons) {
     pthread_key_create(&runStateKey, NULL);
     pthread_key_create(&cobFieldKey, NULL);
     pthread_key_create(&xctlStateKey, NULL);
+    pthread_key_create(&retrieveStateKey, NULL);
     pthread_key_create(&xctlParamsKey, NULL);
     pthread_key_create(&eibbufKey, NULL);
     pthread_key_create(&linkAreaKey, NULL);
@@ -3101,8 +6681,18 @@ void initExec(int initCons) {
     pthread_key_create(&taskLocksKey, NULL);
     pthread_key_create(&callStackKey, NULL);
     pthread_key_create(&callStackPtrKey, NULL);
-    pthread_key_create(&chnBufListKey, NULL);
-    pthread_key_create(&chnBufListPtrKey, NULL);
+    pthread_key_create(&chnStoreKey, NULL);
+    pthread_key_create(&cmdDeferKey, NULL);
+    pthread_key_create(&roParamsKey, NULL);
+    pthread_key_create(&ctrParamsKey, NULL);
+    pthread_key_create(&jrnlParamsKey, NULL);
+    pthread_key_create(&fcParamsKey, NULL);
+    pthread_key_create(&fcTaskKey, NULL);
+    pthread_key_create(&dtBypassKey, NULL);
+    pthread_key_create(&sqlParamsKey, NULL);
+    pthread_key_create(&sqlCursorsKey, NULL);
+    pthread_key_create(&sqlTxModeKey, NULL);
+    pthread_key_create(&sqlPlansKey, NULL);
 
 #ifndef _USE_ONLY_PROCESSES_
     pthread_mutex_init(&moduleMutex,NULL);
@@ -3118,6 +6708,12 @@ void initExec(int initCons) {
     sharedAllocMemPtr = (int*)sharedMalloc(12,sizeof(int));
     cwa = (unsigned char*)sharedMalloc(13,4096);
     initEnqResources(initCons);
+    initNamedCounters(initCons);
+    initJournals();
+    initFileControl(initCons);
+    initDataTables(initCons);
+    initQueryCache(initCons);
+    initTSQueues(initCons);
 
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
@@ -3127,6 +6723,11 @@ void initExec(int initCons) {
     setUpPool(10, GETENV_STRING(connectStr,"QWICS_DB_CONNECTSTR","dbname=qwics"), initCons);
     currentMap[0] = 0x00;
 
+    // Tasks may start from here on, TD queue triggers already on init
+    initBackgroundTasks();
+    initStartScheduler();
+    initTDQueues(initCons);
+
     GETENV_STRING(cobDateFormat,"QWICS_COBDATEFORMAT","YYYY-MM-dd.hh:mm:ss.uuuu");
 }
 
@@ -3135,7 +6736,18 @@ void clearExec(int initCons) {
 #ifndef _USE_ONLY_PROCESSES_
     pthread_cond_destroy(&waitForModuleChange);
 #endif
+    // No more tasks are started, running ones end before their resources are freed
+    clearStartScheduler();
+    clearBackgroundTasks();
+    clearTDQueues(initCons);
     tearDownPool(initCons);
+    clearEnqResources(initCons);
+    clearNamedCounters(initCons);
+    clearJournals();
+    clearFileControl(initCons);
+    clearDataTables(initCons);
+    clearQueryCache(initCons);
+    clearTSQueues(initCons);
     sharedFree(sharedAllocMem,MEM_POOL_SIZE*sizeof(void*));
     sharedFree(sharedAllocMemLen,MEM_POOL_SIZE*sizeof(int));
     sharedFree(sharedAllocMemPtr,sizeof(int));
@@ -3154,6 +6766,7 @@ void execTransaction(char *name, void *fd, int setCommArea, int parCount) {
     int cmdState = 0;
     int runState = 0;
     int xctlState = 0;
+    int retrieveState = 0;
     char progname[9];
     char *xctlParams[10];
     char eibbuf[150];
@@ -3177,8 +6790,18 @@ void execTransaction(char *name, void *fd, int setCommArea, int parCount) {
     struct taskLock *taskLocks = createTaskLocks();
     int callStackPtr = 0;
     struct callLoadlib callStack[1024];
-    int chnBufListPtr = 0;
-    struct chnBuf chnBufList[256];
+    struct chnStore *chnStore = createChnStore();
+    struct cmdDefer cmdDefer;
+    struct roParams roParams;
+    struct ctrParams ctrParams;
+    struct jrnlParams jrnlParams;
+    struct fcParams fcParams;
+    struct fcTask fcTask;
+    int dtBypass = 0;
+    struct sqlParams sqlParams;
+    struct sqlCursors sqlCursors;
+    struct sqlTxMode sqlTxMode;
+    struct sqlPlans sqlPlans;
     int i = 0;
     for (i= 0; i < 150; i++) eibbuf[i] = 0;
     xctlParams[0] = progname;
@@ -3186,12 +6809,28 @@ void execTransaction(char *name, void *fd, int setCommArea, int parCount) {
     cob_field* outputVars[100];
     outputVars[0] = NULL; // NULL terminated list
     cmdbuf[0] = 0x00;
+    cmdDefer.active = 0;
+    cmdDefer.len = 0;
+    cmdDefer.tokens = 0;
+    cmdDefer.noClient = 0;
+    sqlParams.num = 0;
+    sqlParams.len = 0;
+    sqlParams.numArrays = 0;
+    sqlParams.nextArray = 0;
+    initSqlCursors(&sqlCursors);
+    memset(&sqlPlans,0,sizeof(sqlPlans));
+    sqlTxMode.lazy = 0;
+    sqlTxMode.readOnly = 0;
+    sqlTxMode.isolation = DB_ISOLATION_SERIALIZABLE;
+    sqlTxMode.pipeline = 0;
+    initFcTask(&fcTask,taskLocks);
     pthread_setspecific(childfdKey, fd);
     pthread_setspecific(cmdbufKey, &cmdbuf);
     pthread_setspecific(cmdStateKey, &cmdState);
     pthread_setspecific(runStateKey, &runState);
     pthread_setspecific(cobFieldKey, &outputVars);
     pthread_setspecific(xctlStateKey, &xctlState);
+    pthread_setspecific(retrieveStateKey, &retrieveState);
     pthread_setspecific(xctlParamsKey, &xctlParams);
     pthread_setspecific(eibbufKey, &eibbuf);
     pthread_setspecific(linkAreaKey, linkArea);
@@ -3213,8 +6852,18 @@ void execTransaction(char *name, void *fd, int setCommArea, int parCount) {
     pthread_setspecific(taskLocksKey, taskLocks);
     pthread_setspecific(callStackKey, &callStack);
     pthread_setspecific(callStackPtrKey, &callStackPtr);
-    pthread_setspecific(chnBufListKey, &chnBufList);
-    pthread_setspecific(chnBufListPtrKey, &chnBufListPtr);
+    pthread_setspecific(chnStoreKey, chnStore);
+    pthread_setspecific(cmdDeferKey, &cmdDefer);
+    pthread_setspecific(roParamsKey, &roParams);
+    pthread_setspecific(ctrParamsKey, &ctrParams);
+    pthread_setspecific(jrnlParamsKey, &jrnlParams);
+    pthread_setspecific(fcParamsKey, &fcParams);
+    pthread_setspecific(fcTaskKey, &fcTask);
+    pthread_setspecific(dtBypassKey, &dtBypass);
+    pthread_setspecific(sqlParamsKey, &sqlParams);
+    pthread_setspecific(sqlCursorsKey, &sqlCursors);
+    pthread_setspecific(sqlTxModeKey, &sqlTxMode);
+    pthread_setspecific(sqlPlansKey, &sqlPlans);
 
     // Optionally read in content of commarea
     if (setCommArea == 1) {
@@ -3260,17 +6909,23 @@ void execTransaction(char *name, void *fd, int setCommArea, int parCount) {
     sigemptyset( &a.sa_mask );
     sigaction( SIGSEGV, &a, NULL );
 
-    PGconn *conn = getDBConnection();
-    pthread_setspecific(connKey, (void*)conn);
+    // Connection is acquired and the transaction begun by the first EXEC SQL
+    sqlTxMode.lazy = 1;
+    setSqlTxMode(&sqlTxMode,name);
+    pthread_setspecific(connKey, NULL);
     initMain();
     execLoadModule(name,0,parCount);
     releaseLocks(TASK,taskLocks);
+    endSqlCursors(&sqlCursors,1);
+    freeSqlPlans(&sqlPlans);
     globalCallCleanup();
     clearMain();
     free(allocMem);
     free(linkArea);
-    clearChnBufList();
+    freeChnStore(chnStore);
+    PGconn *conn = (PGconn*)pthread_getspecific(connKey);
     returnDBConnection(conn,1);
+    pthread_setspecific(connKey, NULL);
     // Flush output buffers
     fflush(stdout);
     fflush(stderr);
@@ -3283,6 +6938,7 @@ void execInTransaction(char *name, void *fd, int setCommArea, int parCount) {
     int cmdState = 0;
     int runState = 0;
     int xctlState = 0;
+    int retrieveState = 0;
     char *xctlParams[10];
     char eibbuf[150];
     char *linkArea = malloc(16000000);
@@ -3306,8 +6962,18 @@ void execInTransaction(char *name, void *fd, int setCommArea, int parCount) {
     struct taskLock *taskLocks = createTaskLocks();
     int callStackPtr = 0;
     struct callLoadlib callStack[1024];
-    int chnBufListPtr = 0;
-    struct chnBuf chnBufList[256];
+    struct chnStore *chnStore = createChnStore();
+    struct cmdDefer cmdDefer;
+    struct roParams roParams;
+    struct ctrParams ctrParams;
+    struct jrnlParams jrnlParams;
+    struct fcParams fcParams;
+    struct fcTask fcTask;
+    int dtBypass = 0;
+    struct sqlParams sqlParams;
+    struct sqlCursors sqlCursors;
+    struct sqlTxMode sqlTxMode;
+    struct sqlPlans sqlPlans;
     int i = 0;
     for (i= 0; i < 150; i++) eibbuf[i] = 0;
     xctlParams[0] = progname;
@@ -3315,12 +6981,28 @@ void execInTransaction(char *name, void *fd, int setCommArea, int parCount) {
     cob_field* outputVars[100];
     outputVars[0] = NULL; // NULL terminated list
     cmdbuf[0] = 0x00;
+    cmdDefer.active = 0;
+    cmdDefer.len = 0;
+    cmdDefer.tokens = 0;
+    cmdDefer.noClient = 0;
+    sqlParams.num = 0;
+    sqlParams.len = 0;
+    sqlParams.numArrays = 0;
+    sqlParams.nextArray = 0;
+    initSqlCursors(&sqlCursors);
+    memset(&sqlPlans,0,sizeof(sqlPlans));
+    sqlTxMode.lazy = 0;
+    sqlTxMode.readOnly = 0;
+    sqlTxMode.isolation = DB_ISOLATION_SERIALIZABLE;
+    sqlTxMode.pipeline = 0;
+    initFcTask(&fcTask,taskLocks);
     pthread_setspecific(childfdKey, fd);
     pthread_setspecific(cmdbufKey, &cmdbuf);
     pthread_setspecific(cmdStateKey, &cmdState);
     pthread_setspecific(runStateKey, &runState);
     pthread_setspecific(cobFieldKey, &outputVars);
     pthread_setspecific(xctlStateKey, &xctlState);
+    pthread_setspecific(retrieveStateKey, &retrieveState);
     pthread_setspecific(xctlParamsKey, &xctlParams);
     pthread_setspecific(eibbufKey, &eibbuf);
     pthread_setspecific(linkAreaKey, linkArea);
@@ -3342,8 +7024,18 @@ void execInTransaction(char *name, void *fd, int setCommArea, int parCount) {
     pthread_setspecific(taskLocksKey, taskLocks);
     pthread_setspecific(callStackKey, &callStack);
     pthread_setspecific(callStackPtrKey, &callStackPtr);
-    pthread_setspecific(chnBufListKey, &chnBufList);
-    pthread_setspecific(chnBufListPtrKey, &chnBufListPtr);
+    pthread_setspecific(chnStoreKey, chnStore);
+    pthread_setspecific(cmdDeferKey, &cmdDefer);
+    pthread_setspecific(roParamsKey, &roParams);
+    pthread_setspecific(ctrParamsKey, &ctrParams);
+    pthread_setspecific(jrnlParamsKey, &jrnlParams);
+    pthread_setspecific(fcParamsKey, &fcParams);
+    pthread_setspecific(fcTaskKey, &fcTask);
+    pthread_setspecific(dtBypassKey, &dtBypass);
+    pthread_setspecific(sqlParamsKey, &sqlParams);
+    pthread_setspecific(sqlCursorsKey, &sqlCursors);
+    pthread_setspecific(sqlTxModeKey, &sqlTxMode);
+    pthread_setspecific(sqlPlansKey, &sqlPlans);
 
     // Oprionally read in content of commarea
     if (setCommArea == 1) {
@@ -3389,14 +7081,19 @@ void execInTransaction(char *name, void *fd, int setCommArea, int parCount) {
     sigemptyset( &a.sa_mask );
     sigaction( SIGSEGV, &a, NULL );
 
+    if (setSqlTxMode(&sqlTxMode,name)) {
+        switchSqlTxMode(&sqlTxMode);
+    }
     initMain();
     execLoadModule(name,0,parCount);
     releaseLocks(TASK,taskLocks);
+    endSqlCursors(&sqlCursors,1);
+    freeSqlPlans(&sqlPlans);
     globalCallCleanup();
     clearMain();
     free(allocMem);
     free(linkArea);
-    clearChnBufList();
+    freeChnStore(chnStore);
     // Flush output buffers
     fflush(stdout);
     fflush(stderr);
@@ -22,16 +22,17 @@
 #define _cobexec_h
 
 // Manage load module executor
-void initExec();
-void clearExec();
+void initExec(int initCons);
+void clearExec(int initCons);
 
 // Execute COBOL loadmod in transaction
-void execTransaction(char *name, void *fd);
+void execTransaction(char *name, void *fd, int setCommArea, int parCount);
 
 // Exec COBOL module within an existing DB transaction
-void execInTransaction(char *name, void *fd);
+void execInTransaction(char *name, void *fd, int setCommArea, int parCount);
 
 // Execute SQL pure instruction
-void execSql(char *sql, void *fd);
+void _execSql(char *sql, void *fd, int sendRes, int sync);
+#define execSql(sql, fd) _execSql(sql, fd, 1, 0)
 
 #endif
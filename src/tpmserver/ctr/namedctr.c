@@ -0,0 +1,491 @@
+/*******************************************************************************************/
+/*   QWICS Server Named Counter Service                                                    */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <libpq-fe.h>
+
+#include "namedctr.h"
+#include "../env/envconf.h"
+#include "../shm/shmtpm.h"
+
+int ctr_max_counters = -1;
+#define CTR_MAX_COUNTERS GETENV_NUMBER(ctr_max_counters,"QWICS_COUNTER_MAX",1024)
+int ctr_block = -1;
+#define CTR_BLOCK GETENV_NUMBER(ctr_block,"QWICS_COUNTER_BLOCK",100)
+char *ctrConnectStr = NULL;
+char *ctrDbConnectStr = NULL;
+
+#define CTR_ENTRY(t,i) ((struct ctrEntry*)((char*)(t)+sizeof(struct ctrTable)+(long)(i)*sizeof(struct ctrEntry)))
+#define CTR_CLOSED LLONG_MIN
+
+struct ctrTable *ctrTable = NULL;
+long ctrTableSize = 0;
+
+// Sequence access of this process, outside of any task transaction
+PGconn *ctrConn = NULL;
+pthread_mutex_t ctrConnMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void initNamedCounters(int initCons) {
+    ctrTableSize = sizeof(struct ctrTable)+(long)CTR_MAX_COUNTERS*sizeof(struct ctrEntry);
+    ctrTable = (struct ctrTable*)sharedMalloc(18,ctrTableSize);
+    if (ctrTable == NULL) {
+        printf("%s\n","ERROR: Could not allocate named counter table");
+        return;
+    }
+    if (initCons) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&ctrTable->tableLock,&attr);
+        ctrTable->maxCounters = CTR_MAX_COUNTERS;
+        ctrTable->refills = 0;
+        for (int i = 0; i < ctrTable->maxCounters; i++) {
+            CTR_ENTRY(ctrTable,i)->state = 0;
+            pthread_mutex_init(&CTR_ENTRY(ctrTable,i)->lock,&attr);
+        }
+        pthread_mutexattr_destroy(&attr);
+    }
+    GETENV_STRING(ctrDbConnectStr,"QWICS_DB_CONNECTSTR","dbname=qwics");
+    GETENV_STRING(ctrConnectStr,"QWICS_COUNTER_CONNECTSTR",ctrDbConnectStr);
+}
+
+
+void clearNamedCounters(int initCons) {
+    pthread_mutex_lock(&ctrConnMutex);
+    if (ctrConn != NULL) {
+        PQfinish(ctrConn);
+        ctrConn = NULL;
+    }
+    pthread_mutex_unlock(&ctrConnMutex);
+    if (ctrTable == NULL) {
+        return;
+    }
+    if (initCons && (ctrTable->refills > 0)) {
+        printf("%s%ld\n","Named counter blocks reserved: ",ctrTable->refills);
+    }
+    sharedFree(ctrTable,ctrTableSize);
+    ctrTable = NULL;
+}
+
+
+// Runs a statement on the counter connection, returns NULL on error.
+// Caller must hold ctrConnMutex and clear the result.
+PGresult *execCtrSql(char *sql, char *param) {
+    if ((ctrConn != NULL) && (PQstatus(ctrConn) != CONNECTION_OK)) {
+        PQreset(ctrConn);
+    }
+    if (ctrConn == NULL) {
+        ctrConn = PQconnectdb(ctrConnectStr);
+    }
+    if (PQstatus(ctrConn) != CONNECTION_OK) {
+        printf("ERROR: Named counter connection failed: %s",PQerrorMessage(ctrConn));
+        PQfinish(ctrConn);
+        ctrConn = NULL;
+        return NULL;
+    }
+    const char *params[1] = { param };
+    PGresult *res = PQexecParams(ctrConn,sql,(param != NULL) ? 1 : 0,NULL,params,NULL,NULL,0);
+    if ((PQresultStatus(res) != PGRES_TUPLES_OK) && (PQresultStatus(res) != PGRES_COMMAND_OK)) {
+        printf("ERROR: Named counter: %s",PQerrorMessage(ctrConn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+long long getCtrValue(PGresult *res, int col) {
+    if ((res == NULL) || (PQntuples(res) < 1) || PQgetisnull(res,0,col)) {
+        return LLONG_MIN;
+    }
+    return strtoll(PQgetvalue(res,0,col),NULL,10);
+}
+
+
+// Runs a statement on the quoted sequence name of a counter, returns its
+// first value or LLONG_MIN on error. The name replaces %s in DDL, or is
+// passed as $1 where it is used as a value (e.g. $1::regclass).
+long long execSeqSql(char *fmt, char *name) {
+    char buf[CTR_NAME_LEN+16];
+    sprintf(buf,"%s%s","qwics_ctr_",name);
+    long long val = LLONG_MIN;
+    pthread_mutex_lock(&ctrConnMutex);
+    PGresult *res = execCtrSql("SELECT 1",NULL);
+    if (res != NULL) {
+        PQclear(res);
+        char *seq = PQescapeIdentifier(ctrConn,buf,strlen(buf));
+        if (seq != NULL) {
+            char sql[512];
+            snprintf(sql,sizeof(sql),fmt,seq);
+            res = execCtrSql(sql,(strstr(fmt,"$1") != NULL) ? seq : NULL);
+            PQfreemem(seq);
+            if (res != NULL) {
+                val = (PQresultStatus(res) == PGRES_TUPLES_OK) ? getCtrValue(res,0) : 0;
+                PQclear(res);
+            }
+        }
+    }
+    pthread_mutex_unlock(&ctrConnMutex);
+    return val;
+}
+
+
+// Reserves the next block of a counter, returns its last value or LLONG_MIN
+long long reserveBlock(char *name) {
+    __atomic_add_fetch(&ctrTable->refills,1,__ATOMIC_RELAXED);
+    return execSeqSql("SELECT nextval($1::regclass)",name);
+}
+
+
+// Moves the sequence, so the next reserved block starts at value
+int resetSequence(char *name, long long value) {
+    char fmt[128];
+    sprintf(fmt,"%s%lld%s","SELECT setval($1::regclass,",value-1,",true)");
+    return (execSeqSql(fmt,name) == LLONG_MIN) ? -1 : 0;
+}
+
+
+void copyCtrName(char *dest, char *src) {
+    int l = strlen(src);
+    if (l > CTR_NAME_LEN) l = CTR_NAME_LEN;
+    while ((l > 0) && (src[l-1] == ' ')) l--;
+    memcpy(dest,src,l);
+    dest[l] = 0x00;
+}
+
+
+unsigned int hashCtrName(char *name) {
+    unsigned int h = 2166136261U;
+    for (int i = 0; name[i] != 0x00; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619U;
+    }
+    return h;
+}
+
+
+// Entries never move, so lookups of existing counters need no table lock
+struct ctrEntry *findCounter(char *name, int *slot) {
+    struct ctrTable *t = ctrTable;
+    int start = hashCtrName(name) % t->maxCounters;
+    if (slot != NULL) {
+        *slot = -1;
+    }
+    for (int n = 0; n < t->maxCounters; n++) {
+        int i = (start + n) % t->maxCounters;
+        struct ctrEntry *e = CTR_ENTRY(t,i);
+        int state = __atomic_load_n(&e->state,__ATOMIC_ACQUIRE);
+        if (state == 0) {
+            if (slot != NULL) {
+                *slot = i;
+            }
+            return NULL;
+        }
+        if (strcmp(e->name,name) == 0) {
+            if (state == 1) {
+                return e;
+            }
+            // Slot of a deleted counter is only reused by the same name
+            if (slot != NULL) {
+                *slot = i;
+            }
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+
+void setCounter(struct ctrEntry *e, long long next, long long limit) {
+    // Close the block first, so no task assigns from a mix of old and new bounds
+    __atomic_store_n(&e->limit,CTR_CLOSED,__ATOMIC_SEQ_CST);
+    __atomic_store_n(&e->next,next,__ATOMIC_SEQ_CST);
+    __atomic_store_n(&e->limit,limit,__ATOMIC_SEQ_CST);
+}
+
+
+struct ctrEntry *addCounter(int slot, char *name, long long next, long long minimum,
+                            long long maximum, long long block) {
+    struct ctrEntry *e = CTR_ENTRY(ctrTable,slot);
+    sprintf(e->name,"%s",name);
+    e->next = next;
+    e->limit = next-1;
+    e->minimum = minimum;
+    e->maximum = maximum;
+    e->block = block;
+    __atomic_store_n(&e->state,1,__ATOMIC_RELEASE);
+    return e;
+}
+
+
+// Counters defined before a restart are restored from their sequence,
+// values of a block reserved but not assigned before are skipped
+struct ctrEntry *lookupCounter(char *name) {
+    struct ctrEntry *e = findCounter(name,NULL);
+    if ((e != NULL) || (ctrTable == NULL)) {
+        return e;
+    }
+    pthread_mutex_lock(&ctrTable->tableLock);
+    int slot = -1;
+    e = findCounter(name,&slot);
+    if ((e == NULL) && (slot >= 0)) {
+        char seq[CTR_NAME_LEN+16];
+        sprintf(seq,"%s%s","qwics_ctr_",name);
+        pthread_mutex_lock(&ctrConnMutex);
+        PGresult *res = execCtrSql("SELECT min_value, max_value, increment_by, "
+                                   "coalesce(last_value,start_value) FROM pg_sequences "
+                                   "WHERE schemaname = current_schema() AND sequencename = $1",seq);
+        if ((res != NULL) && (PQntuples(res) > 0)) {
+            long long block = getCtrValue(res,2);
+            e = addCounter(slot,name,getCtrValue(res,3)+1,getCtrValue(res,0)+1,
+                           getCtrValue(res,1)-block,block);
+        }
+        if (res != NULL) {
+            PQclear(res);
+        }
+        pthread_mutex_unlock(&ctrConnMutex);
+    }
+    pthread_mutex_unlock(&ctrTable->tableLock);
+    return e;
+}
+
+
+int defineCounter(char *name, long long value, long long minimum, long long maximum, int *resp2) {
+    *resp2 = 0;
+    if (ctrTable == NULL) {
+        return 53;   // SYSIDERR
+    }
+    long long block = CTR_BLOCK;
+    if (maximum > LLONG_MAX - block) {
+        // Doubleword counters are limited to the range of a sequence
+        maximum = LLONG_MAX - block;
+    }
+    if ((minimum == LLONG_MIN) || (minimum > maximum) ||
+        (value < minimum) || (value > maximum)) {
+        return 16;   // INVREQ
+    }
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    if (lookupCounter(cname) != NULL) {
+        return 14;   // DUPREC
+    }
+
+    pthread_mutex_lock(&ctrTable->tableLock);
+    int slot = -1;
+    int resp = 0;
+    if (findCounter(cname,&slot) != NULL) {
+        resp = 14;
+    } else
+    if (slot < 0) {
+        resp = 16;
+        *resp2 = 1;  // Counter table full
+    } else {
+        // The sequence holds the last reserved value, a block starts behind it
+        char fmt[256];
+        sprintf(fmt,"%s%lld%s%lld%s%lld%s%lld",
+                "CREATE SEQUENCE %s AS bigint INCREMENT BY ",block,
+                " MINVALUE ",minimum-1," MAXVALUE ",maximum+block," START WITH ",value-1);
+        if ((execSeqSql(fmt,cname) == LLONG_MIN) || (resetSequence(cname,value) < 0)) {
+            resp = 53;
+        } else {
+            addCounter(slot,cname,value,minimum,maximum,block);
+        }
+    }
+    pthread_mutex_unlock(&ctrTable->tableLock);
+    return resp;
+}
+
+
+int deleteCounter(char *name, int *resp2) {
+    *resp2 = 0;
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    struct ctrEntry *e = lookupCounter(cname);
+    if (e == NULL) {
+        return 13;   // NOTFND
+    }
+    pthread_mutex_lock(&ctrTable->tableLock);
+    pthread_mutex_lock(&e->lock);
+    int resp = 0;
+    if (execSeqSql("DROP SEQUENCE IF EXISTS %s",cname) == LLONG_MIN) {
+        resp = 53;
+    } else {
+        __atomic_store_n(&e->state,2,__ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&e->lock);
+    pthread_mutex_unlock(&ctrTable->tableLock);
+    return resp;
+}
+
+
+// Assigns under the counter lock, reserving further blocks as needed
+int assignSlow(struct ctrEntry *e, long long increment, int opts, long long compMin,
+               long long compMax, long long *value, int *resp2) {
+    int resp = 0;
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        long long v = __atomic_load_n(&e->next,__ATOMIC_SEQ_CST);
+        long long lim = __atomic_load_n(&e->limit,__ATOMIC_SEQ_CST);
+        long long inc = increment;
+        if ((opts & CTR_COMPAREMIN) && (v < compMin)) {
+            resp = 72;   // SUPPRESSED
+            *resp2 = 102;
+            break;
+        }
+        if ((opts & CTR_COMPAREMAX) && (v > compMax)) {
+            resp = 72;
+            *resp2 = 103;
+            break;
+        }
+        if (v > e->maximum - inc + 1) {
+            if ((opts & CTR_REDUCE) && (v <= e->maximum)) {
+                inc = e->maximum - v + 1;
+            } else
+            if (opts & CTR_WRAP) {
+                if (resetSequence(e->name,e->minimum) < 0) {
+                    resp = 53;
+                    break;
+                }
+                setCounter(e,e->minimum,e->minimum-1);
+                continue;
+            } else {
+                resp = 72;
+                *resp2 = 101;   // Counter at limit
+                break;
+            }
+        }
+        if (v + inc - 1 > lim) {
+            long long hwm = reserveBlock(e->name);
+            if (hwm == LLONG_MIN) {
+                resp = 53;
+                break;
+            }
+            if (hwm - e->block == lim) {
+                // Contiguous block, the current one is just extended
+                __atomic_store_n(&e->limit,hwm,__ATOMIC_SEQ_CST);
+            } else {
+                // Blocks in between were reserved by other nodes
+                setCounter(e,hwm - e->block + 1,hwm);
+            }
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&e->next,&v,v+inc,0,__ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST)) {
+            *value = v;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&e->lock);
+    return resp;
+}
+
+
+int getCounter(char *name, long long increment, int opts, long long compMin, long long compMax,
+               long long *value, int *resp2) {
+    *resp2 = 0;
+    if (increment < 0) {
+        return 16;
+    }
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    struct ctrEntry *e = lookupCounter(cname);
+    if (e == NULL) {
+        return (ctrTable == NULL) ? 53 : 13;
+    }
+    if ((opts & (CTR_COMPAREMIN | CTR_COMPAREMAX)) == 0) {
+        // Fast path, values are assigned from the reserved block without locking
+        for (;;) {
+            long long v = __atomic_load_n(&e->next,__ATOMIC_SEQ_CST);
+            long long lim = __atomic_load_n(&e->limit,__ATOMIC_SEQ_CST);
+            if ((lim == CTR_CLOSED) || (v > lim - increment + 1) || (v > e->maximum - increment + 1)) {
+                break;
+            }
+            if (__atomic_compare_exchange_n(&e->next,&v,v+increment,0,
+                                            __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST)) {
+                *value = v;
+                return 0;
+            }
+        }
+    }
+    return assignSlow(e,increment,opts,compMin,compMax,value,resp2);
+}
+
+
+int updateCounter(char *name, long long value, int opts, long long compMin, long long compMax,
+                  int *resp2) {
+    *resp2 = 0;
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    struct ctrEntry *e = lookupCounter(cname);
+    if (e == NULL) {
+        return (ctrTable == NULL) ? 53 : 13;
+    }
+    if ((value < e->minimum) || (value > e->maximum)) {
+        return 16;
+    }
+    int resp = 0;
+    pthread_mutex_lock(&e->lock);
+    long long v = __atomic_load_n(&e->next,__ATOMIC_SEQ_CST);
+    if ((opts & CTR_COMPAREMIN) && (v < compMin)) {
+        resp = 72;
+        *resp2 = 102;
+    } else
+    if ((opts & CTR_COMPAREMAX) && (v > compMax)) {
+        resp = 72;
+        *resp2 = 103;
+    } else
+    if (resetSequence(cname,value) < 0) {
+        resp = 53;
+    } else {
+        setCounter(e,value,value-1);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return resp;
+}
+
+
+int rewindCounter(char *name, int *resp2) {
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    struct ctrEntry *e = lookupCounter(cname);
+    if (e == NULL) {
+        *resp2 = 0;
+        return (ctrTable == NULL) ? 53 : 13;
+    }
+    return updateCounter(cname,e->minimum,0,0,0,resp2);
+}
+
+
+int queryCounter(char *name, long long *value, long long *minimum, long long *maximum, int *resp2) {
+    *resp2 = 0;
+    char cname[CTR_NAME_LEN+1];
+    copyCtrName(cname,name);
+    struct ctrEntry *e = lookupCounter(cname);
+    if (e == NULL) {
+        return (ctrTable == NULL) ? 53 : 13;
+    }
+    *value = __atomic_load_n(&e->next,__ATOMIC_SEQ_CST);
+    *minimum = e->minimum;
+    *maximum = e->maximum;
+    return 0;
+}
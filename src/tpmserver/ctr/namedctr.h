@@ -0,0 +1,66 @@
+/*******************************************************************************************/
+/*   QWICS Server Named Counter Service                                                    */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _namedctr_h
+#define _namedctr_h
+
+#include <pthread.h>
+
+#define CTR_NAME_LEN 16
+
+// Options of GET and UPDATE COUNTER
+#define CTR_WRAP 1
+#define CTR_REDUCE 2
+#define CTR_COMPAREMIN 4
+#define CTR_COMPAREMAX 8
+
+// Values are handed out from [next,limit] in shared memory, the block is
+// reserved in the PostgreSQL sequence of the counter before it is used
+struct ctrEntry {
+    char name[CTR_NAME_LEN+1];
+    int state;            // 0 = free, 1 = used, 2 = deleted
+    pthread_mutex_t lock;
+    long long next;       // Next value to assign
+    long long limit;      // Last value of the reserved block
+    long long minimum;
+    long long maximum;
+    long long block;      // Sequence increment
+};
+
+struct ctrTable {
+    int maxCounters;
+    pthread_mutex_t tableLock;
+    long refills;
+};
+
+void initNamedCounters(int initCons);
+void clearNamedCounters(int initCons);
+
+// All functions return the CICS RESP code and set RESP2
+int defineCounter(char *name, long long value, long long minimum, long long maximum, int *resp2);
+int getCounter(char *name, long long increment, int opts, long long compMin, long long compMax,
+               long long *value, int *resp2);
+int updateCounter(char *name, long long value, int opts, long long compMin, long long compMax,
+                  int *resp2);
+int rewindCounter(char *name, int *resp2);
+int queryCounter(char *name, long long *value, long long *minimum, long long *maximum, int *resp2);
+int deleteCounter(char *name, int *resp2);
+
+#endif
@@ -18,113 +18,783 @@
 /*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
 /*******************************************************************************************/
 
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <libpq-events.h>
+
 #include "conpool.h"
+#include "../env/envconf.h"
 
+#define STMT_BUCKETS 256
 
-void safeExit(PGconn *conn)
-{
-    PQfinish(conn);
-    exit(1);
-}
+int stmt_cache_size = -1;
+#define STMT_CACHE_SIZE GETENV_NUMBER(stmt_cache_size,"QWICS_STMT_CACHE_SIZE",512)
+// Max. statements queued in pipeline mode before waiting for their results, 0 disables.
+// Only used by the programs and TRNIDs listed in QWICS_DB_PIPELINE_TASKS.
+int db_pipeline = -1;
+#define DB_PIPELINE GETENV_NUMBER(db_pipeline,"QWICS_DB_PIPELINE",256)
+
+// Pool sizing, the max. defaults to the size requested by setUpPool
+int poolDefaultSize = 10;
+int db_pool_min = -1;
+#define DB_POOL_MIN GETENV_NUMBER(db_pool_min,"QWICS_DB_POOL_MIN",2)
+int db_pool_max = -1;
+#define DB_POOL_MAX GETENV_NUMBER(db_pool_max,"QWICS_DB_POOL_MAX",poolDefaultSize)
+// Seconds an idle connection above the min. is kept open
+int db_pool_idle_timeout = -1;
+#define DB_POOL_IDLE_TIMEOUT GETENV_NUMBER(db_pool_idle_timeout,"QWICS_DB_POOL_IDLE_TIMEOUT",300)
+int db_health_interval = -1;
+#define DB_HEALTH_INTERVAL GETENV_NUMBER(db_health_interval,"QWICS_DB_HEALTH_INTERVAL",30)
+int db_connect_timeout = -1;
+#define DB_CONNECT_TIMEOUT GETENV_NUMBER(db_connect_timeout,"QWICS_DB_CONNECT_TIMEOUT",30)
+// Hot standby replicas, each gets a pool of the same size as the primary
+#define DB_MAX_REPLICAS 16
+char *db_replicas = NULL;
+#define DB_REPLICAS GETENV_STRING(db_replicas,"QWICS_DB_REPLICA_CONNECTSTRS","")
+int db_replica_max_lag = -1;
+#define DB_REPLICA_MAX_LAG GETENV_NUMBER(db_replica_max_lag,"QWICS_DB_REPLICA_MAX_LAG",5)
+int db_replica_lag_interval = -1;
+#define DB_REPLICA_LAG_INTERVAL GETENV_NUMBER(db_replica_lag_interval,"QWICS_DB_REPLICA_LAG_INTERVAL",1)
+// Directory of the SQL catalogs bound by sqlbind
+char *sql_catalog_dir = NULL;
+#define SQL_CATALOG_DIR GETENV_STRING(sql_catalog_dir,"QWICS_SQLCATDIR","../loadmod")
+
+
+// Prepared statement of a connection, named qwics_<id>
+struct stmtEntry {
+    char *sql;
+    unsigned int hash;
+    int id;
+    long lastUse;
+    int pending;               // Prepared in a pipeline not yet synchronized
+    int binary;                // Result columns can be read in binary format, -1 if not known yet
+    struct stmtEntry *next;
+};
 
+struct stmtCache {
+    struct stmtEntry *buckets[STMT_BUCKETS];
+    int numStmts;
+    int numPending;
+    int nextId;
+    long useCount;
+};
 
-// Pool datacstructure;
+// Pool datacstructure, slots without connection have conn NULL
 struct conRec {
     PGconn *conn;
+    struct dbPool *pool;
     int used;
-} *pool;
+    int readOnly;              // Current transaction is READ ONLY
+    int isolation;             // DB_ISOLATION_* of the current transaction
+    int txStmts;               // Statements executed in the current transaction
+    struct stmtCache *stmts;   // Only used by the task holding the connection
+    int queued;                // Statements sent in pipeline mode without reading results
+    int pipeError;             // A queued statement failed, not yet reported
+    char pipeState[6];
+    time_t lastUse;            // Time the connection was returned
+    time_t lastCheck;
+    struct conRec *next;       // In idle list or free slot list
+};
+
+// Pool of the primary or of one hot standby replica
+struct dbPool {
+    struct conRec *slots;
+    int size;
+    int min;
+    int replica;
+    char *conInfo;
+    // Idle connections are taken from the head, so the ones at the end may be closed
+    struct conRec *idleCons;
+    struct conRec *freeSlots;
+    struct dbPoolStats stats;
+    double lag;                // Replay lag of a replica in seconds, -1 if not reachable
+    PGconn *monitor;           // Replica connection for lag checks
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    pthread_cond_t stop;
+    int stopping;
+    pthread_t healthThread;
+};
+
+// Static statement of a program, prepared on each new connection
+struct catStmt {
+    char *sql;
+    int readOnly;
+};
+
+struct dbPool primaryPool;
+struct dbPool *replicaPools = NULL;
+int numReplicaPools = 0;
+struct catStmt *catStmts = NULL;
+int numCatStmts = 0;
+
+
+// Connection events are not used, the proc only keys the pool record of a connection
+int conEventProc(PGEventId evtId, void *evtInfo, void *passThrough) {
+    return 1;
+}
+
+
+struct conRec *getConRec(PGconn *conn) {
+    if (conn == NULL) {
+        return NULL;
+    }
+    return (struct conRec*)PQinstanceData(conn,conEventProc);
+}
+
+
+// Prepared statements are lost with the session
+void clearStmtCache(struct stmtCache *cache) {
+    for (int b = 0; b < STMT_BUCKETS; b++) {
+        struct stmtEntry *e = cache->buckets[b];
+        while (e != NULL) {
+            struct stmtEntry *n = e->next;
+            free(e->sql);
+            free(e);
+            e = n;
+        }
+        cache->buckets[b] = NULL;
+    }
+    cache->numStmts = 0;
+    cache->numPending = 0;
+}
+
+
+void prepareSqlCatalog(struct conRec *rec);
+
+
+void attachConnection(struct conRec *rec, PGconn *conn) {
+    rec->conn = conn;
+    rec->used = 0;
+    rec->queued = 0;
+    rec->pipeError = 0;
+    rec->lastUse = time(NULL);
+    rec->lastCheck = rec->lastUse;
+    clearStmtCache(rec->stmts);
+    PQregisterEventProc(conn,conEventProc,"qwics",NULL);
+    PQsetInstanceData(conn,conEventProc,rec);
+    prepareSqlCatalog(rec);
+}
 
-int poolSize = 0;
 
-sem_t *poolAccess;
+void closeConnection(struct conRec *rec) {
+    if (rec->conn != NULL) {
+        PQfinish(rec->conn);
+    }
+    rec->conn = NULL;
+    clearStmtCache(rec->stmts);
+}
+
+
+// Opens connections for the slots in parallel with non-blocking connects, returns
+// the number opened. Slots of failed connects keep conn NULL.
+int connectParallel(struct dbPool *pool, struct conRec **recs, int n) {
+    PGconn *conns[n];
+    PostgresPollingStatusType st[n];
+    struct pollfd fds[n];
+    int idx[n];
+    int pending = 0;
+    int ok = 0;
+    for (int i = 0; i < n; i++) {
+        conns[i] = PQconnectStart(pool->conInfo);
+        if ((conns[i] == NULL) || (PQstatus(conns[i]) == CONNECTION_BAD)) {
+            st[i] = PGRES_POLLING_FAILED;
+        } else {
+            st[i] = PGRES_POLLING_WRITING;
+            pending++;
+        }
+    }
+    time_t deadline = time(NULL) + DB_CONNECT_TIMEOUT;
+    while ((pending > 0) && (time(NULL) < deadline)) {
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+            if ((st[i] == PGRES_POLLING_READING) || (st[i] == PGRES_POLLING_WRITING)) {
+                fds[k].fd = PQsocket(conns[i]);
+                fds[k].events = (st[i] == PGRES_POLLING_READING) ? POLLIN : POLLOUT;
+                fds[k].revents = 0;
+                idx[k++] = i;
+            }
+        }
+        if ((poll(fds,k,1000) < 0) && (errno != EINTR)) {
+            break;
+        }
+        for (int j = 0; j < k; j++) {
+            if (fds[j].revents != 0) {
+                int i = idx[j];
+                st[i] = PQconnectPoll(conns[i]);
+                if ((st[i] == PGRES_POLLING_OK) || (st[i] == PGRES_POLLING_FAILED)) {
+                    pending--;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (st[i] == PGRES_POLLING_OK) {
+            attachConnection(recs[i],conns[i]);
+            ok++;
+        } else {
+            printf("ERROR: Connection to database failed: %s",
+                   (conns[i] != NULL) ? PQerrorMessage(conns[i]) : "out of memory\n");
+            if (conns[i] != NULL) {
+                PQfinish(conns[i]);
+            }
+            recs[i]->conn = NULL;
+        }
+    }
+    return ok;
+}
+
+
+// Called with the pool mutex held
+void putIdle(struct dbPool *pool, struct conRec *rec) {
+    rec->used = 0;
+    rec->next = pool->idleCons;
+    pool->idleCons = rec;
+    pool->stats.idle++;
+    pthread_cond_signal(&pool->available);
+}
+
+
+// Called with the pool mutex held
+void putFreeSlot(struct dbPool *pool, struct conRec *rec) {
+    rec->next = pool->freeSlots;
+    pool->freeSlots = rec;
+    pool->stats.open--;
+}
+
+
+// Opens connections up to the min. pool size
+void fillPool(struct dbPool *pool) {
+    struct conRec *recs[pool->size];
+    int n = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while ((pool->stats.open < pool->min) && (pool->freeSlots != NULL)) {
+        recs[n] = pool->freeSlots;
+        pool->freeSlots = pool->freeSlots->next;
+        pool->stats.open++;
+        n++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    if (n == 0) {
+        return;
+    }
+    connectParallel(pool,recs,n);
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < n; i++) {
+        if (recs[i]->conn != NULL) {
+            putIdle(pool,recs[i]);
+        } else {
+            putFreeSlot(pool,recs[i]);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+// Replay lag of a standby, 0 if it has applied all WAL received or was promoted
+void checkReplicaLag(struct dbPool *pool) {
+    if ((pool->monitor != NULL) && (PQstatus(pool->monitor) != CONNECTION_OK)) {
+        PQreset(pool->monitor);
+    }
+    if (pool->monitor == NULL) {
+        pool->monitor = PQconnectdb(pool->conInfo);
+    }
+    double lag = -1;
+    PGresult *res = PQexec(pool->monitor,
+        "SELECT CASE WHEN NOT pg_is_in_recovery() OR "
+        "pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0 "
+        "ELSE COALESCE(EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp()),0) END");
+    if ((PQresultStatus(res) == PGRES_TUPLES_OK) && (PQntuples(res) == 1)) {
+        lag = atof(PQgetvalue(res,0,0));
+    }
+    PQclear(res);
+    pthread_mutex_lock(&pool->mutex);
+    if ((lag > DB_REPLICA_MAX_LAG) && (pool->lag <= DB_REPLICA_MAX_LAG)) {
+        printf("%s%s%s%f%s\n","WARNING: Replica ",pool->conInfo," lags ",lag," s behind");
+    }
+    pool->lag = lag;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+// Background check of idle connections: broken ones are reconnected, surplus ones
+// closed after the idle timeout and the pool is kept at its min. size
+void *poolHealthCheck(void *arg) {
+    struct dbPool *pool = (struct dbPool*)arg;
+    struct conRec *recs[pool->size];
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME,&ts);
+        // Replica lag is checked more often than idle connections
+        ts.tv_sec += pool->replica ? DB_REPLICA_LAG_INTERVAL : DB_HEALTH_INTERVAL;
+        pthread_cond_timedwait(&pool->stop,&pool->mutex,&ts);
+        if (pool->stopping) {
+            break;
+        }
+
+        time_t now = time(NULL);
+        int n = 0;
+        int open = pool->stats.open;
+        struct conRec **p = &pool->idleCons;
+        while (*p != NULL) {
+            struct conRec *rec = *p;
+            int expired = (open > pool->min) && (now - rec->lastUse >= DB_POOL_IDLE_TIMEOUT);
+            if (expired || (now - rec->lastCheck >= DB_HEALTH_INTERVAL)) {
+                *p = rec->next;
+                pool->stats.idle--;
+                rec->used = expired ? -1 : 1;
+                recs[n++] = rec;
+                if (expired) {
+                    open--;
+                }
+            } else {
+                p = &rec->next;
+            }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (int i = 0; i < n; i++) {
+            if (recs[i]->used < 0) {
+                closeConnection(recs[i]);
+                continue;
+            }
+            PGresult *res = PQexec(recs[i]->conn,"");
+            if ((PQresultStatus(res) != PGRES_EMPTY_QUERY) || (PQstatus(recs[i]->conn) != CONNECTION_OK)) {
+                printf("%s\n","WARNING: Reconnecting broken database connection");
+                PQreset(recs[i]->conn);
+                clearStmtCache(recs[i]->stmts);
+                if (PQstatus(recs[i]->conn) != CONNECTION_OK) {
+                    closeConnection(recs[i]);
+                }
+            }
+            PQclear(res);
+            recs[i]->lastCheck = now;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        for (int i = 0; i < n; i++) {
+            if (recs[i]->conn != NULL) {
+                putIdle(pool,recs[i]);
+            } else {
+                putFreeSlot(pool,recs[i]);
+            }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        fillPool(pool);
+        if (pool->replica) {
+            checkReplicaLag(pool);
+        }
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+
+void initPool(struct dbPool *pool, char *conInfo, int replica, int initCons) {
+    pool->conInfo = strdup(conInfo);
+    pool->size = (DB_POOL_MAX > 0) ? DB_POOL_MAX : 1;
+    pool->min = (DB_POOL_MIN < 0) ? 0 : ((DB_POOL_MIN > pool->size) ? pool->size : DB_POOL_MIN);
+    pool->replica = replica;
+    pool->lag = replica ? -1 : 0;
+    pool->monitor = NULL;
+
+    pool->slots = calloc(pool->size,sizeof(struct conRec));
+    if (pool->slots == NULL) {
+        printf("%s%d%s\n","ERROR: Could not allocate connection pool with ",pool->size," connections!");
+        exit(1);
+    }
+    memset(&pool->stats,0,sizeof(pool->stats));
+    pool->idleCons = NULL;
+    pool->freeSlots = NULL;
+    for (int i = pool->size-1; i >= 0; i--) {
+        pool->slots[i].conn = NULL;
+        pool->slots[i].pool = pool;
+        pool->slots[i].stmts = (struct stmtCache*)calloc(1,sizeof(struct stmtCache));
+        pool->slots[i].next = pool->freeSlots;
+        pool->freeSlots = &pool->slots[i];
+    }
+    pthread_mutex_init(&pool->mutex,NULL);
+    pthread_cond_init(&pool->available,NULL);
+    pthread_cond_init(&pool->stop,NULL);
+
+    // Open min. connections in parallel, more are opened on demand
+    if (initCons) {
+        fillPool(pool);
+        if (pool->stats.idle < pool->min) {
+            printf("%s%d%s%d%s%s\n","WARNING: Only ",pool->stats.idle," of ",pool->min,
+                   " database connections opened to ",pool->conInfo);
+        }
+        if (replica) {
+            checkReplicaLag(pool);
+        }
+    }
+    pool->stopping = 0;
+    pthread_create(&pool->healthThread,NULL,poolHealthCheck,pool);
+}
+
+
+void clearPool(struct dbPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_signal(&pool->stop);
+    pthread_mutex_unlock(&pool->mutex);
+    pthread_join(pool->healthThread,NULL);
+
+    // Ensure no transcations are currently processed, wait for completion
+    pthread_mutex_lock(&pool->mutex);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    ts.tv_sec += 10;
+    while (pool->stats.idle < pool->stats.open) {
+        if (pthread_cond_timedwait(&pool->available,&pool->mutex,&ts) != 0) {
+            break;
+        }
+    }
+    printf("%s%s%s%ld%s%ld%s%lld%s%lld%s\n","Database pool ",pool->conInfo,": ",pool->stats.acquires,
+           " acquires, ",pool->stats.waits," waits, ",pool->stats.waitNanos/1000," us waited, max. ",
+           pool->stats.maxWaitNanos/1000," us");
+    for (int i = 0; i < pool->size; i++) {
+        closeConnection(&pool->slots[i]);
+        free(pool->slots[i].stmts);
+    }
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->idleCons = NULL;
+    pool->freeSlots = NULL;
+    pool->stats.open = 0;
+    pool->stats.idle = 0;
+    if (pool->monitor != NULL) {
+        PQfinish(pool->monitor);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    free(pool->conInfo);
+}
+
+
+// Reads the statements of all bound SQL catalogs (*.sqlbnd) of the catalog dir
+void loadSqlCatalogs() {
+    DIR *dir = opendir(SQL_CATALOG_DIR);
+    if (dir == NULL) {
+        return;
+    }
+    int size = 0;
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL) {
+        int l = strlen(d->d_name);
+        if ((l < 8) || (strcmp(&d->d_name[l-7],".sqlbnd") != 0)) {
+            continue;
+        }
+        char path[1024];
+        snprintf(path,sizeof(path),"%s/%s",SQL_CATALOG_DIR,d->d_name);
+        FILE *f = fopen(path,"r");
+        if (f == NULL) {
+            printf("%s%s\n","ERROR: Could not open SQL catalog ",path);
+            continue;
+        }
+        char line[8192];
+        while (fgets(line,sizeof(line),f) != NULL) {
+            // <no> <R|W> <number of params> <host variable types> <text>, separated by tabs
+            char *fields[5];
+            int n = 0;
+            fields[n++] = line;
+            for (char *c = line; (*c != 0x00) && (n < 5); c++) {
+                if (*c == '\t') {
+                    *c = 0x00;
+                    fields[n++] = c+1;
+                }
+            }
+            if ((line[0] == '#') || (n < 5)) {
+                continue;
+            }
+            fields[4][strcspn(fields[4],"\r\n")] = 0x00;
+            if (numCatStmts >= size) {
+                size = (size > 0) ? 2*size : 256;
+                catStmts = (struct catStmt*)realloc(catStmts,size*sizeof(struct catStmt));
+            }
+            catStmts[numCatStmts].sql = strdup(fields[4]);
+            catStmts[numCatStmts].readOnly = (fields[1][0] == 'R');
+            numCatStmts++;
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    if (numCatStmts > 0) {
+        printf("%s%d%s%s\n","Preparing ",numCatStmts," catalog statements of ",SQL_CATALOG_DIR);
+    }
+}
 
 
 // Pool management
-void setUpPool(int numCon, char *conInfo) {
+void setUpPool(int numCon, char *conInfo, int initCons) {
     if (conInfo == NULL) {
         conInfo = "dbname = postgres";
     }
-    
-    pool = malloc(sizeof(struct conRec)*numCon);
-    if (pool == NULL) {
-        printf("%s%d%s\n","ERROR: Could not allocate connection pool with ",numCon," connections!");
-        exit(1);
+    poolDefaultSize = numCon;
+    loadSqlCatalogs();
+    initPool(&primaryPool,conInfo,0,initCons);
+
+    // Hot standby replicas for read only transactions, conninfo strings separated by ;
+    char *replicas = strdup(DB_REPLICAS);
+    char *save = NULL;
+    numReplicaPools = 0;
+    replicaPools = (struct dbPool*)calloc(DB_MAX_REPLICAS,sizeof(struct dbPool));
+    for (char *r = strtok_r(replicas,";",&save); (r != NULL) && (numReplicaPools < DB_MAX_REPLICAS);
+         r = strtok_r(NULL,";",&save)) {
+        while (*r == ' ') r++;
+        if (*r != 0x00) {
+            initPool(&replicaPools[numReplicaPools],r,1,initCons);
+            numReplicaPools++;
+        }
     }
-    poolSize = numCon;
-    
-    sem_unlink("pool");
-    poolAccess = sem_open("pool", O_CREAT, 0600, 1);
-    if(poolAccess == SEM_FAILED) {
-        printf("%s\n","ERROR: Could not open pool access semaphore");
-        exit(1);
+    free(replicas);
+}
+
+
+void tearDownPool(int initCons) {
+    for (int i = 0; i < numReplicaPools; i++) {
+        clearPool(&replicaPools[i]);
     }
-    
-    // Open connections
-    int i;
-    for (i = 0; i < poolSize; i++) {
-        pool[i].used = 0;
-        pool[i].conn = PQconnectdb(conInfo);
-        
-        if (PQstatus(pool[i].conn) != CONNECTION_OK) {
-            printf("ERROR: Connection to database failed: %s",
-                    PQerrorMessage(pool[i].conn));
-            safeExit(pool[i].conn);
+    free(replicaPools);
+    replicaPools = NULL;
+    numReplicaPools = 0;
+    clearPool(&primaryPool);
+    for (int i = 0; i < numCatStmts; i++) {
+        free(catStmts[i].sql);
+    }
+    free(catStmts);
+    catStmts = NULL;
+    numCatStmts = 0;
+}
+
+
+void getDBPoolStats(struct dbPoolStats *stats) {
+    pthread_mutex_lock(&primaryPool.mutex);
+    *stats = primaryPool.stats;
+    pthread_mutex_unlock(&primaryPool.mutex);
+}
+
+
+// Statements prepared in a failed pipeline may not exist on the server
+void endPendingStmts(struct stmtCache *cache, int drop) {
+    if (cache->numPending == 0) {
+        return;
+    }
+    for (int b = 0; b < STMT_BUCKETS; b++) {
+        struct stmtEntry **e = &cache->buckets[b];
+        while (*e != NULL) {
+            if ((*e)->pending && drop) {
+                struct stmtEntry *n = (*e)->next;
+                free((*e)->sql);
+                free(*e);
+                *e = n;
+                cache->numStmts--;
+                continue;
+            }
+            (*e)->pending = 0;
+            e = &(*e)->next;
         }
     }
+    cache->numPending = 0;
 }
 
 
-void tearDownPool() {
-    // Ensure no transcations are currently processed, wait for completion
-    sem_wait(poolAccess);
-    
-    int i;
-    for (i = 0; i < poolSize; i++) {
-        PQfinish(pool[i].conn);
+// Reads the results of the queued statements and leaves pipeline mode
+void flushPipeline(struct conRec *rec) {
+    if ((rec == NULL) || (rec->queued == 0)) {
+        return;
+    }
+    PGconn *conn = rec->conn;
+    int synced = 0;
+    if (PQpipelineSync(conn) == 1) {
+        // Results of the statements are separated by NULL, so two in a row mean a broken connection
+        int nulls = 0;
+        while (!synced && (nulls < 2)) {
+            PGresult *res = PQgetResult(conn);
+            if (res == NULL) {
+                nulls++;
+                continue;
+            }
+            nulls = 0;
+            ExecStatusType st = PQresultStatus(res);
+            if (st == PGRES_PIPELINE_SYNC) {
+                synced = 1;
+            } else
+            if ((st == PGRES_FATAL_ERROR) || (st == PGRES_PIPELINE_ABORTED)) {
+                if (!rec->pipeError) {
+                    char *state = PQresultErrorField(res,PG_DIAG_SQLSTATE);
+                    printf("ERROR: Failure while executing queued SQL:\n %s", PQresultErrorMessage(res));
+                    snprintf(rec->pipeState,sizeof(rec->pipeState),"%s",(state != NULL) ? state : "00000");
+                }
+                rec->pipeError = 1;
+            }
+            PQclear(res);
+        }
     }
-    free(pool);
-    
-    sem_post(poolAccess);
-    sem_close(poolAccess);
-    sem_unlink("pool");
+    if (!synced && !rec->pipeError) {
+        printf("ERROR: Pipeline sync failed: %s", PQerrorMessage(conn));
+        sprintf(rec->pipeState,"%s","08006");
+        rec->pipeError = 1;
+    }
+    endPendingStmts(rec->stmts,rec->pipeError);
+    PQexitPipelineMode(conn);
+    rec->queued = 0;
 }
 
 
-// Pool usage: Used connection always forms one transaction
-PGconn *getDBConnection() {
-    PGconn *conn = NULL;
-    while (conn == NULL) {
-        sem_wait(poolAccess);
-        int i;
-        for (i = 0; i < poolSize; i++) {
-            if (pool[i].used == 0) {
-                pool[i].used = 1;
-                conn = pool[i].conn;
-                break;
+// Statements of a transaction bind it to its connection, see switchDBConnection
+void startStmt(struct conRec *rec) {
+    if (rec != NULL) {
+        flushPipeline(rec);
+        rec->txStmts++;
+    }
+}
+
+
+PGconn *acquireConnection(struct dbPool *pool, int readOnly, int isolation) {
+    struct conRec *rec = NULL;
+    struct timespec start;
+    int waited = 0;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stats.acquires++;
+    while (rec == NULL) {
+        if (pool->idleCons != NULL) {
+            rec = pool->idleCons;
+            pool->idleCons = rec->next;
+            pool->stats.idle--;
+        } else
+        if (pool->freeSlots != NULL) {
+            // Pool grows on demand, the connect runs outside of the lock
+            rec = pool->freeSlots;
+            pool->freeSlots = rec->next;
+            pool->stats.open++;
+            pthread_mutex_unlock(&pool->mutex);
+            int ok = connectParallel(pool,&rec,1);
+            pthread_mutex_lock(&pool->mutex);
+            if (!ok) {
+                putFreeSlot(pool,rec);
+                rec = NULL;
+                // Database is not reachable, retry later
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME,&ts);
+                ts.tv_sec += 1;
+                pthread_cond_timedwait(&pool->available,&pool->mutex,&ts);
+            }
+        } else {
+            if (!waited) {
+                clock_gettime(CLOCK_MONOTONIC,&start);
+                pool->stats.waits++;
+                waited = 1;
             }
+            pthread_cond_wait(&pool->available,&pool->mutex);
         }
-        sem_post(poolAccess);
-        if (conn == NULL) {
-          sleep(5);
+    }
+    rec->used = 1;
+    if (waited) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        long long w = (long long)(now.tv_sec-start.tv_sec)*1000000000LL + (now.tv_nsec-start.tv_nsec);
+        pool->stats.waitNanos += w;
+        if (w > pool->stats.maxWaitNanos) {
+            pool->stats.maxWaitNanos = w;
         }
     }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (PQstatus(rec->conn) != CONNECTION_OK) {
+        PQreset(rec->conn);
+        clearStmtCache(rec->stmts);
+        rec->queued = 0;
+        rec->pipeError = 0;
+    }
+    rec->readOnly = readOnly;
+    rec->isolation = isolation;
+    beginDBConnection(rec->conn);
+    return rec->conn;
+}
+
+
+// Pool usage: Used connection always forms one transaction
+PGconn *getDBConnection() {
+    return acquireConnection(&primaryPool,0,DB_ISOLATION_SERIALIZABLE);
+}
+
+
+// Read only transaction, runs on the replica with the least lag within the max. lag
+// that has a connection left, on the primary if there is none
+PGconn *getDBReadOnlyConnection() {
+    return getDBConnectionMode(1,DB_ISOLATION_SERIALIZABLE);
+}
 
+
+PGconn *getDBConnectionMode(int readOnly, int isolation) {
+    struct dbPool *best = NULL;
+    double bestLag = 0;
+    for (int i = 0; readOnly && (i < numReplicaPools); i++) {
+        struct dbPool *pool = &replicaPools[i];
+        pthread_mutex_lock(&pool->mutex);
+        int avail = (pool->idleCons != NULL) || (pool->freeSlots != NULL);
+        double lag = pool->lag;
+        pthread_mutex_unlock(&pool->mutex);
+        if (avail && (lag >= 0) && (lag <= DB_REPLICA_MAX_LAG) && ((best == NULL) || (lag < bestLag))) {
+            best = pool;
+            bestLag = lag;
+        }
+    }
+    return acquireConnection((best != NULL) ? best : &primaryPool,readOnly,isolation);
+}
+
+
+void beginDBConnection(PGconn *conn) {
     PGresult *res;
-    res = PQexec(conn, "START TRANSACTION ISOLATION LEVEL SERIALIZABLE READ WRITE");
+    struct conRec *rec = getConRec(conn);
+    flushPipeline(rec);
+    if (rec != NULL) {
+        char *level = "SERIALIZABLE";
+        if (rec->isolation == DB_ISOLATION_READ_COMMITTED) {
+            level = "READ COMMITTED";
+        } else
+        if ((rec->isolation == DB_ISOLATION_REPEATABLE_READ) || rec->pool->replica) {
+            // SERIALIZABLE is not available on a hot standby
+            level = "REPEATABLE READ";
+        }
+        char sql[80];
+        sprintf(sql,"%s%s%s","START TRANSACTION ISOLATION LEVEL ",level,
+                rec->readOnly ? " READ ONLY" : " READ WRITE");
+        rec->txStmts = 0;
+        res = PQexec(conn, sql);
+    } else {
+        res = PQexec(conn, "START TRANSACTION ISOLATION LEVEL SERIALIZABLE READ WRITE");
+    }
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         printf("ERROR: START TRANSACTION failed: %s", PQerrorMessage(conn));
     }
     PQclear(res);
-    return conn;
 }
 
 
-int returnDBConnection(PGconn *conn, int commit) {
+int endTransaction(PGconn *conn, int commit) {
     int ret = 1;
     PGresult *res;
-    
+    struct conRec *rec = getConRec(conn);
+
+    flushPipeline(rec);
+    if (rec != NULL) {
+        // Failures of queued statements are not reported after the end of the UOW
+        rec->pipeError = 0;
+    }
     if (commit) {
         res = PQexec(conn, "COMMIT");
+        if ((PQresultStatus(res) == PGRES_COMMAND_OK) && (strcmp(PQcmdStatus(res),"ROLLBACK") == 0)) {
+            // Transaction was aborted by a failed statement
+            ret = 0;
+            printf("ERROR: COMMIT of aborted transaction was rolled back\n");
+        } else
         if (PQresultStatus(res) != PGRES_COMMAND_OK) {
             ret = 0;
             printf("ERROR: COMMIT command failed: %s", PQerrorMessage(conn));
@@ -142,22 +812,64 @@ int returnDBConnection(PGconn *conn, int commit) {
         }
     }
     PQclear(res);
+    return ret;
+}
 
-    sem_wait(poolAccess);
-    int i;
-    for (i = 0; i < poolSize; i++) {
-        if (pool[i].conn == conn) {
-            pool[i].used = 0;
-        }
+
+int returnDBConnection(PGconn *conn, int commit) {
+    if (conn == NULL) {
+        // Transaction was never started, nothing to end
+        return 1;
+    }
+    int ret = endTransaction(conn, commit);
+    struct conRec *rec = getConRec(conn);
+    if (rec == NULL) {
+        return ret;
     }
-    sem_post(poolAccess);
+    pthread_mutex_lock(&rec->pool->mutex);
+    rec->lastUse = time(NULL);
+    putIdle(rec->pool,rec);
+    pthread_mutex_unlock(&rec->pool->mutex);
     return ret;
 }
 
 
+// Syncpoint: connection stays with the task, next unit of work starts at once
+int syncDBConnection(PGconn *conn, int commit) {
+    if (conn == NULL) {
+        return 1;
+    }
+    int ret = endTransaction(conn, commit);
+    beginDBConnection(conn);
+    return ret;
+}
+
+
+// Changes the mode of a transaction that has not executed any statement yet, moves it
+// to a connection of the other kind if needed, returns the connection to use
+PGconn *switchDBConnection(PGconn *conn, int readOnly, int isolation) {
+    struct conRec *rec = getConRec(conn);
+    if ((rec == NULL) || (rec->txStmts > 0) || (rec->queued > 0) ||
+        ((rec->readOnly == readOnly) && (rec->isolation == isolation))) {
+        return conn;
+    }
+    if (rec->pool->replica || (readOnly && !rec->readOnly && (numReplicaPools > 0))) {
+        returnDBConnection(conn,0);
+        return getDBConnectionMode(readOnly,isolation);
+    }
+    // Mode of an empty transaction on the same connection is changed by restarting it
+    endTransaction(conn,0);
+    rec->readOnly = readOnly;
+    rec->isolation = isolation;
+    beginDBConnection(conn);
+    return conn;
+}
+
+
 int execSQL(PGconn *conn, char *sql) {
     int ret = 1;
     PGresult *res;
+    startStmt(getConRec(conn));
     res = PQexec(conn, sql);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
@@ -170,6 +882,7 @@ int execSQL(PGconn *conn, char *sql) {
 
 PGresult* execSQLQuery(PGconn *conn, char *sql) {
     PGresult *res;
+    startStmt(getConRec(conn));
     res = PQexec(conn, sql);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
@@ -180,9 +893,24 @@ PGresult* execSQLQuery(PGconn *conn, char *sql) {
 }
 
 
+// Sends a query whose rows are read one by one with PQgetResult until it returns NULL
+int sendSQLQuery(PGconn *conn, char *sql) {
+    startStmt(getConRec(conn));
+    if (PQsendQuery(conn, sql) != 1) {
+        printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        return 0;
+    }
+    if (PQsetSingleRowMode(conn) != 1) {
+        printf("WARNING: Single row mode not available for SQL %s\n", sql);
+    }
+    return 1;
+}
+
+
 char* execSQLCmd(PGconn *conn, char *sql) {
     char *ret = NULL;
     PGresult *res;
+    startStmt(getConRec(conn));
     res = PQexec(conn, sql);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
@@ -192,3 +920,341 @@ char* execSQLCmd(PGconn *conn, char *sql) {
     PQclear(res);
     return ret;
 }
+
+
+struct stmtCache *getStmtCache(PGconn *conn) {
+    struct conRec *rec = getConRec(conn);
+    return (rec != NULL) ? rec->stmts : NULL;
+}
+
+
+struct stmtEntry *findStmt(struct stmtCache *cache, char *sql, unsigned int *hash) {
+    unsigned int h = 2166136261u;
+    for (char *c = sql; *c != 0x00; c++) {
+        h = (h ^ (unsigned char)*c) * 16777619u;
+    }
+    *hash = h;
+    struct stmtEntry *e = cache->buckets[h % STMT_BUCKETS];
+    while ((e != NULL) && ((e->hash != h) || (strcmp(e->sql,sql) != 0))) {
+        e = e->next;
+    }
+    return e;
+}
+
+
+struct stmtEntry *addStmt(struct stmtCache *cache, char *sql, unsigned int hash) {
+    struct stmtEntry *e = (struct stmtEntry*)malloc(sizeof(struct stmtEntry));
+    e->sql = strdup(sql);
+    e->hash = hash;
+    e->id = cache->nextId++;
+    e->pending = 0;
+    e->binary = -1;
+    e->next = cache->buckets[hash % STMT_BUCKETS];
+    cache->buckets[hash % STMT_BUCKETS] = e;
+    cache->numStmts++;
+    return e;
+}
+
+
+// Prepares the catalog statements on a new connection in one round trip, so tasks find
+// them in the cache. Each has its own sync, a failing one does not abort the others.
+void prepareSqlCatalog(struct conRec *rec) {
+    struct stmtCache *cache = rec->stmts;
+    if ((numCatStmts == 0) || (PQenterPipelineMode(rec->conn) != 1)) {
+        return;
+    }
+    struct stmtEntry *sent[numCatStmts];
+    int n = 0;
+    for (int i = 0; (i < numCatStmts) && (cache->numStmts < STMT_CACHE_SIZE); i++) {
+        unsigned int h;
+        // Replicas only run read only transactions
+        if ((rec->pool->replica && !catStmts[i].readOnly) || (findStmt(cache,catStmts[i].sql,&h) != NULL)) {
+            continue;
+        }
+        struct stmtEntry *e = addStmt(cache,catStmts[i].sql,h);
+        e->lastUse = cache->useCount;
+        e->pending = 1;
+        cache->numPending++;
+        char name[32];
+        sprintf(name,"%s%d","qwics_",e->id);
+        if ((PQsendPrepare(rec->conn,name,e->sql,0,NULL) != 1) || (PQpipelineSync(rec->conn) != 1)) {
+            break;
+        }
+        sent[n++] = e;
+    }
+    int synced = 0;
+    int nulls = 0;
+    while ((synced < n) && (nulls < 2)) {
+        PGresult *res = PQgetResult(rec->conn);
+        if (res == NULL) {
+            nulls++;
+            continue;
+        }
+        nulls = 0;
+        ExecStatusType st = PQresultStatus(res);
+        if (st == PGRES_PIPELINE_SYNC) {
+            synced++;
+        } else
+        if (st == PGRES_COMMAND_OK) {
+            sent[synced]->pending = 0;
+            cache->numPending--;
+        } else {
+            printf("WARNING: Catalog statement not prepared %s:\n %s", sent[synced]->sql, PQresultErrorMessage(res));
+        }
+        PQclear(res);
+    }
+    // The ones not prepared are tried again on first use
+    endPendingStmts(cache,1);
+    PQexitPipelineMode(rec->conn);
+}
+
+
+// Drops the least recently used statement of a full cache
+void evictStmt(PGconn *conn, struct stmtCache *cache) {
+    struct stmtEntry **lru = NULL;
+    for (int b = 0; b < STMT_BUCKETS; b++) {
+        for (struct stmtEntry **e = &cache->buckets[b]; *e != NULL; e = &(*e)->next) {
+            if ((lru == NULL) || ((*e)->lastUse < (*lru)->lastUse)) {
+                lru = e;
+            }
+        }
+    }
+    if (lru == NULL) {
+        return;
+    }
+    struct stmtEntry *victim = *lru;
+    char sql[64];
+    sprintf(sql,"%s%d","DEALLOCATE qwics_",victim->id);
+    PQclear(PQexec(conn,sql));
+    *lru = victim->next;
+    free(victim->sql);
+    free(victim);
+    cache->numStmts--;
+}
+
+
+// Result types the server sends in binary format that are converted to host variables
+int canFetchBinary(PGresult *res) {
+    for (int i = 0; i < PQnfields(res); i++) {
+        switch (PQftype(res,i)) {
+            case DB_OID_INT2:
+            case DB_OID_INT4:
+            case DB_OID_INT8:
+            case DB_OID_NUMERIC:
+            case DB_OID_TEXT:
+            case DB_OID_BPCHAR:
+            case DB_OID_VARCHAR:
+            case DB_OID_NAME:
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Cache entry of a statement, prepared on first use. Returns NULL and the failed
+// result of the prepare in res if it could not be prepared.
+struct stmtEntry *getPreparedStmt(PGconn *conn, struct stmtCache *cache, char *sql, int nParams, PGresult **res) {
+    unsigned int h;
+    struct stmtEntry *e = findStmt(cache,sql,&h);
+    if (e == NULL) {
+        if (cache->numStmts >= STMT_CACHE_SIZE) {
+            evictStmt(conn,cache);
+        }
+        char name[32];
+        sprintf(name,"%s%d","qwics_",cache->nextId);
+        *res = PQprepare(conn,name,sql,nParams,NULL);
+        if (PQresultStatus(*res) != PGRES_COMMAND_OK) {
+            return NULL;
+        }
+        PQclear(*res);
+        e = addStmt(cache,sql,h);
+    }
+    *res = NULL;
+    e->lastUse = cache->useCount++;
+    return e;
+}
+
+
+// Executes a statement prepared on the connection before, prepares it on first use.
+// Results are in binary format if allowed and all column types are known to support it.
+PGresult* execPrepared(PGconn *conn, char *sql, int nParams, char **values, int binary) {
+    struct stmtCache *cache = getStmtCache(conn);
+    if (cache == NULL) {
+        return PQexecParams(conn,sql,nParams,NULL,(const char* const*)values,NULL,NULL,0);
+    }
+    startStmt(getConRec(conn));
+    PGresult *res = NULL;
+    struct stmtEntry *e = getPreparedStmt(conn,cache,sql,nParams,&res);
+    if (e == NULL) {
+        return res;
+    }
+    char name[32];
+    sprintf(name,"%s%d","qwics_",e->id);
+    res = PQexecPrepared(conn,name,nParams,(const char* const*)values,NULL,NULL,
+                                   (binary && (e->binary == 1)) ? 1 : 0);
+    if (binary && (e->binary < 0) && (PQresultStatus(res) == PGRES_TUPLES_OK)) {
+        // Column types are known from the first text result
+        e->binary = canFetchBinary(res);
+    }
+    return res;
+}
+
+
+int execSQLParams(PGconn *conn, char *sql, int nParams, char **values) {
+    int ret = 1;
+    PGresult *res = execPrepared(conn, sql, nParams, values, 0);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        ret = 0;
+    }
+    PQclear(res);
+    return ret;
+}
+
+
+// Prepares a statement of dynamic SQL in the statement cache of the connection,
+// so its executions and descriptions find it there
+int prepareSQL(PGconn *conn, char *sql) {
+    struct stmtCache *cache = getStmtCache(conn);
+    PGresult *res = NULL;
+    startStmt(getConRec(conn));
+    if (cache == NULL) {
+        res = PQprepare(conn,"",sql,0,NULL);
+    } else
+    if (getPreparedStmt(conn,cache,sql,0,&res) != NULL) {
+        return 1;
+    }
+    int ret = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ret) {
+        printf("ERROR: Failure while preparing SQL %s:\n %s", sql, PQerrorMessage(conn));
+    }
+    PQclear(res);
+    return ret;
+}
+
+
+// Param and result column types of a statement, prepared as by prepareSQL
+PGresult* describeSQL(PGconn *conn, char *sql) {
+    struct stmtCache *cache = getStmtCache(conn);
+    char name[32];
+    name[0] = 0x00;
+    if (!prepareSQL(conn,sql)) {
+        return NULL;
+    }
+    if (cache != NULL) {
+        unsigned int h;
+        sprintf(name,"%s%d","qwics_",findStmt(cache,sql,&h)->id);
+    }
+    PGresult *res = PQdescribePrepared(conn,name);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        printf("ERROR: Failure while describing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+PGresult* execSQLQueryParams(PGconn *conn, char *sql, int nParams, char **values) {
+    PGresult *res = execPrepared(conn, sql, nParams, values, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+PGresult* execSQLQueryBinary(PGconn *conn, char *sql, int nParams, char **values) {
+    PGresult *res = execPrepared(conn, sql, nParams, values, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+// FETCH from a cursor, binary is requested by the caller after checking the column types
+PGresult* execSQLFetch(PGconn *conn, char *sql, int binary) {
+    startStmt(getConRec(conn));
+    PGresult *res = PQexecParams(conn,sql,0,NULL,NULL,NULL,NULL,binary ? 1 : 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        printf("ERROR: Failure while executing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+// Queues a statement without waiting for its result (libpq pipeline mode). Results
+// are read at the next statement needing one or at the end of the transaction.
+int execSQLDeferred(PGconn *conn, char *sql, int nParams, char **values) {
+    struct conRec *rec = getConRec(conn);
+    if ((rec == NULL) || (DB_PIPELINE <= 0)) {
+        return execSQLParams(conn, sql, nParams, values);
+    }
+    struct stmtCache *cache = rec->stmts;
+    unsigned int h;
+    struct stmtEntry *e = findStmt(cache,sql,&h);
+    if (((e == NULL) && (cache->numStmts >= STMT_CACHE_SIZE)) || (rec->queued >= DB_PIPELINE)) {
+        // Eviction needs DEALLOCATE outside of the pipeline, results should not pile up
+        flushPipeline(rec);
+        if ((e == NULL) && (cache->numStmts >= STMT_CACHE_SIZE)) {
+            evictStmt(conn,cache);
+        }
+    }
+    if ((rec->queued == 0) && (PQenterPipelineMode(conn) != 1)) {
+        return execSQLParams(conn, sql, nParams, values);
+    }
+    char name[32];
+    if (e == NULL) {
+        e = addStmt(cache,sql,h);
+        sprintf(name,"%s%d","qwics_",e->id);
+        e->pending = 1;
+        cache->numPending++;
+        if (PQsendPrepare(conn,name,sql,nParams,NULL) != 1) {
+            printf("ERROR: Failure while queueing SQL %s:\n %s", sql, PQerrorMessage(conn));
+            rec->queued++;
+            rec->txStmts++;
+            flushPipeline(rec);
+            return 0;
+        }
+    }
+    e->lastUse = cache->useCount++;
+    sprintf(name,"%s%d","qwics_",e->id);
+    rec->queued++;
+    rec->txStmts++;
+    // Queries are buffered by libpq and go out in batches or at the sync
+    if (PQsendQueryPrepared(conn,name,nParams,(const char* const*)values,NULL,NULL,0) != 1) {
+        printf("ERROR: Failure while queueing SQL %s:\n %s", sql, PQerrorMessage(conn));
+        flushPipeline(rec);
+        return 0;
+    }
+    return 1;
+}
+
+
+// Waits for the statements queued by execSQLDeferred, returns 0 and their SQLSTATE
+// if one of them failed
+int syncDBPipeline(PGconn *conn, char *sqlstate) {
+    struct conRec *rec = getConRec(conn);
+    if (rec == NULL) {
+        return 1;
+    }
+    flushPipeline(rec);
+    if (rec->pipeError) {
+        rec->pipeError = 0;
+        if (sqlstate != NULL) {
+            sprintf(sqlstate,"%s",rec->pipeState);
+        }
+        return 0;
+    }
+    return 1;
+}
@@ -30,15 +30,72 @@
 #include <libpq-fe.h>
 
 
-// Pool management
-void setUpPool(int numCon, char *conInfo);
-void tearDownPool();
+// Isolation levels of transactions
+#define DB_ISOLATION_SERIALIZABLE 0
+#define DB_ISOLATION_REPEATABLE_READ 1
+#define DB_ISOLATION_READ_COMMITTED 2
+
+// Type OIDs of result columns read in binary format
+#define DB_OID_NAME 19
+#define DB_OID_INT8 20
+#define DB_OID_INT2 21
+#define DB_OID_INT4 23
+#define DB_OID_TEXT 25
+#define DB_OID_BPCHAR 1042
+#define DB_OID_VARCHAR 1043
+#define DB_OID_NUMERIC 1700
+// Further types described to programs by dynamic SQL
+#define DB_OID_BOOL 16
+#define DB_OID_FLOAT4 700
+#define DB_OID_FLOAT8 701
+#define DB_OID_DATE 1082
+#define DB_OID_TIME 1083
+#define DB_OID_TIMESTAMP 1114
+#define DB_OID_TIMESTAMPTZ 1184
+
+// Wait-time accounting and size of the pool
+struct dbPoolStats {
+    long acquires;
+    long waits;
+    long long waitNanos;
+    long long maxWaitNanos;
+    int open;
+    int idle;
+};
+
+// Pool management, numCon is the default max. size
+void setUpPool(int numCon, char *conInfo, int initCons);
+void tearDownPool(int initCons);
+void getDBPoolStats(struct dbPoolStats *stats);
 
 // Pool usage: Used connection always forms one transaction
 PGconn *getDBConnection();
+// Read only transaction on a hot standby replica if one is configured and not lagging
+PGconn *getDBReadOnlyConnection();
+PGconn *getDBConnectionMode(int readOnly, int isolation);
+// Changes the transaction mode as long as no statement was executed, may replace the connection
+PGconn *switchDBConnection(PGconn *conn, int readOnly, int isolation);
 int returnDBConnection(PGconn *conn, int commit);
+// Ends current transaction and starts a new one on the same connection
+int syncDBConnection(PGconn *conn, int commit);
+void beginDBConnection(PGconn *conn);
 int execSQL(PGconn *conn, char *sql);
 PGresult* execSQLQuery(PGconn *conn, char *sql);
 char* execSQLCmd(PGconn *conn, char *sql);
+// Query in single row mode, results are read with PQgetResult
+int sendSQLQuery(PGconn *conn, char *sql);
+// Statements with $n parameters, prepared once per connection and cached by text
+int execSQLParams(PGconn *conn, char *sql, int nParams, char **values);
+PGresult* execSQLQueryParams(PGconn *conn, char *sql, int nParams, char **values);
+// Dynamic SQL: statements are prepared in the same cache, descriptions are PQdescribePrepared results
+int prepareSQL(PGconn *conn, char *sql);
+PGresult* describeSQL(PGconn *conn, char *sql);
+// Results in binary format once the column types are known, see canFetchBinary
+PGresult* execSQLQueryBinary(PGconn *conn, char *sql, int nParams, char **values);
+PGresult* execSQLFetch(PGconn *conn, char *sql, int binary);
+int canFetchBinary(PGresult *res);
+// Statements without results queued in pipeline mode, failures are returned by the next sync
+int execSQLDeferred(PGconn *conn, char *sql, int nParams, char **values);
+int syncDBPipeline(PGconn *conn, char *sqlstate);
 
 #endif
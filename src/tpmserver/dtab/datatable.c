@@ -0,0 +1,639 @@
+/*******************************************************************************************/
+/*   QWICS Server Shared Data Tables                                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <libpq-fe.h>
+
+#include "datatable.h"
+#include "../env/envconf.h"
+#include "../shm/shmtpm.h"
+
+#define DT_MAGIC 0x44544231
+#define DT_PTR(o) ((char*)dtSpace+(o))
+#define DT_MAX_SELECT 100
+
+// Read only or READ COMMITTED transactions are served from the shared copy,
+// others (SERIALIZABLE by default) always query the DB
+int dt_size = -1;
+#define DT_SIZE GETENV_NUMBER(dt_size,"QWICS_DATATABLE_SIZE",67108864)
+int dt_triggers = -1;
+#define DT_TRIGGERS GETENV_NUMBER(dt_triggers,"QWICS_DATATABLE_TRIGGERS",1)
+char *dtDefFile = NULL;
+char *dtDbConnectStr = NULL;
+char *dtConnectStr = NULL;
+
+struct dtSpace *dtSpace = NULL;
+
+// Loading and notifications are handled on a connection of the listener
+PGconn *dtConn = NULL;
+pthread_t dtListener;
+volatile int dtRunning = 0;
+
+
+unsigned int dtHash(char *key) {
+    unsigned int h = 2166136261u;
+    while (*key != 0x00) {
+        h = (h ^ (unsigned char)*key) * 16777619u;
+        key++;
+    }
+    return h;
+}
+
+
+// Brings a key value into the form it is stored in, returns -1 if the value
+// cannot be compared the way the database would
+int normalizeKey(int keyType, char *in, int quoted, char *out, int outLen) {
+    int l = strlen(in);
+    if (keyType == DT_KEY_INT) {
+        while ((l > 0) && (in[l-1] == ' ')) l--;
+        while ((l > 0) && (*in == ' ')) {
+            in++;
+            l--;
+        }
+        int neg = 0;
+        if ((l > 0) && ((*in == '-') || (*in == '+'))) {
+            neg = (*in == '-');
+            in++;
+            l--;
+        }
+        if (l == 0) {
+            return -1;
+        }
+        for (int i = 0; i < l; i++) {
+            if (!isdigit((unsigned char)in[i])) {
+                return -1;
+            }
+        }
+        while ((l > 1) && (*in == '0')) {
+            in++;
+            l--;
+        }
+        neg = neg && !((l == 1) && (*in == '0'));
+        if ((l > 19) || (l+neg+1 > outLen)) {
+            return -1;
+        }
+        if (neg) {
+            *out++ = '-';
+        }
+        memcpy(out,in,l);
+        out[l] = 0x00;
+        return l+neg;
+    }
+    if (!quoted) {
+        return -1;
+    }
+    if (keyType == DT_KEY_CHAR) {
+        while ((l > 0) && (in[l-1] == ' ')) l--;
+    }
+    if (l+1 > outLen) {
+        return -1;
+    }
+    memcpy(out,in,l);
+    out[l] = 0x00;
+    return l;
+}
+
+
+int nextToken(char **sql, char *tok, int maxlen) {
+    char *p = *sql;
+    int l = 0;
+    int type = DT_TOK_BAD;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == 0x00) {
+        type = DT_TOK_END;
+    } else
+    if (*p == '\'') {
+        type = DT_TOK_STRING;
+        p++;
+        while (type == DT_TOK_STRING) {
+            if (*p == 0x00 || *p == '\\' || l >= maxlen) {
+                type = DT_TOK_BAD;
+            } else
+            if ((*p == '\'') && (p[1] == '\'')) {
+                tok[l++] = '\'';
+                p += 2;
+            } else
+            if (*p == '\'') {
+                p++;
+                break;
+            } else {
+                tok[l++] = *p++;
+            }
+        }
+    } else
+    if (isdigit((unsigned char)*p) || (((*p == '-') || (*p == '+')) && isdigit((unsigned char)p[1]))) {
+        type = DT_TOK_NUMBER;
+        tok[l++] = *p++;
+        while ((isalnum((unsigned char)*p) || (*p == '.')) && (l < maxlen)) {
+            tok[l++] = *p++;
+        }
+    } else
+    if (isalpha((unsigned char)*p) || (*p == '_')) {
+        type = DT_TOK_WORD;
+        while ((isalnum((unsigned char)*p) || (*p == '_') || (*p == '$') || (*p == '.')) && (l < maxlen)) {
+            tok[l++] = *p++;
+        }
+    } else
+    if ((*p == '$') && isdigit((unsigned char)p[1])) {
+        type = DT_TOK_PARAM;
+        p++;
+        while (isdigit((unsigned char)*p) && (l < maxlen)) {
+            tok[l++] = *p++;
+        }
+    } else
+    if ((*p == ',') || (*p == '=') || (*p == '*') || (*p == ';')) {
+        type = DT_TOK_SYM;
+        tok[l++] = *p++;
+    }
+    tok[l] = 0x00;
+    *sql = p;
+    return type;
+}
+
+
+struct dtTable *findTable(char *name) {
+    for (int i = 0; i < dtSpace->numTables; i++) {
+        if (strcasecmp(dtSpace->tables[i].name,name) == 0) {
+            return &dtSpace->tables[i];
+        }
+    }
+    return NULL;
+}
+
+
+// Copies a query result into the heap, returns -1 if the heap is full.
+// Caller holds the write lock.
+int storeTable(struct dtTable *t, PGresult *res) {
+    int cols = PQnfields(res);
+    int rows = PQntuples(res);
+    int key = PQfnumber(res,t->keyCol);
+    t->loaded = 0;
+    if (key < 0) {
+        printf("%s%s%s%s\n","ERROR: Data table ",t->name," has no column ",t->keyCol);
+        return 0;
+    }
+    Oid type = PQftype(res,key);
+    t->keyType = ((type == 20) || (type == 21) || (type == 23)) ? DT_KEY_INT :
+                 (type == 1042) ? DT_KEY_CHAR : ((type == 1043) || (type == 25)) ? DT_KEY_TEXT : 0;
+    if (t->keyType == 0) {
+        printf("%s%s%s\n","ERROR: Key column type of data table ",t->name," not supported");
+        return 0;
+    }
+    int numBuckets = 16;
+    while (numBuckets < 2*rows) numBuckets *= 2;
+    long need = (long)cols*(DT_NAME_LEN+1) + (long)numBuckets*sizeof(long);
+    for (int r = 0; r < rows; r++) {
+        long rowLen = sizeof(struct dtRow) + (cols+1)*sizeof(int) + PQgetlength(res,r,key) + 1;
+        for (int c = 0; c < cols; c++) {
+            rowLen += PQgetlength(res,r,c) + 1;
+        }
+        need += (rowLen + 7) & ~7L;
+    }
+    if (dtSpace->heapTop + need > dtSpace->size) {
+        return -1;
+    }
+
+    long top = dtSpace->heapTop;
+    t->colNames = top;
+    for (int c = 0; c < cols; c++) {
+        snprintf(DT_PTR(top),DT_NAME_LEN+1,"%s",PQfname(res,c));
+        top += DT_NAME_LEN+1;
+    }
+    top = (top + 7) & ~7L;
+    t->buckets = top;
+    long *buckets = (long*)DT_PTR(top);
+    for (int i = 0; i < numBuckets; i++) {
+        buckets[i] = 0;
+    }
+    top += (long)numBuckets*sizeof(long);
+    int stored = 0;
+    for (int r = 0; r < rows; r++) {
+        struct dtRow *row = (struct dtRow*)DT_PTR(top);
+        char *v = (char*)&row->offs[cols+1];
+        if (PQgetisnull(res,r,key) ||
+            (normalizeKey(t->keyType,PQgetvalue(res,r,key),1,v,PQgetlength(res,r,key)+1) < 0)) {
+            // NULL key never matches
+            continue;
+        }
+        row->offs[0] = v - (char*)row;
+        v += strlen(v) + 1;
+        for (int c = 0; c < cols; c++) {
+            row->offs[c+1] = v - (char*)row;
+            memcpy(v,PQgetvalue(res,r,c),PQgetlength(res,r,c)+1);
+            v += PQgetlength(res,r,c) + 1;
+        }
+        row->hash = dtHash((char*)row + row->offs[0]);
+        row->next = buckets[row->hash & (numBuckets-1)];
+        buckets[row->hash & (numBuckets-1)] = top;
+        top = (top + (v - (char*)row) + 7) & ~7L;
+        stored++;
+    }
+    dtSpace->heapTop = top;
+    t->numCols = cols;
+    t->numRows = stored;
+    t->numBuckets = numBuckets;
+    t->loaded = 1;
+    return 0;
+}
+
+
+PGresult *queryTable(struct dtTable *t) {
+    char sql[DT_NAME_LEN+32];
+    sprintf(sql,"%s%s","SELECT * FROM ",t->name);
+    PGresult *res = PQexec(dtConn,sql);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        printf("%s%s%s%s\n","ERROR: Could not load data table ",t->name,": ",PQerrorMessage(dtConn));
+        PQclear(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+// Reloads stale tables or all. If the heap is exhausted by old versions of
+// the tables, it is compacted by loading all tables again.
+void reloadTables(int all) {
+    PGresult *res[DT_MAX_TABLES];
+    int n = dtSpace->numTables;
+    for (int i = 0; i < n; i++) {
+        res[i] = NULL;
+        if (all || dtSpace->tables[i].stale) {
+            dtSpace->tables[i].stale = 0;
+            res[i] = queryTable(&dtSpace->tables[i]);
+        }
+    }
+    int full = 0;
+    pthread_rwlock_wrlock(&dtSpace->lock);
+    for (int i = 0; (i < n) && !full; i++) {
+        if (res[i] != NULL) {
+            full = (storeTable(&dtSpace->tables[i],res[i]) < 0);
+        }
+    }
+    pthread_rwlock_unlock(&dtSpace->lock);
+    if (full) {
+        for (int i = 0; i < n; i++) {
+            if (res[i] == NULL) {
+                res[i] = queryTable(&dtSpace->tables[i]);
+            }
+        }
+        pthread_rwlock_wrlock(&dtSpace->lock);
+        dtSpace->heapTop = dtSpace->heapStart;
+        for (int i = 0; i < n; i++) {
+            dtSpace->tables[i].loaded = 0;
+        }
+        for (int i = 0; i < n; i++) {
+            if ((res[i] != NULL) && (storeTable(&dtSpace->tables[i],res[i]) < 0)) {
+                printf("%s%s\n","ERROR: QWICS_DATATABLE_SIZE too small for data table ",
+                       dtSpace->tables[i].name);
+            }
+        }
+        pthread_rwlock_unlock(&dtSpace->lock);
+    }
+    for (int i = 0; i < n; i++) {
+        if (res[i] != NULL) {
+            PQclear(res[i]);
+            dtSpace->reloads++;
+        }
+    }
+}
+
+
+void execDtSql(char *sql) {
+    PGresult *res = PQexec(dtConn,sql);
+    if ((PQresultStatus(res) != PGRES_COMMAND_OK) && (PQresultStatus(res) != PGRES_TUPLES_OK)) {
+        printf("%s%s%s\n",sql,": ",PQerrorMessage(dtConn));
+    }
+    PQclear(res);
+}
+
+
+// Tables notify the listener at the end of every modifying statement
+void installTriggers() {
+    char sql[2*DT_NAME_LEN+256];
+    execDtSql("CREATE OR REPLACE FUNCTION qwics_dt_notify() RETURNS trigger AS $$ "
+              "BEGIN PERFORM pg_notify('qwics_datatable',TG_TABLE_NAME); RETURN NULL; END; "
+              "$$ LANGUAGE plpgsql");
+    for (int i = 0; i < dtSpace->numTables; i++) {
+        sprintf(sql,"%s%s","DROP TRIGGER IF EXISTS qwics_dt_notify ON ",dtSpace->tables[i].name);
+        execDtSql(sql);
+        sprintf(sql,"%s%s%s","CREATE TRIGGER qwics_dt_notify AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON ",
+                dtSpace->tables[i].name," FOR EACH STATEMENT EXECUTE PROCEDURE qwics_dt_notify()");
+        execDtSql(sql);
+    }
+}
+
+
+int connectListener() {
+    if (dtConn != NULL) {
+        PQfinish(dtConn);
+    }
+    dtConn = PQconnectdb(dtConnectStr);
+    if (PQstatus(dtConn) != CONNECTION_OK) {
+        return -1;
+    }
+    // Listen before loading, so no change gets lost
+    execDtSql("LISTEN qwics_datatable");
+    return 0;
+}
+
+
+void *dataTableListener(void *arg) {
+    while (dtRunning) {
+        if (PQstatus(dtConn) != CONNECTION_OK) {
+            if (connectListener() < 0) {
+                sleep(1);
+                continue;
+            }
+            // Notifications may have been missed
+            reloadTables(1);
+        }
+        int stale = 0;
+        for (int i = 0; i < dtSpace->numTables; i++) {
+            stale = stale || dtSpace->tables[i].stale;
+        }
+        if (stale) {
+            reloadTables(0);
+        }
+
+        int sock = PQsocket(dtConn);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock,&fds);
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        if (select(sock+1,&fds,NULL,NULL,&tv) <= 0) {
+            continue;
+        }
+        PQconsumeInput(dtConn);
+        PGnotify *notify = NULL;
+        while ((notify = PQnotifies(dtConn)) != NULL) {
+            for (int i = 0; i < dtSpace->numTables; i++) {
+                char *name = strrchr(dtSpace->tables[i].name,'.');
+                name = (name != NULL) ? name+1 : dtSpace->tables[i].name;
+                if (strcasecmp(name,notify->extra) == 0) {
+                    dtSpace->tables[i].stale = 1;
+                }
+            }
+            PQfreemem(notify);
+        }
+    }
+    return NULL;
+}
+
+
+void initDataTables(int initCons) {
+    char line[512];
+    GETENV_STRING(dtDefFile,"QWICS_DATATABLE_DEFS","../conf/datatables.conf");
+    GETENV_STRING(dtDbConnectStr,"QWICS_DB_CONNECTSTR","dbname=qwics");
+    GETENV_STRING(dtConnectStr,"QWICS_DATATABLE_CONNECTSTR",dtDbConnectStr);
+    FILE *f = fopen(dtDefFile,"r");
+    if (f == NULL) {
+        return;
+    }
+    dtSpace = (struct dtSpace*)sharedMalloc(19,DT_SIZE);
+    if (dtSpace == NULL) {
+        printf("%s\n","ERROR: Could not allocate data table storage");
+        fclose(f);
+        return;
+    }
+    if (initCons) {
+        dtSpace->numTables = 0;
+        // TABLE KEYCOLUMN
+        while ((fgets(line,sizeof(line),f) != NULL) && (dtSpace->numTables < DT_MAX_TABLES)) {
+            struct dtTable *t = &dtSpace->tables[dtSpace->numTables];
+            if ((line[0] == '#') || (sscanf(line,"%63s %63s",t->name,t->keyCol) != 2)) {
+                continue;
+            }
+            t->loaded = 0;
+            t->stale = 0;
+            dtSpace->numTables++;
+        }
+        dtSpace->size = DT_SIZE;
+        dtSpace->heapStart = (sizeof(struct dtSpace) + 63) & ~63L;
+        dtSpace->heapTop = dtSpace->heapStart;
+        dtSpace->hits = 0;
+        dtSpace->misses = 0;
+        dtSpace->reloads = 0;
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_rwlock_init(&dtSpace->lock,&attr);
+        pthread_rwlockattr_destroy(&attr);
+        dtSpace->magic = DT_MAGIC;
+    }
+    fclose(f);
+    if (!initCons || (dtSpace->numTables == 0)) {
+        return;
+    }
+
+    if (connectListener() < 0) {
+        printf("%s%s\n","ERROR: Could not connect data table listener: ",PQerrorMessage(dtConn));
+    } else {
+        if (DT_TRIGGERS) {
+            installTriggers();
+        }
+        reloadTables(1);
+    }
+    dtRunning = 1;
+    if (pthread_create(&dtListener,NULL,dataTableListener,NULL) != 0) {
+        dtRunning = 0;
+        printf("%s\n","ERROR: Could not start data table listener");
+    }
+}
+
+
+void clearDataTables(int initCons) {
+    if (dtSpace == NULL) {
+        return;
+    }
+    if (dtRunning) {
+        dtRunning = 0;
+        pthread_join(dtListener,NULL);
+    }
+    if (dtConn != NULL) {
+        PQfinish(dtConn);
+        dtConn = NULL;
+    }
+    if (initCons && (dtSpace->numTables > 0)) {
+        printf("%s%ld%s%ld%s%ld\n","Data table hits: ",dtSpace->hits," misses: ",dtSpace->misses,
+               " reloads: ",dtSpace->reloads);
+    }
+    sharedFree(dtSpace,DT_SIZE);
+    dtSpace = NULL;
+}
+
+
+int lookupDataTable(char *sql, char **params, int *text, int numParams,
+                    char **values, int maxValues, int *numValues, char *buf, int bufLen) {
+    if ((dtSpace == NULL) || (dtSpace->numTables == 0)) {
+        return DT_NOT_CACHED;
+    }
+    // SELECT col, ... FROM table WHERE keycol = value
+    char tok[256];
+    char cols[DT_MAX_SELECT][DT_NAME_LEN+1];
+    int numCols = 0;
+    int type = nextToken(&sql,tok,255);
+    if ((type != DT_TOK_WORD) || (strcasecmp(tok,"SELECT") != 0)) {
+        return DT_NOT_CACHED;
+    }
+    while (1) {
+        type = nextToken(&sql,tok,DT_NAME_LEN);
+        if ((numCols >= DT_MAX_SELECT) || ((type != DT_TOK_WORD) && (strcmp(tok,"*") != 0))) {
+            return DT_NOT_CACHED;
+        }
+        sprintf(cols[numCols++],"%s",tok);
+        type = nextToken(&sql,tok,255);
+        if ((type == DT_TOK_WORD) && (strcasecmp(tok,"FROM") == 0)) {
+            break;
+        }
+        if (strcmp(tok,",") != 0) {
+            return DT_NOT_CACHED;
+        }
+    }
+    if (nextToken(&sql,tok,DT_NAME_LEN) != DT_TOK_WORD) {
+        return DT_NOT_CACHED;
+    }
+    struct dtTable *t = findTable(tok);
+    if (t == NULL) {
+        return DT_NOT_CACHED;
+    }
+    if ((nextToken(&sql,tok,255) != DT_TOK_WORD) || (strcasecmp(tok,"WHERE") != 0) ||
+        (nextToken(&sql,tok,255) != DT_TOK_WORD) || (strcasecmp(tok,t->keyCol) != 0) ||
+        (nextToken(&sql,tok,255) != DT_TOK_SYM) || (strcmp(tok,"=") != 0)) {
+        __sync_fetch_and_add(&dtSpace->misses,1);
+        return DT_NOT_CACHED;
+    }
+    char key[256];
+    type = nextToken(&sql,key,255);
+    int quoted = (type == DT_TOK_STRING);
+    if (type == DT_TOK_PARAM) {
+        int n = atoi(key);
+        if ((n < 1) || (n > numParams) || (strlen(params[n-1]) > 255)) {
+            __sync_fetch_and_add(&dtSpace->misses,1);
+            return DT_NOT_CACHED;
+        }
+        sprintf(key,"%s",params[n-1]);
+        quoted = text[n-1];
+    } else
+    if ((type != DT_TOK_STRING) && (type != DT_TOK_NUMBER)) {
+        __sync_fetch_and_add(&dtSpace->misses,1);
+        return DT_NOT_CACHED;
+    }
+    type = nextToken(&sql,tok,255);
+    if ((type == DT_TOK_SYM) && (strcmp(tok,";") == 0)) {
+        type = nextToken(&sql,tok,255);
+    }
+    if (type != DT_TOK_END) {
+        __sync_fetch_and_add(&dtSpace->misses,1);
+        return DT_NOT_CACHED;
+    }
+
+    // Lookups never wait for a reload, the database answers meanwhile
+    if (pthread_rwlock_tryrdlock(&dtSpace->lock) != 0) {
+        __sync_fetch_and_add(&dtSpace->misses,1);
+        return DT_NOT_CACHED;
+    }
+    int r = DT_NOT_CACHED;
+    int idx[DT_MAX_SELECT];
+    int n = 0;
+    char norm[256];
+    if (t->loaded && (normalizeKey(t->keyType,key,quoted,norm,256) >= 0)) {
+        r = DT_NOTFOUND;
+        char *names = DT_PTR(t->colNames);
+        for (int i = 0; (i < numCols) && (r != DT_NOT_CACHED); i++) {
+            int found = 0;
+            for (int c = 0; c < t->numCols; c++) {
+                if ((strcmp(cols[i],"*") == 0) || (strcasecmp(cols[i],&names[c*(DT_NAME_LEN+1)]) == 0)) {
+                    if ((n < maxValues) && (n < DT_MAX_SELECT)) {
+                        idx[n] = c;
+                    }
+                    n++;
+                    found = 1;
+                    if (strcmp(cols[i],"*") != 0) {
+                        break;
+                    }
+                }
+            }
+            if (!found || (n > maxValues) || (n > DT_MAX_SELECT)) {
+                r = DT_NOT_CACHED;
+            }
+        }
+    }
+    if (r == DT_NOTFOUND) {
+        unsigned int h = dtHash(norm);
+        long o = ((long*)DT_PTR(t->buckets))[h & (t->numBuckets-1)];
+        while (o != 0) {
+            struct dtRow *row = (struct dtRow*)DT_PTR(o);
+            if ((row->hash == h) && (strcmp((char*)row + row->offs[0],norm) == 0)) {
+                int l = 0;
+                r = DT_FOUND;
+                for (int i = 0; (i < n) && (r == DT_FOUND); i++) {
+                    char *v = (char*)row + row->offs[idx[i]+1];
+                    int vl = strlen(v) + 1;
+                    if (l + vl > bufLen) {
+                        r = DT_NOT_CACHED;
+                    } else {
+                        memcpy(&buf[l],v,vl);
+                        values[i] = &buf[l];
+                        l += vl;
+                    }
+                }
+                break;
+            }
+            o = row->next;
+        }
+    }
+    pthread_rwlock_unlock(&dtSpace->lock);
+    *numValues = n;
+    __sync_fetch_and_add((r == DT_NOT_CACHED) ? &dtSpace->misses : &dtSpace->hits,1);
+    return r;
+}
+
+
+int isDataTableUpdate(char *sql) {
+    if ((dtSpace == NULL) || (dtSpace->numTables == 0)) {
+        return 0;
+    }
+    char tok[256];
+    int type = nextToken(&sql,tok,255);
+    if ((type != DT_TOK_WORD) ||
+        ((strcasecmp(tok,"INSERT") != 0) && (strcasecmp(tok,"UPDATE") != 0) &&
+         (strcasecmp(tok,"DELETE") != 0) && (strcasecmp(tok,"TRUNCATE") != 0) &&
+         (strcasecmp(tok,"MERGE") != 0))) {
+        return 0;
+    }
+    while ((type = nextToken(&sql,tok,255)) != DT_TOK_END) {
+        if ((type == DT_TOK_BAD) && (*sql != 0x00)) {
+            // Skip characters the tokenizer does not know
+            sql++;
+        }
+        if ((type == DT_TOK_WORD) && (findTable(tok) != NULL)) {
+            return 1;
+        }
+    }
+    return 0;
+}
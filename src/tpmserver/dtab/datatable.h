@@ -0,0 +1,94 @@
+/*******************************************************************************************/
+/*   QWICS Server Shared Data Tables                                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _datatable_h
+#define _datatable_h
+
+#include <pthread.h>
+
+#define DT_NAME_LEN 63
+#define DT_MAX_TABLES 64
+
+// Results of a lookup
+#define DT_FOUND 0
+#define DT_NOTFOUND 1
+#define DT_NOT_CACHED -1   // Statement must be run on the database
+
+// Tokens of a SQL statement
+#define DT_TOK_END 0
+#define DT_TOK_WORD 1
+#define DT_TOK_STRING 2
+#define DT_TOK_NUMBER 3
+#define DT_TOK_SYM 4
+#define DT_TOK_BAD 5       // Not consumed, the caller has to skip it
+#define DT_TOK_PARAM 6
+
+// Types of the key column, other types are not cached
+#define DT_KEY_INT 1
+#define DT_KEY_CHAR 2      // Trailing blanks are not significant
+#define DT_KEY_TEXT 3
+
+// All references within the shared space are offsets from its start
+struct dtRow {
+    long next;
+    unsigned int hash;
+    int offs[];        // Value offsets in the row, key first, then columns
+};
+
+struct dtTable {
+    char name[DT_NAME_LEN+1];
+    char keyCol[DT_NAME_LEN+1];
+    int keyType;
+    int numCols;
+    int numRows;
+    int numBuckets;
+    long colNames;     // numCols names of DT_NAME_LEN+1 bytes
+    long buckets;
+    int loaded;
+    int stale;         // Reload requested by notification
+};
+
+struct dtSpace {
+    int magic;
+    int numTables;
+    long size;
+    long heapStart;
+    long heapTop;
+    long hits;
+    long misses;
+    long reloads;
+    pthread_rwlock_t lock;
+    struct dtTable tables[DT_MAX_TABLES];
+};
+
+void initDataTables(int initCons);
+void clearDataTables(int initCons);
+
+// Answers SELECT ... INTO of a single row by key of a cached table. The key may
+// be a $n param, text marks params given as strings. The values of the selected
+// columns are copied to buf and referenced by values.
+int lookupDataTable(char *sql, char **params, int *text, int numParams,
+                    char **values, int maxValues, int *numValues, char *buf, int bufLen);
+// Returns 1 if sql modifies a cached table
+int isDataTableUpdate(char *sql);
+// Next token of a statement, also used by the query cache
+int nextToken(char **sql, char *tok, int maxlen);
+
+#endif
@@ -0,0 +1,163 @@
+/*******************************************************************************************/
+/*   QWICS Server Cluster ENQ with PG Advisory Locks                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <libpq-fe.h>
+
+#include "enqdeq.h"
+#include "enqcluster.h"
+#include "../env/envconf.h"
+
+int enq_cluster = -1;
+#define ENQ_CLUSTER GETENV_NUMBER(enq_cluster,"QWICS_ENQ_CLUSTER",0)
+int enq_cluster_timeout = -1;
+#define ENQ_CLUSTER_TIMEOUT GETENV_NUMBER(enq_cluster_timeout,"QWICS_ENQ_CLUSTER_TIMEOUT",60000)
+char *enqClusterConnectStr = NULL;
+char *enqClusterDbConnectStr = NULL;
+
+// Dedicated connection holding the session level locks of this node
+PGconn *lockConn = NULL;
+pthread_mutex_t lockConnMutex;
+// Incremented on reset, locks taken in an older session are gone
+int lockSession = 0;
+
+
+int initEnqCluster() {
+    if (!ENQ_CLUSTER) {
+        return 0;
+    }
+    GETENV_STRING(enqClusterDbConnectStr,"QWICS_DB_CONNECTSTR","dbname=qwics");
+    GETENV_STRING(enqClusterConnectStr,"QWICS_ENQ_CLUSTER_CONNECTSTR",enqClusterDbConnectStr);
+    lockConn = PQconnectdb(enqClusterConnectStr);
+    if (PQstatus(lockConn) != CONNECTION_OK) {
+        printf("ERROR: ENQ cluster lock connection failed: %s",PQerrorMessage(lockConn));
+        PQfinish(lockConn);
+        lockConn = NULL;
+        return 0;
+    }
+    pthread_mutex_init(&lockConnMutex,NULL);
+    return 1;
+}
+
+
+void clearEnqCluster() {
+    if (lockConn != NULL) {
+        // Ending the session releases all advisory locks of this node
+        PQfinish(lockConn);
+        lockConn = NULL;
+        pthread_mutex_destroy(&lockConnMutex);
+    }
+}
+
+
+long long clusterKey(unsigned char *name, int len) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ name[i]) * 1099511628211ULL;
+    }
+    return (long long)h;
+}
+
+
+int clusterSession() {
+    return __atomic_load_n(&lockSession,__ATOMIC_ACQUIRE);
+}
+
+
+// Called with lockConnMutex held
+void resetLockConn() {
+    if (PQstatus(lockConn) != CONNECTION_OK) {
+        // Locks of the lost session are gone, other nodes may enter now
+        printf("%s\n","ERROR: ENQ cluster lock connection lost, reconnecting");
+        PQreset(lockConn);
+        __atomic_add_fetch(&lockSession,1,__ATOMIC_RELEASE);
+    }
+}
+
+
+void checkCluster() {
+    pthread_mutex_lock(&lockConnMutex);
+    PGresult *res = PQexec(lockConn,"SELECT 1");
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        resetLockConn();
+    }
+    PQclear(res);
+    pthread_mutex_unlock(&lockConnMutex);
+}
+
+
+// Executes advisory lock function, returns 1 if it returned true
+int execAdvisory(char *func, long long key, int *session) {
+    char sql[80];
+    int ret = 0;
+    sprintf(sql,"SELECT %s(%lld)",func,key);
+    pthread_mutex_lock(&lockConnMutex);
+    PGresult *res = PQexec(lockConn,sql);
+    if (PQresultStatus(res) == PGRES_TUPLES_OK) {
+        ret = (PQgetvalue(res,0,0)[0] == 't');
+        if (session != NULL) {
+            *session = lockSession;
+        }
+    } else {
+        printf("ERROR: %s failed: %s",func,PQerrorMessage(lockConn));
+        resetLockConn();
+    }
+    PQclear(res);
+    pthread_mutex_unlock(&lockConnMutex);
+    return ret;
+}
+
+
+int clusterLock(unsigned char *name, int len, int nosuspend, long timeoutMs, int *session) {
+    long long key = clusterKey(name,len);
+    if (timeoutMs <= 0) {
+        // Deadlocks between nodes are not visible locally, so waits are always limited
+        timeoutMs = ENQ_CLUSTER_TIMEOUT;
+    }
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    long backoff = 1000;
+    while (!execAdvisory("pg_try_advisory_lock",key,session)) {
+        if (nosuspend) {
+            return ENQ_BUSY;
+        }
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        long waited = (now.tv_sec-start.tv_sec)*1000L + (now.tv_nsec-start.tv_nsec)/1000000L;
+        if (waited >= timeoutMs) {
+            return ENQ_TIMEOUT;
+        }
+        // Try-lock keeps the shared connection free for other tasks while waiting
+        usleep(backoff);
+        if (backoff < 50000) {
+            backoff *= 2;
+        }
+    }
+    return ENQ_OK;
+}
+
+
+void clusterUnlock(unsigned char *name, int len) {
+    execAdvisory("pg_advisory_unlock",clusterKey(name,len),NULL);
+}
@@ -0,0 +1,36 @@
+/*******************************************************************************************/
+/*   QWICS Server Cluster ENQ with PG Advisory Locks                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _enqcluster_h
+#define _enqcluster_h
+
+// Opens the lock connection if QWICS_ENQ_CLUSTER is set, returns 1 if active
+int initEnqCluster();
+void clearEnqCluster();
+
+// Returns ENQ_OK, ENQ_BUSY or ENQ_TIMEOUT, session is the one holding the lock
+int clusterLock(unsigned char *name, int len, int nosuspend, long timeoutMs, int *session);
+void clusterUnlock(unsigned char *name, int len);
+// Lock connection session, changes when it was reset and its locks are gone
+int clusterSession();
+// Resets a lost lock connection, also while no ENQ is issued
+void checkCluster();
+
+#endif
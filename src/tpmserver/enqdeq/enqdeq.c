@@ -0,0 +1,761 @@
+/*******************************************************************************************/
+/*   QWICS Server ENQ/DEQ Lock Manager                                                     */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "enqdeq.h"
+#include "enqcluster.h"
+#include "../env/envconf.h"
+#include "../shm/shmtpm.h"
+
+int enq_max_resources = -1;
+#define ENQ_MAX_RESOURCES GETENV_NUMBER(enq_max_resources,"QWICS_ENQ_MAX_RESOURCES",4096)
+int enq_max_locks = -1;
+#define ENQ_MAX_LOCKS GETENV_NUMBER(enq_max_locks,"QWICS_ENQ_MAX_LOCKS",16384)
+int enq_max_tasks = -1;
+#define ENQ_MAX_TASKS GETENV_NUMBER(enq_max_tasks,"QWICS_ENQ_MAX_TASKS",1024)
+int enq_timeout = -1;
+#define ENQ_TIMEOUT_MS GETENV_NUMBER(enq_timeout,"QWICS_ENQ_TIMEOUT",0)
+int enq_cluster_linger = -1;
+#define ENQ_CLUSTER_LINGER GETENV_NUMBER(enq_cluster_linger,"QWICS_ENQ_CLUSTER_LINGER",10)
+// Interval of lock connection checks in ms
+#define ENQ_CLUSTER_CHECK_MS 1000
+
+#define ENQ_HASH(t) ((int*)((char*)(t)+sizeof(struct enqTable)))
+#define ENQ_RES(t,i) (&((struct enqResource*)((char*)ENQ_HASH(t)+(t)->hashSize*sizeof(int)))[i])
+#define ENQ_LOCK(t,i) (&((struct enqLock*)ENQ_RES(t,(t)->maxResources))[i])
+#define ENQ_TASK(t,i) (&((struct enqTask*)ENQ_LOCK(t,(t)->maxLocks))[i])
+
+struct enqTable *enqTable = NULL;
+long enqTableSize = 0;
+int clusterActive = 0;
+int clusterRunning = 0;
+pthread_t clusterThread;
+
+
+long enqTableBytes(int hashSize, int maxResources, int maxLocks, int maxTasks) {
+    return sizeof(struct enqTable) + (long)hashSize*sizeof(int) +
+           (long)maxResources*sizeof(struct enqResource) +
+           (long)maxLocks*sizeof(struct enqLock) +
+           (long)maxTasks*sizeof(struct enqTask);
+}
+
+
+void formatEnqTable(struct enqTable *t, int hashSize) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&t->mutex,&attr);
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&t->clusterCond,&cattr);
+    t->idleHead = -1;
+    t->idleTail = -1;
+
+    t->hashSize = hashSize;
+    t->maxResources = ENQ_MAX_RESOURCES;
+    t->maxLocks = ENQ_MAX_LOCKS;
+    t->maxTasks = ENQ_MAX_TASKS;
+    t->epoch = 0;
+    t->deadlocks = 0;
+    t->timeouts = 0;
+    for (int i = 0; i < t->hashSize; i++) {
+        ENQ_HASH(t)[i] = -1;
+    }
+    for (int i = 0; i < t->maxResources; i++) {
+        ENQ_RES(t,i)->next = (i+1 < t->maxResources) ? i+1 : -1;
+        ENQ_RES(t,i)->cluster = ENQ_CLUSTER_NONE;
+    }
+    for (int i = 0; i < t->maxLocks; i++) {
+        ENQ_LOCK(t,i)->nextInTask = (i+1 < t->maxLocks) ? i+1 : -1;
+    }
+    for (int i = 0; i < t->maxTasks; i++) {
+        struct enqTask *task = ENQ_TASK(t,i);
+        task->used = 0;
+        task->waitNext = (i+1 < t->maxTasks) ? i+1 : -1;
+        pthread_cond_init(&task->cond,&cattr);
+    }
+    pthread_condattr_destroy(&cattr);
+    t->freeResource = 0;
+    t->freeLock = 0;
+    t->freeTask = 0;
+}
+
+
+long nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    return ts.tv_sec*1000L + ts.tv_nsec/1000000L;
+}
+
+
+void releaseResource(struct enqTable *t, int res);
+
+// Cluster locks of a lost lock connection session are taken again for their
+// local holders, called with table locked. Idle ones are dropped by the releaser.
+void relockCluster(struct enqTable *t) {
+    int session = clusterSession();
+    for (int i = 0; i < t->maxResources; i++) {
+        struct enqResource *r = ENQ_RES(t,i);
+        if ((r->cluster != ENQ_CLUSTER_HELD) || (r->session == session) || (r->holders < 0)) {
+            continue;
+        }
+        unsigned char key[ENQ_NAME_LEN];
+        int len = r->len;
+        memcpy(key,r->name,len);
+        r->cluster = ENQ_CLUSTER_ACQUIRING;
+        pthread_mutex_unlock(&t->mutex);
+        int rc = clusterLock(key,len,1,0,&session);
+        pthread_mutex_lock(&t->mutex);
+        if (rc == ENQ_OK) {
+            r->cluster = ENQ_CLUSTER_HELD;
+            r->session = session;
+        } else {
+            // Another node took it meanwhile, local holder is no longer protected
+            r->cluster = ENQ_CLUSTER_NONE;
+            printf("%s%.*s\n","ERROR: ENQ cluster lock lost while held: ",len,key);
+        }
+        pthread_cond_broadcast(&t->clusterCond);
+        releaseResource(t,i);
+        session = clusterSession();
+    }
+}
+
+
+void waitUntil(pthread_cond_t *cond, pthread_mutex_t *mutex, long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    pthread_cond_timedwait(cond,mutex,&ts);
+}
+
+
+// Cluster locks no longer used on this node are released after some linger time,
+// so a resource handed between local tasks is not unlocked and locked again
+void *clusterReleaser(void *arg) {
+    struct enqTable *t = enqTable;
+    long nextCheck = 0;
+    pthread_mutex_lock(&t->mutex);
+    while (clusterRunning) {
+        if (nowMs() >= nextCheck) {
+            pthread_mutex_unlock(&t->mutex);
+            checkCluster();
+            pthread_mutex_lock(&t->mutex);
+            relockCluster(t);
+            nextCheck = nowMs() + ENQ_CLUSTER_CHECK_MS;
+            continue;
+        }
+        if (t->idleHead < 0) {
+            waitUntil(&t->clusterCond,&t->mutex,nextCheck);
+            continue;
+        }
+        int res = t->idleHead;
+        struct enqResource *r = ENQ_RES(t,res);
+        int unused = (r->holders < 0) && (r->waitHead < 0) && (r->cluster == ENQ_CLUSTER_HELD);
+        long due = r->idleSince + ENQ_CLUSTER_LINGER;
+        if (unused && (nowMs() < due)) {
+            waitUntil(&t->clusterCond,&t->mutex,(due < nextCheck) ? due : nextCheck);
+            continue;
+        }
+        t->idleHead = r->idleNext;
+        if (t->idleHead < 0) {
+            t->idleTail = -1;
+        }
+        r->inIdle = 0;
+        if (!unused) {
+            // In use again, enters the list anew when released. Freed now if
+            // its lock of a lost session could not be taken again.
+            releaseResource(t,res);
+            continue;
+        }
+        unsigned char key[ENQ_NAME_LEN];
+        int len = r->len;
+        int lost = (r->session != clusterSession());
+        memcpy(key,r->name,len);
+        r->cluster = ENQ_CLUSTER_RELEASING;
+        pthread_mutex_unlock(&t->mutex);
+        if (!lost) {
+            clusterUnlock(key,len);
+        }
+        pthread_mutex_lock(&t->mutex);
+        r->cluster = ENQ_CLUSTER_NONE;
+        releaseResource(t,res);
+        pthread_cond_broadcast(&t->clusterCond);
+    }
+    pthread_mutex_unlock(&t->mutex);
+    return NULL;
+}
+
+
+void initEnqResources(int initCons) {
+    int hashSize = ENQ_MAX_RESOURCES;
+    enqTableSize = enqTableBytes(hashSize,ENQ_MAX_RESOURCES,ENQ_MAX_LOCKS,ENQ_MAX_TASKS);
+    enqTable = (struct enqTable*)sharedMalloc(17,enqTableSize);
+    if (enqTable == NULL) {
+        printf("%s\n","ERROR: Could not allocate ENQ resource table");
+        return;
+    }
+    if (initCons) {
+        formatEnqTable(enqTable,hashSize);
+    }
+    // Optional cluster wide scope for ENQs by name
+    clusterActive = initEnqCluster();
+    if (clusterActive) {
+        clusterRunning = 1;
+        pthread_create(&clusterThread,NULL,clusterReleaser,NULL);
+    }
+}
+
+
+void clearEnqResources(int initCons) {
+    if (enqTable == NULL) {
+        return;
+    }
+    if (clusterActive) {
+        pthread_mutex_lock(&enqTable->mutex);
+        clusterRunning = 0;
+        pthread_cond_broadcast(&enqTable->clusterCond);
+        pthread_mutex_unlock(&enqTable->mutex);
+        pthread_join(clusterThread,NULL);
+        clearEnqCluster();
+        clusterActive = 0;
+    }
+    if (initCons && ((enqTable->deadlocks > 0) || (enqTable->timeouts > 0))) {
+        printf("%s%ld%s%ld\n","ENQ deadlocks: ",enqTable->deadlocks," timeouts: ",enqTable->timeouts);
+    }
+    sharedFree(enqTable,enqTableSize);
+    enqTable = NULL;
+}
+
+
+struct taskLock *createTaskLocks() {
+    struct taskLock *taskLocks = (struct taskLock*)malloc(sizeof(struct taskLock));
+    if (taskLocks != NULL) {
+        taskLocks->task = -1;
+    }
+    return taskLocks;
+}
+
+
+unsigned int hashEnqName(unsigned char *name, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ name[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+// Resource name is either given by value or by address of the data area
+int enqKey(char *name, int len, unsigned char *key) {
+    if (len <= 0) {
+        memcpy(key,&name,sizeof(char*));
+        return -(int)sizeof(char*);
+    }
+    if (len > ENQ_NAME_LEN) {
+        len = ENQ_NAME_LEN;
+    }
+    memcpy(key,name,len);
+    return len;
+}
+
+
+int lookupResource(struct enqTable *t, unsigned char *key, int len, int create) {
+    int klen = (len < 0) ? -len : len;
+    unsigned int h = hashEnqName(key,klen);
+    int b = h % t->hashSize;
+    for (int i = ENQ_HASH(t)[b]; i >= 0; i = ENQ_RES(t,i)->next) {
+        struct enqResource *r = ENQ_RES(t,i);
+        if ((r->hash == h) && (r->len == len) && (memcmp(r->name,key,klen) == 0)) {
+            return i;
+        }
+    }
+    if (!create || (t->freeResource < 0)) {
+        return -1;
+    }
+    int i = t->freeResource;
+    struct enqResource *r = ENQ_RES(t,i);
+    t->freeResource = r->next;
+    r->hash = h;
+    r->len = len;
+    memcpy(r->name,key,klen);
+    r->exclusive = 0;
+    r->holders = -1;
+    r->waitHead = -1;
+    r->waitTail = -1;
+    r->cluster = ENQ_CLUSTER_NONE;
+    r->inIdle = 0;
+    r->next = ENQ_HASH(t)[b];
+    ENQ_HASH(t)[b] = i;
+    return i;
+}
+
+
+// Unused resources go back to the free list
+void releaseResource(struct enqTable *t, int res) {
+    struct enqResource *r = ENQ_RES(t,res);
+    if ((r->holders >= 0) || (r->waitHead >= 0)) {
+        return;
+    }
+    if (r->cluster != ENQ_CLUSTER_NONE) {
+        // Cluster lock is kept for a while, entry is freed after release
+        if ((r->cluster == ENQ_CLUSTER_HELD) && !r->inIdle) {
+            r->inIdle = 1;
+            r->idleNext = -1;
+            if (t->idleTail >= 0) {
+                ENQ_RES(t,t->idleTail)->idleNext = res;
+            } else {
+                t->idleHead = res;
+            }
+            t->idleTail = res;
+            pthread_cond_broadcast(&t->clusterCond);
+        }
+        r->idleSince = nowMs();
+        return;
+    }
+    if (r->inIdle) {
+        // Still linked in the idle list, freed by the releaser
+        return;
+    }
+    int klen = (r->len < 0) ? -r->len : r->len;
+    int *p = &ENQ_HASH(t)[hashEnqName(r->name,klen) % t->hashSize];
+    while (*p != res) {
+        p = &ENQ_RES(t,*p)->next;
+    }
+    *p = r->next;
+    r->next = t->freeResource;
+    t->freeResource = res;
+}
+
+
+int findLock(struct enqTable *t, int res, int task) {
+    for (int l = ENQ_RES(t,res)->holders; l >= 0; l = ENQ_LOCK(t,l)->nextInRes) {
+        if (ENQ_LOCK(t,l)->task == task) {
+            return l;
+        }
+    }
+    return -1;
+}
+
+
+int addLock(struct enqTable *t, int res, int task, int type) {
+    int l = t->freeLock;
+    if (l < 0) {
+        return -1;
+    }
+    struct enqLock *lock = ENQ_LOCK(t,l);
+    t->freeLock = lock->nextInTask;
+    lock->res = res;
+    lock->task = task;
+    lock->count = 1;
+    lock->type = type;
+    lock->nextInRes = ENQ_RES(t,res)->holders;
+    ENQ_RES(t,res)->holders = l;
+    lock->nextInTask = ENQ_TASK(t,task)->locks;
+    ENQ_TASK(t,task)->locks = l;
+    return l;
+}
+
+
+void removeLock(struct enqTable *t, int l) {
+    struct enqLock *lock = ENQ_LOCK(t,l);
+    int *p = &ENQ_RES(t,lock->res)->holders;
+    while (*p != l) {
+        p = &ENQ_LOCK(t,*p)->nextInRes;
+    }
+    *p = lock->nextInRes;
+    p = &ENQ_TASK(t,lock->task)->locks;
+    while (*p != l) {
+        p = &ENQ_LOCK(t,*p)->nextInTask;
+    }
+    *p = lock->nextInTask;
+    lock->nextInTask = t->freeLock;
+    t->freeLock = l;
+}
+
+
+// Only holder of the resource is task itself (or nobody)
+int onlyHolder(struct enqTable *t, int res, int task) {
+    for (int l = ENQ_RES(t,res)->holders; l >= 0; l = ENQ_LOCK(t,l)->nextInRes) {
+        if (ENQ_LOCK(t,l)->task != task) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int isCompatible(struct enqTable *t, int res, int task, int mode) {
+    struct enqResource *r = ENQ_RES(t,res);
+    if (mode == ENQ_EXCLUSIVE) {
+        return onlyHolder(t,res,task);
+    }
+    return !r->exclusive || onlyHolder(t,res,task);
+}
+
+
+// Hand the resource over to waiters at the head of the FIFO
+void grantWaiters(struct enqTable *t, int res) {
+    struct enqResource *r = ENQ_RES(t,res);
+    while (r->waitHead >= 0) {
+        int w = r->waitHead;
+        struct enqTask *task = ENQ_TASK(t,w);
+        if (!isCompatible(t,res,w,task->waitMode)) {
+            break;
+        }
+        int l = findLock(t,res,w);
+        if (l < 0) {
+            l = addLock(t,res,w,UOW);
+            if (l < 0) {
+                break;
+            }
+            ENQ_LOCK(t,l)->count = 0;
+        }
+        ENQ_LOCK(t,l)->count++;
+        if (task->waitMode == ENQ_EXCLUSIVE) {
+            r->exclusive = 1;
+        }
+        r->waitHead = task->waitNext;
+        if (r->waitHead < 0) {
+            r->waitTail = -1;
+        }
+        task->waitRes = -1;
+        task->waitNext = -1;
+        task->granted = 1;
+        pthread_cond_signal(&task->cond);
+        if (r->exclusive) {
+            break;
+        }
+    }
+}
+
+
+// Check if task would wait for itself by following the wait-for graph
+int dependsOn(struct enqTable *t, int res, int waiter, int task) {
+    struct enqResource *r = ENQ_RES(t,res);
+    for (int l = r->holders; l >= 0; l = ENQ_LOCK(t,l)->nextInRes) {
+        int h = ENQ_LOCK(t,l)->task;
+        if (h == waiter) {
+            continue;
+        }
+        if (h == task) {
+            return 1;
+        }
+        struct enqTask *ht = ENQ_TASK(t,h);
+        if (ht->visit == t->epoch) {
+            continue;
+        }
+        ht->visit = t->epoch;
+        if ((ht->waitRes >= 0) && dependsOn(t,ht->waitRes,h,task)) {
+            return 1;
+        }
+    }
+    // Tasks queued before waiter are served first
+    for (int w = r->waitHead; (w >= 0) && (w != waiter); w = ENQ_TASK(t,w)->waitNext) {
+        if (w == task) {
+            return 1;
+        }
+        struct enqTask *wt = ENQ_TASK(t,w);
+        if (wt->visit == t->epoch) {
+            continue;
+        }
+        wt->visit = t->epoch;
+        if (dependsOn(t,res,w,task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void removeWaiter(struct enqTable *t, int res, int task) {
+    struct enqResource *r = ENQ_RES(t,res);
+    int prev = -1;
+    for (int w = r->waitHead; w >= 0; w = ENQ_TASK(t,w)->waitNext) {
+        if (w == task) {
+            if (prev < 0) {
+                r->waitHead = ENQ_TASK(t,w)->waitNext;
+            } else {
+                ENQ_TASK(t,prev)->waitNext = ENQ_TASK(t,w)->waitNext;
+            }
+            if (r->waitTail == w) {
+                r->waitTail = prev;
+            }
+            break;
+        }
+        prev = w;
+    }
+    ENQ_TASK(t,task)->waitRes = -1;
+    ENQ_TASK(t,task)->waitNext = -1;
+}
+
+
+int getTaskSlot(struct enqTable *t, struct taskLock *taskLocks) {
+    if (taskLocks->task < 0) {
+        int i = t->freeTask;
+        if (i < 0) {
+            return -1;
+        }
+        struct enqTask *task = ENQ_TASK(t,i);
+        t->freeTask = task->waitNext;
+        task->used = 1;
+        task->waitRes = -1;
+        task->waitNext = -1;
+        task->granted = 0;
+        task->visit = -1;
+        task->locks = -1;
+        taskLocks->task = i;
+    }
+    return taskLocks->task;
+}
+
+
+// Take cluster lock for resource granted locally, called with table locked
+int acquireCluster(struct enqTable *t, int res, int nosuspend) {
+    struct enqResource *r = ENQ_RES(t,res);
+    while ((r->cluster == ENQ_CLUSTER_RELEASING) || (r->cluster == ENQ_CLUSTER_ACQUIRING)) {
+        pthread_cond_wait(&t->clusterCond,&t->mutex);
+    }
+    if ((r->cluster == ENQ_CLUSTER_HELD) && (r->session == clusterSession())) {
+        // Node still holds it from a previous local owner
+        return ENQ_OK;
+    }
+    // Not held, or lock of a lost session that another node may hold now
+    unsigned char key[ENQ_NAME_LEN];
+    int len = r->len;
+    int session = 0;
+    memcpy(key,r->name,len);
+    r->cluster = ENQ_CLUSTER_ACQUIRING;
+    pthread_mutex_unlock(&t->mutex);
+    int rc = clusterLock(key,len,nosuspend,ENQ_TIMEOUT_MS,&session);
+    pthread_mutex_lock(&t->mutex);
+    r->cluster = (rc == ENQ_OK) ? ENQ_CLUSTER_HELD : ENQ_CLUSTER_NONE;
+    r->session = session;
+    pthread_cond_broadcast(&t->clusterCond);
+    return rc;
+}
+
+
+void unlock(struct enqTable *t, int l);
+
+// Local grant is only valid together with the cluster lock
+int grantCluster(struct enqTable *t, int res, int self, int mode, int nosuspend) {
+    if (!clusterActive || (mode != ENQ_EXCLUSIVE) || (ENQ_RES(t,res)->len < 0)) {
+        return ENQ_OK;
+    }
+    int rc = acquireCluster(t,res,nosuspend);
+    if (rc != ENQ_OK) {
+        int l = findLock(t,res,self);
+        if (l >= 0) {
+            ENQ_LOCK(t,l)->count--;
+            if (ENQ_LOCK(t,l)->count <= 0) {
+                unlock(t,l);
+            }
+        }
+    }
+    return rc;
+}
+
+
+int enqMode(char *name, int len, int mode, int nosuspend, int type, struct taskLock *taskLocks) {
+    struct enqTable *t = enqTable;
+    unsigned char key[ENQ_NAME_LEN];
+    if ((t == NULL) || (taskLocks == NULL)) {
+        return ENQ_BUSY;
+    }
+    len = enqKey(name,len,key);
+
+    pthread_mutex_lock(&t->mutex);
+    int self = getTaskSlot(t,taskLocks);
+    int res = (self < 0) ? -1 : lookupResource(t,key,len,1);
+    if (res < 0) {
+        pthread_mutex_unlock(&t->mutex);
+        printf("%s\n","ERROR: ENQ resource table full");
+        return ENQ_BUSY;
+    }
+    struct enqResource *r = ENQ_RES(t,res);
+    int l = findLock(t,res,self);
+    if ((l >= 0) && (r->exclusive || (mode == ENQ_SHARED))) {
+        // Already held by this task
+        ENQ_LOCK(t,l)->count++;
+        if (type == TASK) {
+            ENQ_LOCK(t,l)->type = TASK;
+        }
+        pthread_mutex_unlock(&t->mutex);
+        return ENQ_OK;
+    }
+    if ((r->waitHead < 0) && isCompatible(t,res,self,mode)) {
+        if (l < 0) {
+            l = addLock(t,res,self,type);
+            if (l < 0) {
+                releaseResource(t,res);
+                pthread_mutex_unlock(&t->mutex);
+                printf("%s\n","ERROR: ENQ lock table full");
+                return ENQ_BUSY;
+            }
+        } else {
+            ENQ_LOCK(t,l)->count++;
+        }
+        if (mode == ENQ_EXCLUSIVE) {
+            r->exclusive = 1;
+        }
+        int rc = grantCluster(t,res,self,mode,nosuspend);
+        pthread_mutex_unlock(&t->mutex);
+        return rc;
+    }
+    if (nosuspend) {
+        releaseResource(t,res);
+        pthread_mutex_unlock(&t->mutex);
+        return ENQ_BUSY;
+    }
+
+    // Waiting would close a cycle, requesting task is the victim
+    t->epoch++;
+    if (dependsOn(t,res,self,self)) {
+        t->deadlocks++;
+        releaseResource(t,res);
+        pthread_mutex_unlock(&t->mutex);
+        return ENQ_DEADLOCK;
+    }
+
+    struct enqTask *task = ENQ_TASK(t,self);
+    task->waitRes = res;
+    task->waitMode = mode;
+    task->waitNext = -1;
+    task->granted = 0;
+    if (r->waitTail >= 0) {
+        ENQ_TASK(t,r->waitTail)->waitNext = self;
+    } else {
+        r->waitHead = self;
+    }
+    r->waitTail = self;
+
+    struct timespec deadline;
+    long timeout = ENQ_TIMEOUT_MS;
+    if (timeout > 0) {
+        clock_gettime(CLOCK_REALTIME,&deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    while (!task->granted) {
+        int rc = (timeout > 0) ? pthread_cond_timedwait(&task->cond,&t->mutex,&deadline) :
+                                 pthread_cond_wait(&task->cond,&t->mutex);
+        if ((rc == ETIMEDOUT) && !task->granted) {
+            t->timeouts++;
+            removeWaiter(t,res,self);
+            grantWaiters(t,res);
+            releaseResource(t,res);
+            pthread_mutex_unlock(&t->mutex);
+            return ENQ_TIMEOUT;
+        }
+    }
+    task->granted = 0;
+    l = findLock(t,res,self);
+    if ((l >= 0) && (type == TASK)) {
+        ENQ_LOCK(t,l)->type = TASK;
+    }
+    int rc = grantCluster(t,res,self,mode,0);
+    if (rc == ENQ_TIMEOUT) {
+        t->timeouts++;
+    }
+    pthread_mutex_unlock(&t->mutex);
+    return rc;
+}
+
+
+int enq(char *name, int len, int nosuspend, int type, struct taskLock *taskLocks) {
+    return enqMode(name,len,ENQ_EXCLUSIVE,nosuspend,type,taskLocks);
+}
+
+
+void unlock(struct enqTable *t, int l) {
+    int res = ENQ_LOCK(t,l)->res;
+    removeLock(t,l);
+    if (ENQ_RES(t,res)->holders < 0) {
+        ENQ_RES(t,res)->exclusive = 0;
+    }
+    grantWaiters(t,res);
+    releaseResource(t,res);
+}
+
+
+void deq(char *name, int len, int type, struct taskLock *taskLocks) {
+    struct enqTable *t = enqTable;
+    unsigned char key[ENQ_NAME_LEN];
+    if ((t == NULL) || (taskLocks == NULL) || (taskLocks->task < 0)) {
+        return;
+    }
+    len = enqKey(name,len,key);
+
+    pthread_mutex_lock(&t->mutex);
+    int res = lookupResource(t,key,len,0);
+    if (res >= 0) {
+        int l = findLock(t,res,taskLocks->task);
+        if (l >= 0) {
+            ENQ_LOCK(t,l)->count--;
+            if (ENQ_LOCK(t,l)->count <= 0) {
+                unlock(t,l);
+            }
+        }
+    }
+    pthread_mutex_unlock(&t->mutex);
+}
+
+
+void releaseLocks(int type, struct taskLock *taskLocks) {
+    struct enqTable *t = enqTable;
+    if (taskLocks == NULL) {
+        return;
+    }
+    if ((t != NULL) && (taskLocks->task >= 0)) {
+        pthread_mutex_lock(&t->mutex);
+        struct enqTask *task = ENQ_TASK(t,taskLocks->task);
+        int l = task->locks;
+        while (l >= 0) {
+            int n = ENQ_LOCK(t,l)->nextInTask;
+            if ((type == TASK) || (ENQ_LOCK(t,l)->type == UOW)) {
+                unlock(t,l);
+            }
+            l = n;
+        }
+        if (type == TASK) {
+            task->used = 0;
+            task->waitNext = t->freeTask;
+            t->freeTask = taskLocks->task;
+            taskLocks->task = -1;
+        }
+        pthread_mutex_unlock(&t->mutex);
+    }
+    if (type == TASK) {
+        free(taskLocks);
+    }
+}
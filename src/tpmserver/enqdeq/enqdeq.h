@@ -0,0 +1,115 @@
+/*******************************************************************************************/
+/*   QWICS Server ENQ/DEQ Lock Manager                                                     */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _enqdeq_h
+#define _enqdeq_h
+
+#include <pthread.h>
+
+// Lock scope
+#define UOW 0
+#define TASK 1
+
+// Lock mode
+#define ENQ_EXCLUSIVE 0
+#define ENQ_SHARED 1
+
+// Results of enq
+#define ENQ_OK 0
+#define ENQ_BUSY -1       // NOSUSPEND and resource held by other task
+#define ENQ_DEADLOCK -2   // Task chosen as deadlock victim
+#define ENQ_TIMEOUT -3    // Wait exceeded QWICS_ENQ_TIMEOUT
+
+#define ENQ_NAME_LEN 255
+
+struct enqResource {
+    int next;             // Hash chain or free list
+    unsigned int hash;
+    int len;              // < 0 for resources identified by address
+    unsigned char name[ENQ_NAME_LEN];
+    int exclusive;
+    int holders;          // List of enqLock
+    int waitHead;         // FIFO of waiting tasks
+    int waitTail;
+    int cluster;          // Cluster lock state, see ENQ_CLUSTER_*
+    int session;          // Lock connection session of a HELD cluster lock
+    int inIdle;
+    int idleNext;         // Cached cluster locks without local holder
+    long idleSince;
+};
+
+#define ENQ_CLUSTER_NONE 0
+#define ENQ_CLUSTER_ACQUIRING 1
+#define ENQ_CLUSTER_HELD 2
+#define ENQ_CLUSTER_RELEASING 3
+
+struct enqLock {
+    int res;
+    int task;
+    int count;            // Nested ENQs of the same task
+    int type;             // UOW or TASK
+    int nextInRes;
+    int nextInTask;
+};
+
+struct enqTask {
+    int used;
+    int waitRes;          // -1 if not waiting
+    int waitMode;
+    int waitNext;
+    int granted;
+    int visit;            // Deadlock detection epoch
+    int locks;            // List of enqLock held
+    pthread_cond_t cond;
+};
+
+struct enqTable {
+    pthread_mutex_t mutex;
+    int hashSize;
+    int maxResources;
+    int maxLocks;
+    int maxTasks;
+    int freeResource;
+    int freeLock;
+    int freeTask;
+    int epoch;
+    pthread_cond_t clusterCond;
+    int idleHead;
+    int idleTail;
+    long deadlocks;
+    long timeouts;
+};
+
+// Per task handle, task slot is taken on first ENQ
+struct taskLock {
+    int task;
+};
+
+void initEnqResources(int initCons);
+void clearEnqResources(int initCons);
+struct taskLock *createTaskLocks();
+
+int enq(char *name, int len, int nosuspend, int type, struct taskLock *taskLocks);
+int enqMode(char *name, int len, int mode, int nosuspend, int type, struct taskLock *taskLocks);
+void deq(char *name, int len, int type, struct taskLock *taskLocks);
+// UOW releases locks of the unit of work, TASK all locks and the handle
+void releaseLocks(int type, struct taskLock *taskLocks);
+
+#endif
@@ -0,0 +1,453 @@
+/*******************************************************************************************/
+/*   QWICS Server B+Tree Storage for File Control                                          */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bptree.h"
+#include "../env/envconf.h"
+
+#define BPT_MAGIC 0x42505431
+#define BPT_GROW 256
+
+int bpt_map_size = -1;
+#define BPT_MAP_SIZE GETENV_NUMBER(bpt_map_size,"QWICS_FILE_MAP_MB",4096)
+
+#define PAGE(t,p) ((struct bptPage*)((t)->base+(long)(p)*(t)->hdr->pageSize))
+#define SLOT(t,pg,i) (&(pg)->data[(long)(i)*(t)->slotSize])
+#define SLOTLEN(t,pg,i) (*((int*)(SLOT(t,pg,i)+(t)->recOffs-sizeof(int))))
+#define CHILD(t,pg) ((int*)(pg)->data)
+#define IKEY(t,pg,i) (&(pg)->data[((t)->innerCap+1)*sizeof(int)+(long)(i)*(t)->hdr->keyLen])
+
+
+void setBptGeometry(struct bptree *t) {
+    struct bptHeader *h = t->hdr;
+    t->recOffs = ((h->keyLen + 3) & ~3) + sizeof(int);
+    t->slotSize = (t->recOffs + h->maxRecLen + 7) & ~7;
+    t->leafCap = (h->pageSize - sizeof(struct bptPage)) / t->slotSize;
+    t->innerCap = (h->pageSize - sizeof(struct bptPage) - sizeof(int)) / (h->keyLen + sizeof(int));
+}
+
+
+struct bptree *openBptree(char *path, int keyLen, int maxRecLen, int create, int initLock) {
+    if ((keyLen < 1) || (keyLen > BPT_MAX_KEY) || (maxRecLen < 1)) {
+        return NULL;
+    }
+    int fd = open(path,O_RDWR | (create ? O_CREAT : 0),0660);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd,&st);
+    long mapSize = (long)BPT_MAP_SIZE*1048576L;
+    unsigned char *base = (unsigned char*)mmap(NULL,mapSize,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    struct bptree *t = (struct bptree*)malloc(sizeof(struct bptree));
+    t->fd = fd;
+    t->base = base;
+    t->mapSize = mapSize;
+    t->hdr = (struct bptHeader*)base;
+    struct bptHeader *h = t->hdr;
+
+    if (st.st_size == 0) {
+        // New file, pages are sized for at least 4 records per leaf
+        int pageSize = 4096;
+        while ((pageSize - (int)sizeof(struct bptPage)) / ((((keyLen + 3) & ~3) + 4 + maxRecLen + 7) & ~7) < 4) {
+            pageSize *= 2;
+        }
+        if (!create || (ftruncate(fd,(long)pageSize*BPT_GROW) < 0)) {
+            closeBptree(t);
+            return NULL;
+        }
+        h->pageSize = pageSize;
+        h->keyLen = keyLen;
+        h->maxRecLen = maxRecLen;
+        h->root = 1;
+        h->height = 1;
+        h->numPages = 2;
+        h->allocPages = BPT_GROW;
+        h->numRecords = 0;
+        h->nextRba = 0;
+        h->version = 0;
+        struct bptPage *root = (struct bptPage*)(base + pageSize);
+        root->leaf = 1;
+        root->n = 0;
+        root->next = 0;
+        root->prev = 0;
+        h->magic = BPT_MAGIC;
+        initLock = 1;
+    } else
+    if ((h->magic != BPT_MAGIC) || (h->keyLen != keyLen) || (h->maxRecLen != maxRecLen)) {
+        printf("%s%s\n","ERROR: File does not match its definition: ",path);
+        closeBptree(t);
+        return NULL;
+    }
+    setBptGeometry(t);
+    if (initLock) {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+        pthread_rwlock_init(&h->lock,&attr);
+        pthread_rwlockattr_destroy(&attr);
+    }
+    return t;
+}
+
+
+void closeBptree(struct bptree *t) {
+    munmap(t->base,t->mapSize);
+    close(t->fd);
+    free(t);
+}
+
+
+void bptReadLock(struct bptree *t) {
+    pthread_rwlock_rdlock(&t->hdr->lock);
+}
+
+
+void bptWriteLock(struct bptree *t) {
+    pthread_rwlock_wrlock(&t->hdr->lock);
+}
+
+
+void bptUnlock(struct bptree *t) {
+    pthread_rwlock_unlock(&t->hdr->lock);
+}
+
+
+// Makes sure n more pages fit into the file, before a split changes anything
+int reservePages(struct bptree *t, int n) {
+    struct bptHeader *h = t->hdr;
+    if (h->numPages + n <= h->allocPages) {
+        return 0;
+    }
+    long pages = h->allocPages + ((h->allocPages < 65536) ? h->allocPages : 65536);
+    if (pages*h->pageSize > t->mapSize) {
+        pages = t->mapSize / h->pageSize;
+    }
+    if ((h->numPages + n > pages) || (ftruncate(t->fd,pages*h->pageSize) < 0)) {
+        return -1;
+    }
+    h->allocPages = pages;
+    return 0;
+}
+
+
+// Number of separators <= key, which is the index of the child to follow
+int innerSearch(struct bptree *t, struct bptPage *pg, unsigned char *key) {
+    int lo = 0, hi = pg->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (memcmp(IKEY(t,pg,mid),key,t->hdr->keyLen) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+// First slot with key >= key, or > key if upper is set
+int leafSearch(struct bptree *t, struct bptPage *pg, unsigned char *key, int upper) {
+    int lo = 0, hi = pg->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = memcmp(SLOT(t,pg,mid),key,t->hdr->keyLen);
+        if ((cmp < 0) || (upper && (cmp == 0))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+int descend(struct bptree *t, unsigned char *key, int *path, int *pathIdx, int *depth) {
+    int p = t->hdr->root;
+    int d = 0;
+    for (int h = t->hdr->height; h > 1; h--) {
+        struct bptPage *pg = PAGE(t,p);
+        int i = innerSearch(t,pg,key);
+        if (path != NULL) {
+            path[d] = p;
+            pathIdx[d] = i;
+        }
+        d++;
+        p = CHILD(t,pg)[i];
+    }
+    if (depth != NULL) {
+        *depth = d;
+    }
+    return p;
+}
+
+
+// Moves to the next record if the cursor is behind the end of its leaf
+int forward(struct bptree *t, struct bptCursor *c) {
+    struct bptPage *pg = PAGE(t,c->page);
+    while (c->idx >= pg->n) {
+        if (pg->next == 0) {
+            return -1;
+        }
+        c->page = pg->next;
+        c->idx = 0;
+        pg = PAGE(t,c->page);
+        if (pg->next != 0) {
+            // Read ahead for browses
+            madvise(PAGE(t,pg->next),t->hdr->pageSize,MADV_WILLNEED);
+        }
+    }
+    return 0;
+}
+
+
+int backward(struct bptree *t, struct bptCursor *c) {
+    struct bptPage *pg = PAGE(t,c->page);
+    while (c->idx < 0) {
+        if (pg->prev == 0) {
+            return -1;
+        }
+        c->page = pg->prev;
+        pg = PAGE(t,c->page);
+        c->idx = pg->n - 1;
+        if (pg->prev != 0) {
+            madvise(PAGE(t,pg->prev),t->hdr->pageSize,MADV_WILLNEED);
+        }
+    }
+    return 0;
+}
+
+
+int bptFind(struct bptree *t, unsigned char *key, int mode, struct bptCursor *c) {
+    int upper = (mode == BPT_GT) || (mode == BPT_LE);
+    c->page = descend(t,key,NULL,NULL,NULL);
+    c->idx = leafSearch(t,PAGE(t,c->page),key,upper);
+    c->version = t->hdr->version;
+    if ((mode == BPT_LE) || (mode == BPT_LT)) {
+        c->idx--;
+        return backward(t,c);
+    }
+    if (forward(t,c) < 0) {
+        return -1;
+    }
+    if ((mode == BPT_EQ) && (memcmp(bptKey(t,c),key,t->hdr->keyLen) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+int bptNext(struct bptree *t, struct bptCursor *c) {
+    c->idx++;
+    return forward(t,c);
+}
+
+
+int bptPrev(struct bptree *t, struct bptCursor *c) {
+    c->idx--;
+    return backward(t,c);
+}
+
+
+unsigned char *bptKey(struct bptree *t, struct bptCursor *c) {
+    return SLOT(t,PAGE(t,c->page),c->idx);
+}
+
+
+unsigned char *bptRecord(struct bptree *t, struct bptCursor *c, int *len) {
+    struct bptPage *pg = PAGE(t,c->page);
+    *len = SLOTLEN(t,pg,c->idx);
+    return SLOT(t,pg,c->idx) + t->recOffs;
+}
+
+
+void setSlot(struct bptree *t, struct bptPage *pg, int i, unsigned char *key,
+             unsigned char *rec, int len) {
+    if (i < pg->n) {
+        memmove(SLOT(t,pg,i+1),SLOT(t,pg,i),(long)(pg->n-i)*t->slotSize);
+    }
+    memcpy(SLOT(t,pg,i),key,t->hdr->keyLen);
+    SLOTLEN(t,pg,i) = len;
+    memcpy(SLOT(t,pg,i)+t->recOffs,rec,len);
+    pg->n++;
+}
+
+
+void setInner(struct bptree *t, struct bptPage *pg, int i, unsigned char *key, int child) {
+    int keyLen = t->hdr->keyLen;
+    if (i < pg->n) {
+        memmove(IKEY(t,pg,i+1),IKEY(t,pg,i),(long)(pg->n-i)*keyLen);
+        memmove(&CHILD(t,pg)[i+2],&CHILD(t,pg)[i+1],(long)(pg->n-i)*sizeof(int));
+    }
+    memcpy(IKEY(t,pg,i),key,keyLen);
+    CHILD(t,pg)[i+1] = child;
+    pg->n++;
+}
+
+
+// Adds separator key and new right child to the parents, splitting them as needed
+void insertSeparator(struct bptree *t, int *path, int *pathIdx, int depth,
+                     unsigned char *key, int child) {
+    int keyLen = t->hdr->keyLen;
+    unsigned char sep[BPT_MAX_KEY];
+    memcpy(sep,key,keyLen);
+    for (int d = depth-1; d >= 0; d--) {
+        struct bptPage *pg = PAGE(t,path[d]);
+        if (pg->n < t->innerCap) {
+            setInner(t,pg,pathIdx[d],sep,child);
+            return;
+        }
+        // Full inner page, middle key moves up
+        int r = t->hdr->numPages++;
+        struct bptPage *rp = PAGE(t,r);
+        int mid = (pg->n + 1) / 2;
+        unsigned char up[BPT_MAX_KEY];
+        int idx = pathIdx[d];
+        rp->leaf = 0;
+        rp->next = 0;
+        rp->prev = 0;
+        if (idx == mid) {
+            // New separator itself moves up
+            memcpy(up,sep,keyLen);
+            rp->n = pg->n - mid;
+            memcpy(IKEY(t,rp,0),IKEY(t,pg,mid),(long)rp->n*keyLen);
+            CHILD(t,rp)[0] = child;
+            memcpy(&CHILD(t,rp)[1],&CHILD(t,pg)[mid+1],(long)rp->n*sizeof(int));
+            pg->n = mid;
+        } else
+        if (idx < mid) {
+            memcpy(up,IKEY(t,pg,mid-1),keyLen);
+            rp->n = pg->n - mid;
+            memcpy(IKEY(t,rp,0),IKEY(t,pg,mid),(long)rp->n*keyLen);
+            memcpy(CHILD(t,rp),&CHILD(t,pg)[mid],(long)(rp->n+1)*sizeof(int));
+            pg->n = mid - 1;
+            setInner(t,pg,idx,sep,child);
+        } else {
+            memcpy(up,IKEY(t,pg,mid),keyLen);
+            rp->n = pg->n - mid - 1;
+            memcpy(IKEY(t,rp,0),IKEY(t,pg,mid+1),(long)rp->n*keyLen);
+            memcpy(CHILD(t,rp),&CHILD(t,pg)[mid+1],(long)(rp->n+1)*sizeof(int));
+            pg->n = mid;
+            setInner(t,rp,idx-mid-1,sep,child);
+        }
+        memcpy(sep,up,keyLen);
+        child = r;
+    }
+    // Root was split, tree grows by one level
+    int root = t->hdr->numPages++;
+    struct bptPage *rp = PAGE(t,root);
+    rp->leaf = 0;
+    rp->n = 1;
+    rp->next = 0;
+    rp->prev = 0;
+    CHILD(t,rp)[0] = t->hdr->root;
+    CHILD(t,rp)[1] = child;
+    memcpy(IKEY(t,rp,0),sep,keyLen);
+    t->hdr->root = root;
+    t->hdr->height++;
+}
+
+
+int bptInsert(struct bptree *t, unsigned char *key, unsigned char *rec, int len) {
+    struct bptHeader *h = t->hdr;
+    if ((len < 0) || (len > h->maxRecLen)) {
+        return -1;
+    }
+    int path[BPT_MAX_HEIGHT], pathIdx[BPT_MAX_HEIGHT], depth = 0;
+    int leaf = descend(t,key,path,pathIdx,&depth);
+    struct bptPage *pg = PAGE(t,leaf);
+    int i = leafSearch(t,pg,key,0);
+    if ((i < pg->n) && (memcmp(SLOT(t,pg,i),key,h->keyLen) == 0)) {
+        return 1;
+    }
+    if (pg->n < t->leafCap) {
+        setSlot(t,pg,i,key,rec,len);
+    } else {
+        if ((depth+2 >= BPT_MAX_HEIGHT) || (reservePages(t,depth+2) < 0)) {
+            return -1;
+        }
+        int r = h->numPages++;
+        struct bptPage *rp = PAGE(t,r);
+        // Appends to the last leaf keep it full, as for ESDS and sequential loads
+        int mid = ((i == pg->n) && (pg->next == 0)) ? pg->n : (pg->n + 1) / 2;
+        rp->leaf = 1;
+        rp->n = pg->n - mid;
+        memcpy(rp->data,SLOT(t,pg,mid),(long)rp->n*t->slotSize);
+        pg->n = mid;
+        rp->next = pg->next;
+        rp->prev = leaf;
+        if (pg->next != 0) {
+            PAGE(t,pg->next)->prev = r;
+        }
+        pg->next = r;
+        if (i < mid) {
+            setSlot(t,pg,i,key,rec,len);
+        } else {
+            setSlot(t,rp,i-mid,key,rec,len);
+        }
+        insertSeparator(t,path,pathIdx,depth,SLOT(t,rp,0),r);
+    }
+    h->numRecords++;
+    h->version++;
+    return 0;
+}
+
+
+int bptUpdate(struct bptree *t, unsigned char *key, unsigned char *rec, int len) {
+    if ((len < 0) || (len > t->hdr->maxRecLen)) {
+        return -1;
+    }
+    struct bptCursor c;
+    if (bptFind(t,key,BPT_EQ,&c) < 0) {
+        return 1;
+    }
+    struct bptPage *pg = PAGE(t,c.page);
+    SLOTLEN(t,pg,c.idx) = len;
+    memcpy(SLOT(t,pg,c.idx)+t->recOffs,rec,len);
+    return 0;
+}
+
+
+// Leaves are not merged, separators of emptied leaves stay valid
+int bptDelete(struct bptree *t, unsigned char *key) {
+    struct bptCursor c;
+    if (bptFind(t,key,BPT_EQ,&c) < 0) {
+        return 1;
+    }
+    struct bptPage *pg = PAGE(t,c.page);
+    if (c.idx < pg->n-1) {
+        memmove(SLOT(t,pg,c.idx),SLOT(t,pg,c.idx+1),(long)(pg->n-c.idx-1)*t->slotSize);
+    }
+    pg->n--;
+    t->hdr->numRecords--;
+    t->hdr->version++;
+    return 0;
+}
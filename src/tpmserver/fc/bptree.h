@@ -0,0 +1,96 @@
+/*******************************************************************************************/
+/*   QWICS Server B+Tree Storage for File Control                                          */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _bptree_h
+#define _bptree_h
+
+#include <pthread.h>
+
+#define BPT_MAX_KEY 255
+#define BPT_MAX_HEIGHT 16
+
+// Search modes
+#define BPT_EQ 0
+#define BPT_GE 1
+#define BPT_GT 2
+#define BPT_LE 3
+#define BPT_LT 4
+
+// Page 0 of the file, the lock is reinitialized when the server starts
+struct bptHeader {
+    int magic;
+    int pageSize;
+    int keyLen;
+    int maxRecLen;
+    int root;
+    int height;            // 1 if the root is a leaf
+    int numPages;
+    int allocPages;        // Pages the file is sized for
+    long long numRecords;
+    long long nextRba;     // Next RBA of an entry sequenced file
+    long long version;     // Changed by every insert and delete
+    pthread_rwlock_t lock;
+};
+
+// Leaf slots hold key, length and record, inner pages n keys and n+1 children
+struct bptPage {
+    int leaf;
+    int n;
+    int next;              // Leaf chain for browsing, 0 at the ends
+    int prev;
+    unsigned char data[];
+};
+
+struct bptree {
+    int fd;
+    unsigned char *base;   // Whole file range is mapped once, so pages never move
+    long mapSize;
+    struct bptHeader *hdr;
+    int recOffs;           // Offset of the record in a leaf slot
+    int slotSize;
+    int leafCap;
+    int innerCap;
+};
+
+// Position of a record, only valid while version is unchanged
+struct bptCursor {
+    int page;
+    int idx;
+    long long version;
+};
+
+struct bptree *openBptree(char *path, int keyLen, int maxRecLen, int create, int initLock);
+void closeBptree(struct bptree *t);
+void bptReadLock(struct bptree *t);
+void bptWriteLock(struct bptree *t);
+void bptUnlock(struct bptree *t);
+
+// Caller holds the tree lock. Keys are keyLen bytes, compared with memcmp.
+int bptFind(struct bptree *t, unsigned char *key, int mode, struct bptCursor *c);
+int bptNext(struct bptree *t, struct bptCursor *c);
+int bptPrev(struct bptree *t, struct bptCursor *c);
+unsigned char *bptKey(struct bptree *t, struct bptCursor *c);
+unsigned char *bptRecord(struct bptree *t, struct bptCursor *c, int *len);
+// Return 0 if done, 1 for a duplicate key or missing record, -1 if out of space
+int bptInsert(struct bptree *t, unsigned char *key, unsigned char *rec, int len);
+int bptUpdate(struct bptree *t, unsigned char *key, unsigned char *rec, int len);
+int bptDelete(struct bptree *t, unsigned char *key);
+
+#endif
@@ -0,0 +1,480 @@
+/*******************************************************************************************/
+/*   QWICS Server File Control                                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filectl.h"
+#include "../env/envconf.h"
+
+char *fileDefFile = NULL;
+struct fcFile *files = NULL;
+int numFiles = 0;
+
+
+void initFileControl(int initCons) {
+    char line[512];
+    GETENV_STRING(fileDefFile,"QWICS_FILE_DEFS","../conf/files.conf");
+    FILE *f = fopen(fileDefFile,"r");
+    if (f == NULL) {
+        return;
+    }
+    int size = 0;
+    while (fgets(line,sizeof(line),f) != NULL) {
+        // NAME TYPE RECLEN KEYLEN KEYPOS PATH, keys as in IDCAMS KEYS(length offset)
+        char name[FC_NAME_LEN+1], type[5], path[256];
+        int recLen = 0, keyLen = 0, keyPos = 0;
+        if ((line[0] == '#') ||
+            (sscanf(line,"%8s %4s %d %d %d %255s",name,type,&recLen,&keyLen,&keyPos,path) != 6)) {
+            continue;
+        }
+        if (numFiles >= size) {
+            size = (size == 0) ? 16 : 2*size;
+            files = (struct fcFile*)realloc(files,size*sizeof(struct fcFile));
+        }
+        struct fcFile *fc = &files[numFiles];
+        sprintf(fc->name,"%s",name);
+        sprintf(fc->path,"%s",path);
+        fc->type = (strcmp(type,"ESDS") == 0) ? FC_ESDS : (strcmp(type,"RRDS") == 0) ? FC_RRDS : FC_KSDS;
+        fc->recLen = recLen;
+        fc->keyLen = (fc->type == FC_KSDS) ? keyLen : 8;
+        fc->keyPos = (fc->type == FC_KSDS) ? keyPos : 0;
+        fc->tree = openBptree(path,fc->keyLen,recLen,1,initCons);
+        if (fc->tree == NULL) {
+            printf("%s%s\n","ERROR: Could not open file ",name);
+            continue;
+        }
+        numFiles++;
+    }
+    fclose(f);
+}
+
+
+void clearFileControl(int initCons) {
+    for (int i = 0; i < numFiles; i++) {
+        closeBptree(files[i].tree);
+    }
+    free(files);
+    files = NULL;
+    numFiles = 0;
+}
+
+
+int numFileDefs() {
+    return numFiles;
+}
+
+
+struct fcFile *getFile(char *name) {
+    for (int i = 0; i < numFiles; i++) {
+        if (strcmp(files[i].name,name) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+
+void initFcTask(struct fcTask *task, struct taskLock *taskLocks) {
+    task->taskLocks = taskLocks;
+    task->numUpdates = 0;
+    for (int i = 0; i < FC_MAX_BROWSES; i++) {
+        task->browses[i].file = NULL;
+    }
+}
+
+
+// Record locks are released with the other UOW locks
+void endFcUow(struct fcTask *task) {
+    task->numUpdates = 0;
+}
+
+
+void fileKey(struct fcFile *f, unsigned char *data, int len, long long rid, unsigned char *key) {
+    if (f->type != FC_KSDS) {
+        for (int i = 0; i < 8; i++) {
+            key[i] = (unsigned char)(rid >> (56-8*i));
+        }
+        return;
+    }
+    if (len > f->keyLen) {
+        len = f->keyLen;
+    }
+    memcpy(key,data,len);
+    memset(&key[len],' ',f->keyLen-len);
+}
+
+
+long long fileRid(unsigned char *key) {
+    long long rid = 0;
+    for (int i = 0; i < 8; i++) {
+        rid = (rid << 8) | key[i];
+    }
+    return rid;
+}
+
+
+// Record lock name is file name and key
+int lockRecord(struct fcTask *task, struct fcFile *f, unsigned char *key, int nosuspend, int lock) {
+    unsigned char name[FC_NAME_LEN+BPT_MAX_KEY];
+    memset(name,' ',FC_NAME_LEN);
+    memcpy(name,f->name,strlen(f->name));
+    memcpy(&name[FC_NAME_LEN],key,f->keyLen);
+    int l = FC_NAME_LEN + f->keyLen;
+    if (l > ENQ_NAME_LEN) {
+        l = ENQ_NAME_LEN;
+    }
+    if (!lock) {
+        deq((char*)name,l,UOW,task->taskLocks);
+        return 0;
+    }
+    int r = enq((char*)name,l,nosuspend,UOW,task->taskLocks);
+    if (r == ENQ_BUSY) {
+        return 101;   // RECORDBUSY
+    }
+    return (r == ENQ_OK) ? 0 : FC_LOCK_FAILED;
+}
+
+
+int findUpdate(struct fcTask *task, struct fcFile *f) {
+    for (int i = 0; i < task->numUpdates; i++) {
+        if (task->updates[i].file == f) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+void dropUpdate(struct fcTask *task, int i) {
+    lockRecord(task,task->updates[i].file,task->updates[i].key,0,0);
+    task->numUpdates--;
+    task->updates[i] = task->updates[task->numUpdates];
+}
+
+
+// Copies the record at the cursor, caller holds the tree lock
+int copyRecord(struct bptree *t, struct bptCursor *c, unsigned char *key,
+               unsigned char *buf, int *len, int *resp2) {
+    int l = 0;
+    unsigned char *rec = bptRecord(t,c,&l);
+    memcpy(key,bptKey(t,c),t->hdr->keyLen);
+    int resp = 0;
+    if (l > *len) {
+        resp = 22;   // LENGERR
+        *resp2 = 11;
+    } else {
+        *len = l;
+    }
+    if (buf != NULL) {
+        memcpy(buf,rec,*len);
+    }
+    if (resp != 0) {
+        *len = l;
+    }
+    return resp;
+}
+
+
+// Positions on the first record matching key in its first genLen bytes
+int findRecord(struct fcFile *f, unsigned char *key, int genLen, int opts, struct bptCursor *c) {
+    struct bptree *t = f->tree;
+    unsigned char k[BPT_MAX_KEY];
+    memcpy(k,key,f->keyLen);
+    if (genLen < f->keyLen) {
+        memset(&k[genLen],0x00,f->keyLen-genLen);
+    }
+    if (bptFind(t,k,(opts & FC_GTEQ) ? BPT_GE : ((genLen < f->keyLen) ? BPT_GE : BPT_EQ),c) < 0) {
+        return -1;
+    }
+    if (!(opts & FC_GTEQ) && (memcmp(bptKey(t,c),key,genLen) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+int fileRead(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+             unsigned char *buf, int *len, int *resp2) {
+    struct bptree *t = f->tree;
+    struct bptCursor c;
+    int resp = 0;
+    *resp2 = 0;
+    if ((opts & FC_UPDATE) && (findUpdate(task,f) >= 0)) {
+        return 16;   // INVREQ, one record per file may be held for update
+    }
+    if ((opts & FC_UPDATE) && ((genLen < f->keyLen) || (opts & FC_GTEQ))) {
+        // Key of the record to lock is only known after reading
+        bptReadLock(t);
+        if (findRecord(f,key,genLen,opts,&c) < 0) {
+            bptUnlock(t);
+            return 13;   // NOTFND
+        }
+        memcpy(key,bptKey(t,&c),f->keyLen);
+        bptUnlock(t);
+        genLen = f->keyLen;
+        opts &= ~FC_GTEQ;
+    }
+    if (opts & FC_UPDATE) {
+        // Lock first, tree is never locked while waiting for a record
+        resp = lockRecord(task,f,key,opts & FC_NOSUSPEND,1);
+        if (resp != 0) {
+            return resp;
+        }
+    }
+    bptReadLock(t);
+    if (findRecord(f,key,genLen,opts,&c) < 0) {
+        resp = 13;
+    } else {
+        resp = copyRecord(t,&c,key,buf,len,resp2);
+    }
+    bptUnlock(t);
+    if (opts & FC_UPDATE) {
+        if (resp == 13) {
+            lockRecord(task,f,key,0,0);
+        } else {
+            task->updates[task->numUpdates].file = f;
+            memcpy(task->updates[task->numUpdates].key,key,f->keyLen);
+            task->numUpdates++;
+        }
+    }
+    return resp;
+}
+
+
+int fileWrite(struct fcTask *task, struct fcFile *f, unsigned char *key,
+              unsigned char *buf, int len, int *resp2) {
+    struct bptree *t = f->tree;
+    *resp2 = 0;
+    if ((len < 0) || (len > f->recLen)) {
+        return 22;
+    }
+    if ((f->type == FC_RRDS) && (fileRid(key) < 1)) {
+        return 16;
+    }
+    bptWriteLock(t);
+    if (f->type == FC_ESDS) {
+        // New records are appended at the next RBA
+        fileKey(f,NULL,0,t->hdr->nextRba,key);
+    }
+    int r = bptInsert(t,key,buf,len);
+    if ((r == 0) && (f->type == FC_ESDS)) {
+        t->hdr->nextRba += len;
+    }
+    bptUnlock(t);
+    if (r > 0) {
+        return 14;   // DUPREC
+    }
+    return (r < 0) ? 18 : 0;   // NOSPACE
+}
+
+
+int fileRewrite(struct fcTask *task, struct fcFile *f, unsigned char *buf, int len, int *resp2) {
+    *resp2 = 0;
+    int u = findUpdate(task,f);
+    if (u < 0) {
+        return 16;
+    }
+    if ((len < 0) || (len > f->recLen)) {
+        return 22;
+    }
+    bptWriteLock(f->tree);
+    int r = bptUpdate(f->tree,task->updates[u].key,buf,len);
+    bptUnlock(f->tree);
+    dropUpdate(task,u);
+    return (r == 0) ? 0 : 13;
+}
+
+
+int fileDelete(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+               int *numrec, int *resp2) {
+    struct bptree *t = f->tree;
+    *resp2 = 0;
+    *numrec = 0;
+    if (f->type == FC_ESDS) {
+        return 16;
+    }
+    if (key == NULL) {
+        // Record read for update before
+        int u = findUpdate(task,f);
+        if (u < 0) {
+            return 16;
+        }
+        bptWriteLock(t);
+        int r = bptDelete(t,task->updates[u].key);
+        bptUnlock(t);
+        dropUpdate(task,u);
+        *numrec = (r == 0) ? 1 : 0;
+        return (r == 0) ? 0 : 13;
+    }
+    if (genLen >= f->keyLen) {
+        // Wait for a task holding the record for update
+        int resp = lockRecord(task,f,key,opts & FC_NOSUSPEND,1);
+        if (resp != 0) {
+            return resp;
+        }
+        bptWriteLock(t);
+        int r = bptDelete(t,key);
+        bptUnlock(t);
+        lockRecord(task,f,key,0,0);
+        *numrec = (r == 0) ? 1 : 0;
+        return (r == 0) ? 0 : 13;
+    }
+    // Generic delete of all records with the key prefix, each one locked as above
+    struct bptCursor c;
+    while (1) {
+        unsigned char k[BPT_MAX_KEY];
+        bptReadLock(t);
+        if (findRecord(f,key,genLen,0,&c) < 0) {
+            bptUnlock(t);
+            break;
+        }
+        memcpy(k,bptKey(t,&c),f->keyLen);
+        bptUnlock(t);
+        int resp = lockRecord(task,f,k,opts & FC_NOSUSPEND,1);
+        if (resp != 0) {
+            return resp;
+        }
+        bptWriteLock(t);
+        int r = bptDelete(t,k);
+        bptUnlock(t);
+        lockRecord(task,f,k,0,0);
+        if (r == 0) {
+            (*numrec)++;
+        }
+    }
+    return (*numrec > 0) ? 0 : 13;
+}
+
+
+int fileUnlock(struct fcTask *task, struct fcFile *f) {
+    int u = findUpdate(task,f);
+    if (u >= 0) {
+        dropUpdate(task,u);
+    }
+    return 0;
+}
+
+
+struct fcBrowse *findBrowse(struct fcTask *task, struct fcFile *f, int reqid) {
+    for (int i = 0; i < FC_MAX_BROWSES; i++) {
+        if ((task->browses[i].file == f) && (task->browses[i].reqid == reqid)) {
+            return &task->browses[i];
+        }
+    }
+    return NULL;
+}
+
+
+int fileStartbr(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+                int reqid, int reset, int *resp2) {
+    *resp2 = 0;
+    struct fcBrowse *br = findBrowse(task,f,reqid);
+    if ((br == NULL) && !reset) {
+        for (int i = 0; (br == NULL) && (i < FC_MAX_BROWSES); i++) {
+            if (task->browses[i].file == NULL) {
+                br = &task->browses[i];
+            }
+        }
+        if (br == NULL) {
+            return 16;
+        }
+    } else
+    if ((br == NULL) || !reset) {
+        // RESETBR without browse, or STARTBR of an active one
+        return 16;
+    }
+    struct bptCursor c;
+    bptReadLock(f->tree);
+    int found = findRecord(f,key,genLen,opts,&c);
+    bptUnlock(f->tree);
+    if (found < 0) {
+        int high = 1;
+        for (int i = 0; i < genLen; i++) {
+            high = high && (key[i] == 0xFF);
+        }
+        // High values position behind the last record for READPREV
+        if (!high) {
+            if (!reset) {
+                br->file = NULL;
+            }
+            return 13;
+        }
+    }
+    br->file = f;
+    br->reqid = reqid;
+    br->dir = 0;
+    br->inclusive = 1;
+    br->positioned = 0;
+    memcpy(br->key,key,f->keyLen);
+    if (genLen < f->keyLen) {
+        memset(&br->key[genLen],0x00,f->keyLen-genLen);
+    }
+    return 0;
+}
+
+
+int fileReadnext(struct fcTask *task, struct fcFile *f, int reqid, int prev, unsigned char *key,
+                 unsigned char *buf, int *len, int *resp2) {
+    struct bptree *t = f->tree;
+    *resp2 = 0;
+    struct fcBrowse *br = findBrowse(task,f,reqid);
+    if (br == NULL) {
+        return 16;
+    }
+    int dir = prev ? -1 : 1;
+    if ((br->dir != 0) && (br->dir != dir)) {
+        // Change of direction returns the current record again
+        br->inclusive = 1;
+        br->positioned = 0;
+    }
+    bptReadLock(t);
+    int r = 0;
+    if (br->positioned && !br->inclusive && (br->cursor.version == t->hdr->version)) {
+        r = prev ? bptPrev(t,&br->cursor) : bptNext(t,&br->cursor);
+    } else {
+        int mode = prev ? (br->inclusive ? BPT_LE : BPT_LT) : (br->inclusive ? BPT_GE : BPT_GT);
+        r = bptFind(t,br->key,mode,&br->cursor);
+    }
+    int resp = 0;
+    if (r < 0) {
+        resp = 20;   // ENDFILE
+        br->positioned = 0;
+    } else {
+        resp = copyRecord(t,&br->cursor,br->key,buf,len,resp2);
+        memcpy(key,br->key,f->keyLen);
+        br->positioned = 1;
+        br->inclusive = 0;
+        br->dir = dir;
+    }
+    bptUnlock(t);
+    return resp;
+}
+
+
+int fileEndbr(struct fcTask *task, struct fcFile *f, int reqid) {
+    struct fcBrowse *br = findBrowse(task,f,reqid);
+    if (br == NULL) {
+        return 16;
+    }
+    br->file = NULL;
+    return 0;
+}
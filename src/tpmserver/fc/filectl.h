@@ -0,0 +1,104 @@
+/*******************************************************************************************/
+/*   QWICS Server File Control                                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _filectl_h
+#define _filectl_h
+
+#include "bptree.h"
+#include "../enqdeq/enqdeq.h"
+
+#define FC_NAME_LEN 8
+#define FC_MAX_UPDATES 16
+#define FC_MAX_BROWSES 16
+
+// File types, ESDS and RRDS are keyed by RBA or RRN in big endian byte order
+#define FC_KSDS 0
+#define FC_ESDS 1
+#define FC_RRDS 2
+
+// Options of file control cmds
+#define FC_GENERIC 1
+#define FC_GTEQ 2
+#define FC_UPDATE 4
+#define FC_NOSUSPEND 8
+
+// Returned instead of a RESP if the task lost a deadlock or timed out waiting for a record
+#define FC_LOCK_FAILED -1
+
+struct fcFile {
+    char name[FC_NAME_LEN+1];
+    int type;
+    int recLen;
+    int keyLen;
+    int keyPos;
+    char path[256];
+    struct bptree *tree;
+};
+
+// Record read for update, locked until REWRITE, DELETE, UNLOCK or end of UOW
+struct fcUpdate {
+    struct fcFile *file;
+    unsigned char key[BPT_MAX_KEY];
+};
+
+struct fcBrowse {
+    struct fcFile *file;
+    int reqid;
+    int dir;          // Last direction read, 0 after STARTBR or RESETBR
+    int inclusive;    // Next read may return the record at key itself
+    unsigned char key[BPT_MAX_KEY];
+    struct bptCursor cursor;
+    int positioned;   // Cursor is on the record last returned
+};
+
+struct fcTask {
+    struct taskLock *taskLocks;
+    int numUpdates;
+    struct fcUpdate updates[FC_MAX_UPDATES];
+    struct fcBrowse browses[FC_MAX_BROWSES];
+};
+
+void initFileControl(int initCons);
+void clearFileControl(int initCons);
+int numFileDefs();
+struct fcFile *getFile(char *name);
+void initFcTask(struct fcTask *task, struct taskLock *taskLocks);
+void endFcUow(struct fcTask *task);
+
+// Builds the key of a record from RIDFLD data or the RBA/RRN
+void fileKey(struct fcFile *f, unsigned char *data, int len, long long rid, unsigned char *key);
+long long fileRid(unsigned char *key);
+
+// All return the CICS RESP code, key holds the key of the record accessed afterwards
+int fileRead(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+             unsigned char *buf, int *len, int *resp2);
+int fileWrite(struct fcTask *task, struct fcFile *f, unsigned char *key,
+              unsigned char *buf, int len, int *resp2);
+int fileRewrite(struct fcTask *task, struct fcFile *f, unsigned char *buf, int len, int *resp2);
+int fileDelete(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+               int *numrec, int *resp2);
+int fileUnlock(struct fcTask *task, struct fcFile *f);
+int fileStartbr(struct fcTask *task, struct fcFile *f, unsigned char *key, int genLen, int opts,
+                int reqid, int reset, int *resp2);
+int fileReadnext(struct fcTask *task, struct fcFile *f, int reqid, int prev, unsigned char *key,
+                 unsigned char *buf, int *len, int *resp2);
+int fileEndbr(struct fcTask *task, struct fcFile *f, int reqid);
+
+#endif
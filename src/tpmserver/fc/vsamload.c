@@ -0,0 +1,146 @@
+/*******************************************************************************************/
+/*   QWICS File Control Loader for IDCAMS REPRO Exports                                    */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bptree.h"
+
+// Offline loader, reads the fixed length or RDW prefixed records of an IDCAMS REPRO
+// export and loads them into the file defined in the file definitions
+
+#define KSDS 0
+#define ESDS 1
+#define RRDS 2
+
+
+int readRecord(FILE *in, int rdw, int recLen, unsigned char *buf) {
+    if (!rdw) {
+        return (fread(buf,1,recLen,in) == (size_t)recLen) ? recLen : -1;
+    }
+    unsigned char hdr[4];
+    if (fread(hdr,1,4,in) != 4) {
+        return -1;
+    }
+    // Record descriptor word, big endian length including itself
+    int len = ((hdr[0] << 8) | hdr[1]) - 4;
+    if ((len < 0) || (len > recLen) || (fread(buf,1,len,in) != (size_t)len)) {
+        return -2;
+    }
+    return len;
+}
+
+
+int main(int argc, char **argv) {
+    int rdw = 0;
+    if ((argc > 1) && (strcmp(argv[1],"-v") == 0)) {
+        rdw = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 4) {
+        printf("%s\n","Usage: vsamload [-v] <file defs> <file name> <REPRO export>");
+        return 1;
+    }
+
+    FILE *defs = fopen(argv[1],"r");
+    if (defs == NULL) {
+        printf("%s%s\n","ERROR: Could not open ",argv[1]);
+        return 1;
+    }
+    char line[512], name[9], type[5], path[256];
+    int recLen = 0, keyLen = 0, keyPos = 0, found = 0;
+    while (!found && (fgets(line,sizeof(line),defs) != NULL)) {
+        found = (line[0] != '#') &&
+                (sscanf(line,"%8s %4s %d %d %d %255s",name,type,&recLen,&keyLen,&keyPos,path) == 6) &&
+                (strcmp(name,argv[2]) == 0);
+    }
+    fclose(defs);
+    if (!found) {
+        printf("%s%s\n","ERROR: No definition for file ",argv[2]);
+        return 1;
+    }
+    int ftype = (strcmp(type,"ESDS") == 0) ? ESDS : (strcmp(type,"RRDS") == 0) ? RRDS : KSDS;
+    if (ftype != KSDS) {
+        keyLen = 8;
+        keyPos = 0;
+    }
+    if ((keyLen < 1) || (keyLen > BPT_MAX_KEY) || (keyPos < 0) || (keyPos + keyLen > recLen)) {
+        printf("%s%s\n","ERROR: Invalid key definition for file ",name);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[3],"rb");
+    if (in == NULL) {
+        printf("%s%s\n","ERROR: Could not open ",argv[3]);
+        return 1;
+    }
+    struct bptree *t = openBptree(path,keyLen,recLen,1,1);
+    if (t == NULL) {
+        printf("%s%s\n","ERROR: Could not open ",path);
+        fclose(in);
+        return 1;
+    }
+
+    unsigned char *buf = (unsigned char*)malloc(recLen);
+    unsigned char key[BPT_MAX_KEY];
+    long long rid = 0, loaded = 0, dups = 0;
+    int len = 0, r = 0;
+    bptWriteLock(t);
+    while ((len = readRecord(in,rdw,recLen,buf)) >= 0) {
+        if (ftype == KSDS) {
+            if (len < keyPos + keyLen) {
+                printf("%s%lld\n","ERROR: Record too short for key at ",loaded+dups+1);
+                r = -1;
+                break;
+            }
+            memcpy(key,&buf[keyPos],keyLen);
+        } else {
+            rid = (ftype == ESDS) ? t->hdr->nextRba : rid + 1;
+            for (int i = 0; i < 8; i++) {
+                key[i] = (unsigned char)(rid >> (56-8*i));
+            }
+        }
+        r = bptInsert(t,key,buf,len);
+        if (r < 0) {
+            printf("%s\n","ERROR: Could not insert record, file is full");
+            break;
+        }
+        if (r > 0) {
+            dups++;
+            continue;
+        }
+        if (ftype == ESDS) {
+            t->hdr->nextRba += len;
+        }
+        loaded++;
+    }
+    bptUnlock(t);
+    if (len == -2) {
+        printf("%s\n","ERROR: Invalid record descriptor word");
+    }
+    printf("%lld%s%lld%s%s\n",loaded," records loaded, ",dups," duplicate keys skipped into ",path);
+
+    free(buf);
+    closeBptree(t);
+    fclose(in);
+    return ((len == -2) || (r < 0)) ? 1 : 0;
+}
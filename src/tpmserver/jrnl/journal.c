@@ -0,0 +1,478 @@
+/*******************************************************************************************/
+/*   QWICS Server Journal Writer                                                           */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+#include "../env/envconf.h"
+#include "../clock/tpmclock.h"
+
+int jrnl_max_journals = -1;
+#define JRNL_MAX_JOURNALS GETENV_NUMBER(jrnl_max_journals,"QWICS_JOURNAL_MAX",64)
+int jrnl_buffer_size = -1;
+#define JRNL_BUFFER_SIZE GETENV_NUMBER(jrnl_buffer_size,"QWICS_JOURNAL_BUFFER",4194304)
+int jrnl_segment_size = -1;
+#define JRNL_SEGMENT_SIZE GETENV_NUMBER(jrnl_segment_size,"QWICS_JOURNAL_SEGMENT_SIZE",67108864)
+int jrnl_interval = -1;
+#define JRNL_INTERVAL GETENV_NUMBER(jrnl_interval,"QWICS_JOURNAL_INTERVAL",10)
+char *jrnlDir = NULL;
+
+struct journal *journals = NULL;
+int numJournals = 0;
+pthread_mutex_t jrnlMutex;
+pthread_cond_t jrnlCond;
+int jrnlWakeups = 0;
+int jrnlRunning = 0;
+pthread_t jrnlThread;
+
+
+void segmentPath(char *path, char *name, long long segment) {
+    sprintf(path,"%s/%s.%010lld.jnl",jrnlDir,name,segment);
+}
+
+
+// Returns the oldest or newest segment number of a journal, -1 if there is none
+long long findSegment(char *name, int newest) {
+    DIR *dir = opendir(jrnlDir);
+    if (dir == NULL) {
+        return -1;
+    }
+    long long found = -1;
+    int l = strlen(name);
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if ((strncmp(e->d_name,name,l) != 0) || (e->d_name[l] != '.') ||
+            (strlen(e->d_name) != l+15) || (strcmp(&e->d_name[l+11],".jnl") != 0)) {
+            continue;
+        }
+        long long s = atoll(&e->d_name[l+1]);
+        if ((found < 0) || (newest && (s > found)) || (!newest && (s < found))) {
+            found = s;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+
+int openSegment(struct journal *j) {
+    char path[1024];
+    segmentPath(path,j->name,j->segment);
+    j->fd = open(path,O_WRONLY | O_CREAT | O_APPEND,0660);
+    j->segmentLen = 0;
+    if (j->fd < 0) {
+        printf("%s%s\n","ERROR: Could not open journal segment ",path);
+        return -1;
+    }
+    return 0;
+}
+
+
+void wakeJournalWriter() {
+    pthread_mutex_lock(&jrnlMutex);
+    jrnlWakeups++;
+    pthread_cond_signal(&jrnlCond);
+    pthread_mutex_unlock(&jrnlMutex);
+}
+
+
+// No record reaches disk anymore, waiting and later writers get IOERR
+void failJournal(struct journal *j) {
+    printf("%s%s\n","ERROR: Could not write journal ",j->name);
+    pthread_mutex_lock(&j->lock);
+    j->failed = 1;
+    pthread_cond_broadcast(&j->syncCond);
+    pthread_cond_broadcast(&j->spaceCond);
+    pthread_mutex_unlock(&j->lock);
+}
+
+
+// Appends the committed records to the segment file, only called by the writer thread
+void flushJournal(struct journal *j) {
+    if (j->failed) {
+        return;
+    }
+    long long pos = j->tail;
+    long long end = pos;
+    long long head = __atomic_load_n(&j->head,__ATOMIC_ACQUIRE);
+    while (end < head) {
+        unsigned int l = __atomic_load_n((unsigned int*)&j->buf[end % j->size],__ATOMIC_ACQUIRE);
+        if (l == 0) {
+            // Record still being filled, later ones wait for it
+            break;
+        }
+        end += l;
+    }
+    if (end > pos) {
+        struct iovec iov[2];
+        long offs = pos % j->size;
+        long len = end - pos;
+        int n = 1;
+        iov[0].iov_base = &j->buf[offs];
+        iov[0].iov_len = len;
+        if (offs + len > j->size) {
+            iov[0].iov_len = j->size - offs;
+            iov[1].iov_base = j->buf;
+            iov[1].iov_len = len - iov[0].iov_len;
+            n = 2;
+        }
+        if ((j->fd < 0) || (writev(j->fd,iov,n) != len)) {
+            failJournal(j);
+            return;
+        }
+        // Space is reused by producers, commit marks must be cleared
+        for (int i = 0; i < n; i++) {
+            memset(iov[i].iov_base,0x00,iov[i].iov_len);
+        }
+        j->segmentLen += len;
+        pthread_mutex_lock(&j->lock);
+        __atomic_store_n(&j->tail,end,__ATOMIC_RELEASE);
+        pthread_cond_broadcast(&j->spaceCond);
+        pthread_mutex_unlock(&j->lock);
+    }
+    if (j->synced < j->tail) {
+        // One fsync for all records written since the last one
+        if ((j->fd < 0) || (fdatasync(j->fd) != 0)) {
+            failJournal(j);
+            return;
+        }
+        pthread_mutex_lock(&j->lock);
+        j->synced = j->tail;
+        pthread_cond_broadcast(&j->syncCond);
+        pthread_mutex_unlock(&j->lock);
+    }
+    if ((j->segmentLen >= JRNL_SEGMENT_SIZE) && (j->fd >= 0)) {
+        close(j->fd);
+        j->segment++;
+        openSegment(j);
+    }
+}
+
+
+void *journalWriter(void *arg) {
+    pthread_mutex_lock(&jrnlMutex);
+    while (jrnlRunning) {
+        if (jrnlWakeups == 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME,&ts);
+            ts.tv_nsec += (long)JRNL_INTERVAL*1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec = ts.tv_nsec % 1000000000L;
+            pthread_cond_timedwait(&jrnlCond,&jrnlMutex,&ts);
+        }
+        jrnlWakeups = 0;
+        int n = numJournals;
+        pthread_mutex_unlock(&jrnlMutex);
+        for (int i = 0; i < n; i++) {
+            flushJournal(&journals[i]);
+        }
+        pthread_mutex_lock(&jrnlMutex);
+    }
+    pthread_mutex_unlock(&jrnlMutex);
+    return NULL;
+}
+
+
+void initJournals() {
+    GETENV_STRING(jrnlDir,"QWICS_JOURNAL_DIR","../data/journal");
+    mkdir(jrnlDir,0770);
+    long size = (long)JRNL_MAX_JOURNALS*sizeof(struct journal);
+    if (posix_memalign((void**)&journals,64,size) != 0) {
+        printf("%s\n","ERROR: Could not allocate journal table");
+        journals = NULL;
+        return;
+    }
+    memset(journals,0x00,size);
+    numJournals = 0;
+    pthread_mutex_init(&jrnlMutex,NULL);
+    pthread_cond_init(&jrnlCond,NULL);
+    jrnlRunning = 1;
+    pthread_create(&jrnlThread,NULL,journalWriter,NULL);
+}
+
+
+void clearJournals() {
+    if (journals == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&jrnlMutex);
+    jrnlRunning = 0;
+    pthread_cond_signal(&jrnlCond);
+    pthread_mutex_unlock(&jrnlMutex);
+    pthread_join(jrnlThread,NULL);
+    for (int i = 0; i < numJournals; i++) {
+        struct journal *j = &journals[i];
+        flushJournal(j);
+        pthread_mutex_lock(&j->lock);
+        // Release tasks still waiting, their records are on disk now unless failed
+        pthread_cond_broadcast(&j->syncCond);
+        pthread_mutex_unlock(&j->lock);
+        if (j->fd >= 0) {
+            close(j->fd);
+        }
+        free(j->buf);
+    }
+    free(journals);
+    journals = NULL;
+}
+
+
+struct journal *getJournal(char *name) {
+    int n = __atomic_load_n(&numJournals,__ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        if (strcmp(journals[i].name,name) == 0) {
+            return &journals[i];
+        }
+    }
+    struct journal *j = NULL;
+    pthread_mutex_lock(&jrnlMutex);
+    for (int i = n; i < numJournals; i++) {
+        if (strcmp(journals[i].name,name) == 0) {
+            j = &journals[i];
+        }
+    }
+    if ((j == NULL) && (numJournals < JRNL_MAX_JOURNALS)) {
+        j = &journals[numJournals];
+        sprintf(j->name,"%s",name);
+        j->size = JRNL_BUFFER_SIZE & ~(long)(JRNL_ALIGN-1);
+        j->buf = (unsigned char*)calloc(1,j->size);
+        j->head = 0;
+        j->tail = 0;
+        j->synced = 0;
+        j->failed = 0;
+        j->reqid = 0;
+        j->waiters = 0;
+        // A restarted server continues in a new segment, behind a possibly torn one
+        long long last = findSegment(name,1);
+        j->segment = (last < 0) ? 1 : last+1;
+        if ((j->buf == NULL) || (openSegment(j) < 0)) {
+            free(j->buf);
+            j = NULL;
+        } else {
+            pthread_mutex_init(&j->lock,NULL);
+            pthread_cond_init(&j->syncCond,NULL);
+            pthread_cond_init(&j->spaceCond,NULL);
+            j->state = 1;
+            __atomic_store_n(&numJournals,numJournals+1,__ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&jrnlMutex);
+    return j;
+}
+
+
+void ringCopy(struct journal *j, long long pos, unsigned char *data, int len) {
+    long offs = pos % j->size;
+    long l = (offs + len > j->size) ? j->size - offs : len;
+    memcpy(&j->buf[offs],data,l);
+    if (l < len) {
+        memcpy(j->buf,data+l,len-l);
+    }
+}
+
+
+// Returns IOERR if the records could not be written
+int waitJournalSynced(struct journal *j, long long pos) {
+    wakeJournalWriter();
+    pthread_mutex_lock(&j->lock);
+    j->waiters++;
+    while ((j->synced < pos) && jrnlRunning && !j->failed) {
+        pthread_cond_wait(&j->syncCond,&j->lock);
+    }
+    j->waiters--;
+    int resp = (j->synced < pos) ? 17 : 0;
+    pthread_mutex_unlock(&j->lock);
+    return resp;
+}
+
+
+int writeJournal(char *name, char *jtypeid, unsigned char *prefix, int prefixLen,
+                 unsigned char *data, int len, int wait, int nosuspend, unsigned int *reqid) {
+    if ((journals == NULL) || !jrnlRunning) {
+        return 43;   // JIDERR
+    }
+    struct journal *j = getJournal(name);
+    if (j == NULL) {
+        return 43;
+    }
+    if (__atomic_load_n(&j->failed,__ATOMIC_ACQUIRE)) {
+        return 17;   // IOERR
+    }
+    if ((len < 0) || (prefixLen < 0)) {
+        return 22;   // LENGERR
+    }
+    long rl = ((long)sizeof(struct jrnlRecHeader) + prefixLen + len + JRNL_ALIGN-1) & ~(long)(JRNL_ALIGN-1);
+    if (rl > j->size) {
+        return 22;
+    }
+
+    // Reserve space, records are written in order of reservation
+    long long pos = 0;
+    for (;;) {
+        pos = __atomic_load_n(&j->head,__ATOMIC_RELAXED);
+        if (pos + rl - __atomic_load_n(&j->tail,__ATOMIC_ACQUIRE) > j->size) {
+            if (nosuspend) {
+                return 45;   // NOJBUFSP
+            }
+            wakeJournalWriter();
+            pthread_mutex_lock(&j->lock);
+            while ((pos + rl - j->tail > j->size) && jrnlRunning && !j->failed) {
+                pthread_cond_wait(&j->spaceCond,&j->lock);
+            }
+            pthread_mutex_unlock(&j->lock);
+            if (j->failed) {
+                return 17;
+            }
+            if (!jrnlRunning) {
+                return 43;
+            }
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&j->head,&pos,pos+rl,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    struct jrnlRecHeader hdr;
+    memset(&hdr,0x00,sizeof(hdr));
+    hdr.dataLen = len;
+    hdr.prefixLen = prefixLen;
+    hdr.reqid = __atomic_add_fetch(&j->reqid,1,__ATOMIC_RELAXED);
+    hdr.time = getAbsTime();
+    if (jtypeid != NULL) {
+        memcpy(hdr.jtypeid,jtypeid,2);
+    }
+    ringCopy(j,pos,(unsigned char*)&hdr,sizeof(hdr));
+    if (prefixLen > 0) {
+        ringCopy(j,pos+sizeof(hdr),prefix,prefixLen);
+    }
+    if (len > 0) {
+        ringCopy(j,pos+sizeof(hdr)+prefixLen,data,len);
+    }
+    // Setting the length commits the record for the writer thread
+    __atomic_store_n((unsigned int*)&j->buf[pos % j->size],(unsigned int)rl,__ATOMIC_RELEASE);
+    if (reqid != NULL) {
+        *reqid = hdr.reqid;
+    }
+    if (wait) {
+        return waitJournalSynced(j,pos+rl);
+    }
+    return 0;
+}
+
+
+// Waits until all records written to the journal so far are on disk
+int waitJournal(char *name) {
+    if ((journals == NULL) || !jrnlRunning) {
+        return 43;
+    }
+    struct journal *j = getJournal(name);
+    if (j == NULL) {
+        return 43;
+    }
+    return waitJournalSynced(j,__atomic_load_n(&j->head,__ATOMIC_ACQUIRE));
+}
+
+
+struct jrnlReader *openJournalReader(char *name, long long segment) {
+    GETENV_STRING(jrnlDir,"QWICS_JOURNAL_DIR","../data/journal");
+    struct jrnlReader *r = (struct jrnlReader*)malloc(sizeof(struct jrnlReader));
+    if (r == NULL) {
+        return NULL;
+    }
+    snprintf(r->name,sizeof(r->name),"%s",name);
+    if (segment <= 0) {
+        segment = findSegment(name,0);
+    }
+    r->segment = (segment <= 0) ? 1 : segment;
+    r->fd = -1;
+    r->offset = 0;
+    return r;
+}
+
+
+int readJournal(struct jrnlReader *r, struct jrnlRecHeader *hdr, unsigned char *buf, int maxlen) {
+    char path[1024];
+    for (;;) {
+        if (r->fd < 0) {
+            segmentPath(path,r->name,r->segment);
+            r->fd = open(path,O_RDONLY);
+            if (r->fd < 0) {
+                return 0;
+            }
+            r->offset = 0;
+        }
+        if ((pread(r->fd,hdr,sizeof(struct jrnlRecHeader),r->offset) == sizeof(struct jrnlRecHeader)) &&
+            (hdr->len >= sizeof(struct jrnlRecHeader))) {
+            int l = hdr->prefixLen + hdr->dataLen;
+            if (l > maxlen) {
+                return -1;
+            }
+            if (pread(r->fd,buf,l,r->offset+sizeof(struct jrnlRecHeader)) == l) {
+                r->offset += hdr->len;
+                return 1;
+            }
+            // Record not completely written yet
+            return 0;
+        }
+        // Segments are complete once the next one exists
+        segmentPath(path,r->name,r->segment+1);
+        if (access(path,F_OK) != 0) {
+            return 0;
+        }
+        close(r->fd);
+        r->fd = -1;
+        r->segment++;
+    }
+}
+
+
+void closeJournalReader(struct jrnlReader *r) {
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(r);
+}
+
+
+int purgeJournal(char *name, long long segment) {
+    GETENV_STRING(jrnlDir,"QWICS_JOURNAL_DIR","../data/journal");
+    long long s = findSegment(name,0);
+    if (s < 0) {
+        return 0;
+    }
+    int n = 0;
+    char path[1024];
+    for (; s < segment; s++) {
+        segmentPath(path,name,s);
+        if (unlink(path) == 0) {
+            n++;
+        }
+    }
+    return n;
+}
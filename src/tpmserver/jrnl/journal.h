@@ -0,0 +1,85 @@
+/*******************************************************************************************/
+/*   QWICS Server Journal Writer                                                           */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _journal_h
+#define _journal_h
+
+#include <pthread.h>
+
+#define JRNL_NAME_LEN 8
+#define JRNL_ALIGN 8
+
+// Record layout in the buffer and in the segment files
+struct jrnlRecHeader {
+    unsigned int len;        // Total length incl. header and padding, 0 while written
+    unsigned int dataLen;
+    unsigned int prefixLen;
+    unsigned int reqid;
+    long long time;          // ABSTIME of the write
+    char jtypeid[2];
+    char pad[6];
+};
+
+// Producers reserve and fill records without locks, the writer thread
+// appends the committed ones to the current segment file
+struct journal {
+    char name[JRNL_NAME_LEN+1];
+    int state;               // 0 = free, 1 = used
+    unsigned char *buf;
+    long size;
+    long long head __attribute__((aligned(64)));   // Next position to reserve
+    unsigned int reqid;
+    long long tail __attribute__((aligned(64)));   // Written to segment below
+    long long synced;        // On disk below
+    int failed;              // Write or sync error, records are no longer taken
+    int fd;
+    long long segment;
+    long segmentLen;
+    int waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t syncCond;
+    pthread_cond_t spaceCond;
+};
+
+// Sequential access to the segments of a journal, e.g. for offloading
+struct jrnlReader {
+    char name[JRNL_NAME_LEN+1];
+    int fd;
+    long long segment;
+    long offset;
+};
+
+void initJournals();
+void clearJournals();
+
+// Return the CICS RESP code
+int writeJournal(char *name, char *jtypeid, unsigned char *prefix, int prefixLen,
+                 unsigned char *data, int len, int wait, int nosuspend, unsigned int *reqid);
+int waitJournal(char *name);
+
+// Segment 0 starts with the oldest segment present
+struct jrnlReader *openJournalReader(char *name, long long segment);
+// Returns 1 if a record was read, 0 at the end of written data, -1 on error
+int readJournal(struct jrnlReader *r, struct jrnlRecHeader *hdr, unsigned char *buf, int maxlen);
+void closeJournalReader(struct jrnlReader *r);
+// Removes the segments before segment after they were offloaded
+int purgeJournal(char *name, long long segment);
+
+#endif
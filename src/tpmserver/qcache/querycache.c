@@ -0,0 +1,596 @@
+/*******************************************************************************************/
+/*   QWICS Server Query Result Cache                                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <libpq-fe.h>
+
+#include "querycache.h"
+#include "../dtab/datatable.h"
+#include "../env/envconf.h"
+
+#define QC_BUCKETS 4096
+#define QC_STMT_BUCKETS 256
+#define QC_MAX_KEY 16384
+
+// Max. memory of the cached results in bytes, 0 disables the cache. Only used by
+// read only or READ COMMITTED transactions (QWICS_DB_READONLY, QWICS_DB_READ_COMMITTED),
+// results are only stored by READ COMMITTED ones. SERIALIZABLE tasks always query the DB.
+int qc_size = -1;
+#define QC_SIZE GETENV_NUMBER(qc_size,"QWICS_QUERY_CACHE_SIZE",0)
+// Max. age of a result in seconds, bounds staleness if a notification is late
+int qc_ttl = -1;
+#define QC_TTL GETENV_NUMBER(qc_ttl,"QWICS_QUERY_CACHE_TTL",10)
+int qc_triggers = -1;
+#define QC_TRIGGERS GETENV_NUMBER(qc_triggers,"QWICS_QUERY_CACHE_TRIGGERS",1)
+char *qcTableList = NULL;
+char *qcDbConnectStr = NULL;
+char *qcConnectStr = NULL;
+
+// Table whose query results may be cached, gen counts the notified changes
+struct qcTable {
+    char name[QC_NAME_LEN+1];
+    long gen;
+};
+
+// Result of analyzing a statement text, done once per text
+struct qcStmt {
+    char *sql;
+    unsigned int hash;
+    int cacheable;
+    int numTables;
+    int tables[QC_MAX_STMT_TABLES];
+    struct qcStmt *next;
+};
+
+struct qcEntry {
+    unsigned int hash;
+    int keyLen;
+    int numVars;
+    int found;
+    long size;
+    time_t stored;
+    long gens[QC_MAX_STMT_TABLES];   // Of the statement's tables when stored
+    struct qcEntry *next;
+    struct qcEntry *lruPrev;
+    struct qcEntry *lruNext;
+    unsigned char data[];            // Var sizes, key, then the values of the vars
+};
+
+struct qcTable qcTables[QC_MAX_TABLES];
+int qcNumTables = 0;
+struct qcStmt *qcStmts[QC_STMT_BUCKETS];
+struct qcEntry *qcBuckets[QC_BUCKETS];
+// Most recently used first
+struct qcEntry *qcLruHead = NULL;
+struct qcEntry *qcLruTail = NULL;
+long qcUsed = 0;
+long qcHits = 0;
+long qcMisses = 0;
+long qcInvalidations = 0;
+pthread_mutex_t qcMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Results are only used while notifications are received
+PGconn *qcConn = NULL;
+pthread_t qcListener;
+volatile int qcRunning = 0;
+volatile int qcListening = 0;
+
+
+unsigned int qcHash(unsigned char *data, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+// Trigger notifications carry the name without schema
+char *unqualifiedName(char *name) {
+    char *p = strrchr(name,'.');
+    return (p != NULL) ? p+1 : name;
+}
+
+
+int findQcTable(char *name) {
+    name = unqualifiedName(name);
+    for (int i = 0; i < qcNumTables; i++) {
+        if (strcasecmp(unqualifiedName(qcTables[i].name),name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Words making the result depend on more than the tables read
+int isVolatileWord(char *tok) {
+    static char *words[] = { "FOR", "NOW", "CURRENT", "CURRENT_DATE", "CURRENT_TIME", "CURRENT_TIMESTAMP",
+                             "LOCALTIME", "LOCALTIMESTAMP", "CLOCK_TIMESTAMP", "TIMEOFDAY", "RANDOM",
+                             "NEXTVAL", "CURRVAL", "USER", "CURRENT_USER", "SESSION_USER", NULL };
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcasecmp(tok,words[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// A statement is cacheable if it is a single SELECT reading cached tables only
+void analyzeStmt(struct qcStmt *s) {
+    char tok[256];
+    char *sql = s->sql;
+    int inFrom = 0;
+    int expectTable = 0;
+    int type;
+    s->cacheable = 0;
+    s->numTables = 0;
+    if ((nextToken(&sql,tok,255) != DT_TOK_WORD) || (strcasecmp(tok,"SELECT") != 0)) {
+        return;
+    }
+    while ((type = nextToken(&sql,tok,255)) != DT_TOK_END) {
+        if (type == DT_TOK_BAD) {
+            // Parentheses and operators, subqueries are recognized by their SELECT
+            if (*sql != 0x00) {
+                sql++;
+            }
+            continue;
+        }
+        if ((type == DT_TOK_SYM) && (strcmp(tok,",") == 0) && inFrom) {
+            expectTable = 1;
+            continue;
+        }
+        if (type != DT_TOK_WORD) {
+            continue;
+        }
+        if ((strcasecmp(tok,"SELECT") == 0) || (strcasecmp(tok,"UNION") == 0) || isVolatileWord(tok)) {
+            return;
+        }
+        if (expectTable) {
+            int t = findQcTable(tok);
+            if ((t < 0) || (s->numTables >= QC_MAX_STMT_TABLES)) {
+                return;
+            }
+            s->tables[s->numTables++] = t;
+            expectTable = 0;
+            continue;
+        }
+        if ((strcasecmp(tok,"FROM") == 0) || (strcasecmp(tok,"JOIN") == 0)) {
+            inFrom = 1;
+            expectTable = 1;
+        } else
+        if ((strcasecmp(tok,"WHERE") == 0) || (strcasecmp(tok,"ON") == 0) || (strcasecmp(tok,"GROUP") == 0) ||
+            (strcasecmp(tok,"ORDER") == 0) || (strcasecmp(tok,"HAVING") == 0) || (strcasecmp(tok,"FETCH") == 0) ||
+            (strcasecmp(tok,"LIMIT") == 0) || (strcasecmp(tok,"OFFSET") == 0)) {
+            inFrom = 0;
+        }
+    }
+    s->cacheable = (s->numTables > 0) && !expectTable;
+}
+
+
+// Called with the mutex held
+struct qcStmt *getQcStmt(char *sql) {
+    unsigned int h = qcHash((unsigned char*)sql,strlen(sql));
+    struct qcStmt *s = qcStmts[h % QC_STMT_BUCKETS];
+    while ((s != NULL) && ((s->hash != h) || (strcmp(s->sql,sql) != 0))) {
+        s = s->next;
+    }
+    if (s == NULL) {
+        s = (struct qcStmt*)malloc(sizeof(struct qcStmt));
+        if (s == NULL) {
+            return NULL;
+        }
+        s->sql = strdup(sql);
+        s->hash = h;
+        analyzeStmt(s);
+        s->next = qcStmts[h % QC_STMT_BUCKETS];
+        qcStmts[h % QC_STMT_BUCKETS] = s;
+    }
+    return s;
+}
+
+
+// Statement text and param values, a NULL param differs from every string
+int buildKey(char *sql, char **params, int numParams, unsigned char *key) {
+    int l = strlen(sql) + 1;
+    if (l > QC_MAX_KEY) {
+        return -1;
+    }
+    memcpy(key,sql,l);
+    for (int i = 0; i < numParams; i++) {
+        int pl = (params[i] != NULL) ? strlen(params[i]) + 1 : 0;
+        if (l + pl + 1 > QC_MAX_KEY) {
+            return -1;
+        }
+        key[l++] = (params[i] != NULL) ? 1 : 0;
+        if (pl > 0) {
+            memcpy(&key[l],params[i],pl);
+            l += pl;
+        }
+    }
+    return l;
+}
+
+
+long sumGens(struct qcStmt *s) {
+    long sum = 0;
+    for (int i = 0; i < s->numTables; i++) {
+        sum += qcTables[s->tables[i]].gen;
+    }
+    return sum;
+}
+
+
+struct qcEntry *findEntry(unsigned char *key, int keyLen, unsigned int h) {
+    struct qcEntry *e = qcBuckets[h % QC_BUCKETS];
+    while (e != NULL) {
+        if ((e->hash == h) && (e->keyLen == keyLen) &&
+            (memcmp(&e->data[e->numVars*sizeof(int)],key,keyLen) == 0)) {
+            return e;
+        }
+        e = e->next;
+    }
+    return NULL;
+}
+
+
+void unlinkLru(struct qcEntry *e) {
+    if (e->lruPrev != NULL) {
+        e->lruPrev->lruNext = e->lruNext;
+    } else {
+        qcLruHead = e->lruNext;
+    }
+    if (e->lruNext != NULL) {
+        e->lruNext->lruPrev = e->lruPrev;
+    } else {
+        qcLruTail = e->lruPrev;
+    }
+}
+
+
+void pushLru(struct qcEntry *e) {
+    e->lruPrev = NULL;
+    e->lruNext = qcLruHead;
+    if (qcLruHead != NULL) {
+        qcLruHead->lruPrev = e;
+    }
+    qcLruHead = e;
+    if (qcLruTail == NULL) {
+        qcLruTail = e;
+    }
+}
+
+
+void removeEntry(struct qcEntry *e) {
+    struct qcEntry **b = &qcBuckets[e->hash % QC_BUCKETS];
+    while ((*b != NULL) && (*b != e)) {
+        b = &(*b)->next;
+    }
+    if (*b != NULL) {
+        *b = e->next;
+    }
+    unlinkLru(e);
+    qcUsed -= e->size;
+    free(e);
+}
+
+
+int lookupQueryCache(char *sql, char **params, int numParams,
+                     struct qcVar *vars, int numVars, long *ticket) {
+    if (!qcListening) {
+        return QC_NOT_CACHED;
+    }
+    unsigned char key[QC_MAX_KEY];
+    int keyLen = buildKey(sql,params,numParams,key);
+    if (keyLen < 0) {
+        return QC_NOT_CACHED;
+    }
+    unsigned int h = qcHash(key,keyLen);
+    pthread_mutex_lock(&qcMutex);
+    struct qcStmt *s = getQcStmt(sql);
+    if ((s == NULL) || !s->cacheable) {
+        pthread_mutex_unlock(&qcMutex);
+        return QC_NOT_CACHED;
+    }
+    int r = QC_MISS;
+    struct qcEntry *e = findEntry(key,keyLen,h);
+    if (e != NULL) {
+        int valid = (e->numVars == numVars) && (time(NULL) - e->stored < QC_TTL);
+        for (int i = 0; valid && (i < s->numTables); i++) {
+            valid = (e->gens[i] == qcTables[s->tables[i]].gen);
+        }
+        int *sizes = (int*)e->data;
+        for (int i = 0; valid && (i < numVars); i++) {
+            valid = (sizes[i] == vars[i].size);
+        }
+        if (valid) {
+            unsigned char *v = &e->data[e->numVars*sizeof(int)+e->keyLen];
+            for (int i = 0; i < numVars; i++) {
+                memcpy(vars[i].data,v,vars[i].size);
+                v += vars[i].size;
+            }
+            unlinkLru(e);
+            pushLru(e);
+            r = e->found ? QC_FOUND : QC_NOTFOUND;
+        } else {
+            removeEntry(e);
+        }
+    }
+    if (r == QC_MISS) {
+        *ticket = sumGens(s);
+        qcMisses++;
+    } else {
+        qcHits++;
+    }
+    pthread_mutex_unlock(&qcMutex);
+    return r;
+}
+
+
+void storeQueryCache(char *sql, char **params, int numParams,
+                     struct qcVar *vars, int numVars, int found, long ticket) {
+    if (!qcListening) {
+        return;
+    }
+    unsigned char key[QC_MAX_KEY];
+    int keyLen = buildKey(sql,params,numParams,key);
+    if (keyLen < 0) {
+        return;
+    }
+    long size = sizeof(struct qcEntry) + numVars*sizeof(int) + keyLen;
+    for (int i = 0; i < numVars; i++) {
+        size += vars[i].size;
+    }
+    if (size > QC_SIZE/4) {
+        return;
+    }
+    unsigned int h = qcHash(key,keyLen);
+    pthread_mutex_lock(&qcMutex);
+    struct qcStmt *s = getQcStmt(sql);
+    // A change notified after the lookup may not be contained in the result
+    if ((s == NULL) || !s->cacheable || (sumGens(s) != ticket)) {
+        pthread_mutex_unlock(&qcMutex);
+        return;
+    }
+    struct qcEntry *e = findEntry(key,keyLen,h);
+    if (e != NULL) {
+        removeEntry(e);
+    }
+    while ((qcLruTail != NULL) && (qcUsed + size > QC_SIZE)) {
+        removeEntry(qcLruTail);
+    }
+    e = (struct qcEntry*)malloc(size);
+    if (e == NULL) {
+        pthread_mutex_unlock(&qcMutex);
+        return;
+    }
+    e->hash = h;
+    e->keyLen = keyLen;
+    e->numVars = numVars;
+    e->found = found;
+    e->size = size;
+    e->stored = time(NULL);
+    for (int i = 0; i < s->numTables; i++) {
+        e->gens[i] = qcTables[s->tables[i]].gen;
+    }
+    int *sizes = (int*)e->data;
+    unsigned char *v = &e->data[numVars*sizeof(int)];
+    memcpy(v,key,keyLen);
+    v += keyLen;
+    for (int i = 0; i < numVars; i++) {
+        sizes[i] = vars[i].size;
+        memcpy(v,vars[i].data,vars[i].size);
+        v += vars[i].size;
+    }
+    e->next = qcBuckets[h % QC_BUCKETS];
+    qcBuckets[h % QC_BUCKETS] = e;
+    pushLru(e);
+    qcUsed += size;
+    pthread_mutex_unlock(&qcMutex);
+}
+
+
+int isQueryCacheUpdate(char *sql) {
+    if (qcNumTables == 0) {
+        return 0;
+    }
+    char tok[256];
+    int type = nextToken(&sql,tok,255);
+    if ((type != DT_TOK_WORD) ||
+        ((strcasecmp(tok,"INSERT") != 0) && (strcasecmp(tok,"UPDATE") != 0) &&
+         (strcasecmp(tok,"DELETE") != 0) && (strcasecmp(tok,"TRUNCATE") != 0) &&
+         (strcasecmp(tok,"MERGE") != 0))) {
+        return 0;
+    }
+    while ((type = nextToken(&sql,tok,255)) != DT_TOK_END) {
+        if ((type == DT_TOK_BAD) && (*sql != 0x00)) {
+            sql++;
+        }
+        if ((type == DT_TOK_WORD) && (findQcTable(tok) >= 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Invalidates the results of a table, all if name is NULL
+void invalidateTable(char *name) {
+    pthread_mutex_lock(&qcMutex);
+    for (int i = 0; i < qcNumTables; i++) {
+        if ((name == NULL) || (strcasecmp(unqualifiedName(qcTables[i].name),name) == 0)) {
+            qcTables[i].gen++;
+        }
+    }
+    qcInvalidations++;
+    pthread_mutex_unlock(&qcMutex);
+}
+
+
+void execQcSql(char *sql) {
+    PGresult *res = PQexec(qcConn,sql);
+    if ((PQresultStatus(res) != PGRES_COMMAND_OK) && (PQresultStatus(res) != PGRES_TUPLES_OK)) {
+        printf("%s%s%s\n",sql,": ",PQerrorMessage(qcConn));
+    }
+    PQclear(res);
+}
+
+
+// Tables notify the listener at the end of every modifying statement
+void installQcTriggers() {
+    char sql[2*QC_NAME_LEN+256];
+    execQcSql("CREATE OR REPLACE FUNCTION qwics_qc_notify() RETURNS trigger AS $$ "
+              "BEGIN PERFORM pg_notify('qwics_query_cache',TG_TABLE_NAME); RETURN NULL; END; "
+              "$$ LANGUAGE plpgsql");
+    for (int i = 0; i < qcNumTables; i++) {
+        sprintf(sql,"%s%s","DROP TRIGGER IF EXISTS qwics_qc_notify ON ",qcTables[i].name);
+        execQcSql(sql);
+        sprintf(sql,"%s%s%s","CREATE TRIGGER qwics_qc_notify AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON ",
+                qcTables[i].name," FOR EACH STATEMENT EXECUTE PROCEDURE qwics_qc_notify()");
+        execQcSql(sql);
+    }
+}
+
+
+int connectQcListener() {
+    if (qcConn != NULL) {
+        PQfinish(qcConn);
+    }
+    qcConn = PQconnectdb(qcConnectStr);
+    if (PQstatus(qcConn) != CONNECTION_OK) {
+        return -1;
+    }
+    execQcSql("LISTEN qwics_query_cache");
+    return 0;
+}
+
+
+void *queryCacheListener(void *arg) {
+    while (qcRunning) {
+        if (PQstatus(qcConn) != CONNECTION_OK) {
+            qcListening = 0;
+            if (connectQcListener() < 0) {
+                sleep(1);
+                continue;
+            }
+            // Notifications may have been missed
+            invalidateTable(NULL);
+            qcListening = 1;
+        }
+
+        int sock = PQsocket(qcConn);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock,&fds);
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        if (select(sock+1,&fds,NULL,NULL,&tv) <= 0) {
+            continue;
+        }
+        PQconsumeInput(qcConn);
+        PGnotify *notify = NULL;
+        while ((notify = PQnotifies(qcConn)) != NULL) {
+            invalidateTable(notify->extra);
+            PQfreemem(notify);
+        }
+    }
+    qcListening = 0;
+    return NULL;
+}
+
+
+void initQueryCache(int initCons) {
+    GETENV_STRING(qcTableList,"QWICS_QUERY_CACHE_TABLES","");
+    GETENV_STRING(qcDbConnectStr,"QWICS_DB_CONNECTSTR","dbname=qwics");
+    GETENV_STRING(qcConnectStr,"QWICS_QUERY_CACHE_CONNECTSTR",qcDbConnectStr);
+    if (QC_SIZE <= 0) {
+        return;
+    }
+    // Tables separated by blanks or commas
+    char *list = strdup(qcTableList);
+    char *save = NULL;
+    qcNumTables = 0;
+    for (char *t = strtok_r(list," ,",&save); (t != NULL) && (qcNumTables < QC_MAX_TABLES);
+         t = strtok_r(NULL," ,",&save)) {
+        snprintf(qcTables[qcNumTables].name,QC_NAME_LEN+1,"%s",t);
+        qcTables[qcNumTables].gen = 0;
+        qcNumTables++;
+    }
+    free(list);
+    if (qcNumTables == 0) {
+        return;
+    }
+
+    if (connectQcListener() < 0) {
+        printf("%s%s\n","ERROR: Could not connect query cache listener: ",PQerrorMessage(qcConn));
+    } else {
+        if (initCons && QC_TRIGGERS) {
+            installQcTriggers();
+        }
+        qcListening = 1;
+    }
+    qcRunning = 1;
+    if (pthread_create(&qcListener,NULL,queryCacheListener,NULL) != 0) {
+        qcRunning = 0;
+        qcListening = 0;
+        printf("%s\n","ERROR: Could not start query cache listener");
+    }
+}
+
+
+void clearQueryCache(int initCons) {
+    if (qcRunning) {
+        qcRunning = 0;
+        pthread_join(qcListener,NULL);
+    }
+    if (qcConn != NULL) {
+        PQfinish(qcConn);
+        qcConn = NULL;
+    }
+    if (qcNumTables > 0) {
+        printf("%s%ld%s%ld%s%ld\n","Query cache hits: ",qcHits," misses: ",qcMisses,
+               " invalidations: ",qcInvalidations);
+    }
+    pthread_mutex_lock(&qcMutex);
+    while (qcLruTail != NULL) {
+        removeEntry(qcLruTail);
+    }
+    for (int b = 0; b < QC_STMT_BUCKETS; b++) {
+        while (qcStmts[b] != NULL) {
+            struct qcStmt *n = qcStmts[b]->next;
+            free(qcStmts[b]->sql);
+            free(qcStmts[b]);
+            qcStmts[b] = n;
+        }
+    }
+    qcNumTables = 0;
+    pthread_mutex_unlock(&qcMutex);
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************************/
+/*   QWICS Server Query Result Cache                                                       */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+#ifndef _querycache_h
+#define _querycache_h
+
+#define QC_NAME_LEN 63
+#define QC_MAX_TABLES 64
+#define QC_MAX_STMT_TABLES 8
+
+// Results of a lookup
+#define QC_FOUND 0
+#define QC_NOTFOUND 1      // SQLCODE 100 was cached
+#define QC_MISS -1         // Result is to be stored with storeQueryCache
+#define QC_NOT_CACHED -2   // Statement is not cacheable
+
+// Host variable of SELECT ... INTO, holds the converted value
+struct qcVar {
+    unsigned char *data;
+    int size;
+};
+
+void initQueryCache(int initCons);
+void clearQueryCache(int initCons);
+
+// Copies the cached host variable values of a single row SELECT ... INTO with the
+// given params into vars. On QC_MISS, ticket is to be passed to storeQueryCache.
+int lookupQueryCache(char *sql, char **params, int numParams,
+                     struct qcVar *vars, int numVars, long *ticket);
+// Stores the host variable values, unless a table of the statement changed since the lookup
+void storeQueryCache(char *sql, char **params, int numParams,
+                     struct qcVar *vars, int numVars, int found, long ticket);
+// Returns 1 if sql modifies a cached table
+int isQueryCacheUpdate(char *sql);
+
+#endif
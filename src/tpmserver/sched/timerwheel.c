@@ -0,0 +1,316 @@
+/*******************************************************************************************/
+/*   QWICS Server Interval Control Timer Wheel                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "timerwheel.h"
+#include "../task/bgtask.h"
+#include "../env/envconf.h"
+
+int timer_tick_ms = -1;
+#define TIMER_TICK_MS GETENV_NUMBER(timer_tick_ms,"QWICS_TIMER_TICK_MS",100)
+
+pthread_mutex_t twMutex;
+pthread_t twThread;
+int twRunning = 0;
+unsigned long twNow = 0;
+struct timespec twStart;
+struct timerEntry *twSlots[TW_LEVELS][TW_SLOTS];
+struct timerEntry *twReqids[TW_HASH_SIZE];
+
+
+unsigned int hashReqid(char *reqid) {
+    unsigned int h = 2166136261u;
+    while (*reqid != 0x00) {
+        h = (h ^ (unsigned char)(*reqid)) * 16777619u;
+        reqid++;
+    }
+    return h % TW_HASH_SIZE;
+}
+
+
+// Put entry into the wheel level matching its distance from now
+void addToSlot(struct timerEntry *e) {
+    unsigned long delta = (e->expires > twNow) ? e->expires - twNow : 0;
+    int level = 0;
+    while ((level < TW_LEVELS-1) && (delta >= (1UL << (TW_SLOT_BITS*(level+1))))) {
+        level++;
+    }
+    if ((level == TW_LEVELS-1) && (delta >= (1UL << (TW_SLOT_BITS*TW_LEVELS)))) {
+        e->expires = twNow + (1UL << (TW_SLOT_BITS*TW_LEVELS)) - 1;
+    }
+    int idx = (e->expires >> (TW_SLOT_BITS*level)) & (TW_SLOTS-1);
+    e->slot = &twSlots[level][idx];
+    e->prev = NULL;
+    e->next = *e->slot;
+    if (e->next != NULL) {
+        e->next->prev = e;
+    }
+    *e->slot = e;
+}
+
+
+void removeFromSlot(struct timerEntry *e) {
+    if (e->prev != NULL) {
+        e->prev->next = e->next;
+    } else {
+        *e->slot = e->next;
+    }
+    if (e->next != NULL) {
+        e->next->prev = e->prev;
+    }
+}
+
+
+void removeReqid(struct timerEntry *e) {
+    struct timerEntry **p = &twReqids[hashReqid(e->reqid)];
+    while (*p != NULL) {
+        if (*p == e) {
+            *p = e->hnext;
+            return;
+        }
+        p = &(*p)->hnext;
+    }
+}
+
+
+int cascade(int level) {
+    int idx = (twNow >> (TW_SLOT_BITS*level)) & (TW_SLOTS-1);
+    struct timerEntry *e = twSlots[level][idx];
+    twSlots[level][idx] = NULL;
+    while (e != NULL) {
+        struct timerEntry *n = e->next;
+        addToSlot(e);
+        e = n;
+    }
+    return idx;
+}
+
+
+// Advance wheel by one tick, returns list of due entries
+struct timerEntry *tick() {
+    twNow++;
+    int level = 1;
+    if ((twNow & (TW_SLOTS-1)) == 0) {
+        while ((level < TW_LEVELS) && (cascade(level) == 0)) {
+            level++;
+        }
+    }
+    int idx = twNow & (TW_SLOTS-1);
+    struct timerEntry *due = twSlots[0][idx];
+    twSlots[0][idx] = NULL;
+    for (struct timerEntry *e = due; e != NULL; e = e->next) {
+        removeReqid(e);
+    }
+    return due;
+}
+
+
+void runStart(struct timerEntry *e) {
+    if (startBackgroundTask(e->transid,NULL,e->reqid,e->data,e->len,NULL,NULL) < 0) {
+        printf("%s%s\n","ERROR: Could not start transaction ",e->transid);
+    }
+}
+
+
+void *timerThread(void *p) {
+    while (twRunning) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        unsigned long elapsed = (ts.tv_sec - twStart.tv_sec)*1000UL +
+                                (ts.tv_nsec - twStart.tv_nsec)/1000000L;
+        unsigned long target = elapsed / TIMER_TICK_MS;
+        pthread_mutex_lock(&twMutex);
+        struct timerEntry *due = NULL;
+        while (twNow < target) {
+            struct timerEntry *d = tick();
+            while (d != NULL) {
+                struct timerEntry *n = d->next;
+                d->next = due;
+                due = d;
+                d = n;
+            }
+        }
+        pthread_mutex_unlock(&twMutex);
+        while (due != NULL) {
+            struct timerEntry *n = due->next;
+            runStart(due);
+            if (due->data != NULL) {
+                free(due->data);
+            }
+            free(due);
+            due = n;
+        }
+        struct timespec sl;
+        sl.tv_sec = TIMER_TICK_MS / 1000;
+        sl.tv_nsec = (TIMER_TICK_MS % 1000) * 1000000L;
+        nanosleep(&sl,NULL);
+    }
+    return NULL;
+}
+
+
+void initStartScheduler() {
+    pthread_mutex_init(&twMutex,NULL);
+    memset(twSlots,0,sizeof(twSlots));
+    memset(twReqids,0,sizeof(twReqids));
+    clock_gettime(CLOCK_MONOTONIC,&twStart);
+    twNow = 0;
+    twRunning = 1;
+    pthread_create(&twThread,NULL,timerThread,NULL);
+}
+
+
+void clearStartScheduler() {
+    if (!twRunning) {
+        return;
+    }
+    twRunning = 0;
+    pthread_join(twThread,NULL);
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int i = 0; i < TW_SLOTS; i++) {
+            struct timerEntry *e = twSlots[l][i];
+            while (e != NULL) {
+                struct timerEntry *n = e->next;
+                if (e->data != NULL) {
+                    free(e->data);
+                }
+                free(e);
+                e = n;
+            }
+            twSlots[l][i] = NULL;
+        }
+    }
+}
+
+
+long getStartDelay(int mode, long hhmmss, int hours, int minutes, int seconds, int *resp2) {
+    if ((mode == START_INTERVAL) || (mode == START_TIME)) {
+        hours = hhmmss / 10000;
+        minutes = (hhmmss / 100) % 100;
+        seconds = hhmmss % 100;
+        if (minutes > 59) {
+            *resp2 = 5;
+            return -1;
+        }
+        if (seconds > 59) {
+            *resp2 = 6;
+            return -1;
+        }
+    } else {
+        // Single AFTER/AT value may exceed its usual range
+        int n = (hours > 0) + (minutes > 0) + (seconds > 0);
+        if ((hours < 0) || (hours > 99)) {
+            *resp2 = 4;
+            return -1;
+        }
+        if ((minutes < 0) || ((n > 1) && (minutes > 59)) || (minutes > 5999)) {
+            *resp2 = 5;
+            return -1;
+        }
+        if ((seconds < 0) || ((n > 1) && (seconds > 59)) || (seconds > 359999)) {
+            *resp2 = 6;
+            return -1;
+        }
+    }
+    long secs = hours*3600L + minutes*60L + seconds;
+    if ((mode == START_TIME) || (mode == START_AT)) {
+        time_t t = time(NULL);
+        struct tm now = *localtime(&t);
+        secs -= now.tm_hour*3600L + now.tm_min*60L + now.tm_sec;
+        if (secs < 0) {
+            // Expired up to 6 hours ago means now, otherwise tomorrow
+            secs = (secs >= -6*3600L) ? 0 : secs + 24*3600L;
+        }
+    }
+    return secs*1000L;
+}
+
+
+int scheduleStart(char *transid, char *reqid, long delayMs, unsigned char *data, int len) {
+    if (!twRunning || (getTransProgram(transid) == NULL)) {
+        return -1;
+    }
+    struct timerEntry *e = (struct timerEntry*)malloc(sizeof(struct timerEntry));
+    if (e == NULL) {
+        return 18;
+    }
+    sprintf(e->transid,"%s",transid);
+    sprintf(e->reqid,"%s",reqid);
+    e->data = NULL;
+    e->len = 0;
+    if ((data != NULL) && (len > 0)) {
+        e->data = (unsigned char*)malloc(len);
+        if (e->data == NULL) {
+            free(e);
+            return 18;
+        }
+        memcpy(e->data,data,len);
+        e->len = len;
+    }
+    if (delayMs <= 0) {
+        // Due now, no need to go through the wheel
+        int r = startBackgroundTask(e->transid,NULL,e->reqid,e->data,e->len,NULL,NULL);
+        if (e->data != NULL) {
+            free(e->data);
+        }
+        free(e);
+        return (r < 0) ? 28 : 0;
+    }
+    long tickMs = TIMER_TICK_MS;
+    pthread_mutex_lock(&twMutex);
+    e->expires = twNow + (delayMs + tickMs - 1) / tickMs;
+    addToSlot(e);
+    unsigned int h = hashReqid(e->reqid);
+    e->hnext = twReqids[h];
+    twReqids[h] = e;
+    pthread_mutex_unlock(&twMutex);
+    return 0;
+}
+
+
+int cancelStart(char *reqid, char *transid) {
+    struct timerEntry *e = NULL;
+    pthread_mutex_lock(&twMutex);
+    for (e = twReqids[hashReqid(reqid)]; e != NULL; e = e->hnext) {
+        if ((strcmp(e->reqid,reqid) == 0) &&
+            ((transid == NULL) || (transid[0] == 0x00) || (strcmp(e->transid,transid) == 0))) {
+            break;
+        }
+    }
+    if (e != NULL) {
+        removeFromSlot(e);
+        removeReqid(e);
+    }
+    pthread_mutex_unlock(&twMutex);
+    if (e == NULL) {
+        return 13;
+    }
+    if (e->data != NULL) {
+        free(e->data);
+    }
+    free(e);
+    return 0;
+}
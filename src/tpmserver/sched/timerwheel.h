@@ -0,0 +1,57 @@
+/*******************************************************************************************/
+/*   QWICS Server Interval Control Timer Wheel                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#ifndef _timerwheel_h
+#define _timerwheel_h
+
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 8
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_HASH_SIZE 4096
+
+// Pending START request
+struct timerEntry {
+    unsigned long expires;   // in ticks
+    char transid[5];
+    char reqid[9];
+    unsigned char *data;
+    int len;
+    struct timerEntry **slot;
+    struct timerEntry *prev;
+    struct timerEntry *next;
+    struct timerEntry *hnext; // REQID hash chain
+};
+
+void initStartScheduler();
+void clearStartScheduler();
+
+// Delay of START in ms, -1 if values are invalid (resp2 set)
+#define START_INTERVAL 0
+#define START_TIME 1
+#define START_AFTER 2
+#define START_AT 3
+long getStartDelay(int mode, long hhmmss, int hours, int minutes, int seconds, int *resp2);
+
+// Returns CICS RESP code, -1 if transaction is not known locally
+int scheduleStart(char *transid, char *reqid, long delayMs, unsigned char *data, int len);
+int cancelStart(char *reqid, char *transid);
+
+#endif
@@ -0,0 +1,290 @@
+/*******************************************************************************************/
+/*   QWICS Server Background Task Execution                                                */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "bgtask.h"
+#include "../cobexec.h"
+#include "../env/envconf.h"
+
+int bgtask_workers = -1;
+#define BGTASK_WORKERS GETENV_NUMBER(bgtask_workers,"QWICS_BGTASK_WORKERS",4)
+
+pthread_mutex_t bgTaskMutex;
+pthread_cond_t bgTaskAvail;
+struct bgTaskReq *bgTaskHead = NULL;
+struct bgTaskReq *bgTaskTail = NULL;
+pthread_t *bgTaskThreads = NULL;
+int bgTaskRunning = 0;
+int bgTaskIdCnt = 0;
+pthread_key_t bgTaskKey;
+
+// Transaction definitions: TRANSID PROGRAM
+struct transDef {
+    char transid[5];
+    char program[9];
+};
+struct transDef *transDefs = NULL;
+int transDefCount = 0;
+char *transDefFile = NULL;
+
+struct nullTerm {
+    int fd;
+    char prologue[64];
+};
+
+
+// Stands in for the client of a background task. After the EIB values
+// output is dropped and reads are answered by empty lines. Cmds which
+// need the client fail with INVREQ in execCallback, SYNCPOINT is local.
+void *nullTerminal(void *p) {
+    struct nullTerm *t = (struct nullTerm*)p;
+    char buf[4096], nl[256];
+    memset(nl,'\n',sizeof(nl));
+    send(t->fd,t->prologue,strlen(t->prologue),MSG_NOSIGNAL);
+    struct pollfd pfd;
+    pfd.fd = t->fd;
+    pfd.events = POLLIN | POLLOUT;
+    while (1) {
+        if (poll(&pfd,1,-1) < 0) {
+            break;
+        }
+        if (pfd.revents & POLLIN) {
+            if (read(t->fd,buf,sizeof(buf)) <= 0) {
+                break;
+            }
+        }
+        if (pfd.revents & (POLLHUP | POLLERR)) {
+            break;
+        }
+        if (pfd.revents & POLLOUT) {
+            if (send(t->fd,nl,sizeof(nl),MSG_NOSIGNAL) < 0) {
+                break;
+            }
+        }
+    }
+    close(t->fd);
+    return NULL;
+}
+
+
+void runBackgroundTask(struct bgTaskReq *req) {
+    int fds[2];
+    pthread_t term;
+    struct nullTerm t;
+    if (socketpair(AF_UNIX,SOCK_STREAM,0,fds) < 0) {
+        printf("%s%s\n","ERROR: Could not start background task ",req->transid);
+        return;
+    }
+    // EIB values read at program start: TRNID, REQID, TERMID, TASKID, EIBCALEN, EIBAID
+    t.fd = fds[1];
+    sprintf(t.prologue,"%s\n%s\n\n%d\n0\n\n",req->transid,req->reqid,
+            __atomic_add_fetch(&bgTaskIdCnt,1,__ATOMIC_SEQ_CST));
+    if (pthread_create(&term,NULL,nullTerminal,&t) != 0) {
+        printf("%s%s\n","ERROR: Could not start background task ",req->transid);
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    pthread_setspecific(bgTaskKey,req);
+    execTransaction(req->program,&fds[0],0,0);
+    pthread_setspecific(bgTaskKey,NULL);
+    shutdown(fds[0],SHUT_RDWR);
+    pthread_join(term,NULL);
+    close(fds[0]);
+}
+
+
+void *bgTaskWorker(void *p) {
+    while (1) {
+        pthread_mutex_lock(&bgTaskMutex);
+        while ((bgTaskHead == NULL) && bgTaskRunning) {
+            pthread_cond_wait(&bgTaskAvail,&bgTaskMutex);
+        }
+        if (!bgTaskRunning) {
+            pthread_mutex_unlock(&bgTaskMutex);
+            break;
+        }
+        struct bgTaskReq *req = bgTaskHead;
+        bgTaskHead = req->next;
+        if (bgTaskHead == NULL) {
+            bgTaskTail = NULL;
+        }
+        pthread_mutex_unlock(&bgTaskMutex);
+
+        runBackgroundTask(req);
+        if (req->done != NULL) {
+            req->done(req->arg);
+        }
+        if (req->data != NULL) {
+            free(req->data);
+        }
+        free(req);
+    }
+    return NULL;
+}
+
+
+void loadTransDefs() {
+    char line[256];
+    GETENV_STRING(transDefFile,"QWICS_TRANS_DEFS","../conf/transactions.conf");
+    FILE *f = fopen(transDefFile,"r");
+    if (f == NULL) {
+        return;
+    }
+    int size = 0;
+    while (fgets(line,sizeof(line),f) != NULL) {
+        char transid[5], program[9];
+        if ((line[0] == '#') || (sscanf(line,"%4s %8s",transid,program) != 2)) {
+            continue;
+        }
+        if (transDefCount >= size) {
+            size = (size == 0) ? 64 : 2*size;
+            transDefs = (struct transDef*)realloc(transDefs,size*sizeof(struct transDef));
+        }
+        sprintf(transDefs[transDefCount].transid,"%s",transid);
+        sprintf(transDefs[transDefCount].program,"%s",program);
+        transDefCount++;
+    }
+    fclose(f);
+}
+
+
+char *getTransProgram(char *transid) {
+    for (int i = 0; i < transDefCount; i++) {
+        if (strcmp(transDefs[i].transid,transid) == 0) {
+            return transDefs[i].program;
+        }
+    }
+    return NULL;
+}
+
+
+struct bgTaskReq *getBackgroundTask() {
+    return (struct bgTaskReq*)pthread_getspecific(bgTaskKey);
+}
+
+
+void initBackgroundTasks() {
+    pthread_key_create(&bgTaskKey,NULL);
+    loadTransDefs();
+    pthread_mutex_init(&bgTaskMutex,NULL);
+    pthread_cond_init(&bgTaskAvail,NULL);
+    bgTaskRunning = 1;
+    bgTaskThreads = (pthread_t*)malloc(BGTASK_WORKERS*sizeof(pthread_t));
+    for (int i = 0; i < BGTASK_WORKERS; i++) {
+        pthread_create(&bgTaskThreads[i],NULL,bgTaskWorker,NULL);
+    }
+}
+
+
+void clearBackgroundTasks() {
+    if (bgTaskThreads == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&bgTaskMutex);
+    bgTaskRunning = 0;
+    pthread_cond_broadcast(&bgTaskAvail);
+    pthread_mutex_unlock(&bgTaskMutex);
+    for (int i = 0; i < BGTASK_WORKERS; i++) {
+        pthread_join(bgTaskThreads[i],NULL);
+    }
+    free(bgTaskThreads);
+    bgTaskThreads = NULL;
+    while (bgTaskHead != NULL) {
+        struct bgTaskReq *req = bgTaskHead;
+        bgTaskHead = req->next;
+        if (req->done != NULL) {
+            // Not run, e.g. a TD queue trigger is released
+            req->done(req->arg);
+        }
+        if (req->data != NULL) {
+            free(req->data);
+        }
+        free(req);
+    }
+    bgTaskTail = NULL;
+    pthread_cond_destroy(&bgTaskAvail);
+    if (transDefs != NULL) {
+        free(transDefs);
+        transDefs = NULL;
+        transDefCount = 0;
+    }
+}
+
+
+int startBackgroundTask(char *transid, char *program, char *reqid,
+                        unsigned char *data, int len, void (*done)(void *arg), void *arg) {
+    if ((program == NULL) || (program[0] == 0x00)) {
+        program = getTransProgram(transid);
+        if (program == NULL) {
+            return -1;
+        }
+    }
+    struct bgTaskReq *req = (struct bgTaskReq*)malloc(sizeof(struct bgTaskReq));
+    if (req == NULL) {
+        return -1;
+    }
+    snprintf(req->transid,sizeof(req->transid),"%s",transid);
+    snprintf(req->program,sizeof(req->program),"%s",program);
+    snprintf(req->reqid,sizeof(req->reqid),"%s",reqid);
+    req->data = NULL;
+    req->len = 0;
+    req->retrieved = 0;
+    if ((data != NULL) && (len > 0)) {
+        req->data = (unsigned char*)malloc(len);
+        if (req->data == NULL) {
+            free(req);
+            return -1;
+        }
+        memcpy(req->data,data,len);
+        req->len = len;
+    }
+    req->done = done;
+    req->arg = arg;
+    req->next = NULL;
+
+    pthread_mutex_lock(&bgTaskMutex);
+    if (!bgTaskRunning) {
+        // Shut down, also for TD queue triggers of tasks still ending
+        pthread_mutex_unlock(&bgTaskMutex);
+        if (req->data != NULL) {
+            free(req->data);
+        }
+        free(req);
+        return -1;
+    }
+    if (bgTaskTail != NULL) {
+        bgTaskTail->next = req;
+    } else {
+        bgTaskHead = req;
+    }
+    bgTaskTail = req;
+    pthread_cond_signal(&bgTaskAvail);
+    pthread_mutex_unlock(&bgTaskMutex);
+    return 0;
+}
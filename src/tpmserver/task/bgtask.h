@@ -0,0 +1,52 @@
+/*******************************************************************************************/
+/*   QWICS Server Background Task Execution                                                */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#ifndef _bgtask_h
+#define _bgtask_h
+
+// Request to run a transaction without client connection
+struct bgTaskReq {
+    char transid[5];
+    char program[9];
+    char reqid[9];
+    unsigned char *data;
+    int len;
+    int retrieved;   // START data already passed to RETRIEVE
+    void (*done)(void *arg);
+    void *arg;
+    struct bgTaskReq *next;
+};
+
+void initBackgroundTasks();
+void clearBackgroundTasks();
+
+// Queue program for execution, done is called after the task ended.
+// Without program, it is looked up in the transaction definitions.
+int startBackgroundTask(char *transid, char *program, char *reqid,
+                        unsigned char *data, int len, void (*done)(void *arg), void *arg);
+
+// Program of transaction, NULL if not defined
+char *getTransProgram(char *transid);
+
+// Request of the background task running in this thread, NULL otherwise
+struct bgTaskReq *getBackgroundTask();
+
+#endif
@@ -0,0 +1,433 @@
+/*******************************************************************************************/
+/*   QWICS Server Transient Data Queue Manager                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tdqueue.h"
+#include "../task/bgtask.h"
+#include "../env/envconf.h"
+#include "../shm/shmtpm.h"
+
+#define TDQ_MAGIC 0x54445131
+
+int tdq_max_queues = -1;
+#define TDQ_MAX_QUEUES GETENV_NUMBER(tdq_max_queues,"QWICS_TDQ_MAX_QUEUES",64)
+int tdq_cells = -1;
+#define TDQ_CELLS GETENV_NUMBER(tdq_cells,"QWICS_TDQ_CELLS",256)
+int tdq_item_size = -1;
+#define TDQ_ITEM_SIZE GETENV_NUMBER(tdq_item_size,"QWICS_TDQ_ITEM_SIZE",2048)
+char *tdqDefs = NULL;
+char *tdqFile = NULL;
+
+#define TDQ_CELL_STRIDE(s) ((sizeof(struct tdqCell)+(s)->itemSize+15) & ~15L)
+#define TDQ_HEADER(s,i) ((struct tdqHeader*)((char*)(s)+sizeof(struct tdqSpace)+(long)(i)*sizeof(struct tdqHeader)))
+#define TDQ_CELL(s,q,pos) ((struct tdqCell*)((char*)(s)+(s)->cellsOffs+ \
+                          (((long)((q)-TDQ_HEADER(s,0))*(s)->numCells)+((pos)%(s)->numCells))*TDQ_CELL_STRIDE(s)))
+
+struct tdqSpace *tdqMain = NULL;
+struct tdqSpace *tdqPersist = NULL;
+long tdqSize = 0;
+int tdqFd = -1;
+
+void checkTrigger(struct tdqHeader *q);
+
+
+long spaceSize(int maxQueues, int numCells, int itemSize, long *cellsOffs) {
+    long offs = sizeof(struct tdqSpace)+(long)maxQueues*sizeof(struct tdqHeader);
+    offs = (offs + 63) & ~63L;
+    *cellsOffs = offs;
+    return offs + (long)maxQueues*numCells*((sizeof(struct tdqCell)+itemSize+15) & ~15L);
+}
+
+
+void formatTDSpace(struct tdqSpace *space, long size, long cellsOffs) {
+    memset(space,0,cellsOffs);
+    space->maxQueues = TDQ_MAX_QUEUES;
+    space->numCells = TDQ_CELLS;
+    space->itemSize = TDQ_ITEM_SIZE;
+    space->size = size;
+    space->cellsOffs = cellsOffs;
+    space->magic = TDQ_MAGIC;
+}
+
+
+void initTableLock(struct tdqSpace *space) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&space->tableLock,&attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+
+void initRing(struct tdqSpace *space, struct tdqHeader *q) {
+    q->enqPos = 0;
+    q->deqPos = 0;
+    for (long pos = 0; pos < space->numCells; pos++) {
+        TDQ_CELL(space,q,pos)->seq = pos;
+    }
+}
+
+
+// Bring rings of a persistent space into a consistent state after restart
+void recoverRings(struct tdqSpace *space) {
+    for (int i = 0; i < space->maxQueues; i++) {
+        struct tdqHeader *q = TDQ_HEADER(space,i);
+        if (q->state != 1) {
+            continue;
+        }
+        long pos;
+        for (pos = q->deqPos; pos < q->enqPos; pos++) {
+            struct tdqCell *c = TDQ_CELL(space,q,pos);
+            if (c->seq != pos+1) {
+                c->seq = pos+1;
+                c->len = -1;
+            }
+        }
+        for (pos = q->enqPos; pos < q->deqPos+space->numCells; pos++) {
+            TDQ_CELL(space,q,pos)->seq = pos;
+        }
+        q->triggered = 0;
+    }
+}
+
+
+unsigned int hashTDName(char *name) {
+    unsigned int h = 2166136261u;
+    while (*name != 0x00) {
+        h = (h ^ (unsigned char)(*name)) * 16777619u;
+        name++;
+    }
+    return h;
+}
+
+
+// Queues are never removed, so lookup needs no lock
+struct tdqHeader *lookupTDQ(struct tdqSpace *space, char *name, int create) {
+    int i = hashTDName(name) % space->maxQueues;
+    int n;
+    for (n = 0; n < space->maxQueues; n++) {
+        struct tdqHeader *q = TDQ_HEADER(space,i);
+        int state = __atomic_load_n(&q->state,__ATOMIC_ACQUIRE);
+        if (state == 0) {
+            break;
+        }
+        if (strcmp(q->name,name) == 0) {
+            return q;
+        }
+        i = (i + 1) % space->maxQueues;
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    struct tdqHeader *q = NULL;
+    pthread_mutex_lock(&space->tableLock);
+    i = hashTDName(name) % space->maxQueues;
+    for (n = 0; n < space->maxQueues; n++) {
+        struct tdqHeader *h = TDQ_HEADER(space,i);
+        if (h->state == 0) {
+            sprintf(h->name,"%s",name);
+            h->trigLevel = 0;
+            h->transid[0] = 0x00;
+            h->program[0] = 0x00;
+            h->triggered = 0;
+            initRing(space,h);
+            __atomic_store_n(&h->state,1,__ATOMIC_RELEASE);
+            q = h;
+            break;
+        }
+        if (strcmp(h->name,name) == 0) {
+            q = h;
+            break;
+        }
+        i = (i + 1) % space->maxQueues;
+    }
+    pthread_mutex_unlock(&space->tableLock);
+    return q;
+}
+
+
+struct tdqHeader *findTDQ(char *name, int create, struct tdqSpace **space) {
+    struct tdqHeader *q = NULL;
+    if (tdqPersist != NULL) {
+        *space = tdqPersist;
+        q = lookupTDQ(tdqPersist,name,0);
+    }
+    if ((q == NULL) && (tdqMain != NULL)) {
+        *space = tdqMain;
+        q = lookupTDQ(tdqMain,name,create);
+    }
+    return q;
+}
+
+
+// Queue definitions: NAME TRIGGERLEVEL TRANSID PROGRAM [PERSISTENT]
+void loadTDQDefs() {
+    char line[256];
+    GETENV_STRING(tdqDefs,"QWICS_TDQ_DEFS","../conf/tdqueues.conf");
+    FILE *f = fopen(tdqDefs,"r");
+    if (f == NULL) {
+        return;
+    }
+    while (fgets(line,sizeof(line),f) != NULL) {
+        char name[TDQ_NAME_LEN+1], transid[5], program[9], persist[16];
+        int trigLevel = 0;
+        if (line[0] == '#') {
+            continue;
+        }
+        persist[0] = 0x00;
+        int n = sscanf(line,"%16s %d %4s %8s %15s",name,&trigLevel,transid,program,persist);
+        if (n < 4) {
+            if (n > 0) {
+                printf("%s%s","ERROR: Invalid TD queue definition ",line);
+            }
+            continue;
+        }
+        struct tdqSpace *space = ((strcmp(persist,"PERSISTENT") == 0) && (tdqPersist != NULL)) ?
+                                 tdqPersist : tdqMain;
+        if (space == NULL) {
+            continue;
+        }
+        struct tdqHeader *q = lookupTDQ(space,name,1);
+        if (q == NULL) {
+            printf("%s%s\n","ERROR: No space for TD queue ",name);
+            continue;
+        }
+        sprintf(q->transid,"%s",transid);
+        sprintf(q->program,"%s",program);
+        q->trigLevel = trigLevel;
+    }
+    fclose(f);
+}
+
+
+void initTDQueues(int initCons) {
+    long cellsOffs;
+    tdqSize = spaceSize(TDQ_MAX_QUEUES,TDQ_CELLS,TDQ_ITEM_SIZE,&cellsOffs);
+    tdqMain = (struct tdqSpace*)sharedMalloc(16,tdqSize);
+    if (tdqMain == NULL) {
+        printf("%s\n","ERROR: Could not allocate TD queue storage");
+    } else
+    if (initCons) {
+        formatTDSpace(tdqMain,tdqSize,cellsOffs);
+        initTableLock(tdqMain);
+    }
+
+    // Queues defined PERSISTENT are kept in a memory mapped file
+    GETENV_STRING(tdqFile,"QWICS_TDQ_FILE","../data/tdqueue.dat");
+    tdqFd = open(tdqFile,O_RDWR | O_CREAT,0660);
+    if (tdqFd < 0) {
+        printf("%s%s\n","ERROR: Could not open TD queue file ",tdqFile);
+    } else {
+        struct stat st;
+        fstat(tdqFd,&st);
+        int fresh = (st.st_size != tdqSize);
+        if (fresh && initCons) {
+            if (st.st_size > 0) {
+                printf("%s%s\n","WARNING: TD queue settings changed, reinitializing ",tdqFile);
+            }
+            if (ftruncate(tdqFd,tdqSize) < 0) {
+                printf("%s%s\n","ERROR: Could not size TD queue file ",tdqFile);
+            }
+        }
+        tdqPersist = (struct tdqSpace*)mmap(NULL,tdqSize,PROT_READ | PROT_WRITE,MAP_SHARED,tdqFd,0);
+        if (tdqPersist == MAP_FAILED) {
+            printf("%s%s\n","ERROR: Could not map TD queue file ",tdqFile);
+            tdqPersist = NULL;
+            close(tdqFd);
+            tdqFd = -1;
+        } else
+        if (initCons) {
+            if (fresh || (tdqPersist->magic != TDQ_MAGIC)) {
+                formatTDSpace(tdqPersist,tdqSize,cellsOffs);
+            } else {
+                recoverRings(tdqPersist);
+            }
+            initTableLock(tdqPersist);
+        }
+    }
+
+    if (initCons) {
+        loadTDQDefs();
+        // Persistent queues may have reached their trigger level before restart
+        if (tdqPersist != NULL) {
+            for (int i = 0; i < tdqPersist->maxQueues; i++) {
+                if (TDQ_HEADER(tdqPersist,i)->state == 1) {
+                    checkTrigger(TDQ_HEADER(tdqPersist,i));
+                }
+            }
+        }
+    }
+}
+
+
+void clearTDQueues(int initCons) {
+    if (tdqMain != NULL) {
+        sharedFree(tdqMain,tdqSize);
+        tdqMain = NULL;
+    }
+    if (tdqPersist != NULL) {
+        msync(tdqPersist,tdqSize,MS_SYNC);
+        munmap(tdqPersist,tdqSize);
+        tdqPersist = NULL;
+    }
+    if (tdqFd >= 0) {
+        close(tdqFd);
+        tdqFd = -1;
+    }
+}
+
+
+void triggerDone(void *arg) {
+    struct tdqHeader *q = (struct tdqHeader*)arg;
+    __atomic_store_n(&q->triggered,0,__ATOMIC_SEQ_CST);
+    // Records written while the task ran may require the next one
+    checkTrigger(q);
+}
+
+
+void checkTrigger(struct tdqHeader *q) {
+    if ((q->trigLevel <= 0) || (q->program[0] == 0x00)) {
+        return;
+    }
+    long n = __atomic_load_n(&q->enqPos,__ATOMIC_ACQUIRE) - __atomic_load_n(&q->deqPos,__ATOMIC_ACQUIRE);
+    if (n >= q->trigLevel) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&q->triggered,&expected,1,0,__ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST)) {
+            if (startBackgroundTask(q->transid,q->program,"",NULL,0,triggerDone,q) < 0) {
+                __atomic_store_n(&q->triggered,0,__ATOMIC_SEQ_CST);
+            }
+        }
+    }
+}
+
+
+int writeTDQ(char *name, unsigned char *data, int len) {
+    struct tdqSpace *space = NULL;
+    if ((tdqMain == NULL) && (tdqPersist == NULL)) {
+        return -1;
+    }
+    if ((name[0] == 0x00) || (strlen(name) > TDQ_NAME_LEN)) {
+        return 16;
+    }
+    struct tdqHeader *q = findTDQ(name,0,&space);
+    if (q == NULL) {
+        // Not defined in QWICS_TDQ_DEFS, queue is owned by the client
+        return -1;
+    }
+    if ((len <= 0) || (len > space->itemSize)) {
+        return 22;
+    }
+    struct tdqCell *c;
+    long pos = __atomic_load_n(&q->enqPos,__ATOMIC_RELAXED);
+    while (1) {
+        c = TDQ_CELL(space,q,pos);
+        long seq = __atomic_load_n(&c->seq,__ATOMIC_ACQUIRE);
+        long dif = seq - pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->enqPos,&pos,pos+1,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED)) {
+                break;
+            }
+        } else
+        if (dif < 0) {
+            return 18;
+        } else {
+            pos = __atomic_load_n(&q->enqPos,__ATOMIC_RELAXED);
+        }
+    }
+    memcpy(c->data,data,len);
+    c->len = len;
+    __atomic_store_n(&c->seq,pos+1,__ATOMIC_RELEASE);
+    checkTrigger(q);
+    return 0;
+}
+
+
+// len is the buffer size on input and the record length on output
+int readTDQ(char *name, unsigned char *buf, int *len) {
+    struct tdqSpace *space = NULL;
+    if ((tdqMain == NULL) && (tdqPersist == NULL)) {
+        return -1;
+    }
+    struct tdqHeader *q = findTDQ(name,0,&space);
+    if (q == NULL) {
+        return -1;
+    }
+    struct tdqCell *c;
+    long pos;
+    do {
+        pos = __atomic_load_n(&q->deqPos,__ATOMIC_RELAXED);
+        while (1) {
+            c = TDQ_CELL(space,q,pos);
+            long seq = __atomic_load_n(&c->seq,__ATOMIC_ACQUIRE);
+            long dif = seq - (pos+1);
+            if (dif == 0) {
+                if (__atomic_compare_exchange_n(&q->deqPos,&pos,pos+1,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else
+            if (dif < 0) {
+                return 23;
+            } else {
+                pos = __atomic_load_n(&q->deqPos,__ATOMIC_RELAXED);
+            }
+        }
+        int l = c->len;
+        int resp = 0;
+        if (l >= 0) {
+            if (l > *len) {
+                l = *len;
+                resp = 22;
+            }
+            memcpy(buf,c->data,l);
+            *len = c->len;
+        }
+        __atomic_store_n(&c->seq,pos+space->numCells,__ATOMIC_RELEASE);
+        if (l >= 0) {
+            return resp;
+        }
+    } while (1);
+}
+
+
+int deleteTDQ(char *name) {
+    struct tdqSpace *space = NULL;
+    unsigned char buf[1];
+    int len = 1;
+    if ((tdqMain == NULL) && (tdqPersist == NULL)) {
+        return -1;
+    }
+    if (findTDQ(name,0,&space) == NULL) {
+        return -1;
+    }
+    // Intrapartition queue is emptied, definition is kept
+    while (readTDQ(name,buf,&len) != 23) {
+        len = 1;
+    }
+    return 0;
+}
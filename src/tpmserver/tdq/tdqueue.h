@@ -0,0 +1,68 @@
+/*******************************************************************************************/
+/*   QWICS Server Transient Data Queue Manager                                             */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#ifndef _tdqueue_h
+#define _tdqueue_h
+
+#include <pthread.h>
+
+#define TDQ_NAME_LEN 16
+
+struct tdqHeader {
+    char name[TDQ_NAME_LEN+1];
+    int state;      // 0 = free, 1 = used
+    int trigLevel;
+    char transid[5];
+    char program[9];
+    int triggered;
+    // Ring positions, kept on separate cache lines for producers and consumers
+    long enqPos __attribute__((aligned(64)));
+    long deqPos __attribute__((aligned(64)));
+};
+
+// Ring cell, seq coordinates producers and consumers without locks
+struct tdqCell {
+    long seq;
+    int len;        // -1 marks a record lost by an interrupted write
+    int pad;
+    unsigned char data[];
+};
+
+struct tdqSpace {
+    int magic;
+    int maxQueues;
+    int numCells;
+    int itemSize;
+    long size;
+    long cellsOffs;
+    pthread_mutex_t tableLock;
+};
+
+void initTDQueues(int initCons);
+void clearTDQueues(int initCons);
+
+// All functions return the CICS RESP code, or -1 if the queue manager is not available
+// or the queue is not defined in QWICS_TDQ_DEFS
+int writeTDQ(char *name, unsigned char *data, int len);
+int readTDQ(char *name, unsigned char *buf, int *len);
+int deleteTDQ(char *name);
+
+#endif
@@ -54,7 +54,7 @@ void *handle_client(void *fd) {
       char *cmd = strstr(buf,"exec");
       if (cmd) {
         char *name = cmd+5;
-        execTransaction(name, &childfd);
+        execTransaction(name, &childfd, 0, 0);
       } else {
         char *cmd = strstr(buf,"sql");
         if (cmd) {
@@ -64,7 +64,7 @@ void *handle_client(void *fd) {
             char *cmd = strstr(buf,"PROGRAM");
             if (cmd) {
                 char *name = cmd+8;
-                execInTransaction(name, &childfd);
+                execInTransaction(name, &childfd, 0, 0);
             }
         }
       }
@@ -78,7 +78,7 @@ void *handle_client(void *fd) {
 void sig_handler(int signo)
 {
     if (signo == SIGINT) {
-        clearExec();
+        clearExec(1);
     }
 }
 
@@ -156,7 +156,7 @@ int main(int argc, char **argv) {
     printf("%s\n","ERROR: Installing signal handler failed!");
   }
 
-  initExec();
+  initExec(1);
   clientlen = sizeof(clientaddr);
 
   while (1) {
@@ -167,6 +167,6 @@ int main(int argc, char **argv) {
     }
   }  
 
-  clearExec();
+  clearExec(1);
   return 0;
 }
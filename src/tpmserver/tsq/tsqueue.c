@@ -0,0 +1,421 @@
+/*******************************************************************************************/
+/*   QWICS Server Temporary Storage Queue Manager                                          */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tsqueue.h"
+#include "../env/envconf.h"
+#include "../shm/shmtpm.h"
+
+#define TSQ_MAGIC 0x54535131
+
+int tsq_max_queues = -1;
+#define TSQ_MAX_QUEUES GETENV_NUMBER(tsq_max_queues,"QWICS_TSQ_MAX_QUEUES",1024)
+int tsq_main_size = -1;
+#define TSQ_MAIN_SIZE GETENV_NUMBER(tsq_main_size,"QWICS_TSQ_MAIN_SIZE",67108864)
+int tsq_aux_size = -1;
+#define TSQ_AUX_SIZE GETENV_NUMBER(tsq_aux_size,"QWICS_TSQ_AUX_SIZE",268435456)
+char *tsqAuxFile = NULL;
+
+#define TSQ_HEADER(s,i) ((struct tsqHeader*)((char*)(s)+sizeof(struct tsqSpace)+(long)(i)*sizeof(struct tsqHeader)))
+#define TSQ_BLOCK(s,i) ((struct tsqBlock*)((char*)(s)+(s)->blockOffs+(long)(i)*TSQ_BLOCK_SIZE))
+
+struct tsqSpace *tsqMain = NULL;
+struct tsqSpace *tsqAux = NULL;
+int tsqAuxFd = -1;
+
+
+void initSpaceLocks(struct tsqSpace *space) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&space->tableLock,&attr);
+    pthread_mutex_init(&space->heapLock,&attr);
+    for (int i = 0; i < space->maxQueues; i++) {
+        pthread_mutex_init(&TSQ_HEADER(space,i)->lock,&attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+
+int formatSpace(struct tsqSpace *space, long size, int maxQueues) {
+    long offs = sizeof(struct tsqSpace)+(long)maxQueues*sizeof(struct tsqHeader);
+    offs = (offs + 63) & ~63L;
+    if (size - offs < TSQ_BLOCK_SIZE) {
+        return -1;
+    }
+    space->maxQueues = maxQueues;
+    space->size = size;
+    space->blockOffs = offs;
+    space->numBlocks = (int)((size - offs) / TSQ_BLOCK_SIZE);
+    space->freeBlocks = space->numBlocks;
+    space->freeList = 0;
+    for (int i = 0; i < space->numBlocks; i++) {
+        TSQ_BLOCK(space,i)->next = (i < space->numBlocks-1) ? i+1 : -1;
+    }
+    for (int i = 0; i < maxQueues; i++) {
+        TSQ_HEADER(space,i)->state = 0;
+    }
+    space->magic = TSQ_MAGIC;
+    return 0;
+}
+
+
+void initTSQueues(int initCons) {
+    tsqMain = (struct tsqSpace*)sharedMalloc(15,TSQ_MAIN_SIZE);
+    if (tsqMain == NULL) {
+        printf("%s\n","ERROR: Could not allocate TS queue MAIN storage");
+    } else
+    if (initCons) {
+        if (formatSpace(tsqMain,TSQ_MAIN_SIZE,TSQ_MAX_QUEUES) < 0) {
+            printf("%s\n","ERROR: QWICS_TSQ_MAIN_SIZE too small");
+            sharedFree(tsqMain,TSQ_MAIN_SIZE);
+            tsqMain = NULL;
+        } else {
+            initSpaceLocks(tsqMain);
+        }
+    }
+
+    // AUXILIARY queues are kept in a memory mapped file and survive restarts
+    GETENV_STRING(tsqAuxFile,"QWICS_TSQ_AUXFILE","../data/tsqaux.dat");
+    tsqAuxFd = open(tsqAuxFile,O_RDWR | O_CREAT,0660);
+    if (tsqAuxFd < 0) {
+        printf("%s%s\n","ERROR: Could not open TS queue AUXILIARY file ",tsqAuxFile);
+        return;
+    }
+    struct stat st;
+    fstat(tsqAuxFd,&st);
+    int fresh = (st.st_size != TSQ_AUX_SIZE);
+    if (fresh && initCons) {
+        if (ftruncate(tsqAuxFd,TSQ_AUX_SIZE) < 0) {
+            printf("%s%s\n","ERROR: Could not size TS queue AUXILIARY file ",tsqAuxFile);
+            close(tsqAuxFd);
+            tsqAuxFd = -1;
+            return;
+        }
+    }
+    tsqAux = (struct tsqSpace*)mmap(NULL,TSQ_AUX_SIZE,PROT_READ | PROT_WRITE,MAP_SHARED,tsqAuxFd,0);
+    if (tsqAux == MAP_FAILED) {
+        printf("%s%s\n","ERROR: Could not map TS queue AUXILIARY file ",tsqAuxFile);
+        tsqAux = NULL;
+        close(tsqAuxFd);
+        tsqAuxFd = -1;
+        return;
+    }
+    if (initCons) {
+        if (fresh || (tsqAux->magic != TSQ_MAGIC) || (tsqAux->maxQueues != TSQ_MAX_QUEUES)) {
+            if (formatSpace(tsqAux,TSQ_AUX_SIZE,TSQ_MAX_QUEUES) < 0) {
+                printf("%s\n","ERROR: QWICS_TSQ_AUX_SIZE too small");
+                clearTSQueues(0);
+                return;
+            }
+        }
+        // Locks may have been held by tasks of a previous run
+        initSpaceLocks(tsqAux);
+    }
+}
+
+
+void clearTSQueues(int initCons) {
+    if (tsqMain != NULL) {
+        sharedFree(tsqMain,TSQ_MAIN_SIZE);
+        tsqMain = NULL;
+    }
+    if (tsqAux != NULL) {
+        msync(tsqAux,TSQ_AUX_SIZE,MS_SYNC);
+        munmap(tsqAux,TSQ_AUX_SIZE);
+        tsqAux = NULL;
+    }
+    if (tsqAuxFd >= 0) {
+        close(tsqAuxFd);
+        tsqAuxFd = -1;
+    }
+}
+
+
+unsigned int hashName(char *name) {
+    unsigned int h = 2166136261u;
+    while (*name != 0x00) {
+        h = (h ^ (unsigned char)(*name)) * 16777619u;
+        name++;
+    }
+    return h;
+}
+
+
+// Returns the queue header locked, table lock is held while locking the queue
+struct tsqHeader *lockQueue(struct tsqSpace *space, char *name, int create) {
+    struct tsqHeader *q = NULL, *freeSlot = NULL;
+    int i, n;
+    pthread_mutex_lock(&space->tableLock);
+    i = hashName(name) % space->maxQueues;
+    for (n = 0; n < space->maxQueues; n++) {
+        struct tsqHeader *h = TSQ_HEADER(space,i);
+        if (h->state == 0) {
+            if (freeSlot == NULL) {
+                freeSlot = h;
+            }
+            break;
+        }
+        if ((h->state == 2) && (freeSlot == NULL)) {
+            freeSlot = h;
+        }
+        if ((h->state == 1) && (strcmp(h->name,name) == 0)) {
+            q = h;
+            break;
+        }
+        i = (i + 1) % space->maxQueues;
+    }
+    if ((q == NULL) && create && (freeSlot != NULL)) {
+        q = freeSlot;
+        sprintf(q->name,"%s",name);
+        q->numItems = 0;
+        q->lastRead = 0;
+        q->state = 1;
+    }
+    if (q != NULL) {
+        pthread_mutex_lock(&q->lock);
+    }
+    pthread_mutex_unlock(&space->tableLock);
+    return q;
+}
+
+
+int allocBlocks(struct tsqSpace *space, int n) {
+    int first = -1, i;
+    pthread_mutex_lock(&space->heapLock);
+    if (n <= space->freeBlocks) {
+        first = space->freeList;
+        int last = first;
+        for (i = 1; i < n; i++) {
+            last = TSQ_BLOCK(space,last)->next;
+        }
+        space->freeList = TSQ_BLOCK(space,last)->next;
+        TSQ_BLOCK(space,last)->next = -1;
+        space->freeBlocks -= n;
+    }
+    pthread_mutex_unlock(&space->heapLock);
+    return first;
+}
+
+
+void freeBlocks(struct tsqSpace *space, int first) {
+    int last = first, n = 1;
+    if (first < 0) {
+        return;
+    }
+    while (TSQ_BLOCK(space,last)->next >= 0) {
+        last = TSQ_BLOCK(space,last)->next;
+        n++;
+    }
+    pthread_mutex_lock(&space->heapLock);
+    TSQ_BLOCK(space,last)->next = space->freeList;
+    space->freeList = first;
+    space->freeBlocks += n;
+    pthread_mutex_unlock(&space->heapLock);
+}
+
+
+struct tsqItemRef *itemRef(struct tsqSpace *space, struct tsqHeader *q, int item) {
+    struct tsqBlock *page = TSQ_BLOCK(space,q->pages[(item-1) / TSQ_ITEMS_PER_PAGE]);
+    return &((struct tsqItemRef*)page->data)[(item-1) % TSQ_ITEMS_PER_PAGE];
+}
+
+
+// Store data in a new block chain
+int storeData(struct tsqSpace *space, unsigned char *data, int len) {
+    int dataLen = TSQ_BLOCK_SIZE-sizeof(int);
+    int first = allocBlocks(space,(len+dataLen-1) / dataLen);
+    int b = first, pos = 0;
+    while ((b >= 0) && (pos < len)) {
+        int l = (len - pos > dataLen) ? dataLen : len - pos;
+        memcpy(TSQ_BLOCK(space,b)->data,&data[pos],l);
+        pos += l;
+        b = TSQ_BLOCK(space,b)->next;
+    }
+    return first;
+}
+
+
+struct tsqHeader *findQueue(char *name, struct tsqSpace **space) {
+    struct tsqHeader *q = NULL;
+    if (tsqMain != NULL) {
+        *space = tsqMain;
+        q = lockQueue(tsqMain,name,0);
+    }
+    if ((q == NULL) && (tsqAux != NULL)) {
+        *space = tsqAux;
+        q = lockQueue(tsqAux,name,0);
+    }
+    return q;
+}
+
+
+int writeTSQ(char *name, int aux, unsigned char *data, int len, int *item, int rewrite) {
+    struct tsqSpace *space = NULL;
+    if ((tsqMain == NULL) && (tsqAux == NULL)) {
+        return -1;
+    }
+    if ((name[0] == 0x00) || (strlen(name) > TSQ_NAME_LEN)) {
+        return 16;
+    }
+    if ((len <= 0) || (len > TSQ_MAX_ITEM_LEN)) {
+        return 22;
+    }
+    struct tsqHeader *q = findQueue(name,&space);
+    if (q == NULL) {
+        if (rewrite) {
+            return 44;
+        }
+        space = ((aux && (tsqAux != NULL)) || (tsqMain == NULL)) ? tsqAux : tsqMain;
+        q = lockQueue(space,name,1);
+        if (q == NULL) {
+            return 18;
+        }
+    }
+
+    if (rewrite) {
+        if ((*item < 1) || (*item > q->numItems)) {
+            pthread_mutex_unlock(&q->lock);
+            return 26;
+        }
+        int b = storeData(space,data,len);
+        if (b < 0) {
+            pthread_mutex_unlock(&q->lock);
+            return 18;
+        }
+        struct tsqItemRef *ref = itemRef(space,q,*item);
+        int old = ref->block;
+        ref->block = b;
+        ref->len = len;
+        pthread_mutex_unlock(&q->lock);
+        freeBlocks(space,old);
+        return 0;
+    }
+
+    if (q->numItems >= TSQ_MAX_ITEMS) {
+        pthread_mutex_unlock(&q->lock);
+        return 26;
+    }
+    int page = q->numItems / TSQ_ITEMS_PER_PAGE;
+    if ((q->numItems % TSQ_ITEMS_PER_PAGE) == 0) {
+        q->pages[page] = allocBlocks(space,1);
+        if (q->pages[page] < 0) {
+            pthread_mutex_unlock(&q->lock);
+            return 18;
+        }
+    }
+    int b = storeData(space,data,len);
+    if (b < 0) {
+        if ((q->numItems % TSQ_ITEMS_PER_PAGE) == 0) {
+            freeBlocks(space,q->pages[page]);
+        }
+        pthread_mutex_unlock(&q->lock);
+        return 18;
+    }
+    q->numItems++;
+    struct tsqItemRef *ref = itemRef(space,q,q->numItems);
+    ref->block = b;
+    ref->len = len;
+    *item = q->numItems;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+
+// len is the buffer size on input and the item length on output
+int readTSQ(char *name, unsigned char *buf, int *len, int *item, int next, int *numItems) {
+    struct tsqSpace *space = NULL;
+    if ((tsqMain == NULL) && (tsqAux == NULL)) {
+        return -1;
+    }
+    struct tsqHeader *q = findQueue(name,&space);
+    if (q == NULL) {
+        return 44;
+    }
+    int n = next ? q->lastRead + 1 : *item;
+    *numItems = q->numItems;
+    if ((n < 1) || (n > q->numItems)) {
+        pthread_mutex_unlock(&q->lock);
+        return 26;
+    }
+    struct tsqItemRef *ref = itemRef(space,q,n);
+    int dataLen = TSQ_BLOCK_SIZE-sizeof(int);
+    int l = (ref->len < *len) ? ref->len : *len;
+    int b = ref->block, pos = 0;
+    while ((b >= 0) && (pos < l)) {
+        int bl = (l - pos > dataLen) ? dataLen : l - pos;
+        memcpy(&buf[pos],TSQ_BLOCK(space,b)->data,bl);
+        pos += bl;
+        b = TSQ_BLOCK(space,b)->next;
+    }
+    int resp = (ref->len > *len) ? 22 : 0;
+    *len = ref->len;
+    *item = n;
+    q->lastRead = n;
+    pthread_mutex_unlock(&q->lock);
+    return resp;
+}
+
+
+int deleteTSQ(char *name) {
+    struct tsqSpace *spaces[2] = { tsqMain, tsqAux };
+    if ((tsqMain == NULL) && (tsqAux == NULL)) {
+        return -1;
+    }
+    for (int s = 0; s < 2; s++) {
+        struct tsqSpace *space = spaces[s];
+        if (space == NULL) {
+            continue;
+        }
+        pthread_mutex_lock(&space->tableLock);
+        int i = hashName(name) % space->maxQueues;
+        for (int n = 0; n < space->maxQueues; n++) {
+            struct tsqHeader *q = TSQ_HEADER(space,i);
+            if (q->state == 0) {
+                break;
+            }
+            if ((q->state == 1) && (strcmp(q->name,name) == 0)) {
+                pthread_mutex_lock(&q->lock);
+                for (int item = 1; item <= q->numItems; item++) {
+                    freeBlocks(space,itemRef(space,q,item)->block);
+                }
+                for (int p = 0; (int)(p*TSQ_ITEMS_PER_PAGE) < q->numItems; p++) {
+                    freeBlocks(space,q->pages[p]);
+                }
+                q->numItems = 0;
+                q->state = 2;
+                pthread_mutex_unlock(&q->lock);
+                pthread_mutex_unlock(&space->tableLock);
+                return 0;
+            }
+            i = (i + 1) % space->maxQueues;
+        }
+        pthread_mutex_unlock(&space->tableLock);
+    }
+    return 44;
+}
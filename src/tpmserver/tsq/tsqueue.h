@@ -0,0 +1,74 @@
+/*******************************************************************************************/
+/*   QWICS Server Temporary Storage Queue Manager                                          */
+/*                                                                                         */
+/*   Author: Philipp Brune               Date: 18.10.2026                                  */
+/*                                                                                         */
+/*   Copyright (C) 2018 - 2026 by Philipp Brune  Email: Philipp.Brune@qwics.org            */
+/*                                                                                         */
+/*   This file is part of of the QWICS Server project.                                     */
+/*                                                                                         */
+/*   QWICS Server is free software: you can redistribute it and/or modify it under the     */
+/*   terms of the GNU General Public License as published by the Free Software Foundation, */
+/*   either version 3 of the License, or (at your option) any later version.               */
+/*   It is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;       */
+/*   without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR      */
+/*   PURPOSE.  See the GNU General Public License for more details.                        */
+/*                                                                                         */
+/*   You should have received a copy of the GNU General Public License                     */
+/*   along with this project. If not, see <http://www.gnu.org/licenses/>.                  */
+/*******************************************************************************************/
+
+
+#ifndef _tsqueue_h
+#define _tsqueue_h
+
+#include <pthread.h>
+
+#define TSQ_NAME_LEN 16
+#define TSQ_MAX_ITEMS 32767
+#define TSQ_MAX_ITEM_LEN 32763
+#define TSQ_BLOCK_SIZE 512
+#define TSQ_ITEMS_PER_PAGE ((TSQ_BLOCK_SIZE-sizeof(int))/sizeof(struct tsqItemRef))
+#define TSQ_MAX_PAGES 521
+
+// Queue spaces are position independent, all references are block numbers
+struct tsqItemRef {
+    int block;
+    int len;
+};
+
+struct tsqBlock {
+    int next;
+    unsigned char data[TSQ_BLOCK_SIZE-sizeof(int)];
+};
+
+struct tsqHeader {
+    char name[TSQ_NAME_LEN+1];
+    int state;     // 0 = free, 1 = used, 2 = deleted
+    pthread_mutex_t lock;
+    int numItems;
+    int lastRead;
+    int pages[TSQ_MAX_PAGES];
+};
+
+struct tsqSpace {
+    int magic;
+    int maxQueues;
+    int numBlocks;
+    int freeBlocks;
+    int freeList;
+    long size;
+    long blockOffs;
+    pthread_mutex_t tableLock;
+    pthread_mutex_t heapLock;
+};
+
+void initTSQueues(int initCons);
+void clearTSQueues(int initCons);
+
+// All functions return the CICS RESP code, or -1 if the queue manager is not available
+int writeTSQ(char *name, int aux, unsigned char *data, int len, int *item, int rewrite);
+int readTSQ(char *name, unsigned char *buf, int *len, int *item, int next, int *numItems);
+int deleteTSQ(char *name);
+
+#endif
@@ -71,6 +71,9 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 	private boolean closed = false;
 	private int rows;
 	private int currentRow = 0;
+	// Streamed results (rows -1) arrive in chunks, each preceded by its row count
+	private boolean streamed = false;
+	private int chunkRows = 0;
 	private String columnValues[];
 	private String columnNames[];
 	private HashMap<String, Integer> nameIndices = new HashMap<String, Integer>();
@@ -89,6 +92,10 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 			}
 			rows = Integer.parseInt(conn.readResult());
 			currentRow = 0;
+			if (rows < 0) {
+				streamed = true;
+				rows = Integer.MAX_VALUE;
+			}
 		} catch (Exception e) {
 			e.printStackTrace();
 			throw e;
@@ -107,8 +114,34 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 		return false;
 	}
 
+	// Reads the row count of the next chunk, the total count follows the last one
+	private boolean nextChunk() throws Exception {
+		chunkRows = Integer.parseInt(conn.readResult());
+		if (chunkRows < 0) {
+			rows = currentRow;
+			streamed = false;
+			conn.readResult();
+			throw new SQLException("SQL ERROR");
+		}
+		if (chunkRows == 0) {
+			rows = Integer.parseInt(conn.readResult());
+			streamed = false;
+			return false;
+		}
+		return true;
+	}
+
 	@Override
 	public boolean next() throws SQLException {
+		try {
+			if (streamed && (chunkRows == 0) && !nextChunk()) {
+				return false;
+			}
+		} catch (SQLException e) {
+			throw e;
+		} catch (Exception e) {
+			throw new SQLException(e);
+		}
 		if (currentRow < rows) {
 			try {
 				for (int i = 0; i < columnValues.length; i++) {
@@ -118,6 +151,9 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 					}
 				}
 				currentRow++;
+				if (streamed) {
+					chunkRows--;
+				}
 			} catch (Exception e) {
 				throw new SQLException(e);
 			}
@@ -128,14 +164,26 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 
 	@Override
 	public void close() throws SQLException {
-		// Read remaining data and ignore it
 		closed = true;
-		while (currentRow < rows) {
+		skipRows();
+	}
+
+	// Read remaining data and ignore it, also of the chunks still to come
+	private void skipRows() throws SQLException {
+		while (streamed || (currentRow < rows)) {
 			try {
+				if (streamed && (chunkRows == 0) && !nextChunk()) {
+					break;
+				}
 				for (int i = 0; i < columnValues.length; i++) {
 					conn.readResult();
 				}
 				currentRow++;
+				if (streamed) {
+					chunkRows--;
+				}
+			} catch (SQLException e) {
+				throw e;
 			} catch (Exception e) {
 				throw new SQLException(e);
 			}
@@ -495,17 +543,7 @@ public class QwicsResultSet implements ResultSet, ResultSetMetaData {
 
 	@Override
 	public void afterLast() throws SQLException {
-		// Read remaining data and ignore it
-		while (currentRow < rows) {
-			try {
-				for (int i = 0; i < columnValues.length; i++) {
-					conn.readResult();
-				}
-				currentRow++;
-			} catch (Exception e) {
-				throw new SQLException(e);
-			}
-		}
+		skipRows();
 	}
 
 	@Override